@@ -0,0 +1,138 @@
+#include "ActiveSoundSet.h"
+
+#define ACTIVESOUNDSET_MIN_CAPACITY 64
+
+ActiveSoundSet::ActiveSoundSet()
+{
+    m_Table = NULL;
+    m_Capacity = 0;
+    m_Shift = 32;
+    Rehash(ACTIVESOUNDSET_MIN_CAPACITY);
+}
+
+ActiveSoundSet::~ActiveSoundSet()
+{
+    delete[] m_Table;
+}
+
+CKBOOL ActiveSoundSet::Add(CK_ID id)
+{
+    int mask, slot;
+
+    if (FindSlot(id) >= 0)
+        return FALSE;
+
+    /* Keep the load factor at or below 1/2 */
+    if ((m_Ids.Size() + 1) * 2 > m_Capacity)
+        Rehash(m_Capacity * 2);
+
+    mask = m_Capacity - 1;
+    slot = (int)Hash(id);
+    while (m_Table[slot])
+        slot = (slot + 1) & mask;
+
+    m_Ids.PushBack(id);
+    m_Table[slot] = m_Ids.Size();
+    return TRUE;
+}
+
+CKBOOL ActiveSoundSet::Remove(CK_ID id)
+{
+    int slot = FindSlot(id);
+    if (slot < 0)
+        return FALSE;
+
+    RemoveAt(m_Table[slot] - 1);
+    return TRUE;
+}
+
+CKBOOL ActiveSoundSet::Contains(CK_ID id) const
+{
+    return FindSlot(id) >= 0;
+}
+
+void ActiveSoundSet::RemoveAt(int index)
+{
+    int last;
+    CK_ID moved;
+
+    if (index < 0 || index >= m_Ids.Size())
+        return;
+
+    EraseSlot(FindSlot(m_Ids[index]));
+
+    /* Fill the hole with the last ID and repoint its table slot */
+    last = m_Ids.Size() - 1;
+    if (index != last)
+    {
+        moved = m_Ids[last];
+        m_Table[FindSlot(moved)] = index + 1;
+        m_Ids[index] = moved;
+    }
+    m_Ids.PopBack();
+}
+
+void ActiveSoundSet::Clear()
+{
+    m_Ids.Clear();
+    memset(m_Table, 0, m_Capacity * sizeof(int));
+}
+
+int ActiveSoundSet::FindSlot(CK_ID id) const
+{
+    int mask = m_Capacity - 1;
+    int slot = (int)Hash(id);
+
+    while (m_Table[slot])
+    {
+        if (m_Ids[m_Table[slot] - 1] == id)
+            return slot;
+        slot = (slot + 1) & mask;
+    }
+    return -1;
+}
+
+void ActiveSoundSet::EraseSlot(int slot)
+{
+    int mask = m_Capacity - 1;
+    int hole = slot;
+    int next = (slot + 1) & mask;
+    int home;
+
+    /* Backward-shift deletion: pull later entries of the probe run into the
+       hole when the hole lies between their home slot and where they sit */
+    while (m_Table[next])
+    {
+        home = (int)Hash(m_Ids[m_Table[next] - 1]);
+        if (((next - home) & mask) >= ((next - hole) & mask))
+        {
+            m_Table[hole] = m_Table[next];
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+    m_Table[hole] = 0;
+}
+
+void ActiveSoundSet::Rehash(int capacity)
+{
+    int i, slot, mask, bits;
+
+    delete[] m_Table;
+    m_Capacity = capacity;
+    m_Table = new int[m_Capacity];
+    memset(m_Table, 0, m_Capacity * sizeof(int));
+
+    for (bits = 0; (1 << bits) < m_Capacity; ++bits)
+        ;
+    m_Shift = 32 - bits;
+
+    mask = m_Capacity - 1;
+    for (i = 0; i < m_Ids.Size(); ++i)
+    {
+        slot = (int)Hash(m_Ids[i]);
+        while (m_Table[slot])
+            slot = (slot + 1) & mask;
+        m_Table[slot] = i + 1;
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef ACTIVESOUNDSET_H
+#define ACTIVESOUNDSET_H
+
+#include "CKAll.h"
+
+/**
+ * @brief Indexed set of playing sound IDs
+ *
+ * Keeps the IDs densely packed for iteration and indexes them through an
+ * open-addressing hash table (linear probing, backward-shift deletion) so
+ * that insertion, removal and membership tests are O(1) on average.
+ *
+ * Removal swaps the last ID into the freed slot, so iteration order is not
+ * stable across removals. Loops that remove while iterating must do so by
+ * index and not advance after a removal:
+ *
+ *     for (i = 0; i < set.Size();)
+ *         if (drop) set.RemoveAt(i); else ++i;
+ */
+class ActiveSoundSet
+{
+public:
+    ActiveSoundSet();
+    ~ActiveSoundSet();
+
+    // Returns TRUE if the ID was inserted, FALSE if it was already here
+    CKBOOL Add(CK_ID id);
+    // Returns TRUE if the ID was found and removed
+    CKBOOL Remove(CK_ID id);
+    CKBOOL Contains(CK_ID id) const;
+
+    // Removes the ID stored at the given dense index
+    void RemoveAt(int index);
+    void Clear();
+
+    int Size() const { return m_Ids.Size(); }
+    CK_ID operator[](int index) const { return m_Ids[index]; }
+    CK_ID *Begin() const { return m_Ids.Begin(); }
+    CK_ID *End() const { return m_Ids.End(); }
+
+private:
+    int FindSlot(CK_ID id) const;
+    void EraseSlot(int slot);
+    void Rehash(int capacity);
+
+    unsigned int Hash(CK_ID id) const
+    {
+        /* Fibonacci hashing: CK IDs are mostly sequential */
+        return ((unsigned int)id * 2654435769U) >> m_Shift;
+    }
+
+    XArray<CK_ID> m_Ids; /* Dense list of IDs */
+    int *m_Table;        /* Dense index + 1 per slot, 0 when empty */
+    int m_Capacity;      /* Power of two */
+    int m_Shift;         /* 32 - log2(m_Capacity) */
+
+    // Prevent copying (VC6 style - declare but don't implement)
+    ActiveSoundSet(const ActiveSoundSet &);
+    ActiveSoundSet &operator=(const ActiveSoundSet &);
+};
+
+#endif /* ACTIVESOUNDSET_H */
@@ -1,5 +1,6 @@
 #include "Dx8SoundManager.h"
 
+#include <stdlib.h>
 #include <windows.h>
 
 #include "CKAll.h"
@@ -13,6 +14,13 @@ extern CKBOOL g_InitialVolumeChanged;
 #define min(a, b) (((a) < (b)) ? (a) : (b))
 #endif
 
+static LONGLONG ReadPerformanceCounter()
+{
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return counter.QuadPart;
+}
+
 // Factory function
 CKERROR CreateDx8SoundManager(CKContext *context)
 {
@@ -38,6 +46,23 @@ DX8SoundManager::DX8SoundManager(CKContext *Context) : DXSoundManager(Context)
     m_bInitialized = FALSE;
     m_bComInitialized = FALSE;
     m_bCriticalSectionInitialized = FALSE;
+    memset(&m_RestoreStats, 0, sizeof(SoundRestoreStats));
+    m_SampleStore.SetArenas(&m_LevelArena, &m_SceneArena);
+    SoundOutputFormatInit(m_OutputFormat, DEFAULT_SAMPLE_RATE, DEFAULT_CHANNELS, DEFAULT_BITS_PER_SAMPLE);
+    SoundOutputFormatFromEnvironment(m_OutputFormat);
+    m_FadeStepDb = FADE_STEP_DB;
+    ResetAudioClock();
+
+    m_UpdateThread = NULL;
+    m_UpdateStopEvent = NULL;
+    m_UpdateRate = 0;
+    m_ListenerState.m_Valid = FALSE;
+    m_SnapshotCounter = 0;
+    m_SnapshotFrame = 0.0f;
+    if (getenv(UPDATE_RATE_ENV))
+        m_UpdateRate = atoi(getenv(UPDATE_RATE_ENV));
+    if (m_UpdateRate < 0 || m_UpdateRate > MAXIMUM_UPDATE_RATE)
+        m_UpdateRate = 0;
 
     InitializeCriticalSection();
     m_Context->RegisterNewManager(this);
@@ -45,6 +70,7 @@ DX8SoundManager::DX8SoundManager(CKContext *Context) : DXSoundManager(Context)
 
 DX8SoundManager::~DX8SoundManager()
 {
+    StopUpdateThread();
     DeleteCriticalSection();
 }
 
@@ -136,6 +162,10 @@ CKERROR DX8SoundManager::HandleDirectSoundError(HRESULT hr, const char *operatio
     if (SUCCEEDED(hr))
         return CK_OK;
 
+    // Lost buffers are restored at the next PostProcess, don't report them
+    if (hr == DSERR_BUFFERLOST)
+        return CKERR_INVALIDOPERATION;
+
     if (m_Context && m_Context->IsInInterfaceMode())
     {
         char errorMsg[256];
@@ -161,8 +191,61 @@ CKERROR DX8SoundManager::HandleDirectSoundError(HRESULT hr, const char *operatio
 //-----------------------------------------------------------------------------
 
 void *DX8SoundManager::CreateSource(CK_WAVESOUND_TYPE type, CKWaveFormat *wf, CKDWORD bytes, CKBOOL streamed)
+{
+    LPDIRECTSOUNDBUFFER buffer = InternalCreateSource(type, wf, bytes);
+
+    if (!buffer)
+        return NULL;
+
+    // A streamed buffer is written over by its stream: no copy is kept
+    EnterCriticalSection();
+    if (streamed)
+        m_SampleStore.AddStreamed(buffer);
+    else
+        m_SampleStore.Add(buffer, bytes);
+    LeaveCriticalSection();
+
+    if (m_CommandLog)
+        m_CommandLog->RecordCreateSource(buffer, type, wf, bytes, streamed);
+
+    return buffer;
+}
+
+void *DX8SoundManager::CreateMappedSource(CK_WAVESOUND_TYPE type, CKWaveFormat &wf, const BYTE *data, CKDWORD size)
+{
+    LPDIRECTSOUNDBUFFER buffer = InternalCreateSource(type, &wf, size);
+    void *data1, *data2;
+    DWORD size1, size2;
+    HRESULT hr;
+
+    if (!buffer)
+        return NULL;
+
+    // One copy from the mapped pages; the bank also restores lost buffers
+    hr = buffer->Lock(0, 0, &data1, &size1, &data2, &size2, DSBLOCK_ENTIREBUFFER);
+    if (FAILED(hr))
+    {
+        buffer->Release();
+        HandleDirectSoundError(hr, "Lock");
+        return NULL;
+    }
+    memcpy(data1, data, min(size1, size));
+    buffer->Unlock(data1, size1, data2, size2);
+
+    EnterCriticalSection();
+    m_SampleStore.AddMapped(buffer, data, size);
+    LeaveCriticalSection();
+
+    if (m_CommandLog)
+        m_CommandLog->RecordCreateSource(buffer, type, &wf, size, FALSE);
+
+    return buffer;
+}
+
+LPDIRECTSOUNDBUFFER DX8SoundManager::InternalCreateSource(CK_WAVESOUND_TYPE type, CKWaveFormat *wf, CKDWORD bytes)
 {
     DSBUFFERDESC dsbd;
+    WAVEFORMATEXTENSIBLE wfx;
     LPDIRECTSOUNDBUFFER buffer;
     HRESULT hr;
 
@@ -198,6 +281,12 @@ void *DX8SoundManager::CreateSource(CK_WAVESOUND_TYPE type, CKWaveFormat *wf, CK
     dsbd.dwBufferBytes = bytes;
     dsbd.lpwfxFormat = (WAVEFORMATEX *)wf;
 
+    // Float and multichannel data need the extensible description
+    if (SoundMakeExtensible(*(WAVEFORMATEX *)wf, wfx))
+    {
+        dsbd.lpwfxFormat = &wfx.Format;
+    }
+
     // Set type-specific flags
     if (type == CK_WAVESOUND_BACKGROUND)
     {
@@ -231,11 +320,90 @@ void *DX8SoundManager::CreateSource(CK_WAVESOUND_TYPE type, CKWaveFormat *wf, CK
 
 void *DX8SoundManager::DuplicateSource(void *source)
 {
-    LPDIRECTSOUNDBUFFER srcBuffer;
+    LPDIRECTSOUNDBUFFER newBuffer;
+    LONGLONG stamp;
+    CKBOOL copied;
+
+    if (!ValidateSource(source) || !ValidateDirectSound())
+    {
+        return NULL;
+    }
+
+    stamp = m_LatencyProbe.Stamp();
+    if (!AdmitInstance(source))
+        return NULL;
+
+    newBuffer = (LPDIRECTSOUNDBUFFER)TakePrimedSource(source);
+    if (!newBuffer)
+    {
+        newBuffer = InternalDuplicateSource((LPDIRECTSOUNDBUFFER)source, copied);
+        if (!newBuffer)
+            return NULL;
+
+        EnterCriticalSection();
+        if (copied)
+            m_SampleStore.AddCopy(newBuffer, source);
+        else
+            m_SampleStore.AddDuplicate(newBuffer, source);
+        LeaveCriticalSection();
+    }
+    TrackInstance(source, newBuffer);
+    m_LatencyProbe.Trigger(newBuffer, stamp);
+
+    if (m_CommandLog)
+        m_CommandLog->RecordDuplicateSource(source, newBuffer);
+
+    return newBuffer;
+}
+
+void *DX8SoundManager::PrimeSource(void *asset)
+{
+    LPDIRECTSOUNDBUFFER newBuffer;
+    CKBOOL copied;
+
+    if (!ValidateSource(asset) || !ValidateDirectSound())
+        return NULL;
+
+    newBuffer = InternalDuplicateSource((LPDIRECTSOUNDBUFFER)asset, copied);
+    if (!newBuffer)
+        return NULL;
+
+    EnterCriticalSection();
+    if (copied)
+        m_SampleStore.AddCopy(newBuffer, asset);
+    else
+        m_SampleStore.AddDuplicate(newBuffer, asset);
+    LeaveCriticalSection();
+    return newBuffer;
+}
+
+void DX8SoundManager::UnprimeSource(void *source)
+{
+    LPDIRECTSOUNDBUFFER buffer;
+
+    if (!ValidateSource(source))
+        return;
+
+    EnterCriticalSection();
+    m_SampleStore.Remove(source);
+    LeaveCriticalSection();
+
+    buffer = (LPDIRECTSOUNDBUFFER)source;
+    buffer->Release();
+}
+
+void DX8SoundManager::SetSourceGain(void *source, float gain)
+{
+    if (ValidateSource(source))
+        ((LPDIRECTSOUNDBUFFER)source)->SetVolume(FloatToDb(gain));
+}
+
+LPDIRECTSOUNDBUFFER DX8SoundManager::InternalDuplicateSource(LPDIRECTSOUNDBUFFER srcBuffer, CKBOOL &copied)
+{
     LPDIRECTSOUNDBUFFER newBuffer;
     HRESULT hr;
     DWORD formatSize;
-    WAVEFORMATEX waveFormat;
+    WAVEFORMATEXTENSIBLE waveFormat;
     DSBCAPS caps;
     DSBUFFERDESC dsbd;
     LONG volume, pan;
@@ -247,13 +415,8 @@ void *DX8SoundManager::DuplicateSource(void *source)
     DWORD srcSize1, srcSize2;
     DWORD newSize1, newSize2;
 
-    if (!ValidateSource(source) || !ValidateDirectSound())
-    {
-        return NULL;
-    }
-
-    srcBuffer = (LPDIRECTSOUNDBUFFER)source;
     newBuffer = NULL;
+    copied = FALSE;
 
     // First attempt: Use DirectSound's built-in duplicate function
     hr = m_Root->DuplicateSoundBuffer(srcBuffer, &newBuffer);
@@ -263,8 +426,9 @@ void *DX8SoundManager::DuplicateSource(void *source)
         return newBuffer;
     }
 
-    // Fallback: Manual duplication
-    hr = srcBuffer->GetFormat(&waveFormat, sizeof(WAVEFORMATEX), &formatSize);
+    // Fallback: Manual duplication, into memory of its own
+    copied = TRUE;
+    hr = srcBuffer->GetFormat(&waveFormat.Format, sizeof(WAVEFORMATEXTENSIBLE), &formatSize);
     if (FAILED(hr))
         return NULL;
 
@@ -278,7 +442,7 @@ void *DX8SoundManager::DuplicateSource(void *source)
     dsbd.dwSize = sizeof(DSBUFFERDESC);
     dsbd.dwFlags = caps.dwFlags & ~(DSBCAPS_LOCHARDWARE | DSBCAPS_LOCSOFTWARE | DSBCAPS_LOCDEFER);
     dsbd.dwBufferBytes = caps.dwBufferBytes;
-    dsbd.lpwfxFormat = &waveFormat;
+    dsbd.lpwfxFormat = &waveFormat.Format;
 
     hr = m_Root->CreateSoundBuffer(&dsbd, &newBuffer, NULL);
     if (FAILED(hr))
@@ -370,6 +534,18 @@ void DX8SoundManager::ReleaseSource(void *source)
     if (!ValidateSource(source))
         return;
 
+    if (m_CommandLog)
+        m_CommandLog->RecordReleaseSource(source);
+
+    EnterCriticalSection();
+    m_SampleStore.Remove(source);
+    ForgetSource(source);
+    if (m_Scheduled.Size() > 0)
+        RemoveScheduled(source);
+    if (m_Emitters.Size() > 0)
+        RemoveEmitter(source);
+    LeaveCriticalSection();
+
     buffer = (LPDIRECTSOUNDBUFFER)source;
     buffer->Stop();
     buffer->Release();
@@ -381,32 +557,65 @@ void DX8SoundManager::ReleaseSource(void *source)
 
 void DX8SoundManager::InternalPause(void *source)
 {
-    LPDIRECTSOUNDBUFFER buffer;
-
     if (!ValidateSource(source))
         return;
 
-    buffer = (LPDIRECTSOUNDBUFFER)source;
-    buffer->Stop();
+    // StartScheduled runs on the update thread and plays through here too
+    EnterCriticalSection();
+    PauseBuffer((LPDIRECTSOUNDBUFFER)source);
+    LeaveCriticalSection();
 }
 
 void DX8SoundManager::InternalPlay(void *source, CKBOOL loop)
 {
-    LPDIRECTSOUNDBUFFER buffer;
-    DWORD flags;
-
     if (!ValidateSource(source))
         return;
 
-    buffer = (LPDIRECTSOUNDBUFFER)source;
-    flags = loop ? DSBPLAY_LOOPING : 0;
-    buffer->Play(0, 0, flags);
+    EnterCriticalSection();
+    PlayBuffer((LPDIRECTSOUNDBUFFER)source, loop);
+    LeaveCriticalSection();
+}
+
+void DX8SoundManager::PauseBuffer(LPDIRECTSOUNDBUFFER buffer)
+{
+    SampleStoreEntry *entry;
+
+    if (m_Scheduled.Size() > 0)
+        RemoveScheduled(buffer);
+
+    buffer->Stop();
+
+    entry = m_SampleStore.Find(buffer);
+    if (entry)
+        entry->m_Playing = FALSE;
+}
+
+void DX8SoundManager::PlayBuffer(LPDIRECTSOUNDBUFFER buffer, CKBOOL loop)
+{
+    SampleStoreEntry *entry;
+
+    // Playing now replaces a scheduled start
+    if (m_Scheduled.Size() > 0)
+        RemoveScheduled(buffer);
+
+    // Remembered even if the buffer is lost: it starts once restored
+    entry = m_SampleStore.Find(buffer);
+    if (entry)
+    {
+        entry->m_Playing = TRUE;
+        entry->m_Looping = loop;
+    }
+
+    if (buffer->Play(0, 0, loop ? DSBPLAY_LOOPING : 0) == DSERR_BUFFERLOST)
+        OnBufferLost(buffer);
 }
 
 void DX8SoundManager::Play(CKWaveSound *ws, void *source, CKBOOL loop)
 {
     LPDIRECTSOUNDBUFFER buffer = NULL;
     SoundMinion *minion;
+    LONGLONG stamp;
+    int position;
 
     if (!ValidateSource(source))
         return;
@@ -415,7 +624,7 @@ void DX8SoundManager::Play(CKWaveSound *ws, void *source, CKBOOL loop)
     {
         // Normal sound
         buffer = (LPDIRECTSOUNDBUFFER)source;
-        m_SoundsPlaying.AddIfNotHere(ws->GetID());
+        m_SoundsPlaying.Add(ws->GetID());
     }
     else
     {
@@ -429,7 +638,13 @@ void DX8SoundManager::Play(CKWaveSound *ws, void *source, CKBOOL loop)
 
     if (buffer)
     {
+        if (m_CommandLog)
+            m_CommandLog->RecordPlay(ws, buffer, loop);
+
+        stamp = m_LatencyProbe.Stamp();
+        position = stamp ? GetPlayPosition(buffer) : 0;
         InternalPlay(buffer, loop);
+        m_LatencyProbe.Arm(buffer, stamp, position);
     }
 }
 
@@ -440,10 +655,102 @@ void DX8SoundManager::Pause(CKWaveSound *ws, void *source)
     if (!ValidateSource(source))
         return;
 
+    if (m_CommandLog)
+        m_CommandLog->RecordPause(ws, source);
+
     buffer = (LPDIRECTSOUNDBUFFER)source;
     InternalPause(buffer);
 }
 
+CKERROR DX8SoundManager::PlayBatch(CKWaveSound **sounds, void **sources, int count, CKBOOL loop)
+{
+    LPDIRECTSOUNDBUFFER buffer;
+    CKWaveSound *ws;
+    LONGLONG stamp;
+    int i, position;
+
+    if (!IsValidBatch(sources, count))
+        return CKERR_INVALIDPARAMETER;
+    if (!ValidateDirectSound())
+        return CKERR_NOTINITIALIZED;
+
+    // The whole batch is one trigger for the latency probe
+    stamp = m_LatencyProbe.Stamp();
+
+    EnterCriticalSection();
+    for (i = 0; i < count; ++i)
+    {
+        ws = sounds ? sounds[i] : NULL;
+        if (ws)
+        {
+            buffer = (LPDIRECTSOUNDBUFFER)sources[i];
+            m_SoundsPlaying.Add(ws->GetID());
+        }
+        else
+        {
+            buffer = (LPDIRECTSOUNDBUFFER)((SoundMinion *)sources[i])->m_Source;
+            if (!buffer)
+                continue;
+        }
+
+        if (m_CommandLog)
+            m_CommandLog->RecordPlay(ws, buffer, loop);
+
+        position = stamp ? GetPlayPosition(buffer) : 0;
+        PlayBuffer(buffer, loop);
+        m_LatencyProbe.Arm(buffer, stamp, position);
+    }
+    LeaveCriticalSection();
+    return CK_OK;
+}
+
+CKERROR DX8SoundManager::PauseBatch(CKWaveSound **sounds, void **sources, int count)
+{
+    int i;
+
+    if (!IsValidBatch(sources, count))
+        return CKERR_INVALIDPARAMETER;
+    if (!ValidateDirectSound())
+        return CKERR_NOTINITIALIZED;
+
+    EnterCriticalSection();
+    for (i = 0; i < count; ++i)
+    {
+        if (m_CommandLog)
+            m_CommandLog->RecordPause(sounds ? sounds[i] : NULL, sources[i]);
+        PauseBuffer((LPDIRECTSOUNDBUFFER)sources[i]);
+    }
+    LeaveCriticalSection();
+    return CK_OK;
+}
+
+CKERROR DX8SoundManager::StopBatch(CKWaveSound **sounds, void **sources, int count)
+{
+    LPDIRECTSOUNDBUFFER buffer;
+    int i;
+
+    if (!IsValidBatch(sources, count))
+        return CKERR_INVALIDPARAMETER;
+    if (!ValidateDirectSound())
+        return CKERR_NOTINITIALIZED;
+
+    // As Stop: a pause, then a rewind
+    EnterCriticalSection();
+    for (i = 0; i < count; ++i)
+    {
+        buffer = (LPDIRECTSOUNDBUFFER)sources[i];
+        if (m_CommandLog)
+        {
+            m_CommandLog->RecordPause(sounds ? sounds[i] : NULL, buffer);
+            m_CommandLog->RecordSetPlayPosition(buffer, 0);
+        }
+        PauseBuffer(buffer);
+        buffer->SetCurrentPosition(0);
+    }
+    LeaveCriticalSection();
+    return CK_OK;
+}
+
 void DX8SoundManager::SetPlayPosition(void *source, int pos)
 {
     LPDIRECTSOUNDBUFFER buffer;
@@ -451,6 +758,9 @@ void DX8SoundManager::SetPlayPosition(void *source, int pos)
     if (!ValidateSource(source) || pos < 0)
         return;
 
+    if (m_CommandLog)
+        m_CommandLog->RecordSetPlayPosition(source, pos);
+
     buffer = (LPDIRECTSOUNDBUFFER)source;
     buffer->SetCurrentPosition((DWORD)pos);
 }
@@ -476,19 +786,109 @@ int DX8SoundManager::GetPlayPosition(void *source)
 CKBOOL DX8SoundManager::IsPlaying(void *source)
 {
     LPDIRECTSOUNDBUFFER buffer;
+    SampleStoreEntry *entry;
     DWORD status = 0;
+    CKBOOL scheduled;
 
     if (!ValidateSource(source))
         return FALSE;
 
+    // Waiting for its start counts as playing, or minions would be released
+    if (m_Scheduled.Size() > 0)
+    {
+        EnterCriticalSection();
+        scheduled = (FindScheduled(source) >= 0);
+        LeaveCriticalSection();
+        if (scheduled)
+            return TRUE;
+    }
+
     buffer = (LPDIRECTSOUNDBUFFER)source;
 
-    if (SUCCEEDED(buffer->GetStatus(&status)))
+    if (FAILED(buffer->GetStatus(&status)))
+        return FALSE;
+
+    entry = m_SampleStore.Find(source);
+
+    // A lost buffer that was playing is still playing as far as the engine
+    // is concerned: it resumes when restored
+    if (status & DSBSTATUS_BUFFERLOST)
     {
-        return (status & DSBSTATUS_PLAYING) ? TRUE : FALSE;
+        OnBufferLost(source);
+        return entry ? entry->m_Playing : FALSE;
     }
 
-    return FALSE;
+    if (!(status & DSBSTATUS_PLAYING))
+    {
+        if (entry)
+            entry->m_Playing = FALSE;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+CKERROR DX8SoundManager::PlayAt(CKWaveSound *ws, void *source, CKBOOL loop, double time)
+{
+    SoundScheduledStart start;
+    SoundMinion *minion;
+    void *buffer = NULL;
+    double clock;
+    int index;
+
+    if (!ValidateSource(source) || !ValidateDirectSound())
+        return CKERR_INVALIDPARAMETER;
+
+    if (ws)
+    {
+        buffer = source;
+    }
+    else
+    {
+        minion = (SoundMinion *)source;
+        buffer = minion->m_Source;
+    }
+    if (!buffer)
+        return CKERR_INVALIDPARAMETER;
+
+    EnterCriticalSection();
+
+    clock = GetAudioClock();
+    if (m_CommandLog)
+        m_CommandLog->RecordPlayAt(ws, buffer, loop, (float)(time - clock));
+
+    // Registered now: the sound counts as playing while it waits
+    if (ws)
+        m_SoundsPlaying.Add(ws->GetID());
+
+    start.m_Source = buffer;
+    start.m_Sound = ws ? ws->GetID() : 0;
+    start.m_Time = time;
+    start.m_Loop = loop;
+
+    index = FindScheduled(buffer);
+    if (index >= 0)
+        m_Scheduled[index] = start;
+    else
+        m_Scheduled.PushBack(start);
+
+    if (time <= clock)
+        StartScheduled();
+
+    LeaveCriticalSection();
+    return CK_OK;
+}
+
+double DX8SoundManager::GetAudioClock()
+{
+    double clock;
+
+    EnterCriticalSection();
+    UpdateAudioClock();
+    clock = (double)m_ClockBytes / m_ClockBytesPerSecond;
+    LeaveCriticalSection();
+
+    return clock;
 }
 
 //-----------------------------------------------------------------------------
@@ -511,13 +911,25 @@ CKERROR DX8SoundManager::SetWaveFormat(void *source, CKWaveFormat &wf)
 CKERROR DX8SoundManager::GetWaveFormat(void *source, CKWaveFormat &wf)
 {
     LPDIRECTSOUNDBUFFER buffer;
+    WAVEFORMATEXTENSIBLE wfx;
     HRESULT hr;
 
     if (!ValidateSource(source))
         return CKERR_INVALIDPARAMETER;
 
     buffer = (LPDIRECTSOUNDBUFFER)source;
-    hr = buffer->GetFormat((WAVEFORMATEX *)&wf, sizeof(CKWaveFormat), NULL);
+    hr = buffer->GetFormat(&wfx.Format, sizeof(WAVEFORMATEXTENSIBLE), NULL);
+    if (SUCCEEDED(hr))
+    {
+        // Report extensible buffers with the tag they were created from:
+        // the KSDATAFORMAT subtypes carry it in their first field
+        if (wfx.Format.wFormatTag == WAVE_FORMAT_EXTENSIBLE)
+        {
+            wfx.Format.wFormatTag = (WORD)wfx.SubFormat.Data1;
+            wfx.Format.cbSize = 0;
+        }
+        memcpy(&wf, &wfx.Format, sizeof(WAVEFORMATEX));
+    }
     return HandleDirectSoundError(hr, "GetWaveFormat");
 }
 
@@ -551,6 +963,8 @@ CKERROR DX8SoundManager::Lock(void *source, CKDWORD dwWriteCursor, CKDWORD dwNum
                               CK_WAVESOUND_LOCKMODE dwFlags)
 {
     LPDIRECTSOUNDBUFFER buffer;
+    SampleStoreEntry *entry;
+    DWORD playCursor, writeCursor, offset, flags;
     HRESULT hr;
 
     if (!ValidateSource(source) || !pvAudioPtr1 || !dwAudioBytes1)
@@ -559,10 +973,39 @@ CKERROR DX8SoundManager::Lock(void *source, CKDWORD dwWriteCursor, CKDWORD dwNum
     }
 
     buffer = (LPDIRECTSOUNDBUFFER)source;
-    hr = buffer->Lock(dwWriteCursor, dwNumBytes, pvAudioPtr1,
-                      (DWORD *)dwAudioBytes1,
-                      pvAudioPtr2, (DWORD *)dwAudioBytes2,
-                      dwFlags);
+    offset = (dwFlags & CK_WAVESOUND_LOCKENTIREBUFFER) ? 0 : dwWriteCursor;
+    flags = (DWORD)dwFlags;
+    hr = S_OK;
+
+    // The write cursor moves on while Lock runs: read it first and lock at
+    // that offset, so Unlock mirrors the region where it was written
+    if (!(dwFlags & CK_WAVESOUND_LOCKENTIREBUFFER) && (dwFlags & CK_WAVESOUND_LOCKFROMWRITE))
+    {
+        hr = buffer->GetCurrentPosition(&playCursor, &writeCursor);
+        offset = writeCursor;
+        flags &= ~(DWORD)CK_WAVESOUND_LOCKFROMWRITE;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = buffer->Lock(offset, dwNumBytes, pvAudioPtr1,
+                          (DWORD *)dwAudioBytes1,
+                          pvAudioPtr2, (DWORD *)dwAudioBytes2,
+                          flags);
+    }
+
+    if (hr == DSERR_BUFFERLOST)
+    {
+        OnBufferLost(source);
+    }
+    else if (SUCCEEDED(hr))
+    {
+        // Remember where the first region starts to mirror it on Unlock
+        entry = m_SampleStore.Find(source);
+        if (entry)
+            entry->m_LockOffset = offset;
+    }
+
     return HandleDirectSoundError(hr, "Lock");
 }
 
@@ -570,13 +1013,33 @@ CKERROR DX8SoundManager::Unlock(void *source, void *pvAudioPtr1, CKDWORD dwNumBy
                                 void *pvAudioPtr2, CKDWORD dwAudioBytes2)
 {
     LPDIRECTSOUNDBUFFER buffer;
+    SampleStoreEntry *entry;
     HRESULT hr;
 
     if (!ValidateSource(source))
         return CKERR_INVALIDPARAMETER;
 
+    // Mirror the written data while the pointers are still valid; the
+    // second region always starts at the beginning of the buffer. Stream
+    // writes are not read back from the buffer memory: the stream
+    // refills the buffer once restored.
+    entry = m_SampleStore.Find(source);
+    if (entry && !entry->m_Streamed && m_Streams.GetCount() > 0 && m_Streams.Find(source))
+    {
+        EnterCriticalSection();
+        m_SampleStore.SetStreamed(entry);
+        LeaveCriticalSection();
+    }
+    if (entry && !entry->m_Streamed)
+    {
+        m_SampleStore.Write(entry, entry->m_LockOffset, pvAudioPtr1, dwNumBytes1);
+        m_SampleStore.Write(entry, 0, pvAudioPtr2, dwAudioBytes2);
+    }
+
     buffer = (LPDIRECTSOUNDBUFFER)source;
     hr = buffer->Unlock(pvAudioPtr1, dwNumBytes1, pvAudioPtr2, dwAudioBytes2);
+    if (hr == DSERR_BUFFERLOST)
+        OnBufferLost(source);
     return HandleDirectSoundError(hr, "Unlock");
 }
 
@@ -623,45 +1086,53 @@ void DX8SoundManager::UpdateSettings(void *source, CK_SOUNDMANAGER_CAPS settings
                                      CKWaveSoundSettings &settings, CKBOOL set)
 {
     LPDIRECTSOUNDBUFFER buffer;
-    WAVEFORMATEX wf;
-    DWORD newFreq;
+    WAVEFORMATEXTENSIBLE wf;
+    CKWaveSoundSettings heard;
+    SoundBusMember *member;
     LONG volume, pan;
     DWORD frequency;
+    float gain;
 
     if (!ValidateSource(source))
         return;
 
+    // The steps of a CKWaveSound fade are sent by the fade scheduler
+    if (set && m_FadeStepSource)
+    {
+        settingsoptions = TakeFadeStep(source, settingsoptions, settings.m_Gain);
+        if (!settingsoptions)
+            return;
+    }
+
+    // Sources routed through a gain bus are sent and logged scaled by it
+    gain = settings.m_Gain;
+    if (set && (settingsoptions & CK_WAVESOUND_SETTINGS_GAIN))
+        gain = FilterSourceGain(source, settings.m_Gain);
+
+    if (set && m_CommandLog)
+    {
+        heard = settings;
+        heard.m_Gain = gain;
+        m_CommandLog->RecordUpdateSettings(source, settingsoptions, heard);
+    }
+
     buffer = (LPDIRECTSOUNDBUFFER)source;
 
     if (set)
     {
-        // Set settings
-        if (settingsoptions & CK_WAVESOUND_SETTINGS_GAIN)
-        {
-            buffer->SetVolume(FloatToDb(settings.m_Gain));
-        }
-
-        if (settingsoptions & CK_WAVESOUND_SETTINGS_PITCH)
-        {
-            if (SUCCEEDED(buffer->GetFormat(&wf, sizeof(WAVEFORMATEX), NULL)))
-            {
-                newFreq = (DWORD)(wf.nSamplesPerSec * settings.m_Pitch);
-                buffer->SetFrequency(newFreq);
-            }
-        }
-
-        if ((settingsoptions & CK_WAVESOUND_SETTINGS_PAN) &&
-            (GetType(source) == CK_WAVESOUND_BACKGROUND))
-        {
-            buffer->SetPan(FloatPanningToDb(settings.m_Pan));
-        }
+        ApplySettings(buffer, settingsoptions, settings, gain);
     }
     else
     {
         // Get settings
         if (settingsoptions & CK_WAVESOUND_SETTINGS_GAIN)
         {
-            if (SUCCEEDED(buffer->GetVolume(&volume)))
+            member = m_GainBuses.Find(source);
+            if (member)
+            {
+                settings.m_Gain = member->m_Gain;
+            }
+            else if (SUCCEEDED(buffer->GetVolume(&volume)))
             {
                 settings.m_Gain = DbToFloat(volume);
             }
@@ -669,10 +1140,10 @@ void DX8SoundManager::UpdateSettings(void *source, CK_SOUNDMANAGER_CAPS settings
 
         if (settingsoptions & CK_WAVESOUND_SETTINGS_PITCH)
         {
-            if (SUCCEEDED(buffer->GetFormat(&wf, sizeof(WAVEFORMATEX), NULL)) &&
+            if (SUCCEEDED(buffer->GetFormat(&wf.Format, sizeof(WAVEFORMATEXTENSIBLE), NULL)) &&
                 SUCCEEDED(buffer->GetFrequency(&frequency)))
             {
-                settings.m_Pitch = (float)frequency / wf.nSamplesPerSec;
+                settings.m_Pitch = (float)frequency / wf.Format.nSamplesPerSec;
             }
         }
 
@@ -686,6 +1157,63 @@ void DX8SoundManager::UpdateSettings(void *source, CK_SOUNDMANAGER_CAPS settings
     }
 }
 
+void DX8SoundManager::ApplySettings(LPDIRECTSOUNDBUFFER buffer, CK_SOUNDMANAGER_CAPS settingsoptions,
+                                    const CKWaveSoundSettings &settings, float gain)
+{
+    WAVEFORMATEXTENSIBLE wf;
+
+    if (settingsoptions & CK_WAVESOUND_SETTINGS_GAIN)
+    {
+        buffer->SetVolume(FloatToDb(gain));
+    }
+
+    if (settingsoptions & CK_WAVESOUND_SETTINGS_PITCH)
+    {
+        if (SUCCEEDED(buffer->GetFormat(&wf.Format, sizeof(WAVEFORMATEXTENSIBLE), NULL)))
+        {
+            buffer->SetFrequency((DWORD)(wf.Format.nSamplesPerSec * settings.m_Pitch));
+        }
+    }
+
+    if ((settingsoptions & CK_WAVESOUND_SETTINGS_PAN) &&
+        (GetType(buffer) == CK_WAVESOUND_BACKGROUND))
+    {
+        buffer->SetPan(FloatPanningToDb(settings.m_Pan));
+    }
+}
+
+CKERROR DX8SoundManager::UpdateSettingsBatch(void **sources, int count, CK_SOUNDMANAGER_CAPS settingsoptions,
+                                             CKWaveSoundSettings *settings)
+{
+    CKWaveSoundSettings heard;
+    float gain;
+    int i;
+
+    if (!settings || !IsValidBatch(sources, count))
+        return CKERR_INVALIDPARAMETER;
+    if (!ValidateDirectSound())
+        return CKERR_NOTINITIALIZED;
+
+    EnterCriticalSection();
+    for (i = 0; i < count; ++i)
+    {
+        gain = settings[i].m_Gain;
+        if (settingsoptions & CK_WAVESOUND_SETTINGS_GAIN)
+            gain = FilterSourceGain(sources[i], settings[i].m_Gain);
+
+        if (m_CommandLog)
+        {
+            heard = settings[i];
+            heard.m_Gain = gain;
+            m_CommandLog->RecordUpdateSettings(sources[i], settingsoptions, heard);
+        }
+
+        ApplySettings((LPDIRECTSOUNDBUFFER)sources[i], settingsoptions, settings[i], gain);
+    }
+    LeaveCriticalSection();
+    return CK_OK;
+}
+
 //-----------------------------------------------------------------------------
 // 3D Settings Management
 //-----------------------------------------------------------------------------
@@ -704,6 +1232,9 @@ void DX8SoundManager::Update3DSettings(void *source, CK_SOUNDMANAGER_CAPS settin
     if (!ValidateSource(source))
         return;
 
+    if (set && m_CommandLog)
+        m_CommandLog->RecordUpdate3DSettings(source, settingsoptions, settings);
+
     buffer = (LPDIRECTSOUNDBUFFER)source;
     buffer3D = NULL;
 
@@ -713,43 +1244,7 @@ void DX8SoundManager::Update3DSettings(void *source, CK_SOUNDMANAGER_CAPS settin
 
     if (set)
     {
-        // Set 3D settings
-        if (settingsoptions & CK_WAVESOUND_3DSETTINGS_CONE)
-        {
-            buffer3D->SetConeAngles((DWORD)settings.m_InAngle,
-                                    (DWORD)settings.m_OutAngle, DS3D_IMMEDIATE);
-            buffer3D->SetConeOutsideVolume(FloatToDb(settings.m_OutsideGain), DS3D_IMMEDIATE);
-        }
-
-        if (settingsoptions & CK_WAVESOUND_3DSETTINGS_MINMAXDISTANCE)
-        {
-            buffer3D->SetMinDistance(settings.m_MinDistance, DS3D_IMMEDIATE);
-            buffer3D->SetMaxDistance(settings.m_MaxDistance, DS3D_IMMEDIATE);
-        }
-
-        if (settingsoptions & CK_WAVESOUND_3DSETTINGS_POSITION)
-        {
-            buffer3D->SetPosition(settings.m_Position.x, settings.m_Position.y,
-                                  settings.m_Position.z, DS3D_IMMEDIATE);
-        }
-
-        if (settingsoptions & CK_WAVESOUND_3DSETTINGS_VELOCITY)
-        {
-            buffer3D->SetVelocity(settings.m_Velocity.x, settings.m_Velocity.y,
-                                  settings.m_Velocity.z, DS3D_IMMEDIATE);
-        }
-
-        if (settingsoptions & CK_WAVESOUND_3DSETTINGS_ORIENTATION)
-        {
-            buffer3D->SetConeOrientation(settings.m_OrientationDir.x, settings.m_OrientationDir.y,
-                                         settings.m_OrientationDir.z, DS3D_IMMEDIATE);
-        }
-
-        if (settingsoptions & CK_WAVESOUND_3DSETTINGS_HEADRELATIVE)
-        {
-            mode = settings.m_HeadRelative ? DS3DMODE_HEADRELATIVE : DS3DMODE_NORMAL;
-            buffer3D->SetMode(mode, DS3D_IMMEDIATE);
-        }
+        Apply3DSettings(buffer3D, settingsoptions, settings, DS3D_IMMEDIATE);
     }
     else
     {
@@ -809,6 +1304,79 @@ void DX8SoundManager::Update3DSettings(void *source, CK_SOUNDMANAGER_CAPS settin
     buffer3D->Release();
 }
 
+void DX8SoundManager::Apply3DSettings(LPDIRECTSOUND3DBUFFER buffer3D, CK_SOUNDMANAGER_CAPS settingsoptions,
+                                      const CKWaveSound3DSettings &settings, DWORD apply)
+{
+    DWORD mode;
+
+    if (settingsoptions & CK_WAVESOUND_3DSETTINGS_CONE)
+    {
+        buffer3D->SetConeAngles((DWORD)settings.m_InAngle,
+                                (DWORD)settings.m_OutAngle, apply);
+        buffer3D->SetConeOutsideVolume(FloatToDb(settings.m_OutsideGain), apply);
+    }
+
+    if (settingsoptions & CK_WAVESOUND_3DSETTINGS_MINMAXDISTANCE)
+    {
+        buffer3D->SetMinDistance(settings.m_MinDistance, apply);
+        buffer3D->SetMaxDistance(settings.m_MaxDistance, apply);
+    }
+
+    if (settingsoptions & CK_WAVESOUND_3DSETTINGS_POSITION)
+    {
+        buffer3D->SetPosition(settings.m_Position.x, settings.m_Position.y,
+                              settings.m_Position.z, apply);
+    }
+
+    if (settingsoptions & CK_WAVESOUND_3DSETTINGS_VELOCITY)
+    {
+        buffer3D->SetVelocity(settings.m_Velocity.x, settings.m_Velocity.y,
+                              settings.m_Velocity.z, apply);
+    }
+
+    if (settingsoptions & CK_WAVESOUND_3DSETTINGS_ORIENTATION)
+    {
+        buffer3D->SetConeOrientation(settings.m_OrientationDir.x, settings.m_OrientationDir.y,
+                                     settings.m_OrientationDir.z, apply);
+    }
+
+    if (settingsoptions & CK_WAVESOUND_3DSETTINGS_HEADRELATIVE)
+    {
+        mode = settings.m_HeadRelative ? DS3DMODE_HEADRELATIVE : DS3DMODE_NORMAL;
+        buffer3D->SetMode(mode, apply);
+    }
+}
+
+CKERROR DX8SoundManager::Update3DSettingsBatch(void **sources, int count, CK_SOUNDMANAGER_CAPS settingsoptions,
+                                               CKWaveSound3DSettings *settings)
+{
+    LPDIRECTSOUND3DBUFFER buffer3D;
+    int i;
+
+    if (!settings || !IsValidBatch(sources, count))
+        return CKERR_INVALIDPARAMETER;
+    if (!ValidateDirectSound() || !m_Listener)
+        return CKERR_NOTINITIALIZED;
+
+    EnterCriticalSection();
+    for (i = 0; i < count; ++i)
+    {
+        if (m_CommandLog)
+            m_CommandLog->RecordUpdate3DSettings(sources[i], settingsoptions, settings[i]);
+
+        buffer3D = NULL;
+        if (FAILED(((LPDIRECTSOUNDBUFFER)sources[i])->QueryInterface(IID_IDirectSound3DBuffer, (VOID **)&buffer3D)))
+            continue;
+        Apply3DSettings(buffer3D, settingsoptions, settings[i], DS3D_DEFERRED);
+        buffer3D->Release();
+    }
+
+    // DirectSound recomputes the 3D mix once for the whole batch
+    m_Listener->CommitDeferredSettings();
+    LeaveCriticalSection();
+    return CK_OK;
+}
+
 //-----------------------------------------------------------------------------
 // Listener Settings
 //-----------------------------------------------------------------------------
@@ -821,6 +1389,9 @@ void DX8SoundManager::UpdateListenerSettings(CK_SOUNDMANAGER_CAPS settingsoption
     if (!m_Listener)
         return;
 
+    if (set && m_CommandLog)
+        m_CommandLog->RecordUpdateListenerSettings(settingsoptions, settings);
+
     if (set)
     {
         if (settingsoptions & CK_LISTENERSETTINGS_DISTANCE)
@@ -926,12 +1497,11 @@ CKERROR DX8SoundManager::PostClearAll()
     CKERROR result;
 
     EnterCriticalSection();
-
-    result = CKSoundManager::PostClearAll();
-    m_SoundsPlaying.Clear();
-    ReleaseMinions();
-    RegisterAttribute();
-
+    result = DXSoundManager::PostClearAll();
+    m_Scheduled.Clear();
+    /* The update thread would otherwise move the sources of the last level */
+    m_Emitters.Clear();
+    m_ListenerState.m_Valid = FALSE;
     LeaveCriticalSection();
     return result;
 }
@@ -941,7 +1511,8 @@ CKERROR DX8SoundManager::OnCKInit()
     HRESULT hr;
     HWND mainWindow;
     DSBUFFERDESC dsbdesc;
-    WAVEFORMATEX wfx;
+    WAVEFORMATEXTENSIBLE wfx;
+    SoundOutputFormat fallback;
     int soundsCount, i;
     CK_ID *soundIds;
     CKWaveSound *ws;
@@ -954,6 +1525,7 @@ CKERROR DX8SoundManager::OnCKInit()
     EnterCriticalSection();
 
     hr = S_OK;
+    memset(&m_RestoreStats, 0, sizeof(SoundRestoreStats));
 
 #ifdef CK_LIB
     hr = CoInitialize(NULL);
@@ -1059,16 +1631,16 @@ CKERROR DX8SoundManager::OnCKInit()
         return HandleDirectSoundError(hr, "QueryInterface(Listener)");
     }
 
-    // Set primary buffer format
-    ZeroMemory(&wfx, sizeof(WAVEFORMATEX));
-    wfx.wFormatTag = WAVE_FORMAT_PCM;
-    wfx.nChannels = DEFAULT_CHANNELS;
-    wfx.nSamplesPerSec = DEFAULT_SAMPLE_RATE;
-    wfx.wBitsPerSample = DEFAULT_BITS_PER_SAMPLE;
-    wfx.nBlockAlign = wfx.wBitsPerSample / 8 * wfx.nChannels;
-    wfx.nAvgBytesPerSec = wfx.nSamplesPerSec * wfx.nBlockAlign;
-
-    hr = m_Primary->SetFormat(&wfx);
+    // Set primary buffer format. Drivers without multichannel or float
+    // support reject the extensible format: retry as 16-bit stereo.
+    SoundOutputFormatToWave(m_OutputFormat, wfx);
+    hr = m_Primary->SetFormat(&wfx.Format);
+    if (FAILED(hr) && wfx.Format.wFormatTag == WAVE_FORMAT_EXTENSIBLE)
+    {
+        SoundOutputFormatInit(fallback, m_OutputFormat.m_SampleRate, 2, 16);
+        SoundOutputFormatToWave(fallback, wfx);
+        hr = m_Primary->SetFormat(&wfx.Format);
+    }
     if (FAILED(hr))
     {
         // Non-fatal error, continue with default format
@@ -1080,6 +1652,9 @@ CKERROR DX8SoundManager::OnCKInit()
 
     RegisterAttribute();
 
+    // Capture before recreating so the log knows every source
+    StartCommandLogFromEnvironment();
+
     // Recreate existing sounds
     soundsCount = m_Context->GetObjectsCountByClassID(CKCID_WAVESOUND);
     if (soundsCount > 0)
@@ -1097,8 +1672,13 @@ CKERROR DX8SoundManager::OnCKInit()
 
     // Start primary buffer playback
     m_Primary->Play(0, 0, DSBPLAY_LOOPING);
+    ResetAudioClock();
 
     m_bInitialized = TRUE;
+    StartJobPoolFromEnvironment();
+    StartLatencyProbeFromEnvironment();
+    if (m_UpdateRate > 0 && !StartUpdateThread() && m_Context->IsInInterfaceMode())
+        m_Context->OutputToConsole("Warning: Could not start the sound update thread");
     LeaveCriticalSection();
     return CK_OK;
 }
@@ -1110,11 +1690,19 @@ CKERROR DX8SoundManager::OnCKEnd()
         return CK_OK;
     }
 
+    // The thread takes the critical section on every tick
+    StopUpdateThread();
+    StopLatencyProbe();
+    m_JobPool.Stop();
+
     EnterCriticalSection();
 
     // Stop all sounds and clean up
+    m_Scheduled.Clear();
+    ReleasePrimedVoices(TRUE);
     StopAllPlayingSounds();
     CleanupDirectSoundResources();
+    StopCommandLog();
 
     m_bInitialized = FALSE;
 
@@ -1139,6 +1727,8 @@ void DX8SoundManager::CleanupDirectSoundResources()
         m_Listener = NULL;
     }
 
+    m_SampleStore.Clear();
+
     // Stop and release primary buffer
     if (m_Primary)
     {
@@ -1177,75 +1767,546 @@ void DX8SoundManager::StopAllPlayingSounds()
     }
 }
 
-CKERROR DX8SoundManager::PostProcess()
+void DX8SoundManager::ResetAudioClock()
 {
-    float deltaTime;
-    CKBOOL somethingIsPlayingIn3D;
-    CK_ID *it;
-    CKWaveSound *ws;
-    SoundMinion **itm;
-    CK3dEntity *ent;
-    CK3dEntity *listener;
-    const VxMatrix *mat;
-    const VxVector4 *pos, *dir, *up;
-    VxVector velocity;
+    WAVEFORMATEXTENSIBLE wfx;
+    DSBCAPS caps;
+    DWORD write;
 
-    if (!ValidateDirectSound())
-        return CK_OK;
+    m_ClockBytes = 0;
+    m_ClockCounter = ReadPerformanceCounter();
+    m_ClockCursor = 0;
+    m_ClockBufferBytes = 0;
+    m_ClockBytesPerSecond = m_OutputFormat.m_SampleRate * m_OutputFormat.m_Channels * (m_OutputFormat.m_BitsPerSample / 8);
+    if (m_ClockBytesPerSecond == 0)
+        m_ClockBytesPerSecond = 1;
 
-    EnterCriticalSection();
+    if (!m_Primary)
+        return;
 
-    deltaTime = m_Context->GetTimeManager()->GetLastDeltaTime();
-    somethingIsPlayingIn3D = FALSE;
+    // The driver may have refused the requested format
+    if (SUCCEEDED(m_Primary->GetFormat(&wfx.Format, sizeof(WAVEFORMATEXTENSIBLE), NULL)) &&
+        wfx.Format.nAvgBytesPerSec > 0)
+    {
+        m_ClockBytesPerSecond = wfx.Format.nAvgBytesPerSec;
+    }
 
-    // Update playing sounds
-    for (it = m_SoundsPlaying.Begin(); it != m_SoundsPlaying.End();)
+    ZeroMemory(&caps, sizeof(DSBCAPS));
+    caps.dwSize = sizeof(DSBCAPS);
+    if (SUCCEEDED(m_Primary->GetCaps(&caps)) &&
+        SUCCEEDED(m_Primary->GetCurrentPosition(&m_ClockCursor, &write)))
     {
-        ws = (CKWaveSound *)m_Context->GetObject(*it);
+        m_ClockBufferBytes = caps.dwBufferBytes;
+    }
+}
 
-        if (ws && ws->IsPlaying())
-        {
-            // Handle file streaming
-            if (ws->GetFileStreaming() && !(ws->GetState() & CK_WAVESOUND_STREAMFULLYLOADED))
-            {
-                ws->WriteDataFromReader();
-            }
+void DX8SoundManager::UpdateAudioClock()
+{
+    LARGE_INTEGER frequency;
+    LONGLONG now, elapsed, size;
+    DWORD play, write, advance;
+
+    QueryPerformanceFrequency(&frequency);
+    now = ReadPerformanceCounter();
+    elapsed = 0;
+    if (frequency.QuadPart > 0)
+        elapsed = (now - m_ClockCounter) * m_ClockBytesPerSecond / frequency.QuadPart;
+    m_ClockCounter = now;
+
+    // Without a cursor the clock follows the performance counter
+    if (!m_Primary || m_ClockBufferBytes == 0 || FAILED(m_Primary->GetCurrentPosition(&play, &write)))
+    {
+        m_ClockBytes += elapsed;
+        return;
+    }
 
-            // Update fade
-            ws->UpdateFade();
+    advance = (play + m_ClockBufferBytes - m_ClockCursor) % m_ClockBufferBytes;
+    m_ClockCursor = play;
 
-            // Update 3D position
-            if (!(ws->GetType() & CK_WAVESOUND_BACKGROUND))
-            {
-                somethingIsPlayingIn3D = TRUE;
-                ws->UpdatePosition(deltaTime);
-            }
+    // Whole buffers played between two reads leave the cursor in place
+    size = m_ClockBufferBytes;
+    if (elapsed > (LONGLONG)advance + size / 2)
+        m_ClockBytes += (elapsed - (LONGLONG)advance + size / 2) / size * size;
+    m_ClockBytes += advance;
+}
+
+void DX8SoundManager::StartScheduled()
+{
+    XArray<SoundScheduledStart> due;
+    SoundScheduledStart *start;
+    LPDIRECTSOUNDBUFFER buffer;
+    CKWaveFormat wf;
+    DWORD frequency, position, write;
+    LONGLONG target;
+    double clock;
+    int i, size;
 
-            ++it;
+    clock = GetAudioClock();
+
+    for (i = 0; i < m_Scheduled.Size();)
+    {
+        if (m_Scheduled[i].m_Time <= clock)
+        {
+            due.PushBack(m_Scheduled[i]);
+            m_Scheduled[i] = m_Scheduled[m_Scheduled.Size() - 1];
+            m_Scheduled.PopBack();
         }
         else
         {
-            it = m_SoundsPlaying.Remove(it);
+            ++i;
         }
     }
 
-    // Update minions
-    for (itm = m_Minions.Begin(); itm != m_Minions.End(); ++itm)
+    // Position the late buffers first, so that the starts below follow
+    // each other as closely as possible
+    for (i = 0; i < due.Size(); ++i)
     {
-        if (IsPlaying((*itm)->m_Source))
+        start = &due[i];
+        if (start->m_Time >= clock)
+            continue;
+
+        buffer = (LPDIRECTSOUNDBUFFER)start->m_Source;
+        size = GetWaveSize(buffer);
+        if (size <= 0 || GetWaveFormat(buffer, wf) != CK_OK || wf.nBlockAlign == 0 ||
+            FAILED(buffer->GetFrequency(&frequency)) ||
+            FAILED(buffer->GetCurrentPosition(&position, &write)))
         {
-            somethingIsPlayingIn3D = TRUE;
+            continue;
+        }
 
-            if ((*itm)->m_Entity)
+        target = position + (LONGLONG)((clock - start->m_Time) * frequency) * wf.nBlockAlign;
+        if (target >= size)
+        {
+            // A one-shot already over is not started at all
+            if (!start->m_Loop)
             {
-                ent = (CK3dEntity *)m_Context->GetObject((*itm)->m_Entity);
-                if (ent)
+                start->m_Source = NULL;
+                continue;
+            }
+            target %= size;
+        }
+        buffer->SetCurrentPosition((DWORD)target);
+    }
+
+    for (i = 0; i < due.Size(); ++i)
+    {
+        if (due[i].m_Source)
+            InternalPlay(due[i].m_Source, due[i].m_Loop);
+    }
+}
+
+int DX8SoundManager::FindScheduled(void *source) const
+{
+    int i;
+
+    for (i = 0; i < m_Scheduled.Size(); ++i)
+    {
+        if (m_Scheduled[i].m_Source == source)
+            return i;
+    }
+    return -1;
+}
+
+void DX8SoundManager::RemoveScheduled(void *source)
+{
+    int index;
+
+    EnterCriticalSection();
+    index = FindScheduled(source);
+    if (index >= 0)
+    {
+        m_Scheduled[index] = m_Scheduled[m_Scheduled.Size() - 1];
+        m_Scheduled.PopBack();
+    }
+    LeaveCriticalSection();
+}
+
+CKERROR DX8SoundManager::SetUpdateRate(int hz)
+{
+    if (hz < 0 || hz > MAXIMUM_UPDATE_RATE)
+        return CKERR_INVALIDPARAMETER;
+
+    StopUpdateThread();
+    m_UpdateRate = hz;
+
+    if (hz > 0 && m_bInitialized && !StartUpdateThread())
+        return CKERR_OUTOFMEMORY;
+    return CK_OK;
+}
+
+CKBOOL DX8SoundManager::StartUpdateThread()
+{
+    DWORD threadId;
+
+    if (m_UpdateThread)
+        return TRUE;
+
+    m_UpdateStopEvent = ::CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (!m_UpdateStopEvent)
+        return FALSE;
+
+    EnterCriticalSection();
+    m_SnapshotCounter = ReadPerformanceCounter();
+    LeaveCriticalSection();
+
+    m_UpdateThread = ::CreateThread(NULL, 0, UpdateThread, this, 0, &threadId);
+    if (!m_UpdateThread)
+    {
+        StopUpdateThread();
+        return FALSE;
+    }
+    ::SetThreadPriority(m_UpdateThread, THREAD_PRIORITY_ABOVE_NORMAL);
+    return TRUE;
+}
+
+void DX8SoundManager::StopUpdateThread()
+{
+    if (m_UpdateThread)
+    {
+        ::SetEvent(m_UpdateStopEvent);
+        ::WaitForSingleObject(m_UpdateThread, INFINITE);
+        ::CloseHandle(m_UpdateThread);
+        m_UpdateThread = NULL;
+    }
+
+    if (m_UpdateStopEvent)
+    {
+        ::CloseHandle(m_UpdateStopEvent);
+        m_UpdateStopEvent = NULL;
+    }
+
+    EnterCriticalSection();
+    m_Emitters.Clear();
+    m_ListenerState.m_Valid = FALSE;
+    LeaveCriticalSection();
+}
+
+DWORD WINAPI DX8SoundManager::UpdateThread(LPVOID param)
+{
+    ((DX8SoundManager *)param)->UpdateLoop();
+    return 0;
+}
+
+void DX8SoundManager::UpdateLoop()
+{
+    DWORD period;
+
+    period = 1000 / m_UpdateRate;
+    if (period == 0)
+        period = 1;
+
+    // Waits are rounded up to the scheduler tick otherwise
+    timeBeginPeriod(1);
+
+    while (::WaitForSingleObject(m_UpdateStopEvent, period) == WAIT_TIMEOUT)
+    {
+        EnterCriticalSection();
+        if (m_bInitialized)
+            UpdateTick();
+        LeaveCriticalSection();
+    }
+
+    timeEndPeriod(1);
+}
+
+void DX8SoundManager::UpdateTick()
+{
+    LPDIRECTSOUND3DBUFFER source3D;
+    LARGE_INTEGER frequency;
+    SoundEmitterState *emitter;
+    VxVector pos;
+    float ahead, frames;
+    int i;
+
+    // Extrapolate from the last frame, but not for long if frames stall
+    QueryPerformanceFrequency(&frequency);
+    ahead = 0.0f;
+    if (frequency.QuadPart > 0)
+        ahead = (float)(ReadPerformanceCounter() - m_SnapshotCounter) / (float)frequency.QuadPart;
+    if (ahead > MAXIMUM_EXTRAPOLATION)
+        ahead = MAXIMUM_EXTRAPOLATION;
+    if (ahead < 0.0f)
+        ahead = 0.0f;
+
+    // Velocities are moves per frame, as PostProcess sends them
+    frames = (m_SnapshotFrame > 0.0f) ? ahead / m_SnapshotFrame : 0.0f;
+
+    for (i = 0; i < m_Emitters.Size(); ++i)
+    {
+        emitter = &m_Emitters[i];
+
+        source3D = NULL;
+        if (FAILED(((LPDIRECTSOUNDBUFFER)emitter->m_Source)->QueryInterface(IID_IDirectSound3DBuffer, (VOID **)&source3D)))
+            continue;
+
+        pos = emitter->m_Position + emitter->m_Velocity * frames;
+        source3D->SetPosition(pos.x, pos.y, pos.z, DS3D_DEFERRED);
+        source3D->SetVelocity(emitter->m_Velocity.x, emitter->m_Velocity.y, emitter->m_Velocity.z, DS3D_DEFERRED);
+        source3D->SetConeOrientation(emitter->m_Direction.x, emitter->m_Direction.y, emitter->m_Direction.z, DS3D_DEFERRED);
+        source3D->Release();
+    }
+
+    if (m_Listener && m_ListenerState.m_Valid)
+    {
+        pos = m_ListenerState.m_Position + m_ListenerState.m_Velocity * frames;
+        m_Listener->SetPosition(pos.x, pos.y, pos.z, DS3D_DEFERRED);
+        m_Listener->SetVelocity(m_ListenerState.m_Velocity.x, m_ListenerState.m_Velocity.y,
+                                m_ListenerState.m_Velocity.z, DS3D_DEFERRED);
+        m_Listener->SetOrientation(m_ListenerState.m_Front.x, m_ListenerState.m_Front.y, m_ListenerState.m_Front.z,
+                                   m_ListenerState.m_Top.x, m_ListenerState.m_Top.y, m_ListenerState.m_Top.z,
+                                   DS3D_DEFERRED);
+    }
+
+    // One commit for the whole tick
+    if (m_Listener)
+        m_Listener->CommitDeferredSettings();
+
+    if (m_Scheduled.Size() > 0)
+        StartScheduled();
+
+    // Top up the rings between frames; the frame reports what happened
+    if (m_Streams.GetCount() > 0)
+        UpdateStreams();
+}
+
+void DX8SoundManager::PublishSnapshot(float deltaTime)
+{
+    SoundEmitterState emitter;
+    SoundListenerState listenerState;
+    SoundEmitterJob *job;
+    CK3dEntity *listener;
+    const VxMatrix *mat;
+    VxVector pos;
+    int i;
+
+    // Same velocities as without the thread: the move since the last frame
+    ComputeEmitters(1.0f);
+    CullEmitters();
+    ClusterEmitters();
+
+    /* Deferred minions keep the transform of their last snapshot */
+    m_NextEmitters.Clear();
+    for (i = 0; i < m_EmitterJobs.Size(); ++i)
+    {
+        job = &m_EmitterJobs[i];
+        if (job->m_Folded || job->m_Deferred)
+            continue;
+        emitter.m_Source = job->m_Minion->m_Source;
+        emitter.m_Position = job->m_Position;
+        emitter.m_Velocity = job->m_Velocity;
+        emitter.m_Direction = job->m_Direction;
+        m_NextEmitters.PushBack(emitter);
+    }
+
+    listener = GetListener();
+    listenerState.m_Valid = (listener != NULL);
+    if (listener)
+    {
+        mat = &listener->GetWorldMatrix();
+        pos.Set((*mat)[3].x, (*mat)[3].y, (*mat)[3].z);
+
+        listenerState.m_Velocity = pos - m_LastListenerPosition;
+        listenerState.m_Position = pos;
+        listenerState.m_Front.Set((*mat)[2].x, (*mat)[2].y, (*mat)[2].z);
+        listenerState.m_Top.Set((*mat)[1].x, (*mat)[1].y, (*mat)[1].z);
+        m_LastListenerPosition = pos;
+    }
+
+    // Everything above ran unlocked, the thread only waits for the swap
+    EnterCriticalSection();
+    m_Emitters.Swap(m_NextEmitters);
+    m_ListenerState = listenerState;
+    m_SnapshotCounter = ReadPerformanceCounter();
+    m_SnapshotFrame = deltaTime / 1000.0f;
+    LeaveCriticalSection();
+}
+
+void DX8SoundManager::RemoveEmitter(void *source)
+{
+    int i;
+
+    for (i = 0; i < m_Emitters.Size(); ++i)
+    {
+        if (m_Emitters[i].m_Source == source)
+        {
+            m_Emitters[i] = m_Emitters[m_Emitters.Size() - 1];
+            m_Emitters.PopBack();
+            return;
+        }
+    }
+}
+
+void DX8SoundManager::OnBufferLost(void *source)
+{
+    EnterCriticalSection();
+    m_SampleStore.MarkLost(m_SampleStore.Find(source), ReadPerformanceCounter());
+    m_RestoreStats.m_PendingCount = m_SampleStore.GetLostCount();
+    LeaveCriticalSection();
+}
+
+void DX8SoundManager::RestoreLostBuffers()
+{
+    SampleStoreEntry *entry;
+    StoredSample *sample;
+    SoundStreamRing *ring;
+    LPDIRECTSOUNDBUFFER buffer;
+    CKWaveFormat wf;
+    BYTE *data1, *data2;
+    DWORD size1, size2;
+    DWORD status = 0;
+    int fill;
+    LARGE_INTEGER frequency;
+    float latency, longest = 0.0f;
+    int i, restored = 0;
+    HRESULT hr;
+
+    // The primary buffer is lost along with the secondary ones
+    if (m_Primary && SUCCEEDED(m_Primary->GetStatus(&status)) && (status & DSBSTATUS_BUFFERLOST))
+    {
+        if (FAILED(m_Primary->Restore()))
+            return;
+        m_Primary->Play(0, 0, DSBPLAY_LOOPING);
+    }
+
+    QueryPerformanceFrequency(&frequency);
+
+    for (i = 0; i < m_SampleStore.GetLostCount();)
+    {
+        entry = m_SampleStore.GetLost(i);
+        buffer = (LPDIRECTSOUNDBUFFER)entry->m_Source;
+
+        // Still lost: the device is not back yet, retry next frame
+        hr = buffer->Restore();
+        if (hr == DSERR_BUFFERLOST)
+            break;
+
+        if (SUCCEEDED(hr))
+        {
+            sample = entry->m_Sample;
+            data1 = data2 = NULL;
+            size1 = size2 = 0;
+            if (SUCCEEDED(buffer->Lock(0, 0, (LPVOID *)&data1, &size1,
+                                       (LPVOID *)&data2, &size2, DSBLOCK_ENTIREBUFFER)))
+            {
+                if (sample)
+                {
+                    memcpy(data1, sample->m_Data, min(size1, sample->m_Size));
+                }
+                else
                 {
-                    PositionSource((LPDIRECTSOUNDBUFFER)(*itm)->m_Source,
-                                   ent, (*itm)->m_Position, (*itm)->m_Direction, (*itm)->m_OldPosition);
+                    fill = (GetWaveFormat(buffer, wf) == CK_OK && wf.wBitsPerSample == 8) ? 0x80 : 0;
+                    memset(data1, fill, size1);
                 }
+                buffer->Unlock(data1, size1, data2, size2);
             }
+
+            // The queued stream data is gone: the stream writes again from
+            // the play cursor
+            ring = (entry->m_Streamed && m_Streams.GetCount() > 0) ? m_Streams.Find(buffer) : NULL;
+            if (ring)
+                SoundStreamRings::Discard(*ring);
+
+            if (entry->m_Playing)
+                buffer->Play(0, 0, entry->m_Looping ? DSBPLAY_LOOPING : 0);
+
+            latency = (float)((double)(ReadPerformanceCounter() - entry->m_LostTime) * 1000.0 / frequency.QuadPart);
+            if (latency > longest)
+                longest = latency;
+            m_RestoreStats.m_TotalLatency += latency;
+            ++restored;
         }
+
+        // Restored, or failing for another reason: it leaves the queue
+        m_SampleStore.RemoveLost(i);
+    }
+
+    m_RestoreStats.m_PendingCount = m_SampleStore.GetLostCount();
+    if (restored == 0)
+        return;
+
+    m_RestoreStats.m_RestoredCount += restored;
+    m_RestoreStats.m_LastLatency = longest;
+    if (longest > m_RestoreStats.m_MaxLatency)
+        m_RestoreStats.m_MaxLatency = longest;
+
+    if (m_Context->IsInInterfaceMode())
+    {
+        char message[128];
+        sprintf(message, "Sound Manager: restored %d lost buffer(s) after %.1f ms", restored, longest);
+        m_Context->OutputToConsole(message);
+    }
+}
+
+CKERROR DX8SoundManager::PostProcess()
+{
+    float deltaTime;
+    CKBOOL somethingIsPlayingIn3D;
+    SoundEmitterJob *job;
+    LPDIRECTSOUND3DBUFFER source3D;
+    CK3dEntity *listener;
+    const VxMatrix *mat;
+    const VxVector4 *pos, *dir, *up;
+    VxVector velocity;
+    int i;
+
+    if (!ValidateDirectSound())
+        return CK_OK;
+
+    deltaTime = m_Context->GetTimeManager()->GetLastDeltaTime();
+
+    if (m_CommandLog)
+        m_CommandLog->RecordPostProcess(deltaTime);
+
+    // Only the lost and scheduled buffers are shared with the update
+    // thread; the rest of the frame locks where it touches them
+    EnterCriticalSection();
+
+    // Refill the buffers lost since the last frame
+    if (m_SampleStore.GetLostCount() > 0)
+        RestoreLostBuffers();
+
+    // Start the sounds whose time has come, before they are updated
+    if (m_Scheduled.Size() > 0)
+        StartScheduled();
+
+    LeaveCriticalSection();
+
+    // Update playing sounds
+    somethingIsPlayingIn3D = UpdatePlayingSounds(deltaTime);
+
+    // Duplicate ahead of the next triggers of the primed sounds
+    if (m_PrimedVoices.GetPoolCount() > 0)
+        RefillPrimedVoices();
+
+    // With the update thread, publish the transforms it commits instead
+    if (m_UpdateThread)
+    {
+        ProcessMinions();
+        PublishSnapshot(deltaTime);
+        return CK_OK;
+    }
+
+    // Update minions: transforms on the job pool, then the device calls in
+    // order, deferred to the commit below
+    if (ComputeEmitters(1.0f))
+        somethingIsPlayingIn3D = TRUE;
+    CullEmitters();
+    ClusterEmitters();
+
+    for (i = 0; i < m_EmitterJobs.Size(); ++i)
+    {
+        job = &m_EmitterJobs[i];
+        if (job->m_Folded || job->m_Deferred)
+            continue;
+
+        source3D = NULL;
+        if (FAILED(((LPDIRECTSOUNDBUFFER)job->m_Minion->m_Source)->QueryInterface(IID_IDirectSound3DBuffer, (VOID **)&source3D)))
+            continue;
+
+        source3D->SetPosition(job->m_Position.x, job->m_Position.y, job->m_Position.z, DS3D_DEFERRED);
+        source3D->SetVelocity(job->m_Velocity.x, job->m_Velocity.y, job->m_Velocity.z, DS3D_DEFERRED);
+        source3D->SetConeOrientation(job->m_Direction.x, job->m_Direction.y, job->m_Direction.z, DS3D_DEFERRED);
+        source3D->Release();
     }
 
     // Update listener if something is playing in 3D
@@ -1277,7 +2338,6 @@ CKERROR DX8SoundManager::PostProcess()
     // Process minions (cleanup finished ones)
     ProcessMinions();
 
-    LeaveCriticalSection();
     return CK_OK;
 }
 
@@ -1303,6 +2363,7 @@ CKERROR DX8SoundManager::OnCKReset()
 
     m_SoundsPlaying.Clear();
     ReleaseMinions();
+    m_MinionIndex.Clear();
 
     // Restore initial volume if changed
     if (g_InitialVolumeChanged && m_Primary)
@@ -53,7 +53,7 @@ BSC32=bscmake.exe
 # ADD BSC32 /nologo
 LINK32=link.exe
 # ADD BASE LINK32 kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib /nologo /dll /machine:I386
-# ADD LINK32 CK2.lib VxMath.lib dsound.lib dxguid.lib kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib /nologo /dll /machine:I386
+# ADD LINK32 CK2.lib VxMath.lib dsound.lib dxguid.lib winmm.lib kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib /nologo /dll /machine:I386
 
 !ELSEIF  "$(CFG)" == "Dx8SoundManager - Win32 Debug"
 
@@ -79,7 +79,7 @@ BSC32=bscmake.exe
 # ADD BSC32 /nologo
 LINK32=link.exe
 # ADD BASE LINK32 kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib /nologo /dll /debug /machine:I386 /pdbtype:sept
-# ADD LINK32 CK2.lib VxMath.lib dsound.lib dxguid.lib kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib /nologo /dll /debug /machine:I386 /pdbtype:sept
+# ADD LINK32 CK2.lib VxMath.lib dsound.lib dxguid.lib winmm.lib kernel32.lib user32.lib gdi32.lib winspool.lib comdlg32.lib advapi32.lib shell32.lib ole32.lib oleaut32.lib uuid.lib odbc32.lib odbccp32.lib /nologo /dll /debug /machine:I386 /pdbtype:sept
 
 !ENDIF 
 
@@ -98,6 +98,106 @@ SOURCE=.\Dx8SoundManager.cpp
 
 SOURCE=.\DxSoundManager.cpp
 # End Source File
+# Begin Source File
+
+SOURCE=.\ActiveSoundSet.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\MinionIndex.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoftwareMixer.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoftwareSoundManager.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\WaveFileWriter.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundCommandLog.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\SampleStore.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundArena.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundReverb.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundConvolver.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundFFT.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundBiquad.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundOutput.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundFadeScheduler.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundInstanceLimiter.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundJobPool.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundClusterer.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundSpatialIndex.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundAttenuation.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundLatencyProbe.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundPrimedVoices.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundBusTree.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundStreamRing.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundBank.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundReadAhead.cpp
+# End Source File
 # End Group
 # Begin Group "Header Files"
 
@@ -110,6 +210,114 @@ SOURCE=.\Dx8SoundManager.h
 
 SOURCE=.\DxSoundManager.h
 # End Source File
+# Begin Source File
+
+SOURCE=.\ActiveSoundSet.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\MinionIndex.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoftwareMixer.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoftwareSoundManager.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\WaveFileWriter.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundCommandLog.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\SampleStore.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundArena.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundReverb.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundSimd.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundBusEffect.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundConvolver.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundFFT.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundBiquad.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundOutput.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundFadeScheduler.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundInstanceLimiter.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundJobPool.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundClusterer.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundSpatialIndex.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundAttenuation.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundLatencyProbe.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundPrimedVoices.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundBusTree.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundStreamRing.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundBank.h
+# End Source File
+# Begin Source File
+
+SOURCE=.\SoundReadAhead.h
+# End Source File
 # End Group
 # Begin Group "Resource Files"
 
@@ -5,6 +5,7 @@
 #include <dsound.h>
 
 #include "DxSoundManager.h"
+#include "SampleStore.h"
 
 // Constants for better maintainability
 #define DEFAULT_SAMPLE_RATE     22050
@@ -12,6 +13,64 @@
 #define DEFAULT_BITS_PER_SAMPLE 16
 #define MINIMUM_VOLUME_DB       -10000
 #define MAXIMUM_VOLUME_DB       0
+#define FADE_STEP_DB            0.25f /* Smaller fade steps are not sent to DirectSound */
+#define MAXIMUM_UPDATE_RATE     1000
+#define MAXIMUM_EXTRAPOLATION   0.25f /* Seconds a snapshot is extrapolated at most */
+
+// Environment variable starting the update thread at the given rate in Hz
+#define UPDATE_RATE_ENV "DX8SOUND_UPDATE_RATE"
+
+/**
+ * @brief Recovery statistics for lost DirectSound buffers
+ *
+ * Latencies are in milliseconds, from the moment a loss is noticed to the
+ * moment the buffer is refilled (and playing again if it was).
+ */
+struct SoundRestoreStats
+{
+    CKDWORD m_RestoredCount; /* Buffers restored since OnCKInit */
+    CKDWORD m_PendingCount;  /* Buffers still waiting for the device */
+    float m_LastLatency;     /* Longest latency of the last restore pass */
+    float m_MaxLatency;
+    float m_TotalLatency;
+};
+
+/**
+ * @brief A buffer waiting for the audio clock to start it
+ */
+struct SoundScheduledStart
+{
+    void *m_Source;
+    CK_ID m_Sound;  /* 0 for minions */
+    double m_Time;  /* Audio clock in seconds */
+    CKBOOL m_Loop;
+};
+
+/**
+ * @brief Transform of a 3D source published for the update thread
+ *
+ * Velocities are in units per second: the thread extrapolates positions
+ * from the time of the snapshot.
+ */
+struct SoundEmitterState
+{
+    void *m_Source;
+    VxVector m_Position;
+    VxVector m_Velocity;
+    VxVector m_Direction;
+};
+
+/**
+ * @brief Transform of the listener published for the update thread
+ */
+struct SoundListenerState
+{
+    CKBOOL m_Valid;
+    VxVector m_Position;
+    VxVector m_Velocity;
+    VxVector m_Front;
+    VxVector m_Top;
+};
 
 class DX8SoundManager : public DXSoundManager
 {
@@ -36,6 +95,12 @@ public:
     virtual void SetPlayPosition(void *source, int pos);
     virtual int GetPlayPosition(void *source);
     virtual CKBOOL IsPlaying(void *source);
+    // DirectSound cannot start a buffer on a sample: due starts are issued
+    // back to back at the next PostProcess, each skipped ahead by how late
+    // it is so that sounds scheduled together stay aligned
+    virtual CKERROR PlayAt(CKWaveSound *ws, void *source, CKBOOL loop, double time);
+    // Follows the play cursor of the primary buffer
+    virtual double GetAudioClock();
 
     // PCM Buffer Information
     virtual CKERROR SetWaveFormat(void *source, CKWaveFormat &wf);
@@ -58,9 +123,18 @@ public:
     virtual void UpdateSettings(void *source, CK_SOUNDMANAGER_CAPS settingsoptions,
                                 CKWaveSoundSettings &settings, CKBOOL set /* = TRUE */);
 
+    // Batches, checked once and sent under one hold of the critical section
+    virtual CKERROR PlayBatch(CKWaveSound **sounds, void **sources, int count, CKBOOL loop);
+    virtual CKERROR PauseBatch(CKWaveSound **sounds, void **sources, int count);
+    virtual CKERROR StopBatch(CKWaveSound **sounds, void **sources, int count);
+    virtual CKERROR UpdateSettingsBatch(void **sources, int count, CK_SOUNDMANAGER_CAPS settingsoptions,
+                                        CKWaveSoundSettings *settings);
+
     // 3D Settings
     virtual void Update3DSettings(void *source, CK_SOUNDMANAGER_CAPS settingsoptions,
                                   CKWaveSound3DSettings &settings, CKBOOL set /* = TRUE */);
+    virtual CKERROR Update3DSettingsBatch(void **sources, int count, CK_SOUNDMANAGER_CAPS settingsoptions,
+                                          CKWaveSound3DSettings *settings);
 
     // Listener settings
     virtual void UpdateListenerSettings(CK_SOUNDMANAGER_CAPS settingsoptions,
@@ -76,10 +150,62 @@ public:
     // Status
     virtual CKBOOL IsInitialized();
 
+    // Buffer loss recovery
+    const SoundRestoreStats &GetRestoreStats() const { return m_RestoreStats; }
+
+    // Moves minion and listener positioning and scheduled starts to a
+    // thread ticking at a fixed rate in Hz, 0 to update from PostProcess
+    // only. Frames then publish transforms the thread extrapolates. The
+    // thread also refills the streaming rings between frames; fades stay
+    // on the frame, as they go through CKWaveSound and the command log.
+    CKERROR SetUpdateRate(int hz);
+    int GetUpdateRate() const { return m_UpdateRate; }
+
 protected:
     // Internal helper methods
     void InternalPause(void *source);
     void InternalPlay(void *source, CKBOOL loop /* = FALSE */);
+    // Same, with the critical section held
+    void PauseBuffer(LPDIRECTSOUNDBUFFER buffer);
+    void PlayBuffer(LPDIRECTSOUNDBUFFER buffer, CKBOOL loop);
+    // Creates and sets up a buffer, neither tracked nor logged
+    LPDIRECTSOUNDBUFFER InternalCreateSource(CK_WAVESOUND_TYPE type, CKWaveFormat *wf, CKDWORD bytes);
+    // Sets copied when the device could not share the memory of srcBuffer
+    LPDIRECTSOUNDBUFFER InternalDuplicateSource(LPDIRECTSOUNDBUFFER srcBuffer, CKBOOL &copied);
+    void *CreateMappedSource(CK_WAVESOUND_TYPE type, CKWaveFormat &wf, const BYTE *data, CKDWORD size);
+    void *PrimeSource(void *asset);
+    void UnprimeSource(void *source);
+    void SetSourceGain(void *source, float gain);
+    // Sets the settings of a buffer, gain already filtered by the buses
+    void ApplySettings(LPDIRECTSOUNDBUFFER buffer, CK_SOUNDMANAGER_CAPS settingsoptions,
+                       const CKWaveSoundSettings &settings, float gain);
+    // Sets the 3D settings of a buffer, DS3D_IMMEDIATE or DS3D_DEFERRED
+    void Apply3DSettings(LPDIRECTSOUND3DBUFFER buffer3D, CK_SOUNDMANAGER_CAPS settingsoptions,
+                         const CKWaveSound3DSettings &settings, DWORD apply);
+
+    // Buffer loss recovery: losses are queued when a call reports them and
+    // the buffers are restored from the sample store at the next PostProcess
+    void OnBufferLost(void *source);
+    void RestoreLostBuffers();
+
+    // Audio clock and scheduled starts; called with the critical section held
+    void ResetAudioClock();
+    void UpdateAudioClock();
+    void StartScheduled();
+    int FindScheduled(void *source) const;
+    void RemoveScheduled(void *source);
+
+    // Update thread
+    CKBOOL StartUpdateThread();
+    void StopUpdateThread();
+    static DWORD WINAPI UpdateThread(LPVOID param);
+    void UpdateLoop();
+    void UpdateTick();
+    // Publishes the minion and listener transforms of the frame
+    void PublishSnapshot(float deltaTime);
+    void RemoveEmitter(void *source);
+    virtual void EnterUpdateLock() { EnterCriticalSection(); }
+    virtual void LeaveUpdateLock() { LeaveCriticalSection(); }
 
     // Source positioning for 3D audio
     void PositionSource(LPDIRECTSOUNDBUFFER psource, CK3dEntity *ent,
@@ -108,6 +234,31 @@ private:
     CKBOOL m_bComInitialized;
     VxVector m_LastListenerPosition;
 
+    // System-memory PCM copies used to refill lost buffers
+    SampleStore m_SampleStore;
+    SoundRestoreStats m_RestoreStats;
+
+    // Audio clock: bytes played by the primary buffer, accumulated from its
+    // play cursor. The performance counter recovers the wraps missed when
+    // the cursor is read less than once per buffer length.
+    XArray<SoundScheduledStart> m_Scheduled;
+    LONGLONG m_ClockBytes;
+    LONGLONG m_ClockCounter;
+    DWORD m_ClockCursor;
+    DWORD m_ClockBufferBytes;
+    DWORD m_ClockBytesPerSecond;
+
+    // Update thread and the snapshot it consumes, both under the critical
+    // section
+    HANDLE m_UpdateThread;
+    HANDLE m_UpdateStopEvent;
+    int m_UpdateRate;
+    XArray<SoundEmitterState> m_Emitters;
+    XArray<SoundEmitterState> m_NextEmitters; /* Built unlocked, swapped in */
+    SoundListenerState m_ListenerState;
+    LONGLONG m_SnapshotCounter;
+    float m_SnapshotFrame; /* Frame time of the snapshot in seconds, its velocities being moves per frame */
+
     // Thread safety (if needed in multi-threaded scenarios)
     CRITICAL_SECTION m_CriticalSection;
     CKBOOL m_bCriticalSectionInitialized;
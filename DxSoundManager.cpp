@@ -1,5 +1,8 @@
 #include "DxSoundManager.h"
+#include "SoftwareSoundManager.h"
 #include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
 
 #ifdef CK_LIB
     #define CreateNewManager               CreateNewSoundManager
@@ -26,8 +29,9 @@ const char *DXSoundManagerName = "DirectX Sound Manager";
 // GUID for DX8 Sound Manager
 #define DX8_SOUNDMANAGER_GUID CKGUID(0x77135393, 0x225c679a)
 
-// Forward declaration
+// Forward declarations
 CKERROR CreateDx8SoundManager(CKContext *context);
+CKERROR CreateSoftwareSoundManager(CKContext *context);
 
 //-----------------------------------------------------------------------------
 // Plugin Entry Points
@@ -35,8 +39,16 @@ CKERROR CreateDx8SoundManager(CKContext *context);
 
 CKERROR CreateNewManager(CKContext *context)
 {
+    const char *offline;
+
     if (!context)
         return CKERR_INVALIDPARAMETER;
+
+    /* Offline rendering mixes in software instead of opening a device */
+    offline = getenv(SOFTWARE_ENV_OFFLINE_RENDER);
+    if (offline && *offline)
+        return CreateSoftwareSoundManager(context);
+
     return CreateDx8SoundManager(context);
 }
 
@@ -142,27 +154,649 @@ float DbPanningToFloat(long d)
 //-----------------------------------------------------------------------------
 
 DXSoundManager::DXSoundManager(CKContext *Context)
-    : CKSoundManager(Context, DXSoundManagerName)
+    : CKSoundManager(Context, DXSoundManagerName),
+      m_LevelArena("level"),
+      m_SceneArena("scene")
 {
-    /* Base class initialization is sufficient */
+    m_CommandLog = NULL;
+    SoundOutputFormatInit(m_OutputFormat, 44100, 2, 16);
+    m_FadeStepDb = 0.0f;
+    m_FadeStepSource = NULL;
+    m_FadeStepGain = 0.0f;
+    m_FadeStepTaken = FALSE;
+    m_InstanceClock = 0.0f;
+    m_EmitterVelocityScale = 1.0f;
+    m_SettingClusterGain = FALSE;
+    m_EmitterFrame = 0;
+    m_RefileEmitters = FALSE;
+    m_AudibleDistance = 0.0f;
+    m_CullFrame = 0;
 }
 
 DXSoundManager::~DXSoundManager()
 {
+    int i;
+
     /* Cleanup is handled by derived classes */
+    StopCommandLog();
+
+    for (i = 0; i < m_Banks.Size(); ++i)
+        delete m_Banks[i];
 }
 
 CKERROR DXSoundManager::PostClearAll()
 {
-    CKERROR result = CKSoundManager::PostClearAll();
+    CKERROR result;
 
+    /* The one reset of the shared state, backends only add their own */
+    EnterUpdateLock();
+
+    result = CKSoundManager::PostClearAll();
     m_SoundsPlaying.Clear();
+    m_Fades.Clear();
     ReleaseMinions();
+    ReleasePrimedVoices(TRUE);
+    m_Instances.Clear();
+    m_Clusterer.Clear();
+    m_SourceGains.Clear();
+    m_EmitterIndex.Clear();
+    m_EmitterCache.Clear();
+    m_MinionIndex.Clear();
+    CloseStreams();
     RegisterAttribute();
 
+    ResetArena(m_SceneArena);
+    ResetArena(m_LevelArena);
+
+    LeaveUpdateLock();
     return result;
 }
 
+void DXSoundManager::ResetArena(SoundArena &arena)
+{
+    char message[128];
+    CKBOOL reset;
+    int live = arena.GetLiveCount();
+
+    if (live == 0 && arena.GetUsedBytes() == 0)
+        return;
+
+    reset = arena.Reset();
+
+    if (m_Context && m_Context->IsInInterfaceMode())
+    {
+        if (reset)
+            sprintf(message, "Sound %s arena reset: high-water %lu KB, reserved %lu KB",
+                    arena.GetName(), (unsigned long)(arena.GetHighWaterBytes() / 1024),
+                    (unsigned long)(arena.GetReservedBytes() / 1024));
+        else
+            sprintf(message, "Sound %s arena reset deferred: %d allocations still live",
+                    arena.GetName(), live);
+        m_Context->OutputToConsole(message);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Batches
+//-----------------------------------------------------------------------------
+
+CKBOOL DXSoundManager::IsValidBatch(void **sources, int count)
+{
+    int i;
+
+    if (!sources || count < 0)
+        return FALSE;
+    for (i = 0; i < count; ++i)
+    {
+        if (!sources[i])
+            return FALSE;
+    }
+    return TRUE;
+}
+
+// The calls below are the fallback of the backends whose single calls
+// neither lock nor reach a device, and have nothing to share
+
+CKERROR DXSoundManager::PlayBatch(CKWaveSound **sounds, void **sources, int count, CKBOOL loop)
+{
+    int i;
+
+    if (!IsValidBatch(sources, count))
+        return CKERR_INVALIDPARAMETER;
+
+    /* One hold of the lock: an update thread sees the batch as a whole */
+    EnterUpdateLock();
+    for (i = 0; i < count; ++i)
+        Play(sounds ? sounds[i] : NULL, sources[i], loop);
+    LeaveUpdateLock();
+    return CK_OK;
+}
+
+CKERROR DXSoundManager::PauseBatch(CKWaveSound **sounds, void **sources, int count)
+{
+    int i;
+
+    if (!IsValidBatch(sources, count))
+        return CKERR_INVALIDPARAMETER;
+
+    EnterUpdateLock();
+    for (i = 0; i < count; ++i)
+        Pause(sounds ? sounds[i] : NULL, sources[i]);
+    LeaveUpdateLock();
+    return CK_OK;
+}
+
+CKERROR DXSoundManager::StopBatch(CKWaveSound **sounds, void **sources, int count)
+{
+    int i;
+
+    if (!IsValidBatch(sources, count))
+        return CKERR_INVALIDPARAMETER;
+
+    EnterUpdateLock();
+    for (i = 0; i < count; ++i)
+        Stop(sounds ? sounds[i] : NULL, sources[i]);
+    LeaveUpdateLock();
+    return CK_OK;
+}
+
+CKERROR DXSoundManager::UpdateSettingsBatch(void **sources, int count, CK_SOUNDMANAGER_CAPS settingsoptions,
+                                            CKWaveSoundSettings *settings)
+{
+    int i;
+
+    if (!settings || !IsValidBatch(sources, count))
+        return CKERR_INVALIDPARAMETER;
+
+    EnterUpdateLock();
+    for (i = 0; i < count; ++i)
+        UpdateSettings(sources[i], settingsoptions, settings[i], TRUE);
+    LeaveUpdateLock();
+    return CK_OK;
+}
+
+CKERROR DXSoundManager::Update3DSettingsBatch(void **sources, int count, CK_SOUNDMANAGER_CAPS settingsoptions,
+                                              CKWaveSound3DSettings *settings)
+{
+    int i;
+
+    if (!settings || !IsValidBatch(sources, count))
+        return CKERR_INVALIDPARAMETER;
+
+    EnterUpdateLock();
+    for (i = 0; i < count; ++i)
+        Update3DSettings(sources[i], settingsoptions, settings[i], TRUE);
+    LeaveUpdateLock();
+    return CK_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Sound Banks
+//-----------------------------------------------------------------------------
+
+SoundBank *DXSoundManager::OpenSoundBank(const char *path)
+{
+    char message[256];
+    SoundBank *bank = new SoundBank;
+
+    if (!bank->Open(path))
+    {
+        delete bank;
+        if (m_Context && m_Context->IsInInterfaceMode())
+        {
+            sprintf(message, "Cannot open sound bank: %.200s", path ? path : "(null)");
+            m_Context->OutputToConsole(message);
+        }
+        return NULL;
+    }
+
+    m_Banks.PushBack(bank);
+    return bank;
+}
+
+CKERROR DXSoundManager::CloseSoundBank(SoundBank *bank)
+{
+    int i;
+
+    for (i = 0; i < m_Banks.Size(); ++i)
+    {
+        if (m_Banks[i] != bank)
+            continue;
+
+        if (bank->GetSourceCount() > 0)
+            return CKERR_INVALIDOPERATION;
+
+        m_Banks[i] = m_Banks[m_Banks.Size() - 1];
+        m_Banks.Resize(m_Banks.Size() - 1);
+        delete bank;
+        return CK_OK;
+    }
+    return CKERR_INVALIDPARAMETER;
+}
+
+void *DXSoundManager::CreateBankSource(SoundBank *bank, const char *name, CK_WAVESOUND_TYPE type)
+{
+    CKWaveFormat wf;
+    void *source;
+    int index;
+
+    if (!bank || !bank->IsOpen())
+        return NULL;
+
+    index = bank->Find(name);
+    if (index < 0)
+        return NULL;
+
+    bank->GetFormat(index, wf);
+    source = CreateMappedSource(type, wf, bank->GetData(index), bank->GetEntry(index).m_Size);
+    if (source)
+    {
+        bank->AddSource();
+        m_BankSources.Insert(source, bank, TRUE);
+    }
+    return source;
+}
+
+//-----------------------------------------------------------------------------
+// Streaming Rings
+//-----------------------------------------------------------------------------
+
+CKERROR DXSoundManager::OpenStream(void *source)
+{
+    SoundStreamRing *ring;
+    CKWaveFormat wf;
+    CKDWORD guard, size, cursor;
+
+    if (!source || GetWaveFormat(source, wf) != CK_OK)
+        return CKERR_INVALIDPARAMETER;
+
+    guard = (CKDWORD)wf.nAvgBytesPerSec * SOUNDSTREAM_GUARD_MS / 1000;
+    size = (CKDWORD)GetWaveSize(source);
+    cursor = (CKDWORD)GetPlayPosition(source);
+
+    /* The rings are shared with an update thread refilling them */
+    EnterUpdateLock();
+    ring = m_Streams.Open(source, size, wf.nBlockAlign, wf.nAvgBytesPerSec, guard, cursor);
+    LeaveUpdateLock();
+    return ring ? CK_OK : CKERR_INVALIDPARAMETER;
+}
+
+void DXSoundManager::CloseStream(void *source)
+{
+    SoundStreamRing *ring;
+
+    EnterUpdateLock();
+    ring = m_Streams.Find(source);
+    if (ring)
+    {
+        if (ring->m_Pending > 0)
+            Unlock(source, ring->m_Region[0], 0, ring->m_Region[1], 0);
+        m_Streams.Close(source);
+        if (m_ReadAhead.GetCount() > 0)
+            m_ReadAhead.Close(source);
+    }
+    LeaveUpdateLock();
+}
+
+CKERROR DXSoundManager::BeginStreamWrite(void *source, CKDWORD maxBytes,
+                                         void **region1, CKDWORD *bytes1, void **region2, CKDWORD *bytes2)
+{
+    SoundStreamRing *ring;
+    CKDWORD bytes;
+    CKERROR err;
+
+    if (!region1 || !bytes1 || !region2 || !bytes2)
+        return CKERR_INVALIDPARAMETER;
+
+    *region1 = NULL;
+    *bytes1 = 0;
+    *region2 = NULL;
+    *bytes2 = 0;
+
+    EnterUpdateLock();
+    ring = m_Streams.Find(source);
+    if (!ring || ring->m_Pending > 0)
+    {
+        LeaveUpdateLock();
+        return CKERR_INVALIDPARAMETER;
+    }
+
+    AdvanceStream(*ring);
+    bytes = SoundStreamRings::GetWritable(*ring);
+    if (maxBytes < bytes)
+        bytes = maxBytes - maxBytes % ring->m_Align;
+
+    err = CK_OK;
+    if (bytes > 0)
+    {
+        err = Lock(source, SoundStreamRings::GetWriteOffset(*ring), bytes,
+                   region1, bytes1, region2, bytes2, (CK_WAVESOUND_LOCKMODE)0);
+    }
+    if (bytes > 0 && err == CK_OK)
+    {
+        ring->m_Region[0] = *region1;
+        ring->m_Region[1] = *region2;
+        ring->m_RegionBytes[0] = *bytes1;
+        ring->m_RegionBytes[1] = *region2 ? *bytes2 : 0;
+        ring->m_Pending = ring->m_RegionBytes[0] + ring->m_RegionBytes[1];
+    }
+    LeaveUpdateLock();
+    return err;
+}
+
+CKERROR DXSoundManager::EndStreamWrite(void *source, CKDWORD bytes)
+{
+    SoundStreamRing *ring;
+    CKDWORD first;
+    CKERROR err;
+
+    EnterUpdateLock();
+    ring = m_Streams.Find(source);
+    if (!ring || ring->m_Pending == 0)
+    {
+        LeaveUpdateLock();
+        return CKERR_INVALIDPARAMETER;
+    }
+
+    if (bytes > ring->m_Pending)
+        bytes = ring->m_Pending;
+    bytes -= bytes % ring->m_Align;
+    first = (bytes < ring->m_RegionBytes[0]) ? bytes : ring->m_RegionBytes[0];
+
+    err = Unlock(source, ring->m_Region[0], first, ring->m_Region[1], bytes - first);
+    SoundStreamRings::Commit(*ring, bytes);
+    ring->m_Pending = 0;
+    LeaveUpdateLock();
+    return err;
+}
+
+CKERROR DXSoundManager::GetStreamStats(void *source, SoundStreamStats &stats)
+{
+    SoundStreamRing *ring;
+
+    EnterUpdateLock();
+    ring = m_Streams.Find(source);
+    if (ring)
+    {
+        AdvanceStream(*ring);
+        stats = ring->m_Stats;
+    }
+    LeaveUpdateLock();
+    return ring ? CK_OK : CKERR_INVALIDPARAMETER;
+}
+
+CKERROR DXSoundManager::OpenFileStream(void *source, const char *path, CKDWORD dataOffset, CKDWORD dataSize,
+                                       CKBOOL loop)
+{
+    SoundStreamRing *ring;
+    SoundReadAheadStream *stream;
+    CKERROR err;
+
+    if (!path || dataSize == 0)
+        return CKERR_INVALIDPARAMETER;
+
+    EnterUpdateLock();
+    err = CK_OK;
+    ring = m_Streams.Find(source);
+    if (!ring)
+    {
+        err = OpenStream(source);
+        ring = m_Streams.Find(source);
+    }
+
+    if (err == CK_OK && (ring->m_Pending > 0 || dataSize % ring->m_Align != 0))
+        err = CKERR_INVALIDPARAMETER;
+
+    if (err == CK_OK)
+    {
+        stream = m_ReadAhead.Open(source, path, dataOffset, dataSize, loop);
+        if (stream)
+            FillFileStream(*ring, *stream);
+        else
+            err = CKERR_INVALIDFILE;
+    }
+    LeaveUpdateLock();
+    return err;
+}
+
+CKERROR DXSoundManager::GetStreamHealth(void *source, SoundStreamHealth &health)
+{
+    SoundStreamRing *ring;
+    SoundReadAheadStream *stream;
+
+    EnterUpdateLock();
+    ring = m_Streams.Find(source);
+    if (!ring)
+    {
+        LeaveUpdateLock();
+        return CKERR_INVALIDPARAMETER;
+    }
+
+    AdvanceStream(*ring);
+    memset(&health, 0, sizeof(SoundStreamHealth));
+    health.m_TimeToUnderrun = SoundStreamRings::GetTimeToUnderrun(*ring);
+    health.m_MinTimeToUnderrun = (float)ring->m_Stats.m_MinQueued * 1000.0f / ring->m_BytesPerSecond;
+    health.m_LowWarnings = ring->m_Stats.m_LowWarnings;
+    health.m_Underruns = ring->m_Stats.m_Underruns;
+
+    stream = (m_ReadAhead.GetCount() > 0) ? m_ReadAhead.Find(source) : NULL;
+    if (stream)
+    {
+        health.m_ReadAhead = (float)m_ReadAhead.GetReady(*stream) * 1000.0f / ring->m_BytesPerSecond;
+        health.m_PendingReads = m_ReadAhead.GetPending(*stream);
+        health.m_LateReads = stream->m_LateReads;
+        health.m_Finished = stream->m_EndPosition >= 0 && ring->m_Played >= stream->m_EndPosition;
+    }
+    LeaveUpdateLock();
+    return CK_OK;
+}
+
+void DXSoundManager::CloseStreams()
+{
+    SoundStreamRing *ring;
+    int i;
+
+    for (i = 0; i < m_Streams.GetCount(); ++i)
+    {
+        ring = &m_Streams.GetAt(i);
+        if (ring->m_Pending > 0)
+            Unlock(ring->m_Source, ring->m_Region[0], 0, ring->m_Region[1], 0);
+    }
+    m_Streams.Clear();
+
+    /* Closes the files, frees the blocks and stops the I/O thread */
+    m_ReadAhead.Clear();
+}
+
+void DXSoundManager::UpdateStreams()
+{
+    SoundReadAheadStream *stream;
+    int i;
+
+    for (i = 0; i < m_Streams.GetCount(); ++i)
+    {
+        stream = (m_ReadAhead.GetCount() > 0) ? m_ReadAhead.Find(m_Streams.GetAt(i).m_Source) : NULL;
+        if (AdvanceStream(m_Streams.GetAt(i)) && stream && m_ReadAhead.GetPending(*stream) > 0)
+            ++stream->m_LateReads;
+        if (stream)
+            FillFileStream(m_Streams.GetAt(i), *stream);
+    }
+}
+
+CKBOOL DXSoundManager::AdvanceStream(SoundStreamRing &ring)
+{
+    CKBOOL underrun = m_Streams.Advance(ring, (CKDWORD)GetPlayPosition(ring.m_Source));
+
+    m_Streams.CheckLow(ring);
+    return underrun;
+}
+
+void DXSoundManager::ReportStreams()
+{
+    char message[128];
+    SoundStreamRing *ring;
+    int i;
+
+    if (!m_Context || !m_Context->IsInInterfaceMode())
+        return;
+
+    EnterUpdateLock();
+    for (i = 0; i < m_Streams.GetCount(); ++i)
+    {
+        ring = &m_Streams.GetAt(i);
+        if (ring->m_Stats.m_Underruns > ring->m_ReportedUnderruns)
+        {
+            sprintf(message, "Sound stream underrun: %d on this source, %d in all",
+                    ring->m_Stats.m_Underruns, m_Streams.GetUnderrunCount());
+            m_Context->OutputToConsole(message, FALSE);
+        }
+        else if (ring->m_Stats.m_LowWarnings > ring->m_ReportedLowWarnings)
+        {
+            sprintf(message, "Sound stream low: %.0f ms before an underrun",
+                    SoundStreamRings::GetTimeToUnderrun(*ring));
+            m_Context->OutputToConsole(message, FALSE);
+        }
+        ring->m_ReportedUnderruns = ring->m_Stats.m_Underruns;
+        ring->m_ReportedLowWarnings = ring->m_Stats.m_LowWarnings;
+    }
+    LeaveUpdateLock();
+}
+
+void DXSoundManager::FillFileStream(SoundStreamRing &ring, SoundReadAheadStream &stream)
+{
+    CKWaveFormat wf;
+    void *region1, *region2;
+    CKDWORD bytes1, bytes2, ready, copied;
+    int fill;
+
+    ready = m_ReadAhead.GetReady(stream);
+    /* A failed read ends the stream after the data read before it */
+    if (!stream.m_Ended && stream.m_Failed && ready < ring.m_Align)
+    {
+        stream.m_Ended = TRUE;
+        stream.m_EndPosition = ring.m_Written;
+    }
+
+    if (stream.m_Ended)
+    {
+        /* Silence past the end keeps the ring from replaying old data */
+        if (BeginStreamWrite(ring.m_Source, 0xFFFFFFFF, &region1, &bytes1, &region2, &bytes2) == CK_OK &&
+            bytes1 > 0)
+        {
+            fill = (GetWaveFormat(ring.m_Source, wf) == CK_OK && wf.wBitsPerSample == 8) ? 0x80 : 0;
+            memset(region1, fill, bytes1);
+            if (region2)
+                memset(region2, fill, bytes2);
+            EndStreamWrite(ring.m_Source, bytes1 + (region2 ? bytes2 : 0));
+        }
+        return;
+    }
+
+    if (ready >= ring.m_Align &&
+        BeginStreamWrite(ring.m_Source, ready, &region1, &bytes1, &region2, &bytes2) == CK_OK && bytes1 > 0)
+    {
+        copied = m_ReadAhead.Read(stream, region1, bytes1);
+        if (region2 && copied == bytes1)
+            copied += m_ReadAhead.Read(stream, region2, bytes2);
+        EndStreamWrite(ring.m_Source, copied);
+        if (stream.m_Ended)
+            stream.m_EndPosition = ring.m_Written;
+    }
+
+    /* Due when the ring and the blocks already read run out */
+    m_ReadAhead.Schedule(stream,
+                         m_InstanceClock + SoundStreamRings::GetTimeToUnderrun(ring) +
+                             (float)m_ReadAhead.GetReady(stream) * 1000.0f / ring.m_BytesPerSecond,
+                         (float)SOUNDREADAHEAD_BLOCK_SIZE * 1000.0f / ring.m_BytesPerSecond);
+}
+
+CKERROR DXSoundManager::SetReverbBus(int /* bus */, const SoundReverbSettings * /* settings */)
+{
+    return CKERR_NOTIMPLEMENTED;
+}
+
+CKERROR DXSoundManager::SetConvolutionBus(int /* bus */, const float * /* ir */, int /* frames */, int /* channels */,
+                                          float /* gain */)
+{
+    return CKERR_NOTIMPLEMENTED;
+}
+
+CKERROR DXSoundManager::SetReverbSend(void * /* source */, int /* bus */, float /* level */)
+{
+    return CKERR_NOTIMPLEMENTED;
+}
+
+//-----------------------------------------------------------------------------
+// Gain Buses
+//-----------------------------------------------------------------------------
+
+int DXSoundManager::CreateGainBus(int parent, float level)
+{
+    return m_GainBuses.CreateBus(parent, level);
+}
+
+CKERROR DXSoundManager::DestroyGainBus(int bus)
+{
+    return m_GainBuses.DestroyBus(bus, SendBusGain, this) ? CK_OK : CKERR_INVALIDPARAMETER;
+}
+
+CKERROR DXSoundManager::SetGainBusLevel(int bus, float level)
+{
+    return m_GainBuses.SetLevel(bus, level) ? CK_OK : CKERR_INVALIDPARAMETER;
+}
+
+float DXSoundManager::GetGainBusLevel(int bus) const
+{
+    return m_GainBuses.IsBus(bus) ? m_GainBuses.GetBus(bus).m_Level : 0.0f;
+}
+
+CKERROR DXSoundManager::SetGainBusParent(int bus, int parent)
+{
+    return m_GainBuses.SetParent(bus, parent) ? CK_OK : CKERR_INVALIDPARAMETER;
+}
+
+CKERROR DXSoundManager::SetSourceGainBus(void *source, int bus)
+{
+    CKWaveSoundSettings settings;
+
+    if (!source || (bus != SOUNDBUS_NONE && !m_GainBuses.IsBus(bus)))
+        return CKERR_INVALIDPARAMETER;
+
+    /* The gain read back is the own gain of a source already routed */
+    memset(&settings, 0, sizeof(CKWaveSoundSettings));
+    settings.m_Gain = 1.0f;
+    UpdateSettings(source, CK_WAVESOUND_SETTINGS_GAIN, settings, FALSE);
+    SendBusGain(this, source, m_GainBuses.Assign(source, bus, settings.m_Gain));
+    return CK_OK;
+}
+
+int DXSoundManager::GetSourceGainBus(void *source)
+{
+    SoundBusMember *member = m_GainBuses.Find(source);
+
+    return member ? member->m_Bus : SOUNDBUS_NONE;
+}
+
+void DXSoundManager::FlushGainBuses()
+{
+    m_GainBuses.Flush(SendBusGain, this);
+}
+
+void DXSoundManager::SendBusGain(void *context, void *source, float gain)
+{
+    DXSoundManager *manager = (DXSoundManager *)context;
+    CKWaveSoundSettings settings;
+
+    /* Logged as heard, so replays need no buses */
+    if (manager->m_CommandLog)
+    {
+        memset(&settings, 0, sizeof(CKWaveSoundSettings));
+        settings.m_Gain = gain;
+        manager->m_CommandLog->RecordUpdateSettings(source, CK_WAVESOUND_SETTINGS_GAIN, settings);
+    }
+    manager->SetSourceGain(source, gain);
+}
+
 CKERROR DXSoundManager::OnCKPause()
 {
     CK_ID *it;
@@ -230,6 +864,8 @@ CKERROR DXSoundManager::PreLaunchScene(CKScene *OldScene, CKScene *NewScene)
     {
         if (!*itm)
         {
+            /* Slots shift without a release: reindex at the next deletion */
+            m_MinionIndex.Clear();
             itm = m_Minions.Remove(itm);
             continue;
         }
@@ -249,16 +885,19 @@ CKERROR DXSoundManager::PreLaunchScene(CKScene *OldScene, CKScene *NewScene)
         }
     }
 
+    /* Reclaims the minion duplicates unless some survive the scene change;
+       the primed ones are made again next frame */
+    ReleasePrimedVoices(FALSE);
+    ResetArena(m_SceneArena);
+
     return CK_OK;
 }
 
 CKERROR DXSoundManager::SequenceToBeDeleted(CK_ID *objids, int count)
 {
     CKERROR result;
-    CK_ID *it;
+    int i;
     CKWaveSound *ws;
-    SoundMinion **itm;
-    CKObject *entity;
 
     if (!objids || count <= 0)
         return CKERR_INVALIDPARAMETER;
@@ -266,44 +905,994 @@ CKERROR DXSoundManager::SequenceToBeDeleted(CK_ID *objids, int count)
     /* Call base class implementation */
     result = CKSoundManager::SequenceToBeDeleted(objids, count);
 
-    /* Stop and remove sounds that are being deleted */
-    for (it = m_SoundsPlaying.Begin(); it != m_SoundsPlaying.End();)
+    /* Index minions created since the last PostProcess */
+    m_MinionIndex.Sync(m_Minions);
+
+    /* Only touch the sounds and minions referencing a deleted ID, under one
+       hold of the lock: an update thread never sees half a batch */
+    EnterUpdateLock();
+    for (i = 0; i < count; ++i)
     {
-        ws = (CKWaveSound *)m_Context->GetObject(*it);
-        if (!ws || ws->IsToBeDeleted())
+        /* Stop and remove sounds that are being deleted */
+        if (m_SoundsPlaying.Remove(objids[i]))
         {
+            ws = (CKWaveSound *)m_Context->GetObject(objids[i]);
             if (ws)
             {
                 ws->Stop();
             }
-            it = m_SoundsPlaying.Remove(it);
+        }
+
+        m_Fades.RemoveSound(objids[i]);
+
+        /* Clean up minions with deleted original sounds or entities */
+        DetachMinions(MinionIndex::BY_ORIGINAL_SOUND, objids[i]);
+        DetachMinions(MinionIndex::BY_ENTITY, objids[i]);
+    }
+    LeaveUpdateLock();
+
+    return result;
+}
+
+CKBOOL DXSoundManager::UpdatePlayingSounds(float deltaTime)
+{
+    int i;
+    CKWaveSound *ws;
+    CKBOOL somethingIsPlayingIn3D = FALSE;
+
+    /* The calls made back into the manager here are replayed by PostProcess,
+       only the ones coming from the engine belong to the command log */
+    SoundCommandLog *commandLog = m_CommandLog;
+    m_CommandLog = NULL;
+
+    for (i = 0; i < m_SoundsPlaying.Size();)
+    {
+        ws = (CKWaveSound *)m_Context->GetObject(m_SoundsPlaying[i]);
+
+        if (ws && ws->IsPlaying())
+        {
+            /* Handle file streaming */
+            if (ws->GetFileStreaming() && !(ws->GetState() & CK_WAVESOUND_STREAMFULLYLOADED))
+            {
+                ws->WriteDataFromReader();
+            }
+
+            /* The sound starts its fades without telling the manager: they
+               join the ramps, which step them */
+            if (ws->GetState() & CK_WAVESOUND_FADE)
+            {
+                AddNativeFade(ws);
+            }
+
+            /* Update 3D position */
+            if (!(ws->GetType() & CK_WAVESOUND_BACKGROUND))
+            {
+                somethingIsPlayingIn3D = TRUE;
+                ws->UpdatePosition(deltaTime);
+            }
+
+            ++i;
+        }
+        else
+        {
+            m_SoundsPlaying.RemoveAt(i);
+        }
+    }
+
+    m_CommandLog = commandLog;
+
+    /* Ramp steps are device calls like any other: keep them in the log */
+    UpdateFades(deltaTime);
+
+    if (m_GainBuses.IsDirty())
+        FlushGainBuses();
+
+    /* The rings and the clock their reads are due by are shared with an
+       update thread refilling the rings between frames */
+    EnterUpdateLock();
+    if (m_Streams.GetCount() > 0)
+        UpdateStreams();
+    m_InstanceClock += deltaTime;
+    LeaveUpdateLock();
+
+    if (m_Streams.GetCount() > 0)
+        ReportStreams();
+
+    return somethingIsPlayingIn3D;
+}
+
+//-----------------------------------------------------------------------------
+// Gain Ramps
+//-----------------------------------------------------------------------------
+
+CKERROR DXSoundManager::FadeGain(CKWaveSound *ws, float gain, float durationMs, CKBOOL stopAtEnd)
+{
+    CKWaveSoundSettings settings;
+    SoundFade *fade;
+    void *source;
+
+    if (!ws || !ws->GetSource())
+        return CKERR_INVALIDPARAMETER;
+    source = ws->GetSource();
+
+    /* Retargeting starts from where the running ramp is */
+    memset(&settings, 0, sizeof(CKWaveSoundSettings));
+    fade = m_Fades.Find(source);
+    if (fade)
+        settings.m_Gain = SoundFadeScheduler::GetGain(*fade, fade->m_Elapsed);
+    else
+        UpdateSettings(source, CK_WAVESOUND_SETTINGS_GAIN, settings, FALSE);
+
+    m_Fades.Start(ws->GetID(), source, settings.m_Gain, gain, durationMs, stopAtEnd ? SOUNDFADE_STOP : 0);
+
+    /* A ramp without duration ends right away */
+    if (durationMs <= 0.0f)
+        UpdateFades(0.0f);
+
+    return CK_OK;
+}
+
+CKBOOL DXSoundManager::CancelFade(CKWaveSound *ws)
+{
+    if (!ws)
+        return FALSE;
+    return m_Fades.Remove(ws->GetSource());
+}
+
+void DXSoundManager::ApplyFade(SoundFade &fade, float gain, CKBOOL last)
+{
+    CKWaveSoundSettings settings;
+
+    /* Skip the steps too small to be heard: each one is a device call
+       on hardware backends */
+    if (last || fabsf((float)(FloatToDb(gain) - FloatToDb(fade.m_Applied))) >= m_FadeStepDb * 100.0f)
+    {
+        memset(&settings, 0, sizeof(CKWaveSoundSettings));
+        settings.m_Gain = gain;
+        UpdateSettings(fade.m_Source, CK_WAVESOUND_SETTINGS_GAIN, settings, TRUE);
+        fade.m_Applied = gain;
+    }
+}
+
+void DXSoundManager::AddNativeFade(CKWaveSound *ws)
+{
+    CKWaveSoundSettings settings;
+    void *source = ws->GetSource();
+
+    /* A FadeGain ramp holds the gain until it ends */
+    if (!source || m_Fades.Find(source))
+        return;
+
+    memset(&settings, 0, sizeof(CKWaveSoundSettings));
+    UpdateSettings(source, CK_WAVESOUND_SETTINGS_GAIN, settings, FALSE);
+    m_Fades.Start(ws->GetID(), source, settings.m_Gain, settings.m_Gain, 0.0f, SOUNDFADE_NATIVE);
+}
+
+CK_SOUNDMANAGER_CAPS DXSoundManager::TakeFadeStep(void *source, CK_SOUNDMANAGER_CAPS settingsoptions, float gain)
+{
+    if (source != m_FadeStepSource || !(settingsoptions & CK_WAVESOUND_SETTINGS_GAIN))
+        return settingsoptions;
+
+    m_FadeStepGain = gain;
+    m_FadeStepTaken = TRUE;
+    return (CK_SOUNDMANAGER_CAPS)(settingsoptions & ~CK_WAVESOUND_SETTINGS_GAIN);
+}
+
+void DXSoundManager::UpdateFades(float deltaTime)
+{
+    CKWaveSoundSettings settings;
+    SoundCommandLog *commandLog;
+    CKWaveSound *ws;
+    SoundFade fade;
+    CKBOOL done;
+    int i;
+
+    memset(&settings, 0, sizeof(CKWaveSoundSettings));
+
+    for (i = 0; i < m_Fades.Size();)
+    {
+        fade = m_Fades[i];
+
+        /* Drop the ramp if the sound is gone or got another source */
+        ws = (CKWaveSound *)m_Context->GetObject(fade.m_Sound);
+        if (!ws || ws->GetSource() != fade.m_Source)
+        {
+            m_Fades.RemoveAt(i);
+            continue;
+        }
+
+        if (fade.m_Flags & SOUNDFADE_NATIVE)
+        {
+            if (!ws->IsPlaying() || !(ws->GetState() & CK_WAVESOUND_FADE))
+            {
+                m_Fades.RemoveAt(i);
+                continue;
+            }
+
+            /* Stepped once a frame: FadeGain comes here with no time only
+               to end a ramp right away */
+            if (deltaTime <= 0.0f)
+            {
+                ++i;
+                continue;
+            }
+
+            /* The sound computes its gain and may stop at the end. Like the
+               rest of its update, this is replayed by PostProcess and stays
+               out of the log. */
+            commandLog = m_CommandLog;
+            m_CommandLog = NULL;
+            m_FadeStepSource = fade.m_Source;
+            m_FadeStepTaken = FALSE;
+            ws->UpdateFade();
+            m_FadeStepSource = NULL;
+
+            done = !ws->IsPlaying() || !(ws->GetState() & CK_WAVESOUND_FADE);
+            if (m_FadeStepTaken)
+            {
+                fade.m_To = m_FadeStepGain;
+                ApplyFade(fade, fade.m_To, done);
+            }
+            else if (done && fade.m_Applied != fade.m_To)
+            {
+                ApplyFade(fade, fade.m_To, TRUE);
+            }
+            m_CommandLog = commandLog;
         }
         else
         {
-            ++it;
+            /* Ramps hold while their sound does not play */
+            if (!ws->IsPlaying() && fade.m_Duration > 0.0f)
+            {
+                ++i;
+                continue;
+            }
+
+            fade.m_Elapsed += deltaTime;
+            done = (fade.m_Elapsed >= fade.m_Duration);
+            ApplyFade(fade, SoundFadeScheduler::GetGain(fade, fade.m_Elapsed), done);
+        }
+
+        if (!done)
+        {
+            m_Fades[i] = fade;
+            ++i;
+            continue;
+        }
+
+        m_Fades.RemoveAt(i);
+        if (fade.m_Flags & SOUNDFADE_STOP)
+        {
+            /* Stopped sounds start over at their own gain */
+            ws->Stop();
+            settings.m_Gain = ws->GetGain();
+            UpdateSettings(fade.m_Source, CK_WAVESOUND_SETTINGS_GAIN, settings, TRUE);
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Instance Limits
+//-----------------------------------------------------------------------------
+
+CKERROR DXSoundManager::SetInstanceLimit(CKWaveSound *ws, int maxInstances, SOUND_STEAL_POLICY policy, float coalesceMs)
+{
+    if (!ws || !ws->GetSource())
+        return CKERR_INVALIDPARAMETER;
+    if (policy < SOUNDSTEAL_OLDEST || policy > SOUNDSTEAL_REJECT)
+        return CKERR_INVALIDPARAMETER;
+
+    if (maxInstances <= 0 && coalesceMs <= 0.0f)
+        m_Instances.RemoveLimit(ws->GetSource());
+    else
+        m_Instances.SetLimit(ws->GetSource(), maxInstances, policy, coalesceMs);
+
+    return CK_OK;
+}
+
+CKBOOL DXSoundManager::AdmitInstance(void *asset)
+{
+    const SoundInstanceLimit *limit;
+    CKWaveSoundSettings settings, added;
+    SoundInstance *instance, *victim;
+    void *source;
+    float gain, victimGain;
+    int live, i;
+
+    limit = m_Instances.GetLimit(asset);
+    if (!limit)
+        return TRUE;
+
+    memset(&settings, 0, sizeof(CKWaveSoundSettings));
+    memset(&added, 0, sizeof(CKWaveSoundSettings));
+
+    /* Duplicates made this frame are not playing yet but will be */
+    if (limit->m_CoalesceWindow > 0.0f)
+    {
+        instance = m_Instances.FindNewest(asset);
+        if (instance && m_InstanceClock - instance->m_StartTime <= limit->m_CoalesceWindow &&
+            (instance->m_StartTime >= m_InstanceClock || IsPlaying(instance->m_Source)))
+        {
+            /* Coincident copies of a sample add up in amplitude */
+            UpdateSettings(instance->m_Source, CK_WAVESOUND_SETTINGS_GAIN, settings, FALSE);
+            UpdateSettings(asset, CK_WAVESOUND_SETTINGS_GAIN, added, FALSE);
+            settings.m_Gain += added.m_Gain;
+            if (settings.m_Gain > 1.0f)
+                settings.m_Gain = 1.0f;
+            UpdateSettings(instance->m_Source, CK_WAVESOUND_SETTINGS_GAIN, settings, TRUE);
+
+            ++m_Instances.GetStats().m_Coalesced;
+            return FALSE;
+        }
+    }
+
+    if (limit->m_MaxInstances <= 0)
+        return TRUE;
+
+    live = 0;
+    victim = NULL;
+    victimGain = 0.0f;
+    for (i = 0; i < m_Instances.GetInstanceCount(); ++i)
+    {
+        instance = &m_Instances.GetInstance(i);
+        if (instance->m_Asset != asset)
+            continue;
+
+        /* Stopped instances only wait for ProcessMinions to release them;
+           pending ones, made this frame and not started yet, still count
+           and can be stolen: stopping them cancels their start */
+        if (!IsPlaying(instance->m_Source) && instance->m_StartTime < m_InstanceClock)
+            continue;
+        ++live;
+
+        if (limit->m_Policy == SOUNDSTEAL_OLDEST)
+        {
+            if (!victim || instance->m_StartTime < victim->m_StartTime)
+                victim = instance;
+        }
+        else if (limit->m_Policy == SOUNDSTEAL_QUIETEST)
+        {
+            UpdateSettings(instance->m_Source, CK_WAVESOUND_SETTINGS_GAIN, settings, FALSE);
+            gain = settings.m_Gain;
+            if (!victim || gain < victimGain)
+            {
+                victim = instance;
+                victimGain = gain;
+            }
+        }
+    }
+
+    if (live < limit->m_MaxInstances)
+        return TRUE;
+
+    if (!victim)
+    {
+        ++m_Instances.GetStats().m_Rejected;
+        return FALSE;
+    }
+
+    /* Its minion is released once it no longer plays. It stops counting
+       now: a pending victim would otherwise still look live this frame */
+    source = victim->m_Source;
+    Stop(NULL, source);
+    m_Fades.Remove(source);
+    m_Instances.RemoveInstance(source);
+    ++m_Instances.GetStats().m_Stolen;
+    return TRUE;
+}
+
+void DXSoundManager::TrackInstance(void *asset, void *source)
+{
+    SoundBusMember *member;
+    SoundBank **bank;
+    SoundBank *owner;
+    float gain;
+    int bus;
+
+    if (source && m_Instances.GetLimit(asset))
+        m_Instances.AddInstance(asset, source, m_InstanceClock);
+
+    if (source && m_BankSources.Size() > 0)
+    {
+        bank = m_BankSources.FindPtr(asset);
+        if (bank)
+        {
+            owner = *bank;
+            owner->AddSource();
+            m_BankSources.Insert(source, owner, TRUE);
+        }
+    }
+
+    if (source && m_GainBuses.GetMemberCount() > 0)
+    {
+        member = m_GainBuses.Find(asset);
+        if (member)
+        {
+            /* A primed duplicate may predate a level change: always send */
+            bus = member->m_Bus;
+            gain = member->m_Gain;
+            SendBusGain(this, source, m_GainBuses.Assign(source, bus, gain));
+        }
+    }
+}
+
+void DXSoundManager::ForgetSource(void *source)
+{
+    SoundBank **bank;
+
+    if (m_Instances.GetInstanceCount() > 0)
+        m_Instances.RemoveInstance(source);
+    if (m_Instances.GetLimitCount() > 0)
+        m_Instances.RemoveLimit(source);
+    if (m_Clusterer.GetSavedCount() > 0)
+        m_Clusterer.RemoveSaved(source);
+    if (m_SourceGains.Size() > 0)
+        m_SourceGains.Remove(source);
+    if (m_EmitterIndex.GetCount() > 0)
+        m_EmitterIndex.Remove(source);
+    if (m_EmitterCache.Size() > 0)
+        m_EmitterCache.Remove(source);
+    if (m_MinionIndex.GetIndexedCount() > 0)
+        m_MinionIndex.Remove(source);
+    if (m_LatencyProbe.IsRunning())
+        m_LatencyProbe.Forget(source);
+    if (m_GainBuses.GetMemberCount() > 0)
+        m_GainBuses.Remove(source);
+    if (m_Streams.GetCount() > 0)
+        m_Streams.Close(source);
+    if (m_ReadAhead.GetCount() > 0)
+        m_ReadAhead.Close(source);
+    if (m_BankSources.Size() > 0)
+    {
+        bank = m_BankSources.FindPtr(source);
+        if (bank)
+        {
+            (*bank)->RemoveSource();
+            m_BankSources.Remove(source);
         }
     }
+    if (m_PrimedVoices.GetPoolCount() > 0 && m_PrimedVoices.RemovePool(source, m_Unprimed))
+        ReleaseUnprimed();
+}
+
+//-----------------------------------------------------------------------------
+// Primed Voices
+//-----------------------------------------------------------------------------
+
+#define PRIMED_SETTINGS ((CK_SOUNDMANAGER_CAPS)(CK_WAVESOUND_SETTINGS_GAIN | CK_WAVESOUND_SETTINGS_PITCH | CK_WAVESOUND_SETTINGS_PAN))
 
-    /* Clean up minions with deleted entities */
+static CKBOOL SamePrimedSettings(const CKWaveSoundSettings &a, const CKWaveSoundSettings &b)
+{
+    return a.m_Gain == b.m_Gain && a.m_Pitch == b.m_Pitch && a.m_Pan == b.m_Pan;
+}
+
+CKERROR DXSoundManager::SetPrimedVoices(CKWaveSound *ws, int count)
+{
+    if (!ws || !ws->GetSource() || count < 0)
+        return CKERR_INVALIDPARAMETER;
+
+    if (count == 0)
+        m_PrimedVoices.RemovePool(ws->GetSource(), m_Unprimed);
+    else
+        m_PrimedVoices.SetPool(ws->GetSource(), count, m_Unprimed);
+    ReleaseUnprimed();
+
+    return CK_OK;
+}
+
+void *DXSoundManager::TakePrimedSource(void *asset)
+{
+    CKWaveSoundSettings settings;
+    SoundPrimedPool *pool;
+
+    if (m_PrimedVoices.GetPoolCount() == 0)
+        return NULL;
+
+    /* A settings change this frame is only seen by the next refill */
+    pool = m_PrimedVoices.GetPool(asset);
+    if (pool && pool->m_Count > 0)
+    {
+        memset(&settings, 0, sizeof(CKWaveSoundSettings));
+        UpdateSettings(asset, PRIMED_SETTINGS, settings, FALSE);
+        if (!SamePrimedSettings(settings, pool->m_Settings))
+        {
+            ++m_PrimedVoices.GetStats().m_Misses;
+            return NULL;
+        }
+    }
+
+    return m_PrimedVoices.Take(asset);
+}
+
+void DXSoundManager::RefillPrimedVoices()
+{
+    CKWaveSoundSettings settings;
+    SoundPrimedPool *pool;
+    void *source;
+    int i;
+
+    for (i = 0; i < m_PrimedVoices.GetPoolCount(); ++i)
+    {
+        pool = &m_PrimedVoices.GetPoolAt(i);
+
+        /* Duplicates copy the settings of the asset when they are made */
+        memset(&settings, 0, sizeof(CKWaveSoundSettings));
+        UpdateSettings(pool->m_Asset, PRIMED_SETTINGS, settings, FALSE);
+        if (!SamePrimedSettings(settings, pool->m_Settings))
+        {
+            while (pool->m_Count > 0)
+                m_Unprimed.PushBack(pool->m_Ready[--pool->m_Count]);
+            pool->m_Settings = settings;
+        }
+
+        while (pool->m_Count < pool->m_Size)
+        {
+            source = PrimeSource(pool->m_Asset);
+            if (!source)
+                break;
+            m_PrimedVoices.Add(*pool, source);
+        }
+    }
+
+    ReleaseUnprimed();
+}
+
+void DXSoundManager::ReleasePrimedVoices(CKBOOL clear)
+{
+    if (clear)
+        m_PrimedVoices.Clear(m_Unprimed);
+    else
+        m_PrimedVoices.Drain(m_Unprimed);
+    ReleaseUnprimed();
+}
+
+void DXSoundManager::ReleaseUnprimed()
+{
+    int i;
+
+    for (i = 0; i < m_Unprimed.Size(); ++i)
+        UnprimeSource(m_Unprimed[i]);
+    m_Unprimed.Clear();
+}
+
+//-----------------------------------------------------------------------------
+// Latency Probe
+//-----------------------------------------------------------------------------
+
+CKERROR DXSoundManager::StartLatencyProbe()
+{
+    m_LatencyProbe.Reset();
+    if (!m_LatencyProbe.Start(ReadPlayCursor, this))
+        return CKERR_OUTOFMEMORY;
+    return CK_OK;
+}
+
+void DXSoundManager::StopLatencyProbe()
+{
+    SoundLatencyStats stats;
+    char message[160];
+
+    if (!m_LatencyProbe.IsRunning())
+        return;
+    m_LatencyProbe.Stop();
+
+    m_LatencyProbe.GetStats(stats);
+    if (stats.m_Count > 0 && m_Context)
+    {
+        sprintf(message, "Sound trigger latency: %d triggers, p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, max %.2f ms",
+                stats.m_Count, stats.m_P50, stats.m_P90, stats.m_P99, stats.m_Max);
+        m_Context->OutputToConsole(message);
+    }
+}
+
+void DXSoundManager::StartLatencyProbeFromEnvironment()
+{
+    const char *value = getenv(SOUNDLATENCY_ENV);
+
+    if (!value || !value[0] || atoi(value) == 0)
+        return;
+    if (StartLatencyProbe() != CK_OK)
+        m_Context->OutputToConsole("Sound Manager: cannot start the latency probe");
+}
+
+int DXSoundManager::ReadPlayCursor(void *context, void *source)
+{
+    return ((DXSoundManager *)context)->GetPlayPosition(source);
+}
+
+CKERROR DXSoundManager::StartCommandLog(const char *path)
+{
+    StopCommandLog();
+
+    m_CommandLog = new SoundCommandLog;
+    if (!m_CommandLog->Open(path))
+    {
+        delete m_CommandLog;
+        m_CommandLog = NULL;
+        return CKERR_INVALIDFILE;
+    }
+
+    return CK_OK;
+}
+
+void DXSoundManager::StopCommandLog()
+{
+    if (!m_CommandLog)
+        return;
+
+    m_CommandLog->Close();
+    delete m_CommandLog;
+    m_CommandLog = NULL;
+}
+
+void DXSoundManager::StartCommandLogFromEnvironment()
+{
+    const char *path = getenv(SOUNDLOG_ENV_PATH);
+
+    if (path && path[0] && StartCommandLog(path) != CK_OK)
+        m_Context->OutputToConsole("Sound Manager: cannot open command log file");
+}
+
+CKERROR DXSoundManager::SetJobThreads(int workers)
+{
+    if (!m_JobPool.Start(workers))
+        return CKERR_OUTOFMEMORY;
+    return CK_OK;
+}
+
+void DXSoundManager::StartJobPoolFromEnvironment()
+{
+    const char *value = getenv(SOUNDJOB_ENV_THREADS);
+
+    if (!value || !value[0] || m_JobPool.GetWorkerCount() > 0)
+        return;
+    if (SetJobThreads(atoi(value)) != CK_OK)
+        m_Context->OutputToConsole("Sound Manager: cannot start the job threads");
+}
+
+CKBOOL DXSoundManager::ComputeEmitters(float velocityScale)
+{
+    SoundEmitterJob job;
+    SoundEmitterCache added;
+    SoundEmitterCache *cache;
+    SoundMinion **itm;
+    CK3dEntity *ent;
+    CKBOOL playing = FALSE;
+    int i;
+
+    /* Gathered here: neither the sources nor the entities are thread safe */
+    ++m_EmitterFrame;
+    m_EmitterJobs.Clear();
     for (itm = m_Minions.Begin(); itm != m_Minions.End(); ++itm)
     {
-        if (!*itm)
+        if (!IsPlaying((*itm)->m_Source))
             continue;
+        playing = TRUE;
 
-        /* Check if original sound is being deleted */
-        ws = (CKWaveSound *)m_Context->GetObject((*itm)->m_OriginalSound);
-        if (ws && ws->IsToBeDeleted())
+        if (!(*itm)->m_Entity)
+            continue;
+        ent = (CK3dEntity *)m_Context->GetObject((*itm)->m_Entity);
+        if (!ent)
+            continue;
+
+        job.m_Minion = *itm;
+        job.m_World = ent->GetWorldMatrix();
+        job.m_Folded = FALSE;
+        job.m_Deferred = FALSE;
+
+        /* Standing still: last frame's transform, without velocity */
+        cache = m_EmitterCache.FindPtr((*itm)->m_Source);
+        job.m_Moved = !cache ||
+                      memcmp(&cache->m_World, &job.m_World, sizeof(VxMatrix)) != 0 ||
+                      cache->m_Offset != (*itm)->m_Position || cache->m_Aim != (*itm)->m_Direction;
+        if (!job.m_Moved)
         {
-            (*itm)->m_OriginalSound = 0;
+            job.m_Position = cache->m_Position;
+            job.m_Direction = cache->m_Direction;
+            job.m_Velocity.Set(0.0f, 0.0f, 0.0f);
+            cache->m_Job = m_EmitterJobs.Size();
+            cache->m_Frame = m_EmitterFrame;
         }
+        m_EmitterJobs.PushBack(job);
+    }
 
-        /* Check if attached entity is being deleted */
-        entity = m_Context->GetObject((*itm)->m_Entity);
-        if (!entity || entity->IsToBeDeleted())
+    m_EmitterVelocityScale = velocityScale;
+    m_JobPool.ParallelFor(ComputeEmitterRange, this, m_EmitterJobs.Size(), SOUNDJOB_DEFAULT_CHUNK);
+
+    /* Remember the new transforms once the jobs are done with them */
+    for (i = 0; i < m_EmitterJobs.Size(); ++i)
+    {
+        if (!m_EmitterJobs[i].m_Moved)
+            continue;
+
+        cache = m_EmitterCache.FindPtr(m_EmitterJobs[i].m_Minion->m_Source);
+        if (!cache)
         {
-            (*itm)->m_Entity = 0;
+            m_EmitterCache.Insert(m_EmitterJobs[i].m_Minion->m_Source, added, TRUE);
+            cache = m_EmitterCache.FindPtr(m_EmitterJobs[i].m_Minion->m_Source);
         }
+        cache->m_World = m_EmitterJobs[i].m_World;
+        cache->m_Offset = m_EmitterJobs[i].m_Minion->m_Position;
+        cache->m_Aim = m_EmitterJobs[i].m_Minion->m_Direction;
+        cache->m_Position = m_EmitterJobs[i].m_Position;
+        cache->m_Direction = m_EmitterJobs[i].m_Direction;
+        cache->m_Job = i;
+        cache->m_Frame = m_EmitterFrame;
     }
+    return playing;
+}
 
-    return result;
+void DXSoundManager::ComputeEmitterRange(void *context, int begin, int end)
+{
+    DXSoundManager *man = (DXSoundManager *)context;
+    SoundEmitterJob *job;
+    SoundMinion *minion;
+    float scale = man->m_EmitterVelocityScale;
+    int i;
+
+    /* A job only writes its own slot and minion, whichever thread runs it */
+    for (i = begin; i < end; ++i)
+    {
+        job = &man->m_EmitterJobs[i];
+        if (!job->m_Moved)
+            continue;
+        minion = job->m_Minion;
+
+        Vx3DMultiplyMatrixVector(&job->m_Position, job->m_World, &minion->m_Position);
+        Vx3DRotateVector(&job->m_Direction, job->m_World, &minion->m_Direction);
+        job->m_Velocity = (job->m_Position - minion->m_OldPosition) * scale;
+        minion->m_OldPosition = job->m_Position;
+    }
+}
+
+void DXSoundManager::SetAudibleDistance(float distance)
+{
+    m_AudibleDistance = (distance > 0.0f) ? distance : 0.0f;
+    if (m_AudibleDistance == 0.0f)
+    {
+        m_EmitterIndex.Clear();
+        m_RefileEmitters = TRUE;
+        return;
+    }
+
+    /* A query then covers three cells a side */
+    m_EmitterIndex.SetCellSize(m_AudibleDistance);
+}
+
+int DXSoundManager::GetAudibleEmitters(float distance, XArray<void *> &sources)
+{
+    CK3dEntity *listener;
+    const VxMatrix *mat;
+    VxVector position;
+    int i;
+
+    listener = GetListener();
+    if (!listener || m_AudibleDistance <= 0.0f)
+        return 0;
+
+    mat = &listener->GetWorldMatrix();
+    position.Set((*mat)[3].x, (*mat)[3].y, (*mat)[3].z);
+
+    /* Released minions left the index, the jobs may still point at them */
+    m_AudibleEntries.Clear();
+    m_EmitterIndex.Query(position, distance, m_AudibleEntries);
+    for (i = 0; i < m_AudibleEntries.Size(); ++i)
+        sources.PushBack(m_EmitterIndex.GetEntry(m_AudibleEntries[i]).m_Source);
+    return m_AudibleEntries.Size();
+}
+
+void DXSoundManager::CullEmitters()
+{
+    SoundEmitterJob *job;
+    SoundEmitterCache *cache;
+    CK3dEntity *listener;
+    const VxMatrix *mat;
+    VxVector position;
+    int i;
+
+    /* Moves made meanwhile are not filed, file everything next time */
+    listener = GetListener();
+    if (m_AudibleDistance <= 0.0f || !listener)
+    {
+        m_RefileEmitters = TRUE;
+        return;
+    }
+
+    /* Only the moved minions are updated, and only the ones leaving their
+       cell re-filed; released minions leave the index in ForgetSource */
+    for (i = 0; i < m_EmitterJobs.Size(); ++i)
+    {
+        job = &m_EmitterJobs[i];
+        if (job->m_Moved || m_RefileEmitters)
+            m_EmitterIndex.Update(job->m_Minion->m_Source, job->m_Position);
+        job->m_Deferred = TRUE;
+    }
+    m_RefileEmitters = FALSE;
+
+    mat = &listener->GetWorldMatrix();
+    position.Set((*mat)[3].x, (*mat)[3].y, (*mat)[3].z);
+
+    m_AudibleEntries.Clear();
+    m_EmitterIndex.Query(position, m_AudibleDistance, m_AudibleEntries);
+    for (i = 0; i < m_AudibleEntries.Size(); ++i)
+    {
+        /* Stopped or detached minions stay filed but are no job this frame */
+        cache = m_EmitterCache.FindPtr(m_EmitterIndex.GetEntry(m_AudibleEntries[i]).m_Source);
+        if (cache && cache->m_Frame == m_EmitterFrame)
+            m_EmitterJobs[cache->m_Job].m_Deferred = FALSE;
+    }
+
+    /* The others take turns, so each still moves a few times a second */
+    m_CullFrame = (m_CullFrame + 1) % SOUND_FAR_UPDATE_INTERVAL;
+    for (i = (SOUND_FAR_UPDATE_INTERVAL - m_CullFrame) % SOUND_FAR_UPDATE_INTERVAL;
+         i < m_EmitterJobs.Size(); i += SOUND_FAR_UPDATE_INTERVAL)
+        m_EmitterJobs[i].m_Deferred = FALSE;
 }
+
+void DXSoundManager::ClusterEmitters()
+{
+    SoundClusterEmitter emitter;
+    SoundClusterEmitter *member;
+    SoundClusterSaved *saved;
+    const SoundCluster *cluster;
+    SoundEmitterJob *job;
+    CK3dEntity *listener;
+    const VxMatrix *mat;
+    VxVector position;
+    float gain;
+    int count, i;
+
+    if (!m_Clusterer.IsEnabled() && m_Clusterer.GetSavedCount() == 0)
+    {
+        /* Gains set from now on are not recorded */
+        if (m_SourceGains.Size() > 0)
+            m_SourceGains.Clear();
+        return;
+    }
+
+    /* Clustered sources are muted or louder: weigh them by their own gain */
+    m_ClusterEmitters.Clear();
+    for (i = 0; i < m_EmitterJobs.Size(); ++i)
+    {
+        job = &m_EmitterJobs[i];
+        emitter.m_Source = job->m_Minion->m_Source;
+        emitter.m_Asset = job->m_Minion->m_OriginalSound;
+        emitter.m_Position = job->m_Position;
+        emitter.m_Velocity = job->m_Velocity;
+
+        saved = m_Clusterer.FindSaved(emitter.m_Source);
+        emitter.m_Gain = saved ? saved->m_Gain : GetOwnGain(emitter.m_Source);
+        m_ClusterEmitters.PushBack(emitter);
+    }
+
+    /* Without a listener nothing is far */
+    listener = GetListener();
+    count = 0;
+    position.Set(0.0f, 0.0f, 0.0f);
+    if (listener)
+    {
+        mat = &listener->GetWorldMatrix();
+        position.Set((*mat)[3].x, (*mat)[3].y, (*mat)[3].z);
+        count = m_ClusterEmitters.Size();
+    }
+    m_Clusterer.Build(m_ClusterEmitters.Begin(), count, position);
+
+    for (i = 0; i < count; ++i)
+    {
+        member = &m_ClusterEmitters[i];
+        if (member->m_Cluster < 0)
+            continue;
+
+        cluster = &m_Clusterer.GetCluster(member->m_Cluster);
+        job = &m_EmitterJobs[i];
+        if (cluster->m_Leader == i)
+        {
+            job->m_Position = cluster->m_Position;
+            job->m_Velocity = cluster->m_Velocity;
+            gain = cluster->m_Gain;
+        }
+        else
+        {
+            job->m_Folded = TRUE;
+            gain = 0.0f;
+        }
+
+        saved = m_Clusterer.SaveGain(member->m_Source, member->m_Gain);
+        if (saved->m_Applied != gain)
+        {
+            SetClusterGain(member->m_Source, gain);
+            saved->m_Applied = gain;
+        }
+    }
+
+    /* Split clusters, and minions that stopped or lost their entity */
+    m_Clusterer.GetStaleSources(m_StaleSources);
+    for (i = 0; i < m_StaleSources.Size(); ++i)
+    {
+        saved = m_Clusterer.FindSaved(m_StaleSources[i]);
+        if (saved->m_Applied != saved->m_Gain)
+            SetClusterGain(m_StaleSources[i], saved->m_Gain);
+        m_Clusterer.RemoveSaved(m_StaleSources[i]);
+    }
+}
+
+float DXSoundManager::FilterSourceGain(void *source, float gain)
+{
+    SoundClusterSaved *saved;
+
+    /* The clusterer sends the gain of a cluster, not a new own gain */
+    if (m_SettingClusterGain)
+        return gain * m_GainBuses.GetScale(source);
+
+    if (m_Clusterer.IsEnabled() || m_Clusterer.GetSavedCount() > 0)
+    {
+        m_SourceGains.Insert(source, gain, TRUE);
+
+        /* A clustered source gets it back when voiced alone again */
+        saved = m_Clusterer.FindSaved(source);
+        if (saved)
+        {
+            saved->m_Gain = gain;
+            m_GainBuses.Scale(source, gain);
+            return saved->m_Applied * m_GainBuses.GetScale(source);
+        }
+    }
+    return m_GainBuses.Scale(source, gain);
+}
+
+float DXSoundManager::GetOwnGain(void *source)
+{
+    CKWaveSoundSettings settings;
+    float *cached = m_SourceGains.FindPtr(source);
+
+    if (cached)
+        return *cached;
+
+    /* Set before clustering was on: read back once */
+    memset(&settings, 0, sizeof(CKWaveSoundSettings));
+    UpdateSettings(source, CK_WAVESOUND_SETTINGS_GAIN, settings, FALSE);
+    m_SourceGains.Insert(source, settings.m_Gain, TRUE);
+    return settings.m_Gain;
+}
+
+void DXSoundManager::SetClusterGain(void *source, float gain)
+{
+    CKWaveSoundSettings settings;
+
+    memset(&settings, 0, sizeof(CKWaveSoundSettings));
+    settings.m_Gain = gain;
+    m_SettingClusterGain = TRUE;
+    UpdateSettings(source, CK_WAVESOUND_SETTINGS_GAIN, settings, TRUE);
+    m_SettingClusterGain = FALSE;
+}
+
+void DXSoundManager::DetachMinions(MinionIndex::Key key, CK_ID id)
+{
+    int entry, i;
+    SoundMinion *minion;
+
+    for (entry = m_MinionIndex.First(key, id); entry >= 0; entry = m_MinionIndex.Next(key, entry))
+        DetachMinion(m_MinionIndex.GetMinion(entry), key, id);
+    m_MinionIndex.RemoveKey(key, id);
+
+    /* Minions past one still waiting for its source are not indexed yet */
+    for (i = m_MinionIndex.GetIndexedCount(); i < m_Minions.Size(); ++i)
+    {
+        minion = m_Minions[i];
+        if (minion)
+            DetachMinion(minion, key, id);
+    }
+}
+
+void DXSoundManager::DetachMinion(SoundMinion *minion, MinionIndex::Key key, CK_ID id)
+{
+    if (key == MinionIndex::BY_ENTITY)
+    {
+        if (minion->m_Entity == id)
+            minion->m_Entity = 0;
+    }
+    else if (minion->m_OriginalSound == id)
+    {
+        minion->m_OriginalSound = 0;
+    }
+}
\ No newline at end of file
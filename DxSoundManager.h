@@ -3,6 +3,79 @@
 
 #include "CKAll.h"
 
+#include "ActiveSoundSet.h"
+#include "MinionIndex.h"
+#include "SoundArena.h"
+#include "SoundBank.h"
+#include "SoundBusTree.h"
+#include "SoundClusterer.h"
+#include "SoundCommandLog.h"
+#include "SoundFadeScheduler.h"
+#include "SoundInstanceLimiter.h"
+#include "SoundJobPool.h"
+#include "SoundLatencyProbe.h"
+#include "SoundOutput.h"
+#include "SoundPrimedVoices.h"
+#include "SoundReadAhead.h"
+#include "SoundReverb.h"
+#include "SoundSpatialIndex.h"
+#include "SoundStreamRing.h"
+
+/* Frames between the 3D updates of the minions out of audible distance */
+#define SOUND_FAR_UPDATE_INTERVAL 8
+
+/**
+ * @brief World transform of a playing minion, computed on the job pool
+ *
+ * The entity matrix is copied on the main thread, the rest is written by
+ * the job that owns the slot.
+ */
+struct SoundEmitterJob
+{
+    SoundMinion *m_Minion;
+    VxMatrix m_World;
+    VxVector m_Position;
+    VxVector m_Velocity;   /* Since the last frame, times the scale asked */
+    VxVector m_Direction;
+    CKBOOL m_Folded;       /* Muted member of a cluster, not to commit */
+    CKBOOL m_Deferred;     /* Out of audible distance and not its turn */
+    CKBOOL m_Moved;        /* Transform changed, computed by the job */
+};
+
+/**
+ * @brief Last transform computed for the minion playing a source
+ *
+ * An emitter whose entity matrix and minion offset did not change since
+ * is neither transformed again nor re-filed in the emitter index.
+ */
+struct SoundEmitterCache
+{
+    VxMatrix m_World;
+    VxVector m_Offset;     /* SoundMinion::m_Position */
+    VxVector m_Aim;        /* SoundMinion::m_Direction */
+    VxVector m_Position;
+    VxVector m_Direction;
+    int m_Job;             /* Slot in m_EmitterJobs */
+    int m_Frame;           /* Of m_Job, emitters of older frames are not jobs */
+};
+
+/**
+ * @brief How close a streaming ring is to running dry, in milliseconds
+ *
+ * The read-ahead fields stay zero unless the ring is fed from a file.
+ */
+struct SoundStreamHealth
+{
+    float m_TimeToUnderrun;     /* Of the data queued ahead of the play cursor */
+    float m_MinTimeToUnderrun;  /* Lowest seen once data was written */
+    int m_LowWarnings;          /* Times it fell below SOUNDSTREAM_LOW_MS */
+    int m_Underruns;
+    float m_ReadAhead;          /* Read from the file, not yet in the ring */
+    int m_PendingReads;         /* Blocks queued or being read */
+    int m_LateReads;            /* Underruns with a block still outstanding */
+    CKBOOL m_Finished;          /* The last byte of the file was played */
+};
+
 /**
  * @brief Abstract base class for DirectX Sound Manager implementations
  *
@@ -38,6 +111,56 @@ public:
     virtual int GetPlayPosition(void *source) = 0;
     virtual CKBOOL IsPlaying(void *source) = 0;
 
+    // Starts a source (or minion, with no sound) when the audio clock
+    // reaches the given time. Sources scheduled for the same time start
+    // together and count as playing while they wait; a time already past
+    // starts at once, skipping what would have played since.
+    virtual CKERROR PlayAt(CKWaveSound *ws, void *source, CKBOOL loop, double time) = 0;
+    // Seconds of output played since OnCKInit, following the output
+    // stream rather than the frame time
+    virtual double GetAudioClock() = 0;
+
+    // Batches of the calls above over count sources, for groups such as
+    // the layers of a sound or the sounds of a category. Sources are given
+    // as to the single calls, sounds may be NULL (for minions only) and
+    // settings hold one entry per source. The sources are checked once up
+    // front: a NULL one fails the whole batch before any call is made. The
+    // whole batch runs under one hold of the update lock; backends may also
+    // defer the device calls to a single commit.
+    virtual CKERROR PlayBatch(CKWaveSound **sounds, void **sources, int count, CKBOOL loop);
+    virtual CKERROR PauseBatch(CKWaveSound **sounds, void **sources, int count);
+    virtual CKERROR StopBatch(CKWaveSound **sounds, void **sources, int count);
+    virtual CKERROR UpdateSettingsBatch(void **sources, int count, CK_SOUNDMANAGER_CAPS settingsoptions,
+                                        CKWaveSoundSettings *settings);
+    virtual CKERROR Update3DSettingsBatch(void **sources, int count, CK_SOUNDMANAGER_CAPS settingsoptions,
+                                          CKWaveSound3DSettings *settings);
+
+    // Streaming rings over the buffer of a source. The manager follows the
+    // play cursor and hands the producer the region it may overwrite, so a
+    // decoder writes straight into the buffer with no staging copy. Writing
+    // starts at the play cursor. Once data was written, the cursor
+    // overtaking it counts as an underrun and writing resumes
+    // SOUNDSTREAM_GUARD_MS ahead of it. Close the ring after the last
+    // write, or the tail playing out counts as one.
+    CKERROR OpenStream(void *source);
+    void CloseStream(void *source);
+    // Locks up to maxBytes of the free region (whole frames) in one or two
+    // segments, the second one empty unless the region wraps
+    CKERROR BeginStreamWrite(void *source, CKDWORD maxBytes,
+                             void **region1, CKDWORD *bytes1, void **region2, CKDWORD *bytes2);
+    // Unlocks the region, committing its first bytes
+    CKERROR EndStreamWrite(void *source, CKDWORD bytes);
+    CKERROR GetStreamStats(void *source, SoundStreamStats &stats);
+    int GetStreamUnderrunCount() const { return m_Streams.GetUnderrunCount(); }
+    // Feeds the ring of the source from a file read ahead on the I/O
+    // thread, opening the ring if needed. The bytes [dataOffset,
+    // dataOffset + dataSize) of the file are PCM in the format of the
+    // source, played once or looped. Once played, silence is written and
+    // the health reports the stream finished. CloseStream ends it.
+    CKERROR OpenFileStream(void *source, const char *path, CKDWORD dataOffset, CKDWORD dataSize, CKBOOL loop);
+    CKERROR GetStreamHealth(void *source, SoundStreamHealth &health);
+    const SoundReadAheadStats &GetReadAheadStats() const { return m_ReadAhead.GetStats(); }
+
     // PCM Buffer Information
     virtual CKERROR SetWaveFormat(void *source, CKWaveFormat &wf) = 0;
     virtual CKERROR GetWaveFormat(void *source, CKWaveFormat &wf) = 0;
@@ -100,13 +223,267 @@ public:
     virtual CKERROR PreLaunchScene(CKScene *OldScene, CKScene *NewScene);
     virtual CKERROR SequenceToBeDeleted(CK_ID *objids, int count);
 
+    // Command capture, replayed by Tools/SoundReplay
+    CKERROR StartCommandLog(const char *path);
+    void StopCommandLog();
+    CKBOOL IsLoggingCommands() const { return m_CommandLog != NULL; }
+
+    // Reverb buses shared by every voice sending to them (bus index below
+    // SOUNDREVERB_MAX_BUSES). NULL settings remove the bus. Backends that
+    // do not mix in software return CKERR_NOTIMPLEMENTED.
+    virtual CKERROR SetReverbBus(int bus, const SoundReverbSettings *settings);
+    // Makes the bus convolve its sends with an impulse response: 1 or 2
+    // interleaved channels at the mix rate, transformed once here
+    virtual CKERROR SetConvolutionBus(int bus, const float *ir, int frames, int channels, float gain);
+    // Sends a source to a bus at the given level (0 or bus -1 to stop).
+    // Duplicates made afterwards inherit the send.
+    virtual CKERROR SetReverbSend(void *source, int bus, float level);
+
+    // Gain buses (music, effects, voices...) forming a tree: a source routed
+    // to a bus is heard at its own gain times the levels of its bus and of
+    // every bus above. Level changes are sent at the next frame, or by
+    // FlushGainBuses, to the sources of the buses they affect only.
+    // Duplicates made afterwards inherit the bus of their source.
+    int CreateGainBus(int parent, float level);
+    // Children and sources move to the parent bus
+    CKERROR DestroyGainBus(int bus);
+    CKERROR SetGainBusLevel(int bus, float level);
+    float GetGainBusLevel(int bus) const;
+    CKERROR SetGainBusParent(int bus, int parent);
+    // Routes a source through a bus, SOUNDBUS_NONE to take it out
+    CKERROR SetSourceGainBus(void *source, int bus);
+    int GetSourceGainBus(void *source);
+    void FlushGainBuses();
+    const SoundBusStats &GetGainBusStats() const { return m_GainBuses.GetStats(); }
+
+    // Ramps the gain of a sound linearly to the given value, stopping the
+    // sound at the end if asked. The ramp only advances while the sound
+    // plays and is dropped if its source changes. Only the ramps in
+    // progress are visited each frame, and backends may coalesce the gain
+    // changes below an audible step.
+    CKERROR FadeGain(CKWaveSound *ws, float gain, float durationMs, CKBOOL stopAtEnd);
+    // Returns TRUE if the sound had a ramp; its gain stays where it was
+    CKBOOL CancelFade(CKWaveSound *ws);
+    // Ramps plus CKWaveSound fades in progress
+    int GetActiveFadeCount() const { return m_Fades.Size(); }
+
+    // Bounds how many duplicates of a sound play at once, for the minions
+    // a behavior may create many times a frame. Past the limit the policy
+    // steals a running instance or rejects the trigger. Triggers within
+    // coalesceMs of the newest instance merge into it instead, adding the
+    // gain of the sound to its own. A limit of 0 with no window removes it.
+    CKERROR SetInstanceLimit(CKWaveSound *ws, int maxInstances, SOUND_STEAL_POLICY policy, float coalesceMs);
+    const SoundInstanceStats &GetInstanceStats() const { return m_Instances.GetStats(); }
+
+    // Keeps count duplicates of a sound (at most SOUNDPRIMED_MAX_VOICES)
+    // made between frames, ready to start, so the minions of a latency
+    // critical sound skip the duplication when triggered. Ready voices are
+    // made again when the gain, pitch or pan of the sound changes. 0
+    // releases them.
+    CKERROR SetPrimedVoices(CKWaveSound *ws, int count);
+    const SoundPrimedStats &GetPrimedStats() const { return m_PrimedVoices.GetStats(); }
+
+    // Measures the time from Play, or from the duplication for minions, to
+    // the play cursor moving. DX8SOUND_LATENCY_PROBE starts it at OnCKInit;
+    // the percentiles are reported when it stops.
+    CKERROR StartLatencyProbe();
+    void StopLatencyProbe();
+    void GetTriggerLatency(SoundLatencyStats &stats) { m_LatencyProbe.GetStats(stats); }
+
+    // Rate, speaker layout and sample type of the output. Taken into
+    // account at the next OnCKInit; the DX8SOUND_OUTPUT_* variables
+    // override the defaults of each backend.
+    void SetOutputFormat(const SoundOutputFormat &format) { m_OutputFormat = format; }
+    const SoundOutputFormat &GetOutputFormat() const { return m_OutputFormat; }
+
+    // Threads computing the minion transforms besides the main one, 0 to
+    // compute them serially. DX8SOUND_JOB_THREADS sets it at OnCKInit.
+    CKERROR SetJobThreads(int workers);
+    int GetJobThreads() const { return m_JobPool.GetWorkerCount(); }
+    const SoundJobStats &GetJobStats() const { return m_JobPool.GetStats(); }
+
+    // Merges the playing minions of a sound that are farther than distance
+    // from the listener, per world cell of cellSize (0 for distance): the
+    // loudest is voiced at their gain-weighted centroid with their combined
+    // gain and the others are muted. Clusters split again as the listener
+    // comes closer. A distance of 0 restores every minion.
+    void SetEmitterClustering(float distance, float cellSize) { m_Clusterer.SetDistance(distance, cellSize); }
+    const SoundClusterStats &GetClusterStats() const { return m_Clusterer.GetStats(); }
+
+    // Minions farther than distance from the listener only have their 3D
+    // settings sent every SOUND_FAR_UPDATE_INTERVAL frames, in turns. They
+    // are found through a grid of the minion positions kept while the
+    // distance is set; 0 drops it and updates every minion every frame.
+    void SetAudibleDistance(float distance);
+    float GetAudibleDistance() const { return m_AudibleDistance; }
+    // Sources of the playing minions within distance of the listener as of
+    // the last frame, appended to sources. Needs an audible distance.
+    int GetAudibleEmitters(float distance, XArray<void *> &sources);
+    const SoundSpatialStats &GetEmitterIndexStats() const { return m_EmitterIndex.GetStats(); }
+
+    // Sound banks written by Tools/SoundBankPacker, mapped rather than read:
+    // their samples are already in the output format and sources are made
+    // straight from the mapped pages. The software mixer plays them in
+    // place, read-only. A bank closes once the sources made from it,
+    // duplicates included, are released.
+    SoundBank *OpenSoundBank(const char *path);
+    CKERROR CloseSoundBank(SoundBank *bank);
+    // A source holding the named sample, used like any other source
+    void *CreateBankSource(SoundBank *bank, const char *name, CK_WAVESOUND_TYPE type);
+
+    // Bookkeeping arenas, reset on ClearAll and on scene changes
+    const SoundArena &GetLevelArena() const { return m_LevelArena; }
+    const SoundArena &GetSceneArena() const { return m_SceneArena; }
+
 protected:
     // Common data members for all DirectX sound managers
-    XObjectArray m_SoundsPlaying; /* List of currently playing sounds */
+    ActiveSoundSet m_SoundsPlaying; /* Set of currently playing sounds */
+    MinionIndex m_MinionIndex;      /* Entity/original sound ID -> minions */
+    SoundCommandLog *m_CommandLog;  /* NULL unless capturing commands */
+    SoundArena m_LevelArena;        /* Sources and their data, until ClearAll */
+    SoundArena m_SceneArena;        /* Duplicates made for minions */
+    SoundOutputFormat m_OutputFormat; /* Format requested from the device */
+    SoundFadeScheduler m_Fades;     /* Ramps started with FadeGain and CKWaveSound fades */
+    float m_FadeStepDb;             /* Smallest ramp step sent to a source, 0 for every step */
+    void *m_FadeStepSource;         /* Source of the CKWaveSound fade being stepped */
+    float m_FadeStepGain;           /* Gain the step sent to it */
+    CKBOOL m_FadeStepTaken;
+    SoundInstanceLimiter m_Instances; /* Limits of the assets and their duplicates */
+    float m_InstanceClock;          /* Milliseconds of playback, dates the duplicates */
+    SoundJobPool m_JobPool;         /* Per-minion computations of a frame */
+    XArray<SoundEmitterJob> m_EmitterJobs; /* Playing minions attached to an entity */
+    float m_EmitterVelocityScale;   /* Of the ComputeEmitters in progress */
+    SoundClusterer m_Clusterer;     /* Distant minions voiced together */
+    XHashTable<float, void *, SourceHash> m_SourceGains; /* Own gains set while clustering, by source */
+    CKBOOL m_SettingClusterGain;    /* The gain being set is a cluster's */
+    XArray<SoundClusterEmitter> m_ClusterEmitters; /* m_EmitterJobs as offered to it */
+    XArray<void *> m_StaleSources;
+    SoundSpatialIndex m_EmitterIndex; /* Minion positions */
+    XHashTable<SoundEmitterCache, void *, SourceHash> m_EmitterCache; /* Last transforms, by source */
+    int m_EmitterFrame;             /* Counts the ComputeEmitters calls */
+    CKBOOL m_RefileEmitters;        /* The index was emptied, file every emitter again */
+    float m_AudibleDistance;        /* 0 to update every minion */
+    XArray<int> m_AudibleEntries;
+    int m_CullFrame;                /* Picks the far minions updated this frame */
+    SoundPrimedVoices m_PrimedVoices; /* Ready duplicates of the primed sounds */
+    XArray<void *> m_Unprimed;      /* Ready voices being released */
+    SoundLatencyProbe m_LatencyProbe;
+    SoundBusTree m_GainBuses;       /* Levels applied over the gains of the sources */
+    SoundStreamRings m_Streams;     /* Sources written through BeginStreamWrite */
+    SoundReadAhead m_ReadAhead;     /* Rings fed from a file */
+    XArray<SoundBank *> m_Banks;
+    XHashTable<SoundBank *, void *, SourceHash> m_BankSources; /* Sources made from a bank, duplicates included */
+
+    // Streams, fades and repositions the playing sounds, dropping the ones
+    // that stopped. Returns TRUE if a 3D sound is still playing.
+    CKBOOL UpdatePlayingSounds(float deltaTime);
+    // Follows the play cursors of the streaming rings, counting underruns
+    // and low rings, and refills the rings fed from a file. Called with the
+    // update lock held, from the frame or an update thread.
+    void UpdateStreams();
+    // Returns TRUE on a new underrun
+    CKBOOL AdvanceStream(SoundStreamRing &ring);
+    // Shows the underruns and low rings counted since the last call on the
+    // console, from the frame: rings may advance on an update thread
+    void ReportStreams();
+    // Closes every ring and the files feeding them, unlocking the writes
+    // left in progress
+    void CloseStreams();
+    // Copies the data read ahead into the ring and queues the next reads
+    void FillFileStream(SoundStreamRing &ring, SoundReadAheadStream &stream);
+    // Advances the FadeGain ramps by deltaTime milliseconds and steps the
+    // CKWaveSound fades
+    void UpdateFades(float deltaTime);
+    // Sends the gain of a ramp if it moved enough since the last one sent,
+    // or if it is the last of the ramp
+    void ApplyFade(SoundFade &fade, float gain, CKBOOL last);
+    // Starts tracking the fade a sound runs itself
+    void AddNativeFade(CKWaveSound *ws);
+    // Called by UpdateSettings: while a CKWaveSound fade steps, keeps the
+    // gain it sends to its source for ApplyFade and returns the other
+    // options to set
+    CK_SOUNDMANAGER_CAPS TakeFadeStep(void *source, CK_SOUNDMANAGER_CAPS settingsoptions, float gain);
+
+    // TRUE if sources holds count sources, none of them NULL
+    static CKBOOL IsValidBatch(void **sources, int count);
+
+    // Guards the state shared with an update thread; no-ops by default
+    virtual void EnterUpdateLock() {}
+    virtual void LeaveUpdateLock() {}
+
+    // Logs and sends the gain a bus computed for a source
+    static void SendBusGain(void *context, void *source, float gain);
+
+    // Applies the limit of an asset before duplicating it. Returns FALSE
+    // if the trigger was merged or rejected and no duplicate must be made.
+    CKBOOL AdmitInstance(void *asset);
+    // Tracks a duplicate of a limited, routed or bank asset; ForgetSource
+    // on release
+    void TrackInstance(void *asset, void *source);
+    void ForgetSource(void *source);
+
+    // A ready duplicate of the asset, NULL if it has none or its settings
+    // changed since it was made
+    void *TakePrimedSource(void *asset);
+    // Tops up the pools between frames
+    void RefillPrimedVoices();
+    // Releases the ready voices, keeping the pools unless clear is set
+    void ReleasePrimedVoices(CKBOOL clear);
+    void ReleaseUnprimed();
+
+    // Gathers the playing minions attached to an entity into m_EmitterJobs
+    // and computes the world position, direction and velocity (the move
+    // since the last call times velocityScale) of the ones that moved on
+    // the job pool. The others keep their cached transform and no velocity.
+    // The backend then commits m_EmitterJobs in order. Returns TRUE if a
+    // minion plays.
+    CKBOOL ComputeEmitters(float velocityScale);
+    static void ComputeEmitterRange(void *context, int begin, int end);
+    // Files the moved m_EmitterJobs in the emitter index and marks the ones
+    // out of audible distance as deferred, but for those whose turn has come
+    void CullEmitters();
+    // Applies the clusters to m_EmitterJobs: leaders take the transform
+    // and gain of their cluster, the others are muted and marked folded.
+    // Sources no longer clustered get their gain back.
+    void ClusterEmitters();
+
+    // Clears the references minions hold to a deleted object; the minion
+    // index must have been synced with m_Minions since the last creation
+    void DetachMinions(MinionIndex::Key key, CK_ID id);
+    static void DetachMinion(SoundMinion *minion, MinionIndex::Key key, CK_ID id);
+
+    // Resets an arena once it holds no live allocation, reporting its
+    // high-water mark in interface mode
+    void ResetArena(SoundArena &arena);
+
+    // Starts capturing if DX8SOUND_COMMAND_LOG names an output file
+    void StartCommandLogFromEnvironment();
+    // Starts the job pool if DX8SOUND_JOB_THREADS asks for workers
+    void StartJobPoolFromEnvironment();
+    // Starts the latency probe if DX8SOUND_LATENCY_PROBE is set
+    void StartLatencyProbeFromEnvironment();
+    static int ReadPlayCursor(void *context, void *source);
+
+    // Gain to send when a source is given one: records it as the source's
+    // own, applies the buses, and keeps the gain of the cluster on a
+    // clustered source
+    float FilterSourceGain(void *source, float gain);
+    // Own gain of a source as last set, read back once if never seen
+    float GetOwnGain(void *source);
+    void SetClusterGain(void *source, float gain);
 
     // Pure virtual internal methods that must be implemented
     virtual void InternalPause(void *source) = 0;
     virtual void InternalPlay(void *source, CKBOOL loop /* = FALSE */) = 0;
+    // Duplicates the asset for a pool, neither logged nor tracked
+    virtual void *PrimeSource(void *asset) = 0;
+    // Releases a primed duplicate never handed out
+    virtual void UnprimeSource(void *source) = 0;
+    // Sets the gain of a source as is, neither scaled by its bus nor logged
+    virtual void SetSourceGain(void *source, float gain) = 0;
+    // Creates a source holding size bytes of bank data, which stays mapped
+    // while the source lives
+    virtual void *CreateMappedSource(CK_WAVESOUND_TYPE type, CKWaveFormat &wf, const BYTE *data, CKDWORD size) = 0;
 
 private:
     // Prevent copying (VC6 style - declare but don't implement)
@@ -0,0 +1,279 @@
+#include "MinionIndex.h"
+
+#define MINIONINDEX_MIN_CAPACITY 32
+#define MINIONINDEX_MIN_SHIFT    27 /* 32 - log2(MINIONINDEX_MIN_CAPACITY) */
+
+MinionIndex::MinionIndex()
+{
+    int k, i;
+
+    for (k = 0; k < KEY_COUNT; ++k)
+    {
+        m_Tables[k].m_Capacity = MINIONINDEX_MIN_CAPACITY;
+        m_Tables[k].m_Shift = MINIONINDEX_MIN_SHIFT;
+        m_Tables[k].m_Count = 0;
+        m_Tables[k].m_Keys = new CK_ID[MINIONINDEX_MIN_CAPACITY];
+        m_Tables[k].m_Heads = new int[MINIONINDEX_MIN_CAPACITY];
+        for (i = 0; i < MINIONINDEX_MIN_CAPACITY; ++i)
+            m_Tables[k].m_Heads[i] = -1;
+    }
+    m_FreeList = -1;
+    m_Indexed = 0;
+}
+
+MinionIndex::~MinionIndex()
+{
+    int k;
+
+    for (k = 0; k < KEY_COUNT; ++k)
+    {
+        delete[] m_Tables[k].m_Keys;
+        delete[] m_Tables[k].m_Heads;
+    }
+}
+
+void MinionIndex::Clear()
+{
+    int k, i;
+
+    for (k = 0; k < KEY_COUNT; ++k)
+    {
+        for (i = 0; i < m_Tables[k].m_Capacity; ++i)
+            m_Tables[k].m_Heads[i] = -1;
+        m_Tables[k].m_Count = 0;
+    }
+    m_Entries.Clear();
+    m_Lookup.Clear();
+    m_FreeList = -1;
+    m_Indexed = 0;
+}
+
+void MinionIndex::Sync(const XArray<SoundMinion *> &minions)
+{
+    int slot;
+
+    /* A minion left without its source being released: start over */
+    if (minions.Size() < m_Indexed)
+    {
+        Clear();
+    }
+
+    /* The prefix stops at a minion without a source yet: Remove could not
+       retire it, and it is indexed by a later Sync once it has one */
+    for (slot = m_Indexed; slot < minions.Size(); ++slot)
+    {
+        if (!minions[slot] || !minions[slot]->m_Source)
+            break;
+        Insert(minions[slot]);
+    }
+    m_Indexed = slot;
+}
+
+void MinionIndex::Remove(void *source)
+{
+    int *found = m_Lookup.FindPtr(source);
+    int entry, k;
+
+    if (!found)
+        return;
+
+    entry = *found;
+    for (k = 0; k < KEY_COUNT; ++k)
+        Unlink((Key)k, entry);
+    m_Lookup.Remove(source);
+
+    m_Entries[entry].m_Minion = NULL;
+    m_Entries[entry].m_Source = NULL;
+    m_Entries[entry].m_Next[0] = m_FreeList;
+    m_FreeList = entry;
+
+    /* The survivors moved down a slot, the indexed ones still lead */
+    --m_Indexed;
+}
+
+void MinionIndex::RemoveKey(Key key, CK_ID id)
+{
+    Table &table = m_Tables[key];
+    int slot = FindSlot(table, id);
+    int entry, next;
+
+    if (slot < 0)
+        return;
+
+    for (entry = table.m_Heads[slot]; entry >= 0; entry = next)
+    {
+        next = m_Entries[entry].m_Next[key];
+        m_Entries[entry].m_Ids[key] = 0;
+        m_Entries[entry].m_Prev[key] = -1;
+        m_Entries[entry].m_Next[key] = -1;
+    }
+    EraseSlot(table, slot);
+}
+
+int MinionIndex::First(Key key, CK_ID id) const
+{
+    int slot = FindSlot(m_Tables[key], id);
+    return (slot >= 0) ? m_Tables[key].m_Heads[slot] : -1;
+}
+
+void MinionIndex::Insert(SoundMinion *minion)
+{
+    Entry e;
+    int entry, k;
+
+    e.m_Minion = minion;
+    e.m_Source = minion->m_Source;
+    for (k = 0; k < KEY_COUNT; ++k)
+    {
+        e.m_Ids[k] = 0;
+        e.m_Prev[k] = -1;
+        e.m_Next[k] = -1;
+    }
+
+    if (m_FreeList >= 0)
+    {
+        entry = m_FreeList;
+        m_FreeList = m_Entries[entry].m_Next[0];
+        m_Entries[entry] = e;
+    }
+    else
+    {
+        m_Entries.PushBack(e);
+        entry = m_Entries.Size() - 1;
+    }
+    m_Lookup.Insert(minion->m_Source, entry, TRUE);
+
+    if (minion->m_Entity)
+        Link(BY_ENTITY, minion->m_Entity, entry);
+    if (minion->m_OriginalSound)
+        Link(BY_ORIGINAL_SOUND, minion->m_OriginalSound, entry);
+}
+
+void MinionIndex::Link(Key key, CK_ID id, int entry)
+{
+    Table &table = m_Tables[key];
+    Entry *e = &m_Entries[entry];
+    int mask, pos;
+
+    pos = FindSlot(table, id);
+    if (pos < 0)
+    {
+        /* New key: keep the load factor at or below 1/2 */
+        if ((table.m_Count + 1) * 2 > table.m_Capacity)
+            Grow(table);
+
+        mask = table.m_Capacity - 1;
+        pos = (int)Hash(id, table);
+        while (table.m_Heads[pos] >= 0)
+            pos = (pos + 1) & mask;
+
+        table.m_Keys[pos] = id;
+        ++table.m_Count;
+    }
+
+    /* Push the entry at the head of the key chain */
+    e->m_Ids[key] = id;
+    e->m_Prev[key] = -1;
+    e->m_Next[key] = table.m_Heads[pos];
+    if (e->m_Next[key] >= 0)
+        m_Entries[e->m_Next[key]].m_Prev[key] = entry;
+    table.m_Heads[pos] = entry;
+}
+
+void MinionIndex::Unlink(Key key, int entry)
+{
+    Table &table = m_Tables[key];
+    Entry *e = &m_Entries[entry];
+    int slot;
+
+    if (!e->m_Ids[key])
+        return;
+
+    if (e->m_Next[key] >= 0)
+        m_Entries[e->m_Next[key]].m_Prev[key] = e->m_Prev[key];
+    if (e->m_Prev[key] >= 0)
+    {
+        m_Entries[e->m_Prev[key]].m_Next[key] = e->m_Next[key];
+    }
+    else
+    {
+        /* The last minion of the key takes the key with it */
+        slot = FindSlot(table, e->m_Ids[key]);
+        if (e->m_Next[key] >= 0)
+            table.m_Heads[slot] = e->m_Next[key];
+        else
+            EraseSlot(table, slot);
+    }
+
+    e->m_Ids[key] = 0;
+    e->m_Prev[key] = -1;
+    e->m_Next[key] = -1;
+}
+
+void MinionIndex::Grow(Table &table)
+{
+    CK_ID *oldKeys = table.m_Keys;
+    int *oldHeads = table.m_Heads;
+    int oldCapacity = table.m_Capacity;
+    int i, pos, mask;
+
+    table.m_Capacity = oldCapacity * 2;
+    --table.m_Shift;
+    table.m_Keys = new CK_ID[table.m_Capacity];
+    table.m_Heads = new int[table.m_Capacity];
+    for (i = 0; i < table.m_Capacity; ++i)
+        table.m_Heads[i] = -1;
+
+    mask = table.m_Capacity - 1;
+    for (i = 0; i < oldCapacity; ++i)
+    {
+        if (oldHeads[i] < 0)
+            continue;
+
+        pos = (int)Hash(oldKeys[i], table);
+        while (table.m_Heads[pos] >= 0)
+            pos = (pos + 1) & mask;
+        table.m_Keys[pos] = oldKeys[i];
+        table.m_Heads[pos] = oldHeads[i];
+    }
+
+    delete[] oldKeys;
+    delete[] oldHeads;
+}
+
+int MinionIndex::FindSlot(const Table &table, CK_ID id) const
+{
+    int mask = table.m_Capacity - 1;
+    int pos = (int)Hash(id, table);
+
+    while (table.m_Heads[pos] >= 0)
+    {
+        if (table.m_Keys[pos] == id)
+            return pos;
+        pos = (pos + 1) & mask;
+    }
+    return -1;
+}
+
+void MinionIndex::EraseSlot(Table &table, int slot)
+{
+    int mask = table.m_Capacity - 1;
+    int hole = slot;
+    int next = (slot + 1) & mask;
+    int home;
+
+    /* Backward-shift deletion, as in ActiveSoundSet */
+    while (table.m_Heads[next] >= 0)
+    {
+        home = (int)Hash(table.m_Keys[next], table);
+        if (((next - home) & mask) >= ((next - hole) & mask))
+        {
+            table.m_Keys[hole] = table.m_Keys[next];
+            table.m_Heads[hole] = table.m_Heads[next];
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+    table.m_Heads[hole] = -1;
+    --table.m_Count;
+}
@@ -0,0 +1,98 @@
+#ifndef MINIONINDEX_H
+#define MINIONINDEX_H
+
+#include "CKAll.h"
+
+#include "SampleStore.h"
+
+/**
+ * @brief Reverse index from object IDs to the minions referencing them
+ *
+ * Maps both SoundMinion::m_Entity and SoundMinion::m_OriginalSound to the
+ * minions holding them, so that a deletion batch only touches the minions
+ * it concerns.
+ *
+ * The index is kept up to date incrementally and never rescans the minion
+ * array. CKSoundManager::CreateMinion only appends to the array and its
+ * removals keep the order of the survivors, so the minions indexed so far
+ * are always its first m_Indexed slots: Sync indexes the ones appended
+ * since. Every removed minion has its source released first, and Remove
+ * retires its entry from there, before the minion is deleted.
+ *
+ * Only minions with a source are indexed, so the prefix stops at the
+ * first one still waiting for its source. The slots past
+ * GetIndexedCount() are not indexed and have to be scanned.
+ */
+class MinionIndex
+{
+public:
+    enum Key
+    {
+        BY_ENTITY = 0,
+        BY_ORIGINAL_SOUND = 1,
+        KEY_COUNT = 2
+    };
+
+    MinionIndex();
+    ~MinionIndex();
+
+    // Indexes minions appended since the last Sync, up to the first
+    // one without a source
+    void Sync(const XArray<SoundMinion *> &minions);
+    // Retires the minion playing source, if indexed
+    void Remove(void *source);
+    // Unlinks every minion from id, once they no longer reference it
+    void RemoveKey(Key key, CK_ID id);
+    void Clear();
+
+    // Entry iteration: First/Next return -1 at the end of the chain
+    int First(Key key, CK_ID id) const;
+    int Next(Key key, int entry) const { return m_Entries[entry].m_Next[key]; }
+    SoundMinion *GetMinion(int entry) const { return m_Entries[entry].m_Minion; }
+
+    int GetIndexedCount() const { return m_Indexed; }
+
+private:
+    struct Entry
+    {
+        SoundMinion *m_Minion;  /* NULL while on the free list */
+        void *m_Source;
+        CK_ID m_Ids[KEY_COUNT]; /* 0 when not linked under the key */
+        int m_Prev[KEY_COUNT];
+        int m_Next[KEY_COUNT];  /* m_Next[0] chains the free list */
+    };
+
+    struct Table
+    {
+        CK_ID *m_Keys;
+        int *m_Heads;   /* First entry per key, -1 when the slot is empty */
+        int m_Capacity; /* Power of two */
+        int m_Shift;    /* 32 - log2(m_Capacity) */
+        int m_Count;
+    };
+
+    void Insert(SoundMinion *minion);
+    void Link(Key key, CK_ID id, int entry);
+    void Unlink(Key key, int entry);
+    void Grow(Table &table);
+    int FindSlot(const Table &table, CK_ID id) const;
+    void EraseSlot(Table &table, int slot);
+
+    static unsigned int Hash(CK_ID id, const Table &table)
+    {
+        /* Fibonacci hashing: the high bits of the product mix best */
+        return ((unsigned int)id * 2654435769U) >> table.m_Shift;
+    }
+
+    Table m_Tables[KEY_COUNT];
+    XArray<Entry> m_Entries;
+    XHashTable<int, void *, SourceHash> m_Lookup; /* Source to entry */
+    int m_FreeList;
+    int m_Indexed; /* Leading array slots indexed so far */
+
+    // Prevent copying (VC6 style - declare but don't implement)
+    MinionIndex(const MinionIndex &);
+    MinionIndex &operator=(const MinionIndex &);
+};
+
+#endif /* MINIONINDEX_H */
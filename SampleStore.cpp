@@ -0,0 +1,323 @@
+#include "SampleStore.h"
+
+#include <stdlib.h>
+
+SampleStore::SampleStore()
+    : m_EntryPool(sizeof(SampleStoreEntry)),
+      m_DuplicatePool(sizeof(SampleStoreEntry)),
+      m_SamplePool(sizeof(StoredSample))
+{
+    m_DataArena = NULL;
+    m_RetainedBytes = 0;
+}
+
+SampleStore::~SampleStore()
+{
+    Clear();
+}
+
+void SampleStore::SetArenas(SoundArena *levelArena, SoundArena *sceneArena)
+{
+    m_EntryPool.SetArena(levelArena);
+    m_DuplicatePool.SetArena(sceneArena);
+    m_SamplePool.SetArena(levelArena);
+    m_DataArena = levelArena;
+}
+
+SampleStoreEntry *SampleStore::Add(void *source, CKDWORD size)
+{
+    SampleStoreEntry *entry;
+    StoredSample *sample;
+
+    if (!source)
+        return NULL;
+
+    Remove(source);
+
+    sample = (StoredSample *)m_SamplePool.Allocate();
+    if (!sample)
+        return NULL;
+    sample->m_Data = (BYTE *)(m_DataArena ? m_DataArena->Allocate(size) : malloc(size ? size : 1));
+    if (!sample->m_Data)
+    {
+        m_SamplePool.Free(sample);
+        return NULL;
+    }
+    sample->m_Size = size;
+    sample->m_RefCount = 1;
+    sample->m_Mapped = FALSE;
+    memset(sample->m_Data, 0, size);
+    m_RetainedBytes += size;
+
+    entry = (SampleStoreEntry *)m_EntryPool.Allocate();
+    if (!entry)
+    {
+        ReleaseSample(sample);
+        return NULL;
+    }
+    memset(entry, 0, sizeof(SampleStoreEntry));
+    entry->m_Source = source;
+    entry->m_Sample = sample;
+
+    m_Entries.Insert(source, entry, TRUE);
+    return entry;
+}
+
+SampleStoreEntry *SampleStore::AddMapped(void *source, const BYTE *data, CKDWORD size)
+{
+    SampleStoreEntry *entry;
+    StoredSample *sample;
+
+    if (!source || !data)
+        return NULL;
+
+    Remove(source);
+
+    sample = (StoredSample *)m_SamplePool.Allocate();
+    if (!sample)
+        return NULL;
+    sample->m_Data = (BYTE *)data;
+    sample->m_Size = size;
+    sample->m_RefCount = 1;
+    sample->m_Mapped = TRUE;
+
+    entry = (SampleStoreEntry *)m_EntryPool.Allocate();
+    if (!entry)
+    {
+        ReleaseSample(sample);
+        return NULL;
+    }
+    memset(entry, 0, sizeof(SampleStoreEntry));
+    entry->m_Source = source;
+    entry->m_Sample = sample;
+
+    m_Entries.Insert(source, entry, TRUE);
+    return entry;
+}
+
+SampleStoreEntry *SampleStore::AddDuplicate(void *source, void *original)
+{
+    SampleStoreEntry *entry;
+    SampleStoreEntry *originalEntry = Find(original);
+
+    if (!source || !originalEntry)
+        return NULL;
+
+    Remove(source);
+
+    entry = (SampleStoreEntry *)m_DuplicatePool.Allocate();
+    if (!entry)
+        return NULL;
+    memset(entry, 0, sizeof(SampleStoreEntry));
+    entry->m_Source = source;
+    entry->m_Duplicate = TRUE;
+    entry->m_Streamed = originalEntry->m_Streamed;
+    entry->m_Sample = originalEntry->m_Sample;
+    if (entry->m_Sample)
+        ++entry->m_Sample->m_RefCount;
+
+    m_Entries.Insert(source, entry, TRUE);
+    return entry;
+}
+
+SampleStoreEntry *SampleStore::AddCopy(void *source, void *original)
+{
+    SampleStoreEntry *entry;
+    SampleStoreEntry *originalEntry = Find(original);
+    StoredSample *sample, *shared;
+
+    if (!source || !originalEntry)
+        return NULL;
+
+    Remove(source);
+
+    // Nothing to copy: the duplicate is restored as silence too
+    if (originalEntry->m_Streamed)
+        return AddDuplicate(source, original);
+
+    shared = originalEntry->m_Sample;
+    sample = (StoredSample *)m_SamplePool.Allocate();
+    if (!sample)
+        return NULL;
+    sample->m_Size = shared->m_Size;
+    sample->m_RefCount = 1;
+    sample->m_Mapped = shared->m_Mapped;
+    if (shared->m_Mapped)
+    {
+        sample->m_Data = shared->m_Data;
+    }
+    else
+    {
+        sample->m_Data = (BYTE *)(m_DataArena ? m_DataArena->Allocate(shared->m_Size)
+                                              : malloc(shared->m_Size ? shared->m_Size : 1));
+        if (!sample->m_Data)
+        {
+            m_SamplePool.Free(sample);
+            return NULL;
+        }
+        memcpy(sample->m_Data, shared->m_Data, shared->m_Size);
+        m_RetainedBytes += shared->m_Size;
+    }
+
+    entry = (SampleStoreEntry *)m_DuplicatePool.Allocate();
+    if (!entry)
+    {
+        ReleaseSample(sample);
+        return NULL;
+    }
+    memset(entry, 0, sizeof(SampleStoreEntry));
+    entry->m_Source = source;
+    entry->m_Duplicate = TRUE;
+    entry->m_Sample = sample;
+
+    m_Entries.Insert(source, entry, TRUE);
+    return entry;
+}
+
+SampleStoreEntry *SampleStore::AddStreamed(void *source)
+{
+    SampleStoreEntry *entry;
+
+    if (!source)
+        return NULL;
+
+    Remove(source);
+
+    entry = (SampleStoreEntry *)m_EntryPool.Allocate();
+    if (!entry)
+        return NULL;
+    memset(entry, 0, sizeof(SampleStoreEntry));
+    entry->m_Source = source;
+    entry->m_Streamed = TRUE;
+
+    m_Entries.Insert(source, entry, TRUE);
+    return entry;
+}
+
+void SampleStore::SetStreamed(SampleStoreEntry *entry)
+{
+    if (!entry || entry->m_Streamed)
+        return;
+
+    // Duplicates keep the copy they share
+    ReleaseSample(entry->m_Sample);
+    entry->m_Sample = NULL;
+    entry->m_Streamed = TRUE;
+}
+
+void SampleStore::Remove(void *source)
+{
+    SampleStoreEntry *entry = Find(source);
+    int i;
+
+    if (!entry)
+        return;
+
+    if (entry->m_Lost)
+    {
+        for (i = 0; i < m_Lost.Size(); ++i)
+        {
+            if (m_Lost[i] == entry)
+            {
+                RemoveLost(i);
+                break;
+            }
+        }
+    }
+
+    m_Entries.Remove(source);
+    ReleaseSample(entry->m_Sample);
+    FreeEntry(entry);
+}
+
+void SampleStore::Clear()
+{
+    XHashTable<SampleStoreEntry *, void *, SourceHash>::Iterator it;
+
+    for (it = m_Entries.Begin(); it != m_Entries.End(); ++it)
+    {
+        ReleaseSample((*it)->m_Sample);
+        FreeEntry(*it);
+    }
+
+    m_Entries.Clear();
+    m_Lost.Clear();
+}
+
+void SampleStore::Write(SampleStoreEntry *entry, CKDWORD offset, const void *data, CKDWORD bytes)
+{
+    StoredSample *sample;
+
+    if (!entry || !entry->m_Sample || !data || !bytes)
+        return;
+
+    sample = entry->m_Sample;
+    if (offset >= sample->m_Size)
+        return;
+
+    /* The buffer was written over: its bank data no longer restores it */
+    if (sample->m_Mapped && !CopyMapped(sample))
+        return;
+
+    if (bytes > sample->m_Size - offset)
+        bytes = sample->m_Size - offset;
+    memcpy(sample->m_Data + offset, data, bytes);
+}
+
+void SampleStore::MarkLost(SampleStoreEntry *entry, LONGLONG time)
+{
+    if (!entry || entry->m_Lost)
+        return;
+
+    entry->m_Lost = TRUE;
+    entry->m_LostTime = time;
+    m_Lost.PushBack(entry);
+}
+
+void SampleStore::RemoveLost(int index)
+{
+    m_Lost[index]->m_Lost = FALSE;
+    m_Lost[index] = m_Lost[m_Lost.Size() - 1];
+    m_Lost.PopBack();
+}
+
+CKBOOL SampleStore::CopyMapped(StoredSample *sample)
+{
+    BYTE *data = (BYTE *)(m_DataArena ? m_DataArena->Allocate(sample->m_Size) : malloc(sample->m_Size));
+
+    if (!data)
+        return FALSE;
+
+    memcpy(data, sample->m_Data, sample->m_Size);
+    sample->m_Data = data;
+    sample->m_Mapped = FALSE;
+    m_RetainedBytes += sample->m_Size;
+    return TRUE;
+}
+
+void SampleStore::ReleaseSample(StoredSample *sample)
+{
+    if (!sample || --sample->m_RefCount > 0)
+        return;
+
+    if (sample->m_Mapped)
+    {
+        m_SamplePool.Free(sample);
+        return;
+    }
+
+    m_RetainedBytes -= sample->m_Size;
+    if (m_DataArena)
+        m_DataArena->Free(sample->m_Data, sample->m_Size);
+    else
+        free(sample->m_Data);
+    m_SamplePool.Free(sample);
+}
+
+void SampleStore::FreeEntry(SampleStoreEntry *entry)
+{
+    if (entry->m_Duplicate)
+        m_DuplicatePool.Free(entry);
+    else
+        m_EntryPool.Free(entry);
+}
@@ -0,0 +1,123 @@
+#ifndef SAMPLESTORE_H
+#define SAMPLESTORE_H
+
+#include "CKAll.h"
+
+#include "SoundArena.h"
+
+/**
+ * @brief PCM data shared by a source and its duplicates
+ */
+struct StoredSample
+{
+    BYTE *m_Data;
+    CKDWORD m_Size;
+    int m_RefCount;
+    CKBOOL m_Mapped;  /* m_Data is read-only sound bank memory, not owned */
+};
+
+/**
+ * @brief Per-source restore information
+ */
+struct SampleStoreEntry
+{
+    void *m_Source;
+    StoredSample *m_Sample;
+    CKDWORD m_LockOffset; /* Buffer offset of the first region of the current lock */
+    CKBOOL m_Playing;     /* Last known play state, resumed after a restore */
+    CKBOOL m_Looping;
+    CKBOOL m_Lost;
+    CKBOOL m_Duplicate;
+    CKBOOL m_Streamed;    /* Refilled by its stream: no copy kept, restored as silence */
+    LONGLONG m_LostTime; /* Performance counter value when the loss was noticed */
+};
+
+struct SourceHash
+{
+    int operator()(void *const &source) const
+    {
+        /* Fibonacci hashing; buffers are at least 4-byte aligned */
+        return (int)(((unsigned int)(size_t)source >> 2) * 2654435769U);
+    }
+};
+
+/**
+ * @brief System-memory copy of the PCM written to sound sources
+ *
+ * A DirectSound buffer loses its content when the device is taken away
+ * (focus switch, device reset). Every write made through the manager is
+ * mirrored here, so a lost buffer can be restored and refilled without
+ * reloading the sound. Duplicated sources share the copy of their original,
+ * as DuplicateSoundBuffer shares the buffer memory. A duplicate made by
+ * hand when the device refuses to share has memory of its own, and gets
+ * its own copy.
+ *
+ * Sources and their PCM copies live in the level arena. Duplicates are
+ * made for minions, which rarely outlive a scene: their entries live in
+ * the scene arena.
+ */
+class SampleStore
+{
+public:
+    SampleStore();
+    ~SampleStore();
+
+    // Arenas must be set before any source is added
+    void SetArenas(SoundArena *levelArena, SoundArena *sceneArena);
+
+    // Starts tracking a source holding size bytes of silence
+    SampleStoreEntry *Add(void *source, CKDWORD size);
+    // Starts tracking a source filled from sound bank memory, which stays
+    // mapped while the source lives; it is copied on the first Write
+    SampleStoreEntry *AddMapped(void *source, const BYTE *data, CKDWORD size);
+    // Starts tracking a duplicate, sharing the data of the original
+    SampleStoreEntry *AddDuplicate(void *source, void *original);
+    // Starts tracking a duplicate holding its own copy of the data of the
+    // original; bank memory is only copied on the first Write
+    SampleStoreEntry *AddCopy(void *source, void *original);
+    // Starts tracking a streamed source, without a copy
+    SampleStoreEntry *AddStreamed(void *source);
+    // Drops the copy of a source now written by a stream
+    void SetStreamed(SampleStoreEntry *entry);
+    void Remove(void *source);
+    void Clear();
+
+    SampleStoreEntry *Find(void *source) const
+    {
+        SampleStoreEntry **entry = m_Entries.FindPtr(source);
+        return entry ? *entry : NULL;
+    }
+
+    // Mirrors bytes written at the given buffer offset
+    void Write(SampleStoreEntry *entry, CKDWORD offset, const void *data, CKDWORD bytes);
+
+    // Lost sources, waiting for a restore
+    void MarkLost(SampleStoreEntry *entry, LONGLONG time);
+    int GetLostCount() const { return m_Lost.Size(); }
+    SampleStoreEntry *GetLost(int index) const { return m_Lost[index]; }
+    // Forgets the lost source at the given index (swapping the last one in)
+    void RemoveLost(int index);
+
+    // Bytes of PCM retained in system memory, bank memory excluded
+    CKDWORD GetRetainedBytes() const { return m_RetainedBytes; }
+
+private:
+    void ReleaseSample(StoredSample *sample);
+    // Gives a mapped sample its own copy of the data
+    CKBOOL CopyMapped(StoredSample *sample);
+    void FreeEntry(SampleStoreEntry *entry);
+
+    SoundPool m_EntryPool;     /* Entries of created sources */
+    SoundPool m_DuplicatePool; /* Entries of duplicated sources */
+    SoundPool m_SamplePool;
+    SoundArena *m_DataArena;   /* PCM copies, NULL for the heap */
+    XHashTable<SampleStoreEntry *, void *, SourceHash> m_Entries;
+    XArray<SampleStoreEntry *> m_Lost;
+    CKDWORD m_RetainedBytes;
+
+    // Prevent copying (VC6 style - declare but don't implement)
+    SampleStore(const SampleStore &);
+    SampleStore &operator=(const SampleStore &);
+};
+
+#endif /* SAMPLESTORE_H */
@@ -0,0 +1,1089 @@
+#include "SoftwareMixer.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#define SOFTWAREMIXER_SPEED_OF_SOUND 343.0f /* Meters per second */
+#define SOFTWAREMIXER_MIN_DOPPLER    0.5f
+#define SOFTWAREMIXER_MAX_DOPPLER    2.0f
+#define SOFTWAREMIXER_RAD_TO_DEG     57.29578f
+
+// Channels a voice is rendered with, before the matrix to the speakers
+static int GetRenderChannels(const SoftwareVoice &voice)
+{
+    /* 3D voices are point sources, folded to mono, and so are the
+       cheaper tiers once they no longer blend with a full one */
+    if (voice.m_Type != CK_WAVESOUND_BACKGROUND)
+        return 1;
+    if (voice.m_Lod != SOFTWARELOD_FULL && (voice.m_LodFade == 0 || voice.m_LodFrom != SOFTWARELOD_FULL))
+        return 1;
+    if (voice.m_Format.nChannels > SOUNDOUTPUT_MAX_CHANNELS)
+        return SOUNDOUTPUT_MAX_CHANNELS;
+    return voice.m_Format.nChannels;
+}
+
+SoftwareMixer::SoftwareMixer()
+    : m_VoicePool(sizeof(SoftwareVoice)),
+      m_DuplicatePool(sizeof(SoftwareVoice)),
+      m_SamplePool(sizeof(SoftwareSample))
+{
+    int i;
+
+    for (i = 0; i < SOUNDREVERB_MAX_BUSES; ++i)
+        m_Buses[i] = NULL;
+    m_Sending = FALSE;
+    m_Scratch = NULL;
+    m_ScratchFrames = 0;
+    m_EqBuffer = NULL;
+    m_BusBuffer = NULL;
+    m_PendingCount = 0;
+    m_PendingPlanes = 0;
+    m_Channels = SOFTWAREMIXER_DEFAULT_CHANNELS;
+    m_DataArena = NULL;
+    m_SampleRate = 44100;
+    m_MixedFrames = 0;
+    for (i = 0; i < SOFTWARELOD_TIERS - 1; ++i)
+        m_LodLevels[i] = 0.0f;
+    memset(&m_LodStats, 0, sizeof(SoftwareLodStats));
+
+    memset(&m_Listener, 0, sizeof(SoftwareListener));
+    m_Listener.m_Front.Set(0.0f, 0.0f, 1.0f);
+    m_Listener.m_Top.Set(0.0f, 1.0f, 0.0f);
+    m_Listener.m_DistanceFactor = 1.0f;
+    m_Listener.m_DopplerFactor = 1.0f;
+    m_Listener.m_RollOff = 1.0f;
+    m_Listener.m_GlobalGain = 1.0f;
+    SoundEqualizerInit(m_Listener.m_Eq);
+}
+
+SoftwareMixer::~SoftwareMixer()
+{
+    int i;
+
+    DestroyAllVoices();
+
+    for (i = 0; i < SOUNDREVERB_MAX_BUSES; ++i)
+        delete m_Buses[i];
+    delete[] m_Scratch;
+    delete[] m_EqBuffer;
+    delete[] m_BusBuffer;
+}
+
+void SoftwareMixer::SetArenas(SoundArena *levelArena, SoundArena *sceneArena)
+{
+    m_VoicePool.SetArena(levelArena);
+    m_DuplicatePool.SetArena(sceneArena);
+    m_SamplePool.SetArena(levelArena);
+    m_DataArena = levelArena;
+}
+
+CKBOOL SoftwareMixer::SetChannels(int channels)
+{
+    if (channels < 1 || channels > SOUNDOUTPUT_MAX_CHANNELS || SoundGetChannelMask(channels) == 0)
+        return FALSE;
+
+    m_Channels = channels;
+    return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// Voice Management
+//-----------------------------------------------------------------------------
+
+SoftwareVoice *SoftwareMixer::CreateVoice(const WAVEFORMATEX &wf, CKDWORD bytes, CK_WAVESOUND_TYPE type, CKBOOL streamed)
+{
+    SoftwareSample *sample;
+
+    if (bytes == 0 || wf.nBlockAlign == 0 || wf.nChannels == 0)
+        return NULL;
+
+    sample = (SoftwareSample *)m_SamplePool.Allocate();
+    if (!sample)
+        return NULL;
+    sample->m_Size = bytes;
+    sample->m_RefCount = 1;
+    sample->m_Mapped = FALSE;
+    sample->m_Data = (BYTE *)(m_DataArena ? m_DataArena->Allocate(bytes) : malloc(bytes));
+    if (!sample->m_Data)
+    {
+        ReleaseSample(sample);
+        return NULL;
+    }
+    /* Silence is 0x80 for unsigned 8-bit PCM */
+    memset(sample->m_Data, (wf.wBitsPerSample == 8) ? 0x80 : 0, bytes);
+
+    return AddVoice(sample, wf, type, streamed);
+}
+
+SoftwareVoice *SoftwareMixer::CreateMappedVoice(const WAVEFORMATEX &wf, const BYTE *data, CKDWORD bytes,
+                                                CK_WAVESOUND_TYPE type)
+{
+    SoftwareSample *sample;
+
+    if (!data || bytes == 0 || wf.nBlockAlign == 0 || wf.nChannels == 0)
+        return NULL;
+
+    sample = (SoftwareSample *)m_SamplePool.Allocate();
+    if (!sample)
+        return NULL;
+    sample->m_Size = bytes;
+    sample->m_RefCount = 1;
+    sample->m_Mapped = TRUE;
+    sample->m_Data = (BYTE *)data;
+
+    return AddVoice(sample, wf, type, FALSE);
+}
+
+SoftwareVoice *SoftwareMixer::AddVoice(SoftwareSample *sample, const WAVEFORMATEX &wf, CK_WAVESOUND_TYPE type,
+                                       CKBOOL streamed)
+{
+    SoftwareVoice *voice = (SoftwareVoice *)m_VoicePool.Allocate();
+
+    if (!voice)
+    {
+        ReleaseSample(sample);
+        return NULL;
+    }
+
+    memset(voice, 0, sizeof(SoftwareVoice));
+    voice->m_Magic = SOFTWAREVOICE_MAGIC;
+    voice->m_Sample = sample;
+    voice->m_Format = wf;
+    voice->m_Format.wFormatTag = SoundGetFormatTag(wf); /* The extension is not kept */
+    voice->m_Format.cbSize = 0;
+    voice->m_FrameCount = (int)(sample->m_Size / wf.nBlockAlign);
+    voice->m_Type = type;
+    voice->m_Streamed = streamed;
+    voice->m_Frequency = wf.nSamplesPerSec;
+    voice->m_Gain = 1.0f;
+    voice->m_GainTarget = 1.0f;
+    voice->m_Bus = -1;
+    SoundEqualizerInit(voice->m_Eq);
+    voice->m_ConeOrientation.Set(0.0f, 0.0f, 1.0f);
+    voice->m_InAngle = 360.0f;
+    voice->m_OutAngle = 360.0f;
+    voice->m_OutsideGain = 1.0f;
+    voice->m_MinDistance = 1.0f;
+    voice->m_MaxDistance = 1000000000.0f;
+    voice->m_Audibility = 1.0f;
+
+    voice->m_MixerIndex = m_Voices.Size();
+    m_Voices.PushBack(voice);
+    return voice;
+}
+
+SoftwareVoice *SoftwareMixer::DuplicateVoice(const SoftwareVoice *voice)
+{
+    SoftwareVoice *copy;
+
+    if (!voice)
+        return NULL;
+
+    copy = (SoftwareVoice *)m_DuplicatePool.Allocate();
+    if (!copy)
+        return NULL;
+    *copy = *voice;
+    copy->m_Duplicate = TRUE;
+    memset(copy->m_Eq.m_State, 0, sizeof(copy->m_Eq.m_State));
+    copy->m_Gain = copy->m_GainTarget;
+    copy->m_RampFrames = 0;
+    copy->m_Playing = FALSE;
+    copy->m_Cursor = 0.0;
+    copy->m_StartFrame = 0;
+    copy->m_LodFade = 0;
+    ++copy->m_Sample->m_RefCount;
+
+    copy->m_MixerIndex = m_Voices.Size();
+    m_Voices.PushBack(copy);
+    return copy;
+}
+
+void SoftwareMixer::ScheduleVoice(SoftwareVoice *voice, CKBOOL loop, LONGLONG frame)
+{
+    if (!voice)
+        return;
+
+    voice->m_Looping = loop;
+    voice->m_Playing = TRUE;
+    voice->m_StartFrame = 0;
+
+    if (frame > m_MixedFrames)
+    {
+        voice->m_StartFrame = frame;
+        return;
+    }
+
+    /* A late start keeps in phase with the clock */
+    voice->m_Cursor += (double)(m_MixedFrames - frame) * voice->m_Frequency / m_SampleRate;
+    if (voice->m_Cursor < voice->m_FrameCount)
+        return;
+    if (loop && voice->m_FrameCount > 0)
+    {
+        voice->m_Cursor = fmod(voice->m_Cursor, (double)voice->m_FrameCount);
+        return;
+    }
+    voice->m_Playing = FALSE;
+    voice->m_Cursor = 0.0;
+}
+
+void SoftwareMixer::SetVoiceGain(SoftwareVoice *voice, float gain, int rampFrames)
+{
+    if (!voice)
+        return;
+
+    voice->m_GainTarget = gain;
+    if (rampFrames <= 0 || !voice->m_Playing)
+    {
+        voice->m_Gain = gain;
+        voice->m_RampFrames = 0;
+        return;
+    }
+
+    voice->m_GainStep = (gain - voice->m_Gain) / rampFrames;
+    voice->m_RampFrames = rampFrames;
+}
+
+void SoftwareMixer::SetLodLevels(float reduced, float minimal)
+{
+    m_LodLevels[SOFTWARELOD_REDUCED - 1] = (reduced > 0.0f) ? reduced : 0.0f;
+    m_LodLevels[SOFTWARELOD_MINIMAL - 1] = (minimal > 0.0f) ? minimal : 0.0f;
+}
+
+void SoftwareMixer::DestroyVoice(SoftwareVoice *voice)
+{
+    int index, last;
+
+    if (!voice)
+        return;
+
+    /* Swap-remove from the voice list */
+    index = voice->m_MixerIndex;
+    last = m_Voices.Size() - 1;
+    if (index >= 0 && index <= last && m_Voices[index] == voice)
+    {
+        if (index != last)
+        {
+            m_Voices[index] = m_Voices[last];
+            m_Voices[index]->m_MixerIndex = index;
+        }
+        m_Voices.PopBack();
+    }
+
+    ReleaseSample(voice->m_Sample);
+
+    voice->m_Magic = 0;
+    if (voice->m_Duplicate)
+        m_DuplicatePool.Free(voice);
+    else
+        m_VoicePool.Free(voice);
+}
+
+void SoftwareMixer::ReleaseSample(SoftwareSample *sample)
+{
+    if (--sample->m_RefCount > 0)
+        return;
+
+    if (sample->m_Data && !sample->m_Mapped)
+    {
+        if (m_DataArena)
+            m_DataArena->Free(sample->m_Data, sample->m_Size);
+        else
+            free(sample->m_Data);
+    }
+    m_SamplePool.Free(sample);
+}
+
+void SoftwareMixer::DestroyAllVoices()
+{
+    while (m_Voices.Size() > 0)
+    {
+        DestroyVoice(m_Voices[m_Voices.Size() - 1]);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Reverb Buses
+//-----------------------------------------------------------------------------
+
+CKBOOL SoftwareMixer::SetBus(int bus, const SoundReverbSettings *settings)
+{
+    if (bus < 0 || bus >= SOUNDREVERB_MAX_BUSES)
+        return FALSE;
+
+    if (!settings)
+    {
+        delete m_Buses[bus];
+        m_Buses[bus] = NULL;
+        return TRUE;
+    }
+
+    if (m_Buses[bus] && m_Buses[bus]->GetType() != SOUNDBUS_REVERB)
+    {
+        delete m_Buses[bus];
+        m_Buses[bus] = NULL;
+    }
+
+    if (!m_Buses[bus])
+    {
+        m_Buses[bus] = new SoundReverb;
+        if (!m_Buses[bus]->SetSampleRate(m_SampleRate))
+        {
+            delete m_Buses[bus];
+            m_Buses[bus] = NULL;
+            return FALSE;
+        }
+    }
+
+    ((SoundReverb *)m_Buses[bus])->SetSettings(*settings);
+    return TRUE;
+}
+
+CKBOOL SoftwareMixer::SetConvolutionBus(int bus, const float *ir, int frames, int channels, float gain)
+{
+    SoundConvolver *convolver;
+
+    if (bus < 0 || bus >= SOUNDREVERB_MAX_BUSES)
+        return FALSE;
+
+    /* Preprocess before replacing the bus, so a failure keeps the old one */
+    convolver = new SoundConvolver;
+    if (!convolver->SetImpulseResponse(ir, frames, channels))
+    {
+        delete convolver;
+        return FALSE;
+    }
+    convolver->SetGain(gain);
+
+    delete m_Buses[bus];
+    m_Buses[bus] = convolver;
+    return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// Mixing
+//-----------------------------------------------------------------------------
+
+void SoftwareMixer::Mix(float *output, int frames)
+{
+    SoftwareVoice *voice;
+    SoftwareMixerPending *pending;
+    SoundBiquadLane lanes[SOUNDBIQUAD_LANES];
+    float gains[SOUNDOUTPUT_MAX_CHANNELS * SOUNDOUTPUT_MAX_CHANNELS];
+    float sends[2 * SOUNDOUTPUT_MAX_CHANNELS];
+    float returns[SOUNDOUTPUT_MAX_CHANNELS * 2];
+    float *outPlanes[SOUNDOUTPUT_MAX_CHANNELS];
+    const float *busPlanes[2];
+    float *left, *right, *busInput, *busOutput;
+    int i, m, bus, channels, count, start;
+
+    if (!output || frames <= 0)
+        return;
+
+    ReserveScratch(frames);
+    for (m = 0; m < m_Channels; ++m)
+    {
+        outPlanes[m] = GetPlane(m);
+        memset(outPlanes[m], 0, frames * sizeof(float));
+    }
+
+    /* Clear the sends of the active buses */
+    m_Sending = FALSE;
+    for (bus = 0; bus < SOUNDREVERB_MAX_BUSES; ++bus)
+    {
+        if (!m_Buses[bus])
+            continue;
+        m_Sending = TRUE;
+
+        /* The rate may have changed since the bus was created */
+        m_Buses[bus]->SetSampleRate(m_SampleRate);
+        memset(GetPlane(SOFTWAREMIXER_SEND_PLANE + 2 * bus), 0, frames * sizeof(float));
+        memset(GetPlane(SOFTWAREMIXER_SEND_PLANE + 2 * bus + 1), 0, frames * sizeof(float));
+    }
+
+    ComputeAudibility();
+    memset(m_LodStats.m_Voices, 0, sizeof(m_LodStats.m_Voices));
+    memset(m_LodStats.m_Fetches, 0, sizeof(m_LodStats.m_Fetches));
+    m_LodStats.m_Crossfades = 0;
+
+    m_PendingCount = 0;
+    m_PendingPlanes = 0;
+    for (i = 0; i < m_Voices.Size(); ++i)
+    {
+        voice = m_Voices[i];
+        if (!voice->m_Playing)
+            continue;
+
+        /* Scheduled voices start on their frame, silent before it */
+        start = 0;
+        if (voice->m_StartFrame > 0)
+        {
+            if (voice->m_StartFrame >= m_MixedFrames + frames)
+                continue;
+            if (voice->m_StartFrame > m_MixedFrames)
+                start = (int)(voice->m_StartFrame - m_MixedFrames);
+            voice->m_StartFrame = 0;
+        }
+
+        /* Muted voices, such as the folded members of a cluster, only
+           move on */
+        if (voice->m_Gain == 0.0f && voice->m_RampFrames == 0)
+        {
+            SkipVoice(*voice, start, frames);
+            continue;
+        }
+        SelectLod(*voice);
+
+        SoundEqualizerPrepare(voice->m_Eq, m_SampleRate);
+        if (voice->m_Eq.m_Flat)
+        {
+            channels = RenderVoice(*voice, SOFTWAREMIXER_VOICE_PLANE, gains, sends, start, frames);
+            SpatializeVoice(*voice, SOFTWAREMIXER_VOICE_PLANE, channels, gains, sends, frames);
+            continue;
+        }
+
+        /* Equalized voices are filtered in batches, a SIMD lane per channel */
+        if (m_PendingPlanes > 0 && m_PendingPlanes + GetRenderChannels(*voice) > SOUNDBIQUAD_LANES)
+            FlushEqualized(frames);
+
+        pending = &m_Pending[m_PendingCount];
+        pending->m_Voice = voice;
+        pending->m_Plane = SOFTWAREMIXER_PENDING_PLANE + m_PendingPlanes;
+        pending->m_Channels = RenderVoice(*voice, pending->m_Plane, pending->m_Gains, pending->m_Sends, start, frames);
+        if (pending->m_Channels > 0)
+        {
+            ++m_PendingCount;
+            m_PendingPlanes += pending->m_Channels;
+        }
+    }
+    FlushEqualized(frames);
+
+    /* One reverb pass per bus, however many voices feed it */
+    if (m_Sending)
+    {
+        SoundBuildChannelMatrix(2, m_Channels, returns);
+        busInput = m_BusBuffer;
+        busOutput = m_BusBuffer + 2 * frames;
+
+        for (bus = 0; bus < SOUNDREVERB_MAX_BUSES; ++bus)
+        {
+            if (!m_Buses[bus])
+                continue;
+
+            left = GetPlane(SOFTWAREMIXER_SEND_PLANE + 2 * bus);
+            right = GetPlane(SOFTWAREMIXER_SEND_PLANE + 2 * bus + 1);
+            for (i = 0; i < frames; ++i)
+            {
+                busInput[2 * i] = left[i];
+                busInput[2 * i + 1] = right[i];
+            }
+
+            memset(busOutput, 0, 2 * frames * sizeof(float));
+            m_Buses[bus]->Process(busInput, busOutput, frames);
+
+            /* The return reaches the speakers like a stereo source */
+            for (i = 0; i < frames; ++i)
+            {
+                left[i] = busOutput[2 * i];
+                right[i] = busOutput[2 * i + 1];
+            }
+            busPlanes[0] = left;
+            busPlanes[1] = right;
+            SoundMatrixMix(busPlanes, 2, outPlanes, m_Channels, returns, frames);
+        }
+    }
+
+    /* Listener equalization of the whole mix */
+    SoundEqualizerPrepare(m_Listener.m_Eq, m_SampleRate);
+    if (!m_Listener.m_Eq.m_Flat)
+    {
+        for (m = 0; m < m_Channels; m += SOUNDBIQUAD_LANES)
+        {
+            count = m_Channels - m;
+            if (count > SOUNDBIQUAD_LANES)
+                count = SOUNDBIQUAD_LANES;
+            for (i = 0; i < count; ++i)
+            {
+                lanes[i].m_Stages = m_Listener.m_Eq.m_Stages;
+                lanes[i].m_State = m_Listener.m_Eq.m_State[m + i][0];
+            }
+            EqualizePlanes(m, lanes, count, frames);
+        }
+    }
+
+    for (m = 0; m < m_Channels; ++m)
+    {
+        left = outPlanes[m];
+        for (i = 0; i < frames; ++i)
+            output[i * m_Channels + m] = left[i];
+    }
+
+    m_MixedFrames += frames;
+}
+
+void SoftwareMixer::ReserveScratch(int frames)
+{
+    if (frames <= m_ScratchFrames)
+        return;
+
+    delete[] m_Scratch;
+    delete[] m_EqBuffer;
+    delete[] m_BusBuffer;
+    m_Scratch = new float[frames * SOFTWAREMIXER_SCRATCH_PLANES];
+    m_EqBuffer = new float[frames * SOUNDBIQUAD_LANES];
+    m_BusBuffer = new float[frames * 4];
+    m_ScratchFrames = frames;
+}
+
+void SoftwareMixer::EqualizePlanes(int plane, const SoundBiquadLane *lanes, int count, int frames)
+{
+    SoundBiquadLane batch[SOUNDBIQUAD_LANES];
+    float *data;
+    int lane, i;
+
+    memset(batch, 0, sizeof(batch));
+    memset(m_EqBuffer, 0, frames * SOUNDBIQUAD_LANES * sizeof(float));
+
+    for (lane = 0; lane < count; ++lane)
+    {
+        batch[lane] = lanes[lane];
+        data = GetPlane(plane + lane);
+        for (i = 0; i < frames; ++i)
+            m_EqBuffer[i * SOUNDBIQUAD_LANES + lane] = data[i];
+    }
+
+    SoundBiquadProcess(m_EqBuffer, frames, batch);
+
+    for (lane = 0; lane < count; ++lane)
+    {
+        data = GetPlane(plane + lane);
+        for (i = 0; i < frames; ++i)
+            data[i] = m_EqBuffer[i * SOUNDBIQUAD_LANES + lane];
+    }
+}
+
+void SoftwareMixer::FlushEqualized(int frames)
+{
+    SoundBiquadLane lanes[2 * SOUNDOUTPUT_MAX_CHANNELS];
+    SoftwareMixerPending *pending;
+    int v, c, p, count;
+
+    if (m_PendingCount == 0)
+        return;
+
+    for (v = 0; v < m_PendingCount; ++v)
+    {
+        pending = &m_Pending[v];
+        for (c = 0; c < pending->m_Channels; ++c)
+        {
+            p = pending->m_Plane - SOFTWAREMIXER_PENDING_PLANE + c;
+            lanes[p].m_Stages = pending->m_Voice->m_Eq.m_Stages;
+            lanes[p].m_State = pending->m_Voice->m_Eq.m_State[c][0];
+        }
+    }
+
+    for (p = 0; p < m_PendingPlanes; p += SOUNDBIQUAD_LANES)
+    {
+        count = m_PendingPlanes - p;
+        if (count > SOUNDBIQUAD_LANES)
+            count = SOUNDBIQUAD_LANES;
+        EqualizePlanes(SOFTWAREMIXER_PENDING_PLANE + p, lanes + p, count, frames);
+    }
+
+    /* The sends follow the equalized signal */
+    for (v = 0; v < m_PendingCount; ++v)
+    {
+        pending = &m_Pending[v];
+        SpatializeVoice(*pending->m_Voice, pending->m_Plane, pending->m_Channels,
+                        pending->m_Gains, pending->m_Sends, frames);
+    }
+
+    m_PendingCount = 0;
+    m_PendingPlanes = 0;
+}
+
+void SoftwareMixer::SpatializeVoice(const SoftwareVoice &voice, int plane, int channels,
+                                    const float *gains, const float *sends, int frames)
+{
+    const float *input[SOUNDOUTPUT_MAX_CHANNELS];
+    float *output[SOUNDOUTPUT_MAX_CHANNELS];
+    int c, m;
+
+    if (channels <= 0)
+        return;
+
+    for (c = 0; c < channels; ++c)
+        input[c] = GetPlane(plane + c);
+    for (m = 0; m < m_Channels; ++m)
+        output[m] = GetPlane(m);
+    SoundMatrixMix(input, channels, output, m_Channels, gains, frames);
+
+    /* Post-fader send: the wet level follows distance and cones */
+    if (m_Sending && voice.m_SendLevel > 0.0f && IsBusActive(voice.m_Bus))
+    {
+        output[0] = GetPlane(SOFTWAREMIXER_SEND_PLANE + 2 * voice.m_Bus);
+        output[1] = GetPlane(SOFTWAREMIXER_SEND_PLANE + 2 * voice.m_Bus + 1);
+        SoundMatrixMix(input, channels, output, 2, sends, frames);
+    }
+}
+
+void SoftwareMixer::SkipVoice(SoftwareVoice &voice, int start, int frames)
+{
+    float gain, pan, azimuth, pitch;
+    double step;
+
+    if (!voice.m_Sample || voice.m_FrameCount <= 0)
+    {
+        voice.m_Playing = FALSE;
+        return;
+    }
+
+    /* Doppler still sets the pace */
+    ComputeVoiceGains(voice, gain, pan, azimuth, pitch);
+    step = (double)voice.m_Frequency * pitch / m_SampleRate;
+    if (step <= 0.0)
+        return;
+
+    voice.m_Cursor += step * (frames - start);
+    if (voice.m_Cursor < voice.m_FrameCount)
+        return;
+    if (voice.m_Looping)
+    {
+        voice.m_Cursor = fmod(voice.m_Cursor, (double)voice.m_FrameCount);
+        return;
+    }
+    voice.m_Playing = FALSE;
+    voice.m_Cursor = 0.0;
+}
+
+float SoftwareMixer::FetchSample(const SoftwareVoice &voice, int frame, int channel) const
+{
+    const BYTE *p = voice.m_Sample->m_Data + frame * voice.m_Format.nBlockAlign;
+    int value;
+
+    switch (voice.m_Format.wBitsPerSample)
+    {
+    case 8:
+        return ((int)p[channel] - 128) * (1.0f / 128.0f);
+    case 16:
+        return ((const short *)p)[channel] * (1.0f / 32768.0f);
+    case 24:
+        p += channel * 3;
+        value = (int)(((CKDWORD)p[0] << 8) | ((CKDWORD)p[1] << 16) | ((CKDWORD)p[2] << 24)) >> 8;
+        return value * (1.0f / 8388608.0f);
+    case 32:
+        if (voice.m_Format.wFormatTag == 3 /* WAVE_FORMAT_IEEE_FLOAT */)
+            return ((const float *)p)[channel];
+        return ((const int *)p)[channel] * (1.0f / 2147483648.0f);
+    default:
+        return 0.0f;
+    }
+}
+
+float SoftwareMixer::FetchNearest(const SoftwareVoice &voice, double position) const
+{
+    float value = 0.0f;
+    int frame, c;
+
+    if (position >= voice.m_FrameCount)
+    {
+        if (!voice.m_Looping)
+            return 0.0f;
+        position = fmod(position, (double)voice.m_FrameCount);
+    }
+
+    frame = (int)position;
+    for (c = 0; c < voice.m_Format.nChannels; ++c)
+        value += FetchSample(voice, frame, c);
+    return value / voice.m_Format.nChannels;
+}
+
+int SoftwareMixer::RenderTier(const SoftwareVoice &voice, int tier, float **planes, int channels,
+                              int start, int frames, double step, double &cursor)
+{
+    int sourceChannels = voice.m_Format.nChannels;
+    float *mono = planes[0];
+    float frac, a, b, value, from, to, delta;
+    int i, k, c, frame, next, end, reads;
+
+    end = frames;
+    if (tier == SOFTWARELOD_MINIMAL)
+    {
+        /* Where a one-shot runs out, as the per-frame tiers would find */
+        if (!voice.m_Looping && cursor + step * (frames - start) >= voice.m_FrameCount)
+        {
+            end = start + (int)ceil((voice.m_FrameCount - cursor) / step);
+            if (end < start)
+                end = start;
+            if (end > frames)
+                end = frames;
+        }
+
+        /* One read every SOFTWARELOD_DECIMATION frames, lines between */
+        reads = 0;
+        from = FetchNearest(voice, cursor);
+        for (i = start; i < end; i = next)
+        {
+            next = i + SOFTWARELOD_DECIMATION;
+            to = FetchNearest(voice, cursor + step * (next - start));
+            delta = (to - from) / SOFTWARELOD_DECIMATION;
+            for (k = i; k < next && k < end; ++k)
+            {
+                mono[k] = from;
+                from += delta;
+            }
+            from = to;
+            ++reads;
+        }
+        m_LodStats.m_Fetches[tier] += (reads + 1) * sourceChannels;
+
+        cursor += step * (frames - start);
+        if (voice.m_Looping && cursor >= voice.m_FrameCount)
+            cursor = fmod(cursor, (double)voice.m_FrameCount);
+    }
+    else
+    {
+        for (i = start; i < frames; ++i)
+        {
+            frame = (int)cursor;
+            if (frame >= voice.m_FrameCount)
+            {
+                if (!voice.m_Looping)
+                {
+                    end = i;
+                    break;
+                }
+                cursor = fmod(cursor, (double)voice.m_FrameCount);
+                frame = (int)cursor;
+            }
+
+            if (tier == SOFTWARELOD_REDUCED)
+            {
+                mono[i] = FetchNearest(voice, cursor);
+                cursor += step;
+                continue;
+            }
+
+            next = frame + 1;
+            if (next >= voice.m_FrameCount)
+                next = voice.m_Looping ? 0 : -1;
+            frac = (float)(cursor - frame);
+
+            if (voice.m_Type != CK_WAVESOUND_BACKGROUND)
+            {
+                value = 0.0f;
+                for (c = 0; c < sourceChannels; ++c)
+                {
+                    a = FetchSample(voice, frame, c);
+                    b = (next >= 0) ? FetchSample(voice, next, c) : 0.0f;
+                    value += a + (b - a) * frac;
+                }
+                mono[i] = value / sourceChannels;
+            }
+            else
+            {
+                for (c = 0; c < channels; ++c)
+                {
+                    a = FetchSample(voice, frame, c);
+                    b = (next >= 0) ? FetchSample(voice, next, c) : 0.0f;
+                    planes[c][i] = a + (b - a) * frac;
+                }
+            }
+            cursor += step;
+        }
+
+        if (tier == SOFTWARELOD_REDUCED)
+            m_LodStats.m_Fetches[tier] += (end - start) * sourceChannels;
+        else if (voice.m_Type != CK_WAVESOUND_BACKGROUND)
+            m_LodStats.m_Fetches[tier] += (end - start) * sourceChannels * 2;
+        else
+            m_LodStats.m_Fetches[tier] += (end - start) * channels * 2;
+    }
+
+    /* Mono renditions blending with a full one feed all its channels */
+    if (tier != SOFTWARELOD_FULL && end > start)
+    {
+        for (c = 1; c < channels; ++c)
+            memcpy(planes[c] + start, mono + start, (end - start) * sizeof(float));
+    }
+    return end;
+}
+
+void SoftwareMixer::SelectLod(SoftwareVoice &voice)
+{
+    float level;
+    int tier, target;
+
+    /* What the listener hears of the voice, fading out or in */
+    level = (voice.m_Gain > voice.m_GainTarget) ? voice.m_Gain : voice.m_GainTarget;
+    level *= m_Listener.m_GlobalGain;
+    if (voice.m_Type != CK_WAVESOUND_BACKGROUND)
+        level *= voice.m_Audibility;
+
+    target = SOFTWARELOD_FULL;
+    for (tier = SOFTWARELOD_REDUCED; tier < SOFTWARELOD_TIERS; ++tier)
+    {
+        if (level < m_LodLevels[tier - 1])
+            target = tier;
+    }
+
+    /* Down at once, up only with a margin above each level crossed */
+    tier = voice.m_Lod;
+    while (tier > target && level >= m_LodLevels[tier - 1] * SOFTWARELOD_HYSTERESIS)
+        --tier;
+    if (target > tier)
+        tier = target;
+    if (tier == voice.m_Lod)
+        return;
+
+    voice.m_LodFrom = voice.m_Lod;
+    voice.m_Lod = tier;
+    voice.m_LodFade = SOFTWARELOD_CROSSFADE_FRAMES;
+    ++m_LodStats.m_Switches;
+}
+
+int SoftwareMixer::RenderVoice(SoftwareVoice &voice, int plane, float *gains, float *sends, int start, int frames)
+{
+    float *planes[SOUNDOUTPUT_MAX_CHANNELS];
+    float *faded[SOUNDOUTPUT_MAX_CHANNELS];
+    float map[SOUNDOUTPUT_MAX_CHANNELS * SOUNDOUTPUT_MAX_CHANNELS];
+    float balance[SOUNDOUTPUT_MAX_CHANNELS];
+    float gain, pan, azimuth, pitch;
+    float left, right, level, weight, envelope;
+    double step, cursor, previous;
+    int i, c, m, end, channels;
+    CKBOOL point;
+
+    if (!voice.m_Sample || voice.m_FrameCount <= 0)
+    {
+        voice.m_Playing = FALSE;
+        return 0;
+    }
+
+    ComputeVoiceGains(voice, gain, pan, azimuth, pitch);
+
+    step = (double)voice.m_Frequency * pitch / m_SampleRate;
+    if (step <= 0.0)
+        return 0;
+
+    point = (voice.m_Type != CK_WAVESOUND_BACKGROUND);
+    channels = GetRenderChannels(voice);
+    for (c = 0; c < channels; ++c)
+    {
+        planes[c] = GetPlane(plane + c);
+        memset(planes[c], 0, frames * sizeof(float));
+    }
+
+    /* A tier change blends the outgoing rendition into the new one, both
+       read from the same position */
+    cursor = voice.m_Cursor;
+    if (voice.m_LodFade > 0)
+    {
+        for (c = 0; c < channels; ++c)
+        {
+            faded[c] = GetPlane(SOFTWAREMIXER_FADE_PLANE + c);
+            memset(faded[c], 0, frames * sizeof(float));
+        }
+        previous = cursor;
+        RenderTier(voice, voice.m_LodFrom, faded, channels, start, frames, step, previous);
+        ++m_LodStats.m_Crossfades;
+    }
+    end = RenderTier(voice, voice.m_Lod, planes, channels, start, frames, step, cursor);
+    ++m_LodStats.m_Voices[voice.m_Lod];
+
+    for (i = start; i < frames && voice.m_LodFade > 0; ++i)
+    {
+        weight = (float)voice.m_LodFade / SOFTWARELOD_CROSSFADE_FRAMES;
+        for (c = 0; c < channels; ++c)
+            planes[c][i] += (faded[c][i] - planes[c][i]) * weight;
+        --voice.m_LodFade;
+    }
+
+    if (end < frames)
+    {
+        /* Like DirectSound, a finished one-shot rewinds and stops */
+        voice.m_Playing = FALSE;
+        cursor = 0.0;
+    }
+    voice.m_Cursor = cursor;
+
+    /* A ramping gain is applied per frame, the rest through the matrix */
+    envelope = voice.m_Gain;
+    if (voice.m_RampFrames > 0)
+    {
+        for (i = start; i < end; ++i)
+        {
+            for (c = 0; c < channels; ++c)
+                planes[c][i] *= envelope;
+            if (voice.m_RampFrames > 0)
+            {
+                envelope += voice.m_GainStep;
+                if (--voice.m_RampFrames == 0)
+                    envelope = voice.m_GainTarget;
+            }
+        }
+    }
+    else
+    {
+        gain *= voice.m_Gain;
+    }
+    voice.m_Gain = envelope;
+
+    /* DirectSound panning only ever attenuates the opposite channel */
+    left = gain * ((pan > 0.0f) ? 1.0f - pan : 1.0f);
+    right = gain * ((pan < 0.0f) ? 1.0f + pan : 1.0f);
+    level = voice.m_SendLevel;
+
+    if (channels == 1)
+    {
+        /* Mono voices pan as a pair of stereo gains, except 3D voices
+           around a surround layout */
+        if (point && m_Channels > 2)
+        {
+            SoundPanGains(m_Channels, azimuth, balance);
+            for (m = 0; m < m_Channels; ++m)
+                gains[m] = balance[m] * gain;
+        }
+        else if (m_Channels == 1)
+        {
+            gains[0] = (left + right) * 0.5f;
+        }
+        else
+        {
+            SoundBuildChannelMatrix(2, m_Channels, map);
+            for (m = 0; m < m_Channels; ++m)
+                gains[m] = map[2 * m] * left + map[2 * m + 1] * right;
+        }
+        sends[0] = left * level;
+        sends[1] = right * level;
+        return 1;
+    }
+
+    /* Multichannel sources fold to the output layout, balanced by the pan */
+    SoundPanChannels(channels, pan, balance);
+    SoundBuildChannelMatrix(channels, m_Channels, map);
+    for (m = 0; m < m_Channels; ++m)
+    {
+        for (c = 0; c < channels; ++c)
+            gains[m * channels + c] = map[m * channels + c] * balance[c] * gain;
+    }
+    SoundBuildChannelMatrix(channels, 2, map);
+    for (m = 0; m < 2; ++m)
+    {
+        for (c = 0; c < channels; ++c)
+            sends[m * channels + c] = map[m * channels + c] * balance[c] * gain * level;
+    }
+    return channels;
+}
+
+void SoftwareMixer::ComputeAudibility()
+{
+    SoftwareVoice *voice;
+    VxVector rel;
+    int i;
+
+    m_Spatialized.Clear();
+    for (i = 0; i < m_Voices.Size(); ++i)
+    {
+        voice = m_Voices[i];
+        if (voice->m_Playing && voice->m_Type != CK_WAVESOUND_BACKGROUND)
+            m_Spatialized.PushBack(voice);
+    }
+
+    m_Attenuation.Resize(m_Spatialized.Size());
+    for (i = 0; i < m_Spatialized.Size(); ++i)
+    {
+        voice = m_Spatialized[i];
+        rel = voice->m_Position;
+        if (!voice->m_HeadRelative)
+            rel -= m_Listener.m_Position;
+        m_Attenuation.SetVoice(i, rel, voice->m_ConeOrientation,
+                               voice->m_MinDistance, voice->m_MaxDistance,
+                               voice->m_InAngle, voice->m_OutAngle, voice->m_OutsideGain);
+    }
+
+    m_Attenuation.Compute(m_Listener.m_RollOff);
+    for (i = 0; i < m_Spatialized.Size(); ++i)
+        m_Spatialized[i]->m_Audibility = m_Attenuation.GetGain(i);
+}
+
+void SoftwareMixer::ComputeVoiceGains(const SoftwareVoice &voice, float &gain, float &pan, float &azimuth, float &pitch) const
+{
+    const SoftwareListener &lst = m_Listener;
+    VxVector rel, dir, side;
+    float dist, lateral, forward, len;
+    float c, vl, vs;
+
+    /* The voice gain is left to the caller, which may be ramping it */
+    gain = lst.m_GlobalGain;
+    pan = 0.0f;
+    azimuth = 0.0f;
+    pitch = 1.0f;
+
+    if (voice.m_Type == CK_WAVESOUND_BACKGROUND)
+    {
+        pan = voice.m_Pan;
+        return;
+    }
+
+    /* Source position relative to the listener */
+    if (voice.m_HeadRelative)
+    {
+        rel = voice.m_Position;
+    }
+    else
+    {
+        rel.Set(voice.m_Position.x - lst.m_Position.x,
+                voice.m_Position.y - lst.m_Position.y,
+                voice.m_Position.z - lst.m_Position.z);
+    }
+    dist = sqrtf(rel.x * rel.x + rel.y * rel.y + rel.z * rel.z);
+
+    /* Pan from the lateral component in the listener frame, azimuth
+       from the lateral and forward ones */
+    if (dist > 0.0f)
+    {
+        lateral = forward = 0.0f;
+        if (voice.m_HeadRelative)
+        {
+            lateral = rel.x;
+            forward = rel.z;
+        }
+        else
+        {
+            /* Left-handed frame: right = top x front */
+            side.Set(lst.m_Top.y * lst.m_Front.z - lst.m_Top.z * lst.m_Front.y,
+                     lst.m_Top.z * lst.m_Front.x - lst.m_Top.x * lst.m_Front.z,
+                     lst.m_Top.x * lst.m_Front.y - lst.m_Top.y * lst.m_Front.x);
+            len = sqrtf(side.x * side.x + side.y * side.y + side.z * side.z);
+            if (len > 0.0f)
+                lateral = (rel.x * side.x + rel.y * side.y + rel.z * side.z) / len;
+            len = sqrtf(lst.m_Front.x * lst.m_Front.x + lst.m_Front.y * lst.m_Front.y + lst.m_Front.z * lst.m_Front.z);
+            if (len > 0.0f)
+                forward = (rel.x * lst.m_Front.x + rel.y * lst.m_Front.y + rel.z * lst.m_Front.z) / len;
+        }
+        pan = lateral / dist;
+        azimuth = atan2f(lateral, forward) * SOFTWAREMIXER_RAD_TO_DEG;
+    }
+
+    /* Distance rolloff and cone, batched by ComputeAudibility */
+    gain *= voice.m_Audibility;
+
+    /* Doppler shift along the listener-source axis */
+    if (lst.m_DopplerFactor > 0.0f && dist > 0.0f)
+    {
+        c = SOFTWAREMIXER_SPEED_OF_SOUND / ((lst.m_DistanceFactor > 0.0f) ? lst.m_DistanceFactor : 1.0f);
+        dir.Set(rel.x / dist, rel.y / dist, rel.z / dist);
+        vl = voice.m_HeadRelative ? 0.0f : (lst.m_Velocity.x * dir.x + lst.m_Velocity.y * dir.y + lst.m_Velocity.z * dir.z);
+        vs = voice.m_Velocity.x * dir.x + voice.m_Velocity.y * dir.y + voice.m_Velocity.z * dir.z;
+        vl *= lst.m_DopplerFactor;
+        vs *= lst.m_DopplerFactor;
+        if (c + vs > 0.0f)
+        {
+            pitch = (c + vl) / (c + vs);
+            if (pitch < SOFTWAREMIXER_MIN_DOPPLER)
+                pitch = SOFTWAREMIXER_MIN_DOPPLER;
+            if (pitch > SOFTWAREMIXER_MAX_DOPPLER)
+                pitch = SOFTWAREMIXER_MAX_DOPPLER;
+        }
+    }
+}
@@ -0,0 +1,284 @@
+#ifndef SOFTWAREMIXER_H
+#define SOFTWAREMIXER_H
+
+#include "CKAll.h"
+
+#include "SoundArena.h"
+#include "SoundAttenuation.h"
+#include "SoundBiquad.h"
+#include "SoundConvolver.h"
+#include "SoundOutput.h"
+#include "SoundReverb.h"
+
+// Tag stored at the start of every SoftwareVoice so the manager can tell
+// voices apart from the SoundMinion pointers it is sometimes handed.
+#define SOFTWAREVOICE_MAGIC 0x56575344 /* 'DSWV' */
+
+#define SOFTWAREMIXER_DEFAULT_CHANNELS 2
+
+// Planes of SoftwareMixer::m_Scratch: output channels, a voice being mixed,
+// the voices of an equalization batch, the stereo sends of the buses, then
+// the tier a voice crossfades from
+#define SOFTWAREMIXER_VOICE_PLANE   SOUNDOUTPUT_MAX_CHANNELS
+#define SOFTWAREMIXER_PENDING_PLANE (2 * SOUNDOUTPUT_MAX_CHANNELS)
+#define SOFTWAREMIXER_SEND_PLANE    (3 * SOUNDOUTPUT_MAX_CHANNELS)
+#define SOFTWAREMIXER_FADE_PLANE    (SOFTWAREMIXER_SEND_PLANE + 2 * SOUNDREVERB_MAX_BUSES)
+#define SOFTWAREMIXER_SCRATCH_PLANES (SOFTWAREMIXER_FADE_PLANE + SOUNDOUTPUT_MAX_CHANNELS)
+
+#define SOFTWARELOD_DECIMATION       4    /* Output frames per source read at the minimal tier */
+#define SOFTWARELOD_CROSSFADE_FRAMES 256  /* Output frames a tier change is blended over */
+#define SOFTWARELOD_HYSTERESIS       2.0f /* Level ratio (+6 dB) a voice must regain to go up a tier */
+
+/**
+ * @brief Rendering quality of a voice, lowered for the voices barely heard
+ */
+enum SOFTWARELOD_TIER
+{
+    SOFTWARELOD_FULL = 0, /* Linear interpolation, every channel */
+    SOFTWARELOD_REDUCED,  /* Nearest source frame, summed to mono */
+    SOFTWARELOD_MINIMAL,  /* As reduced, read every SOFTWARELOD_DECIMATION frames */
+    SOFTWARELOD_TIERS
+};
+
+/**
+ * @brief Mix cost per tier
+ */
+struct SoftwareLodStats
+{
+    int m_Voices[SOFTWARELOD_TIERS];  /* Voices rendered at each tier by the last mix */
+    int m_Fetches[SOFTWARELOD_TIERS]; /* Source samples they read */
+    int m_Crossfades;                 /* Voices blending two tiers in the last mix */
+    int m_Switches;                   /* Tier changes since the mixer was created */
+};
+
+/**
+ * @brief PCM storage shared between a voice and its duplicates
+ *
+ * Mirrors DirectSound's DuplicateSoundBuffer, where duplicates share the
+ * original buffer memory.
+ */
+struct SoftwareSample
+{
+    BYTE *m_Data;
+    CKDWORD m_Size;
+    int m_RefCount;
+    CKBOOL m_Mapped;  /* m_Data is read-only sound bank memory, not owned */
+};
+
+/**
+ * @brief A software-mixed sound source
+ *
+ * Holds the playback and 3D state that a DirectSound buffer would hold.
+ * The manager hands these out as the opaque source handles.
+ */
+struct SoftwareVoice
+{
+    CKDWORD m_Magic;
+    int m_MixerIndex; /* Slot in SoftwareMixer::m_Voices */
+
+    // Sample data
+    SoftwareSample *m_Sample;
+    WAVEFORMATEX m_Format;
+    int m_FrameCount;
+    CK_WAVESOUND_TYPE m_Type;
+    CKBOOL m_Streamed;
+    CKBOOL m_Duplicate; /* Drawn from the scene pool */
+
+    // Playback state
+    CKBOOL m_Playing;
+    CKBOOL m_Looping;
+    double m_Cursor;     /* Play position in source frames */
+    LONGLONG m_StartFrame; /* Mix frame a scheduled start waits for, 0 once started */
+    CKDWORD m_Frequency; /* Playback rate in Hz (pitch) */
+    float m_Gain;       /* Current gain, ramping towards m_GainTarget */
+    float m_GainTarget;
+    float m_GainStep;   /* Per output frame */
+    int m_RampFrames;   /* Output frames left in the ramp */
+    float m_Pan;
+    int m_Bus;        /* Reverb bus fed by this voice, -1 for none */
+    float m_SendLevel; /* Share of the voice output sent to the bus */
+    SoundEqualizer m_Eq;
+
+    // 3D state
+    VxVector m_Position;
+    VxVector m_Velocity;
+    VxVector m_ConeOrientation;
+    float m_InAngle;
+    float m_OutAngle;
+    float m_OutsideGain;
+    float m_MinDistance;
+    float m_MaxDistance;
+    CKBOOL m_HeadRelative;
+    float m_Audibility;  /* Distance and cone gain, from the last mix */
+
+    // Level of detail
+    int m_Lod;           /* SOFTWARELOD_TIER rendered */
+    int m_LodFrom;       /* Tier faded out while m_LodFade > 0 */
+    int m_LodFade;       /* Output frames left in the crossfade */
+};
+
+/**
+ * @brief Listener state used to spatialize 3D voices
+ */
+struct SoftwareListener
+{
+    VxVector m_Position;
+    VxVector m_Velocity;
+    VxVector m_Front;
+    VxVector m_Top;
+    float m_DistanceFactor;
+    float m_DopplerFactor;
+    float m_RollOff;
+    float m_GlobalGain;
+    SoundEqualizer m_Eq; /* Applied to the whole mix */
+};
+
+/**
+ * @brief A voice rendered and waiting for its equalization batch
+ */
+struct SoftwareMixerPending
+{
+    SoftwareVoice *m_Voice;
+    int m_Plane;    /* First scratch plane of the voice */
+    int m_Channels; /* Channels rendered */
+    float m_Gains[SOUNDOUTPUT_MAX_CHANNELS * SOUNDOUTPUT_MAX_CHANNELS];
+    float m_Sends[2 * SOUNDOUTPUT_MAX_CHANNELS];
+};
+
+/**
+ * @brief Float software mixer
+ *
+ * Resamples every playing voice to the output rate and applies gain, pan
+ * and the DirectSound 3D model (inverse distance rolloff, cones, doppler)
+ * through a matrix from the voice channels to the output speakers. 3D
+ * voices are panned at constant power between the two speakers around
+ * them, multichannel sources are folded to the output layout. Mixing
+ * happens in planar channels, interleaved into the float output at the
+ * end. Voices barely heard can be rendered at a cheaper tier, see
+ * SetLodLevels. Mixing only depends on the voice and listener state, never on
+ * wall-clock time, so rendering the same command sequence always produces
+ * the same samples.
+ */
+class SoftwareMixer
+{
+public:
+    SoftwareMixer();
+    ~SoftwareMixer();
+
+    void SetSampleRate(int sampleRate) { m_SampleRate = sampleRate; }
+    int GetSampleRate() const { return m_SampleRate; }
+    // Output layout, 1 to SOUNDOUTPUT_MAX_CHANNELS channels in the order of
+    // SoundGetChannelMask. Stereo keeps the DirectSound linear pan law.
+    CKBOOL SetChannels(int channels);
+    int GetChannels() const { return m_Channels; }
+
+    // Voices and samples come from the level arena, duplicates from the
+    // scene arena. Must be set before any voice is created.
+    void SetArenas(SoundArena *levelArena, SoundArena *sceneArena);
+
+    // Voice management
+    SoftwareVoice *CreateVoice(const WAVEFORMATEX &wf, CKDWORD bytes, CK_WAVESOUND_TYPE type, CKBOOL streamed);
+    // Plays the data in place; it must outlive the voice and its duplicates
+    SoftwareVoice *CreateMappedVoice(const WAVEFORMATEX &wf, const BYTE *data, CKDWORD bytes,
+                                     CK_WAVESOUND_TYPE type);
+    SoftwareVoice *DuplicateVoice(const SoftwareVoice *voice);
+    void DestroyVoice(SoftwareVoice *voice);
+    void DestroyAllVoices();
+    int GetVoiceCount() const { return m_Voices.Size(); }
+
+    // Starts the voice at an absolute mix frame (see GetMixedFrames). The
+    // voice counts as playing from now on; frames already mixed start it
+    // at the next Mix.
+    void ScheduleVoice(SoftwareVoice *voice, CKBOOL loop, LONGLONG frame);
+
+    // Ramps the gain of the voice linearly over the given output frames
+    // (0 to set it at once)
+    void SetVoiceGain(SoftwareVoice *voice, float gain, int rampFrames);
+
+    static CKBOOL IsVoice(const void *source)
+    {
+        return source && ((const SoftwareVoice *)source)->m_Magic == SOFTWAREVOICE_MAGIC;
+    }
+
+    SoftwareListener &GetListener() { return m_Listener; }
+
+    // Reverb buses. A bus processes the sum of its sends once per mix,
+    // whatever the number of voices sending to it. NULL settings remove it.
+    CKBOOL SetBus(int bus, const SoundReverbSettings *settings);
+    // Makes the bus a convolution with the impulse response (see
+    // SoundConvolver::SetImpulseResponse)
+    CKBOOL SetConvolutionBus(int bus, const float *ir, int frames, int channels, float gain);
+    CKBOOL IsBusActive(int bus) const
+    {
+        return bus >= 0 && bus < SOUNDREVERB_MAX_BUSES && m_Buses[bus] != NULL;
+    }
+
+    // Audio level of detail: voices heard below the reduced level (linear,
+    // after distance, cone and gains) render at SOFTWARELOD_REDUCED, below
+    // the minimal level at SOFTWARELOD_MINIMAL. A level of 0 disables the
+    // tier. Voices go back up only once SOFTWARELOD_HYSTERESIS times louder
+    // than the level, and every change is crossfaded.
+    void SetLodLevels(float reduced, float minimal);
+    float GetLodLevel(int tier) const { return (tier > 0 && tier < SOFTWARELOD_TIERS) ? m_LodLevels[tier - 1] : 0.0f; }
+    const SoftwareLodStats &GetLodStats() const { return m_LodStats; }
+
+    // Mixes the next frames into an interleaved output buffer of
+    // GetChannels() channels (overwritten)
+    void Mix(float *output, int frames);
+    LONGLONG GetMixedFrames() const { return m_MixedFrames; }
+
+private:
+    // Takes the sample, released on failure
+    SoftwareVoice *AddVoice(SoftwareSample *sample, const WAVEFORMATEX &wf, CK_WAVESOUND_TYPE type,
+                            CKBOOL streamed);
+    void ReleaseSample(SoftwareSample *sample);
+    void ReserveScratch(int frames);
+    float *GetPlane(int plane) const { return m_Scratch + plane * m_ScratchFrames; }
+    int RenderVoice(SoftwareVoice &voice, int plane, float *gains, float *sends, int start, int frames);
+    // Resamples the voice from the cursor at a tier into the planes and
+    // returns the frame a one-shot ran out at (frames if it did not)
+    int RenderTier(const SoftwareVoice &voice, int tier, float **planes, int channels,
+                   int start, int frames, double step, double &cursor);
+    void SelectLod(SoftwareVoice &voice);
+    // Advances a muted voice as RenderVoice would, without reading it
+    void SkipVoice(SoftwareVoice &voice, int start, int frames);
+    void SpatializeVoice(const SoftwareVoice &voice, int plane, int channels,
+                         const float *gains, const float *sends, int frames);
+    void FlushEqualized(int frames);
+    void EqualizePlanes(int plane, const SoundBiquadLane *lanes, int count, int frames);
+    // Distance and cone gains of every playing 3D voice, in one batch
+    void ComputeAudibility();
+    void ComputeVoiceGains(const SoftwareVoice &voice, float &gain, float &pan, float &azimuth, float &pitch) const;
+    float FetchSample(const SoftwareVoice &voice, int frame, int channel) const;
+    // Source frame at a position, channels averaged, 0 past a one-shot
+    float FetchNearest(const SoftwareVoice &voice, double position) const;
+
+    SoundPool m_VoicePool;
+    SoundPool m_DuplicatePool;
+    SoundPool m_SamplePool;
+    SoundArena *m_DataArena; /* Sample data, NULL for the heap */
+    XArray<SoftwareVoice *> m_Voices;
+    SoftwareListener m_Listener;
+    SoundAttenuationBatch m_Attenuation;
+    XArray<SoftwareVoice *> m_Spatialized; /* Voices of m_Attenuation */
+    float m_LodLevels[SOFTWARELOD_TIERS - 1];
+    SoftwareLodStats m_LodStats;
+    SoundBusEffect *m_Buses[SOUNDREVERB_MAX_BUSES];
+    CKBOOL m_Sending;      /* A bus is active in the current mix */
+    float *m_Scratch;      /* SOFTWAREMIXER_SCRATCH_PLANES planes */
+    int m_ScratchFrames;   /* Frames per plane */
+    float *m_EqBuffer;     /* SOUNDBIQUAD_LANES interleaved planes */
+    float *m_BusBuffer;    /* Interleaved stereo input and output of a bus */
+    SoftwareMixerPending m_Pending[SOUNDBIQUAD_LANES];
+    int m_PendingCount;
+    int m_PendingPlanes;
+    int m_Channels;
+    int m_SampleRate;
+    LONGLONG m_MixedFrames;
+
+    // Prevent copying (VC6 style - declare but don't implement)
+    SoftwareMixer(const SoftwareMixer &);
+    SoftwareMixer &operator=(const SoftwareMixer &);
+};
+
+#endif /* SOFTWAREMIXER_H */
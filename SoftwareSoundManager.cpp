@@ -0,0 +1,1035 @@
+#include "SoftwareSoundManager.h"
+
+#include <windows.h>
+#include <stdlib.h>
+
+#include "CKAll.h"
+
+// Factory function
+CKERROR CreateSoftwareSoundManager(CKContext *context)
+{
+    if (!context)
+        return CKERR_INVALIDPARAMETER;
+
+    SoftwareSoundManager *manager = new SoftwareSoundManager(context);
+    if (!manager)
+        return CKERR_OUTOFMEMORY;
+
+    return CK_OK;
+}
+
+static LONGLONG ReadPerformanceCounter()
+{
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return counter.QuadPart;
+}
+
+static int ReadEnvironmentInt(const char *name, int defaultValue)
+{
+    const char *value = getenv(name);
+    int result;
+
+    if (!value || !*value)
+        return defaultValue;
+
+    result = atoi(value);
+    return (result > 0) ? result : defaultValue;
+}
+
+//-----------------------------------------------------------------------------
+// Constructor/Destructor
+//-----------------------------------------------------------------------------
+
+SoftwareSoundManager::SoftwareSoundManager(CKContext *Context) : DXSoundManager(Context)
+{
+    m_Block = NULL;
+    m_BlockFrames = 0;
+    m_PendingFrames = 0.0;
+    m_RenderTicks = 0;
+    m_GainRampFrames = 0;
+    m_bInitialized = FALSE;
+    m_Mixer.SetArenas(&m_LevelArena, &m_SceneArena);
+    SoundOutputFormatInit(m_OutputFormat, SOFTWARE_DEFAULT_SAMPLE_RATE, SOFTWAREMIXER_DEFAULT_CHANNELS, 32);
+    m_OutputFormat.m_Float = TRUE;
+    SoundOutputFormatFromEnvironment(m_OutputFormat);
+
+    m_Context->RegisterNewManager(this);
+}
+
+SoftwareSoundManager::~SoftwareSoundManager()
+{
+    EndOfflineRender();
+}
+
+//-----------------------------------------------------------------------------
+// Capability and Status Methods
+//-----------------------------------------------------------------------------
+
+CK_SOUNDMANAGER_CAPS SoftwareSoundManager::GetCaps()
+{
+    CKDWORD caps = CK_WAVESOUND_SETTINGS_ALL |
+                   CK_WAVESOUND_3DSETTINGS_ALL |
+                   CK_LISTENERSETTINGS_ALL |
+                   CK_WAVESOUND_3DSETTINGS_DISTANCEFACTOR |
+                   CK_WAVESOUND_3DSETTINGS_DOPPLERFACTOR |
+                   CK_SOUNDMANAGER_ONFLYTYPE;
+
+    // Remove unsupported features
+    caps &= ~(CK_WAVESOUND_SETTINGS_PRIORITY |
+              CK_LISTENERSETTINGS_PRIORITY);
+
+    return (CK_SOUNDMANAGER_CAPS)caps;
+}
+
+CKBOOL SoftwareSoundManager::IsInitialized()
+{
+    return m_bInitialized;
+}
+
+SoftwareVoice *SoftwareSoundManager::GetVoice(void *source) const
+{
+    return SoftwareMixer::IsVoice(source) ? (SoftwareVoice *)source : NULL;
+}
+
+float SoftwareSoundManager::GetAudibility(void *source) const
+{
+    SoftwareVoice *voice = GetVoice(source);
+
+    if (!voice || voice->m_Type == CK_WAVESOUND_BACKGROUND)
+        return 1.0f;
+    return voice->m_Audibility;
+}
+
+int SoftwareSoundManager::GetLod(void *source) const
+{
+    SoftwareVoice *voice = GetVoice(source);
+
+    return voice ? voice->m_Lod : SOFTWARELOD_FULL;
+}
+
+//-----------------------------------------------------------------------------
+// Source Creation and Management
+//-----------------------------------------------------------------------------
+
+void *SoftwareSoundManager::CreateSource(CK_WAVESOUND_TYPE type, CKWaveFormat *wf, CKDWORD bytes, CKBOOL streamed)
+{
+    if (!wf || bytes == 0)
+        return NULL;
+
+    if (m_Context->GetStartOptions() & CK_CONFIG_DISABLEDSOUND)
+    {
+        if (m_Context->IsInInterfaceMode())
+        {
+            m_Context->OutputToConsole("Cannot create sound: Sound disabled");
+        }
+        return NULL;
+    }
+
+    SoftwareVoice *voice = m_Mixer.CreateVoice(*(WAVEFORMATEX *)wf, bytes, type, streamed);
+
+    if (m_CommandLog && voice)
+        m_CommandLog->RecordCreateSource(voice, type, wf, bytes, streamed);
+
+    return voice;
+}
+
+void *SoftwareSoundManager::DuplicateSource(void *source)
+{
+    SoftwareVoice *voice;
+    LONGLONG stamp;
+
+    if (!GetVoice(source))
+        return NULL;
+
+    stamp = m_LatencyProbe.Stamp();
+    if (!AdmitInstance(source))
+        return NULL;
+
+    voice = (SoftwareVoice *)TakePrimedSource(source);
+    if (!voice)
+        voice = m_Mixer.DuplicateVoice(GetVoice(source));
+    TrackInstance(source, voice);
+    m_LatencyProbe.Trigger(voice, stamp);
+
+    if (m_CommandLog && voice)
+        m_CommandLog->RecordDuplicateSource(source, voice);
+
+    return voice;
+}
+
+void SoftwareSoundManager::ReleaseSource(void *source)
+{
+    SoftwareVoice *voice = GetVoice(source);
+
+    if (m_CommandLog && voice)
+        m_CommandLog->RecordReleaseSource(voice);
+
+    ForgetSource(source);
+    m_Mixer.DestroyVoice(voice);
+}
+
+void *SoftwareSoundManager::PrimeSource(void *asset)
+{
+    return m_Mixer.DuplicateVoice(GetVoice(asset));
+}
+
+void SoftwareSoundManager::UnprimeSource(void *source)
+{
+    m_Mixer.DestroyVoice(GetVoice(source));
+}
+
+void *SoftwareSoundManager::CreateMappedSource(CK_WAVESOUND_TYPE type, CKWaveFormat &wf, const BYTE *data,
+                                               CKDWORD size)
+{
+    SoftwareVoice *voice = m_Mixer.CreateMappedVoice(wf, data, size, type);
+
+    if (m_CommandLog && voice)
+        m_CommandLog->RecordCreateSource(voice, type, &wf, size, FALSE);
+
+    return voice;
+}
+
+void SoftwareSoundManager::SetSourceGain(void *source, float gain)
+{
+    SoftwareVoice *voice = GetVoice(source);
+
+    if (voice)
+        m_Mixer.SetVoiceGain(voice, DbToFloat(FloatToDb(gain)), m_GainRampFrames);
+}
+
+//-----------------------------------------------------------------------------
+// Playback Control
+//-----------------------------------------------------------------------------
+
+void SoftwareSoundManager::InternalPause(void *source)
+{
+    SoftwareVoice *voice = GetVoice(source);
+    if (voice)
+    {
+        voice->m_Playing = FALSE;
+        voice->m_StartFrame = 0;
+    }
+}
+
+void SoftwareSoundManager::InternalPlay(void *source, CKBOOL loop)
+{
+    SoftwareVoice *voice = GetVoice(source);
+    if (voice)
+    {
+        voice->m_Looping = loop;
+        voice->m_Playing = TRUE;
+        voice->m_StartFrame = 0;
+    }
+}
+
+void SoftwareSoundManager::Play(CKWaveSound *ws, void *source, CKBOOL loop)
+{
+    SoftwareVoice *voice = NULL;
+    SoundMinion *minion;
+    LONGLONG stamp;
+    int position;
+
+    if (!source)
+        return;
+
+    if (ws)
+    {
+        // Normal sound
+        voice = GetVoice(source);
+        m_SoundsPlaying.Add(ws->GetID());
+    }
+    else
+    {
+        // Minion sound: accept both the minion and its source
+        voice = GetVoice(source);
+        if (!voice)
+        {
+            minion = (SoundMinion *)source;
+            voice = GetVoice(minion->m_Source);
+        }
+    }
+
+    if (voice)
+    {
+        if (m_CommandLog)
+            m_CommandLog->RecordPlay(ws, voice, loop);
+
+        stamp = m_LatencyProbe.Stamp();
+        position = stamp ? GetPlayPosition(voice) : 0;
+        InternalPlay(voice, loop);
+        m_LatencyProbe.Arm(voice, stamp, position);
+    }
+}
+
+CKERROR SoftwareSoundManager::PlayAt(CKWaveSound *ws, void *source, CKBOOL loop, double time)
+{
+    SoftwareVoice *voice;
+    SoundMinion *minion;
+    double clock;
+
+    if (!source)
+        return CKERR_INVALIDPARAMETER;
+
+    // Minions are accepted as in Play
+    voice = GetVoice(source);
+    if (!voice && !ws)
+    {
+        minion = (SoundMinion *)source;
+        voice = GetVoice(minion->m_Source);
+    }
+    if (!voice)
+        return CKERR_INVALIDPARAMETER;
+
+    if (ws)
+        m_SoundsPlaying.Add(ws->GetID());
+
+    clock = GetAudioClock();
+    if (m_CommandLog)
+        m_CommandLog->RecordPlayAt(ws, voice, loop, (float)(time - clock));
+
+    /* The mixer counts frames: rounding keeps equal times on one frame */
+    m_Mixer.ScheduleVoice(voice, loop, (LONGLONG)(time * m_Mixer.GetSampleRate() + 0.5));
+    return CK_OK;
+}
+
+double SoftwareSoundManager::GetAudioClock()
+{
+    if (m_Mixer.GetSampleRate() <= 0)
+        return 0.0;
+    return (double)m_Mixer.GetMixedFrames() / m_Mixer.GetSampleRate();
+}
+
+void SoftwareSoundManager::Pause(CKWaveSound *ws, void *source)
+{
+    if (m_CommandLog && GetVoice(source))
+        m_CommandLog->RecordPause(ws, source);
+
+    InternalPause(source);
+}
+
+void SoftwareSoundManager::SetPlayPosition(void *source, int pos)
+{
+    SoftwareVoice *voice = GetVoice(source);
+
+    if (!voice || pos < 0)
+        return;
+
+    if (m_CommandLog)
+        m_CommandLog->RecordSetPlayPosition(voice, pos);
+
+    voice->m_Cursor = (double)(pos / voice->m_Format.nBlockAlign);
+    if (voice->m_Cursor >= voice->m_FrameCount)
+        voice->m_Cursor = 0.0;
+}
+
+int SoftwareSoundManager::GetPlayPosition(void *source)
+{
+    SoftwareVoice *voice = GetVoice(source);
+
+    if (!voice)
+        return 0;
+
+    return (int)voice->m_Cursor * voice->m_Format.nBlockAlign;
+}
+
+CKBOOL SoftwareSoundManager::IsPlaying(void *source)
+{
+    SoftwareVoice *voice = GetVoice(source);
+    return voice ? voice->m_Playing : FALSE;
+}
+
+//-----------------------------------------------------------------------------
+// PCM Buffer Information
+//-----------------------------------------------------------------------------
+
+CKERROR SoftwareSoundManager::SetWaveFormat(void *source, CKWaveFormat &wf)
+{
+    SoftwareVoice *voice = GetVoice(source);
+    WAVEFORMATEX *format = (WAVEFORMATEX *)&wf;
+
+    if (!voice || format->nBlockAlign == 0)
+        return CKERR_INVALIDPARAMETER;
+
+    voice->m_Format = *format;
+    voice->m_Format.wFormatTag = SoundGetFormatTag(*format);
+    voice->m_Format.cbSize = 0;
+    voice->m_FrameCount = (int)(voice->m_Sample->m_Size / format->nBlockAlign);
+    voice->m_Frequency = format->nSamplesPerSec;
+    voice->m_Cursor = 0.0;
+    return CK_OK;
+}
+
+CKERROR SoftwareSoundManager::GetWaveFormat(void *source, CKWaveFormat &wf)
+{
+    SoftwareVoice *voice = GetVoice(source);
+
+    if (!voice)
+        return CKERR_INVALIDPARAMETER;
+
+    memcpy(&wf, &voice->m_Format, sizeof(WAVEFORMATEX));
+    return CK_OK;
+}
+
+int SoftwareSoundManager::GetWaveSize(void *source)
+{
+    SoftwareVoice *voice = GetVoice(source);
+    return voice ? (int)voice->m_Sample->m_Size : 0;
+}
+
+//-----------------------------------------------------------------------------
+// Buffer Access
+//-----------------------------------------------------------------------------
+
+CKERROR SoftwareSoundManager::Lock(void *source, CKDWORD dwWriteCursor, CKDWORD dwNumBytes,
+                                   void **pvAudioPtr1, CKDWORD *dwAudioBytes1,
+                                   void **pvAudioPtr2, CKDWORD *dwAudioBytes2,
+                                   CK_WAVESOUND_LOCKMODE dwFlags)
+{
+    SoftwareVoice *voice = GetVoice(source);
+    CKDWORD size, start;
+
+    if (!voice || !pvAudioPtr1 || !dwAudioBytes1)
+        return CKERR_INVALIDPARAMETER;
+
+    // Bank samples are played in place from read-only pages
+    if (voice->m_Sample->m_Mapped)
+        return CKERR_INVALIDOPERATION;
+
+    size = voice->m_Sample->m_Size;
+    if (pvAudioPtr2)
+        *pvAudioPtr2 = NULL;
+    if (dwAudioBytes2)
+        *dwAudioBytes2 = 0;
+
+    if ((dwFlags & CK_WAVESOUND_LOCKENTIREBUFFER) || dwNumBytes >= size)
+    {
+        *pvAudioPtr1 = voice->m_Sample->m_Data;
+        *dwAudioBytes1 = size;
+        return CK_OK;
+    }
+
+    start = (dwFlags & CK_WAVESOUND_LOCKFROMWRITE) ? (CKDWORD)GetPlayPosition(voice) : dwWriteCursor;
+    if (start >= size)
+        return CKERR_INVALIDPARAMETER;
+
+    // Wrap into a second segment like a DirectSound circular buffer
+    *pvAudioPtr1 = voice->m_Sample->m_Data + start;
+    if (start + dwNumBytes <= size)
+    {
+        *dwAudioBytes1 = dwNumBytes;
+    }
+    else
+    {
+        *dwAudioBytes1 = size - start;
+        if (!pvAudioPtr2 || !dwAudioBytes2)
+            return CK_OK;
+        *pvAudioPtr2 = voice->m_Sample->m_Data;
+        *dwAudioBytes2 = dwNumBytes - *dwAudioBytes1;
+    }
+    return CK_OK;
+}
+
+CKERROR SoftwareSoundManager::Unlock(void *source, void * /* pvAudioPtr1 */, CKDWORD /* dwNumBytes1 */,
+                                     void * /* pvAudioPtr2 */, CKDWORD /* dwAudioBytes2 */)
+{
+    // Voices are mixed straight from their sample memory
+    return GetVoice(source) ? CK_OK : CKERR_INVALIDPARAMETER;
+}
+
+//-----------------------------------------------------------------------------
+// Type Management
+//-----------------------------------------------------------------------------
+
+void SoftwareSoundManager::SetType(void *source, CK_WAVESOUND_TYPE type)
+{
+    SoftwareVoice *voice = GetVoice(source);
+    if (voice)
+    {
+        voice->m_Type = type;
+    }
+}
+
+CK_WAVESOUND_TYPE SoftwareSoundManager::GetType(void *source)
+{
+    SoftwareVoice *voice = GetVoice(source);
+    return voice ? voice->m_Type : CK_WAVESOUND_BACKGROUND;
+}
+
+//-----------------------------------------------------------------------------
+// Settings Management
+//-----------------------------------------------------------------------------
+
+void SoftwareSoundManager::UpdateSettings(void *source, CK_SOUNDMANAGER_CAPS settingsoptions,
+                                          CKWaveSoundSettings &settings, CKBOOL set)
+{
+    SoftwareVoice *voice = GetVoice(source);
+    CKWaveSoundSettings heard;
+    SoundBusMember *member;
+    float gain;
+
+    if (!voice)
+        return;
+
+    // The steps of a CKWaveSound fade are sent by the fade scheduler
+    if (set && m_FadeStepSource)
+    {
+        settingsoptions = TakeFadeStep(voice, settingsoptions, settings.m_Gain);
+        if (!settingsoptions)
+            return;
+    }
+
+    gain = settings.m_Gain;
+    if (set && (settingsoptions & CK_WAVESOUND_SETTINGS_GAIN))
+        gain = FilterSourceGain(voice, settings.m_Gain);
+
+    if (set && m_CommandLog)
+    {
+        heard = settings;
+        heard.m_Gain = gain;
+        m_CommandLog->RecordUpdateSettings(voice, settingsoptions, heard);
+    }
+
+    if (set)
+    {
+        if (settingsoptions & CK_WAVESOUND_SETTINGS_GAIN)
+        {
+            // Same range as the DirectSound volume, ramped over a frame so
+            // that fades stay smooth between the updates
+            m_Mixer.SetVoiceGain(voice, DbToFloat(FloatToDb(gain)), m_GainRampFrames);
+        }
+
+        if (settingsoptions & CK_WAVESOUND_SETTINGS_PITCH)
+        {
+            voice->m_Frequency = (CKDWORD)(voice->m_Format.nSamplesPerSec * settings.m_Pitch);
+        }
+
+        if (settingsoptions & CK_WAVESOUND_SETTINGS_EQUALIZATION)
+        {
+            SoundEqualizerSet(voice->m_Eq, settings.m_Eq);
+        }
+
+        if ((settingsoptions & CK_WAVESOUND_SETTINGS_PAN) &&
+            (voice->m_Type == CK_WAVESOUND_BACKGROUND))
+        {
+            voice->m_Pan = settings.m_Pan;
+            if (voice->m_Pan < -1.0f)
+                voice->m_Pan = -1.0f;
+            if (voice->m_Pan > 1.0f)
+                voice->m_Pan = 1.0f;
+        }
+    }
+    else
+    {
+        if (settingsoptions & CK_WAVESOUND_SETTINGS_GAIN)
+        {
+            member = m_GainBuses.Find(voice);
+            settings.m_Gain = member ? member->m_Gain : voice->m_GainTarget;
+        }
+
+        if (settingsoptions & CK_WAVESOUND_SETTINGS_PITCH)
+        {
+            settings.m_Pitch = (float)voice->m_Frequency / voice->m_Format.nSamplesPerSec;
+        }
+
+        if (settingsoptions & CK_WAVESOUND_SETTINGS_EQUALIZATION)
+        {
+            settings.m_Eq = voice->m_Eq.m_Setting;
+        }
+
+        if (settingsoptions & CK_WAVESOUND_SETTINGS_PAN)
+        {
+            settings.m_Pan = voice->m_Pan;
+        }
+    }
+}
+
+void SoftwareSoundManager::Update3DSettings(void *source, CK_SOUNDMANAGER_CAPS settingsoptions,
+                                            CKWaveSound3DSettings &settings, CKBOOL set)
+{
+    SoftwareVoice *voice = GetVoice(source);
+
+    if (!voice)
+        return;
+
+    if (set && m_CommandLog)
+        m_CommandLog->RecordUpdate3DSettings(voice, settingsoptions, settings);
+
+    if (set)
+    {
+        if (settingsoptions & CK_WAVESOUND_3DSETTINGS_CONE)
+        {
+            voice->m_InAngle = settings.m_InAngle;
+            voice->m_OutAngle = settings.m_OutAngle;
+            voice->m_OutsideGain = DbToFloat(FloatToDb(settings.m_OutsideGain));
+        }
+
+        if (settingsoptions & CK_WAVESOUND_3DSETTINGS_MINMAXDISTANCE)
+        {
+            voice->m_MinDistance = settings.m_MinDistance;
+            voice->m_MaxDistance = settings.m_MaxDistance;
+        }
+
+        if (settingsoptions & CK_WAVESOUND_3DSETTINGS_POSITION)
+        {
+            voice->m_Position = settings.m_Position;
+        }
+
+        if (settingsoptions & CK_WAVESOUND_3DSETTINGS_VELOCITY)
+        {
+            voice->m_Velocity = settings.m_Velocity;
+        }
+
+        if (settingsoptions & CK_WAVESOUND_3DSETTINGS_ORIENTATION)
+        {
+            voice->m_ConeOrientation = settings.m_OrientationDir;
+        }
+
+        if (settingsoptions & CK_WAVESOUND_3DSETTINGS_HEADRELATIVE)
+        {
+            voice->m_HeadRelative = settings.m_HeadRelative ? TRUE : FALSE;
+        }
+    }
+    else
+    {
+        if (settingsoptions & CK_WAVESOUND_3DSETTINGS_CONE)
+        {
+            settings.m_InAngle = voice->m_InAngle;
+            settings.m_OutAngle = voice->m_OutAngle;
+            settings.m_OutsideGain = voice->m_OutsideGain;
+        }
+
+        if (settingsoptions & CK_WAVESOUND_3DSETTINGS_MINMAXDISTANCE)
+        {
+            settings.m_MinDistance = voice->m_MinDistance;
+            settings.m_MaxDistance = voice->m_MaxDistance;
+        }
+
+        if (settingsoptions & CK_WAVESOUND_3DSETTINGS_HEADRELATIVE)
+        {
+            settings.m_HeadRelative = voice->m_HeadRelative ? 1 : 0;
+        }
+
+        if (settingsoptions & CK_WAVESOUND_3DSETTINGS_POSITION)
+        {
+            settings.m_Position = voice->m_Position;
+        }
+
+        if (settingsoptions & CK_WAVESOUND_3DSETTINGS_VELOCITY)
+        {
+            settings.m_Velocity = voice->m_Velocity;
+        }
+
+        if (settingsoptions & CK_WAVESOUND_3DSETTINGS_ORIENTATION)
+        {
+            settings.m_OrientationDir = voice->m_ConeOrientation;
+        }
+    }
+}
+
+void SoftwareSoundManager::UpdateListenerSettings(CK_SOUNDMANAGER_CAPS settingsoptions,
+                                                  CKListenerSettings &settings, CKBOOL set)
+{
+    SoftwareListener &listener = m_Mixer.GetListener();
+
+    if (set && m_CommandLog)
+        m_CommandLog->RecordUpdateListenerSettings(settingsoptions, settings);
+
+    if (set)
+    {
+        if (settingsoptions & CK_LISTENERSETTINGS_DISTANCE)
+        {
+            listener.m_DistanceFactor = settings.m_DistanceFactor;
+        }
+        if (settingsoptions & CK_LISTENERSETTINGS_DOPPLER)
+        {
+            listener.m_DopplerFactor = settings.m_DopplerFactor;
+        }
+        if (settingsoptions & CK_LISTENERSETTINGS_ROLLOFF)
+        {
+            listener.m_RollOff = settings.m_RollOff;
+        }
+        if (settingsoptions & CK_LISTENERSETTINGS_GAIN)
+        {
+            listener.m_GlobalGain = DbToFloat(FloatToDb(settings.m_GlobalGain));
+        }
+        if (settingsoptions & CK_LISTENERSETTINGS_EQ)
+        {
+            SoundEqualizerSet(listener.m_Eq, settings.m_GlobalEq);
+        }
+    }
+    else
+    {
+        if (settingsoptions & CK_LISTENERSETTINGS_DISTANCE)
+        {
+            settings.m_DistanceFactor = listener.m_DistanceFactor;
+        }
+        if (settingsoptions & CK_LISTENERSETTINGS_DOPPLER)
+        {
+            settings.m_DopplerFactor = listener.m_DopplerFactor;
+        }
+        if (settingsoptions & CK_LISTENERSETTINGS_ROLLOFF)
+        {
+            settings.m_RollOff = listener.m_RollOff;
+        }
+        if (settingsoptions & CK_LISTENERSETTINGS_GAIN)
+        {
+            settings.m_GlobalGain = listener.m_GlobalGain;
+        }
+        if (settingsoptions & CK_LISTENERSETTINGS_EQ)
+        {
+            settings.m_GlobalEq = listener.m_Eq.m_Setting;
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Offline Rendering
+//-----------------------------------------------------------------------------
+
+CKERROR SoftwareSoundManager::BeginOfflineRender(const char *path, int blockFrames)
+{
+    EndOfflineRender();
+
+    if (blockFrames <= 0)
+        blockFrames = SOFTWARE_DEFAULT_BLOCK_FRAMES;
+
+    if (!m_Writer.Open(path, m_Mixer.GetSampleRate(), m_Mixer.GetChannels()))
+    {
+        if (m_Context->IsInInterfaceMode())
+        {
+            m_Context->OutputToConsole("Offline render: cannot open output file");
+        }
+        return CKERR_CANTWRITETOFILE;
+    }
+
+    m_BlockFrames = blockFrames;
+    m_Block = new float[m_BlockFrames * m_Mixer.GetChannels()];
+    m_PendingFrames = 0.0;
+    m_RenderTicks = 0;
+    return CK_OK;
+}
+
+CKERROR SoftwareSoundManager::RenderOffline(float seconds)
+{
+    LONGLONG start;
+    CKDWORD target;
+    float blockDelta;
+
+    if (!IsRenderingOffline())
+        return CKERR_NOTINITIALIZED;
+
+    blockDelta = 1000.0f * m_BlockFrames / m_Mixer.GetSampleRate();
+    target = m_Writer.GetWrittenFrames() + (CKDWORD)(seconds * m_Mixer.GetSampleRate());
+
+    while (m_Writer.GetWrittenFrames() < target)
+    {
+        start = ReadPerformanceCounter();
+        Step(blockDelta);
+        RenderBlock();
+        m_RenderTicks += ReadPerformanceCounter() - start;
+    }
+
+    return CK_OK;
+}
+
+void SoftwareSoundManager::EndOfflineRender()
+{
+    char msg[256];
+    float audioSeconds;
+
+    if (!IsRenderingOffline())
+        return;
+
+    audioSeconds = (float)m_Writer.GetWrittenFrames() / m_Mixer.GetSampleRate();
+    sprintf(msg, "Offline render: %.2f s of audio at %.2fx realtime",
+            audioSeconds, GetRealtimeFactor());
+    m_Context->OutputToConsole(msg, FALSE);
+
+    m_Writer.Close();
+    delete[] m_Block;
+    m_Block = NULL;
+}
+
+float SoftwareSoundManager::GetRealtimeFactor() const
+{
+    LARGE_INTEGER frequency;
+    double cpuSeconds, audioSeconds;
+
+    QueryPerformanceFrequency(&frequency);
+    if (m_RenderTicks <= 0 || frequency.QuadPart <= 0)
+        return 0.0f;
+
+    cpuSeconds = (double)m_RenderTicks / (double)frequency.QuadPart;
+    audioSeconds = (double)m_Writer.GetWrittenFrames() / m_Mixer.GetSampleRate();
+    return (float)(audioSeconds / cpuSeconds);
+}
+
+void SoftwareSoundManager::RenderBlock()
+{
+    m_Mixer.Mix(m_Block, m_BlockFrames);
+    m_Writer.Write(m_Block, m_BlockFrames);
+}
+
+//-----------------------------------------------------------------------------
+// Reverb Buses
+//-----------------------------------------------------------------------------
+
+CKERROR SoftwareSoundManager::SetReverbBus(int bus, const SoundReverbSettings *settings)
+{
+    if (bus < 0 || bus >= SOUNDREVERB_MAX_BUSES)
+        return CKERR_INVALIDPARAMETER;
+
+    if (!m_Mixer.SetBus(bus, settings))
+        return CKERR_OUTOFMEMORY;
+
+    return CK_OK;
+}
+
+CKERROR SoftwareSoundManager::SetConvolutionBus(int bus, const float *ir, int frames, int channels, float gain)
+{
+    if (bus < 0 || bus >= SOUNDREVERB_MAX_BUSES || !ir || frames <= 0 || channels < 1 || channels > 2)
+        return CKERR_INVALIDPARAMETER;
+
+    if (!m_Mixer.SetConvolutionBus(bus, ir, frames, channels, gain))
+        return CKERR_OUTOFMEMORY;
+
+    return CK_OK;
+}
+
+CKERROR SoftwareSoundManager::SetReverbSend(void *source, int bus, float level)
+{
+    SoftwareVoice *voice = GetVoice(source);
+
+    if (!voice || bus >= SOUNDREVERB_MAX_BUSES)
+        return CKERR_INVALIDPARAMETER;
+
+    if (level < 0.0f)
+        level = 0.0f;
+    if (level > 1.0f)
+        level = 1.0f;
+
+    voice->m_Bus = (bus < 0) ? -1 : bus;
+    voice->m_SendLevel = (bus < 0) ? 0.0f : level;
+    return CK_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Lifecycle Management
+//-----------------------------------------------------------------------------
+
+CKERROR SoftwareSoundManager::OnCKInit()
+{
+    int soundsCount, i;
+    CK_ID *soundIds;
+    CKWaveSound *ws;
+    const char *path;
+
+    if (m_Context->GetStartOptions() & CK_CONFIG_DISABLEDSOUND)
+    {
+        return CK_OK;
+    }
+
+    m_Mixer.SetSampleRate(ReadEnvironmentInt(SOFTWARE_ENV_OFFLINE_RATE, m_OutputFormat.m_SampleRate));
+    if (!m_Mixer.SetChannels(m_OutputFormat.m_Channels))
+        m_Mixer.SetChannels(SOFTWAREMIXER_DEFAULT_CHANNELS);
+
+    RegisterAttribute();
+
+    // Capture before recreating so the log knows every source
+    StartCommandLogFromEnvironment();
+
+    StartJobPoolFromEnvironment();
+    StartLatencyProbeFromEnvironment();
+
+    // Recreate existing sounds
+    soundsCount = m_Context->GetObjectsCountByClassID(CKCID_WAVESOUND);
+    if (soundsCount > 0)
+    {
+        soundIds = m_Context->GetObjectsListByClassID(CKCID_WAVESOUND);
+        for (i = 0; i < soundsCount; ++i)
+        {
+            ws = (CKWaveSound *)m_Context->GetObject(soundIds[i]);
+            if (ws)
+            {
+                ws->Recreate();
+            }
+        }
+    }
+
+    // Start the offline render requested by the environment
+    path = getenv(SOFTWARE_ENV_OFFLINE_RENDER);
+    if (path && *path)
+    {
+        BeginOfflineRender(path, ReadEnvironmentInt(SOFTWARE_ENV_OFFLINE_BLOCK, SOFTWARE_DEFAULT_BLOCK_FRAMES));
+    }
+
+    m_bInitialized = TRUE;
+    return CK_OK;
+}
+
+CKERROR SoftwareSoundManager::OnCKEnd()
+{
+    if (m_Context->GetStartOptions() & CK_CONFIG_DISABLEDSOUND)
+    {
+        return CK_OK;
+    }
+
+    EndOfflineRender();
+    StopLatencyProbe();
+    StopAllPlayingSounds();
+    ReleasePrimedVoices(TRUE);
+    m_Mixer.DestroyAllVoices();
+    StopCommandLog();
+    m_JobPool.Stop();
+
+    m_bInitialized = FALSE;
+    return CK_OK;
+}
+
+void SoftwareSoundManager::StopAllPlayingSounds()
+{
+    int soundsCount, i;
+    CK_ID *soundIds;
+    CKWaveSound *ws;
+
+    // Release existing sounds
+    soundsCount = m_Context->GetObjectsCountByClassID(CKCID_WAVESOUND);
+    if (soundsCount > 0)
+    {
+        soundIds = m_Context->GetObjectsListByClassID(CKCID_WAVESOUND);
+        for (i = 0; i < soundsCount; ++i)
+        {
+            ws = (CKWaveSound *)m_Context->GetObject(soundIds[i]);
+            if (ws)
+            {
+                ws->Release();
+            }
+        }
+    }
+}
+
+CKERROR SoftwareSoundManager::OnCKReset()
+{
+    CK_ID *it;
+    CKWaveSound *ws;
+
+    if (!m_bInitialized)
+        return CK_OK;
+
+    // Stop all playing sounds
+    for (it = m_SoundsPlaying.Begin(); it != m_SoundsPlaying.End(); ++it)
+    {
+        ws = (CKWaveSound *)m_Context->GetObject(*it);
+        if (ws && ws->m_Source)
+        {
+            ws->InternalStop();
+        }
+    }
+
+    m_SoundsPlaying.Clear();
+    ReleaseMinions();
+    m_MinionIndex.Clear();
+
+    // Restore the initial global gain
+    m_Mixer.GetListener().m_GlobalGain = 1.0f;
+
+    return CK_OK;
+}
+
+void SoftwareSoundManager::Step(float deltaTime)
+{
+    CKBOOL somethingIsPlayingIn3D;
+    SoundEmitterJob *job;
+    SoftwareVoice *voice;
+    CK3dEntity *listener;
+    const VxMatrix *mat;
+    const VxVector4 *pos, *dir, *up;
+    SoftwareListener &lst = m_Mixer.GetListener();
+    int i;
+
+    // Gain changes made during this step ramp until the next one
+    m_GainRampFrames = (int)(deltaTime * 0.001f * m_Mixer.GetSampleRate());
+    if (m_GainRampFrames < SOFTWARE_MIN_GAIN_RAMP)
+        m_GainRampFrames = SOFTWARE_MIN_GAIN_RAMP;
+    if (m_GainRampFrames > m_Mixer.GetSampleRate() / 10)
+        m_GainRampFrames = m_Mixer.GetSampleRate() / 10;
+
+    // Update playing sounds
+    somethingIsPlayingIn3D = UpdatePlayingSounds(deltaTime);
+
+    // Duplicate ahead of the next triggers of the primed sounds
+    if (m_PrimedVoices.GetPoolCount() > 0)
+        RefillPrimedVoices();
+
+    // Update minions: transforms on the job pool, then the voices in order
+    if (ComputeEmitters(1.0f))
+        somethingIsPlayingIn3D = TRUE;
+    CullEmitters();
+    ClusterEmitters();
+
+    for (i = 0; i < m_EmitterJobs.Size(); ++i)
+    {
+        job = &m_EmitterJobs[i];
+        voice = GetVoice(job->m_Minion->m_Source);
+        if (!voice || job->m_Folded || job->m_Deferred)
+            continue;
+
+        voice->m_Position = job->m_Position;
+        voice->m_Velocity = job->m_Velocity;
+        voice->m_ConeOrientation = job->m_Direction;
+    }
+
+    // Update listener if something is playing in 3D
+    if (somethingIsPlayingIn3D)
+    {
+        listener = GetListener();
+        if (listener)
+        {
+            mat = &listener->GetWorldMatrix();
+            pos = &(*mat)[3];
+            dir = &(*mat)[2];
+            up = &(*mat)[1];
+
+            lst.m_Position.Set(pos->x, pos->y, pos->z);
+            lst.m_Velocity = lst.m_Position - m_LastListenerPosition;
+            lst.m_Front.Set(dir->x, dir->y, dir->z);
+            lst.m_Top.Set(up->x, up->y, up->z);
+            m_LastListenerPosition = lst.m_Position;
+        }
+    }
+
+    // Process minions (cleanup finished ones)
+    ProcessMinions();
+}
+
+CKERROR SoftwareSoundManager::PostProcess()
+{
+    LONGLONG start;
+    float deltaTime;
+
+    if (!m_bInitialized)
+        return CK_OK;
+
+    start = ReadPerformanceCounter();
+    deltaTime = m_Context->GetTimeManager()->GetLastDeltaTime();
+
+    if (m_CommandLog)
+        m_CommandLog->RecordPostProcess(deltaTime);
+
+    Step(deltaTime);
+
+    // Render the composition time that elapsed, in whole blocks
+    if (IsRenderingOffline())
+    {
+        m_PendingFrames += deltaTime * 0.001 * m_Mixer.GetSampleRate();
+        while (m_PendingFrames >= m_BlockFrames)
+        {
+            RenderBlock();
+            m_PendingFrames -= m_BlockFrames;
+        }
+        m_RenderTicks += ReadPerformanceCounter() - start;
+    }
+
+    return CK_OK;
+}
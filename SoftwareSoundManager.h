@@ -0,0 +1,154 @@
+#ifndef SOFTWARESOUNDMANAGER_H
+#define SOFTWARESOUNDMANAGER_H
+
+#include "DxSoundManager.h"
+#include "SoftwareMixer.h"
+#include "WaveFileWriter.h"
+
+// Constants for the software backend
+#define SOFTWARE_DEFAULT_SAMPLE_RATE  48000
+#define SOFTWARE_DEFAULT_BLOCK_FRAMES 256
+#define SOFTWARE_MIN_GAIN_RAMP        64 /* Output frames a gain change is ramped over, at least */
+
+// Environment variables selecting and configuring the offline renderer
+#define SOFTWARE_ENV_OFFLINE_RENDER "DX8SOUND_OFFLINE_RENDER" /* Output WAV path */
+#define SOFTWARE_ENV_OFFLINE_RATE   "DX8SOUND_OFFLINE_RATE"   /* Sample rate in Hz */
+#define SOFTWARE_ENV_OFFLINE_BLOCK  "DX8SOUND_OFFLINE_BLOCK"  /* Block size in frames */
+
+/**
+ * @brief Sound manager mixing every source in software
+ *
+ * Implements the DXSoundManager interface without a sound device: sources
+ * are SoftwareVoice objects mixed by a SoftwareMixer. In offline mode the
+ * mix is rendered in fixed-size blocks and written to a WAV file, driven by
+ * the composition time rather than the wall clock, as fast as the CPU
+ * allows. The realtime factor (audio time rendered per second of CPU time
+ * spent in the manager) is reported when the render ends.
+ */
+class SoftwareSoundManager : public DXSoundManager
+{
+    friend class CKWaveSound;
+
+public:
+    // Constructor/Destructor
+    SoftwareSoundManager(CKContext *Context);
+    virtual ~SoftwareSoundManager();
+
+    // Get the caps of the sound manager
+    virtual CK_SOUNDMANAGER_CAPS GetCaps();
+
+    // Creation and management
+    virtual void *CreateSource(CK_WAVESOUND_TYPE flags, CKWaveFormat *wf, CKDWORD bytes, CKBOOL streamed);
+    virtual void *DuplicateSource(void *source);
+    virtual void ReleaseSource(void *source);
+
+    // Playback control
+    virtual void Play(CKWaveSound *ws, void *source, CKBOOL loop);
+    virtual void Pause(CKWaveSound *ws, void *source);
+    virtual void SetPlayPosition(void *source, int pos);
+    virtual int GetPlayPosition(void *source);
+    virtual CKBOOL IsPlaying(void *source);
+    // Sample accurate: the voice starts on its frame within a mix block
+    virtual CKERROR PlayAt(CKWaveSound *ws, void *source, CKBOOL loop, double time);
+    // Frames mixed so far
+    virtual double GetAudioClock();
+
+    // PCM Buffer Information
+    virtual CKERROR SetWaveFormat(void *source, CKWaveFormat &wf);
+    virtual CKERROR GetWaveFormat(void *source, CKWaveFormat &wf);
+    virtual int GetWaveSize(void *source);
+
+    // Buffer access
+    virtual CKERROR Lock(void *source, CKDWORD dwWriteCursor, CKDWORD dwNumBytes,
+                         void **pvAudioPtr1, CKDWORD *dwAudioBytes1,
+                         void **pvAudioPtr2, CKDWORD *dwAudioBytes2,
+                         CK_WAVESOUND_LOCKMODE dwFlags);
+    virtual CKERROR Unlock(void *source, void *pvAudioPtr1, CKDWORD dwNumBytes1,
+                           void *pvAudioPtr2, CKDWORD dwAudioBytes2);
+
+    // 2D/3D Members Functions
+    virtual void SetType(void *source, CK_WAVESOUND_TYPE type);
+    virtual CK_WAVESOUND_TYPE GetType(void *source);
+
+    // 2D/3D Settings
+    virtual void UpdateSettings(void *source, CK_SOUNDMANAGER_CAPS settingsoptions,
+                                CKWaveSoundSettings &settings, CKBOOL set /* = TRUE */);
+
+    // 3D Settings
+    virtual void Update3DSettings(void *source, CK_SOUNDMANAGER_CAPS settingsoptions,
+                                  CKWaveSound3DSettings &settings, CKBOOL set /* = TRUE */);
+
+    // Listener settings
+    virtual void UpdateListenerSettings(CK_SOUNDMANAGER_CAPS settingsoptions,
+                                        CKListenerSettings &settings, CKBOOL set /* = TRUE */);
+
+    // Lifecycle management
+    virtual CKERROR OnCKInit();
+    virtual CKERROR OnCKEnd();
+    virtual CKERROR OnCKReset();
+    virtual CKERROR PostProcess();
+
+    // Status
+    virtual CKBOOL IsInitialized();
+
+    // Offline rendering
+    CKERROR BeginOfflineRender(const char *path, int blockFrames);
+    // Steps the manager by whole blocks for the given duration (in seconds)
+    // without waiting for the composition. FadeGain ramps follow the steps,
+    // but CKWaveSound fades still read the time manager, so use it for
+    // tails rather than for content faded that way.
+    CKERROR RenderOffline(float seconds);
+    void EndOfflineRender();
+    CKBOOL IsRenderingOffline() const { return m_Writer.IsOpen(); }
+    float GetRealtimeFactor() const;
+
+    // Reverb buses
+    virtual CKERROR SetReverbBus(int bus, const SoundReverbSettings *settings);
+    virtual CKERROR SetConvolutionBus(int bus, const float *ir, int frames, int channels, float gain);
+    virtual CKERROR SetReverbSend(void *source, int bus, float level);
+
+    // Distance and cone gain of a 3D source as of the last mix, 1 for 2D
+    // ones: what the listener hears of it before the source gain
+    float GetAudibility(void *source) const;
+    // SOFTWARELOD_TIER a source was rendered at by the last mix
+    int GetLod(void *source) const;
+
+    SoftwareMixer &GetMixer() { return m_Mixer; }
+
+protected:
+    // Internal helper methods
+    void InternalPause(void *source);
+    void InternalPlay(void *source, CKBOOL loop /* = FALSE */);
+    void *PrimeSource(void *asset);
+    void UnprimeSource(void *source);
+    void SetSourceGain(void *source, float gain);
+    void *CreateMappedSource(CK_WAVESOUND_TYPE type, CKWaveFormat &wf, const BYTE *data, CKDWORD size);
+
+    SoftwareVoice *GetVoice(void *source) const;
+
+    // Per-frame update shared by PostProcess and RenderOffline
+    void Step(float deltaTime);
+    void RenderBlock();
+    void StopAllPlayingSounds();
+
+private:
+    SoftwareMixer m_Mixer;
+    WaveFileWriter m_Writer;
+
+    // Offline rendering state
+    float *m_Block;
+    int m_BlockFrames;
+    double m_PendingFrames; /* Composition time not rendered yet, in frames */
+    LONGLONG m_RenderTicks; /* Performance counter ticks spent rendering */
+    int m_GainRampFrames;   /* Ramp length of the gain changes, in output frames */
+
+    // Internal state
+    CKBOOL m_bInitialized;
+    VxVector m_LastListenerPosition;
+
+    // Prevent copy construction and assignment (VC6 style)
+    SoftwareSoundManager(const SoftwareSoundManager &);
+    SoftwareSoundManager &operator=(const SoftwareSoundManager &);
+};
+
+#endif // SOFTWARESOUNDMANAGER_H
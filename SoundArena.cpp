@@ -0,0 +1,254 @@
+#include "SoundArena.h"
+
+#include <stdlib.h>
+
+#define SOUNDARENA_CAPACITY    (SOUNDARENA_BLOCK_SIZE - SOUNDARENA_ALIGNMENT)
+
+//-----------------------------------------------------------------------------
+// SoundArena
+//-----------------------------------------------------------------------------
+
+SoundArena::SoundArena(const char *name)
+{
+    int i;
+
+    m_Name = name;
+    m_Blocks = NULL;
+    m_FreeBlocks = NULL;
+    for (i = 0; i < SOUNDARENA_CLASS_COUNT; ++i)
+        m_FreeChunks[i] = NULL;
+    m_BlockCount = 0;
+    m_UsedBytes = 0;
+    m_LargeBytes = 0;
+    m_HighWaterBytes = 0;
+    m_LiveCount = 0;
+    m_Generation = 0;
+}
+
+SoundArena::~SoundArena()
+{
+    Block *block;
+
+    while (m_Blocks)
+    {
+        block = m_Blocks;
+        m_Blocks = block->m_Next;
+        free(block);
+    }
+    while (m_FreeBlocks)
+    {
+        block = m_FreeBlocks;
+        m_FreeBlocks = block->m_Next;
+        free(block);
+    }
+}
+
+void *SoundArena::Allocate(CKDWORD size)
+{
+    Block *block;
+    FreeChunk *chunk;
+    void *ptr;
+    int sizeClass;
+
+    if (size == 0)
+        size = 1;
+
+    // Large allocations have their own lifetime on the heap
+    if (size > SOUNDARENA_LARGE_SIZE)
+    {
+        ptr = malloc(size);
+        if (!ptr)
+            return NULL;
+        m_LargeBytes += size;
+        ++m_LiveCount;
+        UpdateHighWater();
+        return ptr;
+    }
+
+    // Reuse an allocation of the same class freed earlier
+    sizeClass = GetSizeClass(size);
+    chunk = m_FreeChunks[sizeClass];
+    if (chunk)
+    {
+        m_FreeChunks[sizeClass] = chunk->m_Next;
+        m_UsedBytes += size;
+        ++m_LiveCount;
+        UpdateHighWater();
+        return chunk;
+    }
+
+    block = m_Blocks;
+    if (!block || block->m_Used + size > SOUNDARENA_CAPACITY)
+    {
+        // Take a block kept from a previous reset before asking the heap
+        if (m_FreeBlocks)
+        {
+            block = m_FreeBlocks;
+            m_FreeBlocks = block->m_Next;
+        }
+        else
+        {
+            block = (Block *)malloc(SOUNDARENA_BLOCK_SIZE);
+            if (!block)
+                return NULL;
+            ++m_BlockCount;
+        }
+        block->m_Used = 0;
+        block->m_Next = m_Blocks;
+        m_Blocks = block;
+    }
+
+    ptr = GetBlockData(block) + block->m_Used;
+    block->m_Used += size;
+    m_UsedBytes += size;
+    ++m_LiveCount;
+    UpdateHighWater();
+    return ptr;
+}
+
+void SoundArena::Free(void *ptr, CKDWORD size)
+{
+    FreeChunk *chunk;
+    int sizeClass;
+
+    if (!ptr)
+        return;
+
+    if (size == 0)
+        size = 1;
+
+    if (size > SOUNDARENA_LARGE_SIZE)
+    {
+        free(ptr);
+        m_LargeBytes -= size;
+    }
+    else
+    {
+        sizeClass = GetSizeClass(size);
+        chunk = (FreeChunk *)ptr;
+        chunk->m_Next = m_FreeChunks[sizeClass];
+        m_FreeChunks[sizeClass] = chunk;
+        m_UsedBytes -= size;
+    }
+
+    --m_LiveCount;
+}
+
+CKBOOL SoundArena::Reset()
+{
+    Block *block;
+    int i;
+
+    if (m_LiveCount > 0)
+        return FALSE;
+
+    // Keep the blocks for the next level or scene
+    while (m_Blocks)
+    {
+        block = m_Blocks;
+        m_Blocks = block->m_Next;
+        block->m_Next = m_FreeBlocks;
+        m_FreeBlocks = block;
+    }
+
+    // The free lists point into the blocks just reclaimed
+    for (i = 0; i < SOUNDARENA_CLASS_COUNT; ++i)
+        m_FreeChunks[i] = NULL;
+
+    m_UsedBytes = 0;
+    ++m_Generation;
+    return TRUE;
+}
+
+int SoundArena::GetSizeClass(CKDWORD &size)
+{
+    CKDWORD classSize = SOUNDARENA_ALIGNMENT;
+    int sizeClass = 0;
+
+    while (classSize < size)
+    {
+        classSize <<= 1;
+        ++sizeClass;
+    }
+    size = classSize;
+    return sizeClass;
+}
+
+void SoundArena::UpdateHighWater()
+{
+    if (m_UsedBytes + m_LargeBytes > m_HighWaterBytes)
+        m_HighWaterBytes = m_UsedBytes + m_LargeBytes;
+}
+
+//-----------------------------------------------------------------------------
+// SoundPool
+//-----------------------------------------------------------------------------
+
+SoundPool::SoundPool(CKDWORD objectSize)
+{
+    m_Arena = NULL;
+    m_ObjectSize = (objectSize < sizeof(FreeObject)) ? sizeof(FreeObject) : objectSize;
+    m_FreeList = NULL;
+}
+
+SoundPool::~SoundPool()
+{
+    // Arena objects go away with the arena
+    if (!m_Arena)
+    {
+        while (m_FreeList)
+        {
+            FreeObject *object = m_FreeList;
+            m_FreeList = object->m_Next;
+            free(object);
+        }
+    }
+}
+
+void SoundPool::SetArena(SoundArena *arena)
+{
+    if (!m_Arena)
+    {
+        while (m_FreeList)
+        {
+            FreeObject *object = m_FreeList;
+            m_FreeList = object->m_Next;
+            free(object);
+        }
+    }
+
+    m_Arena = arena;
+    m_FreeList = NULL;
+}
+
+void *SoundPool::Allocate()
+{
+    FreeObject *object;
+
+    // The arena recycles the objects through its size classes
+    if (m_Arena)
+        return m_Arena->Allocate(m_ObjectSize);
+
+    object = m_FreeList;
+    if (!object)
+        return malloc(m_ObjectSize);
+    m_FreeList = object->m_Next;
+    return object;
+}
+
+void SoundPool::Free(void *ptr)
+{
+    FreeObject *object = (FreeObject *)ptr;
+
+    if (!object)
+        return;
+
+    if (m_Arena)
+    {
+        m_Arena->Free(ptr, m_ObjectSize);
+        return;
+    }
+
+    object->m_Next = m_FreeList;
+    m_FreeList = object;
+}
@@ -0,0 +1,116 @@
+#ifndef SOUNDARENA_H
+#define SOUNDARENA_H
+
+#include "CKAll.h"
+
+#define SOUNDARENA_BLOCK_SIZE  (64 * 1024)
+#define SOUNDARENA_ALIGNMENT   16
+#define SOUNDARENA_LARGE_SIZE  (SOUNDARENA_BLOCK_SIZE / 4) /* Larger allocations bypass the blocks */
+#define SOUNDARENA_CLASS_COUNT 11 /* Powers of two from SOUNDARENA_ALIGNMENT to SOUNDARENA_LARGE_SIZE */
+
+/**
+ * @brief Bump allocator for audio bookkeeping with a bulk reset
+ *
+ * Small allocations are carved out of 64 KB blocks, rounded up to a power
+ * of two. A freed one goes to the free list of its size class and the next
+ * allocation of that class reuses it, so an arena that is never reset does
+ * not grow past its peak of live allocations. Free lists are not merged:
+ * memory freed in one class only serves another after Reset(), which
+ * reclaims everything at once. Blocks are kept for reuse afterwards, so a
+ * level or scene change does not touch the heap. Large allocations (PCM
+ * copies) go to the heap directly and are returned as soon as they are
+ * freed.
+ *
+ * Free() must still be called for every allocation: the arena counts live
+ * allocations and refuses to reset while any remains, rather than leaving
+ * dangling pointers behind.
+ */
+class SoundArena
+{
+public:
+    SoundArena(const char *name);
+    ~SoundArena();
+
+    void *Allocate(CKDWORD size);
+    void Free(void *ptr, CKDWORD size);
+
+    // Reclaims every allocation at once. Returns FALSE, keeping everything,
+    // while allocations are still live.
+    CKBOOL Reset();
+
+    const char *GetName() const { return m_Name; }
+    CKDWORD GetUsedBytes() const { return m_UsedBytes + m_LargeBytes; }
+    CKDWORD GetHighWaterBytes() const { return m_HighWaterBytes; }
+    CKDWORD GetReservedBytes() const { return m_BlockCount * SOUNDARENA_BLOCK_SIZE + m_LargeBytes; }
+    int GetLiveCount() const { return m_LiveCount; }
+    // Incremented by each successful Reset
+    CKDWORD GetGeneration() const { return m_Generation; }
+
+private:
+    struct Block
+    {
+        Block *m_Next;
+        CKDWORD m_Used;
+    };
+
+    struct FreeChunk
+    {
+        FreeChunk *m_Next;
+    };
+
+    BYTE *GetBlockData(Block *block) const { return (BYTE *)block + SOUNDARENA_ALIGNMENT; }
+    void UpdateHighWater();
+    // Size class of a small allocation, its size rounded up to the class
+    static int GetSizeClass(CKDWORD &size);
+
+    const char *m_Name;
+    Block *m_Blocks;     /* Blocks in use, current one first */
+    Block *m_FreeBlocks; /* Blocks kept across resets */
+    FreeChunk *m_FreeChunks[SOUNDARENA_CLASS_COUNT]; /* Freed small allocations */
+    int m_BlockCount;
+    CKDWORD m_UsedBytes;  /* Bytes of live small allocations */
+    CKDWORD m_LargeBytes; /* Bytes of live large allocations */
+    CKDWORD m_HighWaterBytes;
+    int m_LiveCount;
+    CKDWORD m_Generation;
+
+    // Prevent copying (VC6 style - declare but don't implement)
+    SoundArena(const SoundArena &);
+    SoundArena &operator=(const SoundArena &);
+};
+
+/**
+ * @brief Free list of fixed-size objects drawn from a SoundArena
+ *
+ * With an arena, freed objects are recycled through its size classes until
+ * it is reset. Without one, objects come from the heap and freed ones are
+ * kept on a free list of the pool.
+ */
+class SoundPool
+{
+public:
+    SoundPool(CKDWORD objectSize);
+    ~SoundPool();
+
+    void SetArena(SoundArena *arena);
+    SoundArena *GetArena() const { return m_Arena; }
+
+    void *Allocate();
+    void Free(void *ptr);
+
+private:
+    struct FreeObject
+    {
+        FreeObject *m_Next;
+    };
+
+    SoundArena *m_Arena;
+    CKDWORD m_ObjectSize;
+    FreeObject *m_FreeList; /* Without an arena only */
+
+    // Prevent copying (VC6 style - declare but don't implement)
+    SoundPool(const SoundPool &);
+    SoundPool &operator=(const SoundPool &);
+};
+
+#endif /* SOUNDARENA_H */
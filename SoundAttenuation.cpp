@@ -0,0 +1,212 @@
+#include "SoundAttenuation.h"
+
+#include <math.h>
+
+#include "SoundSimd.h"
+
+#define SOUNDATTEN_PI 3.14159265f
+#define SOUNDATTEN_RAD_TO_DEG 57.2957795f
+
+/* Abramowitz and Stegun 4.4.46: acos(x) = sqrt(1 - x) * P(x) on [0, 1] */
+static const float s_AcosCoefficients[8] =
+{
+    1.5707963050f, -0.2145988016f, 0.0889789874f, -0.0501743046f,
+    0.0308918810f, -0.0170881256f, 0.0066700901f, -0.0012624911f
+};
+
+/* Full cone angle, in degrees, of a half-angle cosine */
+static float ConeAngle(float c)
+{
+    float a = (c < 0.0f) ? -c : c;
+    float p, r;
+    int k;
+
+    p = s_AcosCoefficients[7];
+    for (k = 6; k >= 0; --k)
+        p = p * a + s_AcosCoefficients[k];
+    r = sqrtf(1.0f - a) * p;
+    if (c < 0.0f)
+        r = SOUNDATTEN_PI - r;
+    return 2.0f * r * SOUNDATTEN_RAD_TO_DEG;
+}
+
+#ifdef SOUNDSIMD_SSE
+static inline __m128 ConeAngle4(__m128 c)
+{
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 a = _mm_andnot_ps(sign, c);
+    __m128 p, r;
+    int k;
+
+    p = _mm_set1_ps(s_AcosCoefficients[7]);
+    for (k = 6; k >= 0; --k)
+        p = _mm_add_ps(_mm_mul_ps(p, a), _mm_set1_ps(s_AcosCoefficients[k]));
+    r = _mm_mul_ps(_mm_sqrt_ps(_mm_sub_ps(_mm_set1_ps(1.0f), a)), p);
+    r = SoundSimdSelect(_mm_cmplt_ps(c, _mm_setzero_ps()), _mm_sub_ps(_mm_set1_ps(SOUNDATTEN_PI), r), r);
+    return _mm_mul_ps(r, _mm_set1_ps(2.0f * SOUNDATTEN_RAD_TO_DEG));
+}
+#endif
+
+SoundAttenuationBatch::SoundAttenuationBatch()
+    : m_Count(0),
+      m_Stride(0)
+{
+}
+
+void SoundAttenuationBatch::Resize(int count)
+{
+    int stride, f, i;
+
+    if (count < 0)
+        count = 0;
+
+    stride = (count + 3) & ~3;
+    if (stride != m_Stride)
+    {
+        m_Data.Resize(stride * SOUNDATTEN_FIELDS);
+        m_Stride = stride;
+    }
+    m_Count = count;
+
+    /* Padding lanes go through the kernel too, keep them harmless */
+    for (f = 0; f < SOUNDATTEN_FIELDS; ++f)
+    {
+        for (i = count; i < stride; ++i)
+            m_Data[f * stride + i] = 0.0f;
+    }
+}
+
+void SoundAttenuationBatch::SetVoice(int index, const VxVector &relative, const VxVector &cone,
+                                     float minDistance, float maxDistance,
+                                     float insideAngle, float outsideAngle, float outsideGain)
+{
+    float *data = m_Data.Begin() + index;
+
+    data[SOUNDATTEN_X * m_Stride] = relative.x;
+    data[SOUNDATTEN_Y * m_Stride] = relative.y;
+    data[SOUNDATTEN_Z * m_Stride] = relative.z;
+    data[SOUNDATTEN_CONE_X * m_Stride] = cone.x;
+    data[SOUNDATTEN_CONE_Y * m_Stride] = cone.y;
+    data[SOUNDATTEN_CONE_Z * m_Stride] = cone.z;
+    data[SOUNDATTEN_MIN_DISTANCE * m_Stride] = minDistance;
+    data[SOUNDATTEN_MAX_DISTANCE * m_Stride] = maxDistance;
+    data[SOUNDATTEN_INSIDE_ANGLE * m_Stride] = insideAngle;
+    data[SOUNDATTEN_OUTSIDE_ANGLE * m_Stride] = outsideAngle;
+    data[SOUNDATTEN_OUTSIDE_GAIN * m_Stride] = outsideGain;
+}
+
+void SoundAttenuationBatch::Compute(float rollOff)
+{
+    int i = 0;
+
+#ifdef SOUNDSIMD_SSE
+    const float *x = GetField(SOUNDATTEN_X);
+    const float *y = GetField(SOUNDATTEN_Y);
+    const float *z = GetField(SOUNDATTEN_Z);
+    const float *cx = GetField(SOUNDATTEN_CONE_X);
+    const float *cy = GetField(SOUNDATTEN_CONE_Y);
+    const float *cz = GetField(SOUNDATTEN_CONE_Z);
+    const float *minDistance = GetField(SOUNDATTEN_MIN_DISTANCE);
+    const float *maxDistance = GetField(SOUNDATTEN_MAX_DISTANCE);
+    const float *insideAngle = GetField(SOUNDATTEN_INSIDE_ANGLE);
+    const float *outsideAngle = GetField(SOUNDATTEN_OUTSIDE_ANGLE);
+    const float *outsideGain = GetField(SOUNDATTEN_OUTSIDE_GAIN);
+    float *gain = GetField(SOUNDATTEN_GAIN);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 full = _mm_set1_ps(360.0f);
+    const __m128 r = _mm_set1_ps(rollOff);
+    __m128 px, py, pz, ox, oy, oz, dist, len, d, lo, hi, att, mask;
+    __m128 c, angle, in, out, og, cone, ramp;
+
+    /* The stride is a multiple of 4: the padding lanes are computed too */
+    for (; i < m_Count; i += 4)
+    {
+        px = _mm_loadu_ps(x + i);
+        py = _mm_loadu_ps(y + i);
+        pz = _mm_loadu_ps(z + i);
+        dist = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(px, px), _mm_mul_ps(py, py)), _mm_mul_ps(pz, pz)));
+
+        /* Distance rolloff, the masked lanes may divide by zero */
+        lo = _mm_loadu_ps(minDistance + i);
+        hi = _mm_loadu_ps(maxDistance + i);
+        d = _mm_min_ps(dist, hi);
+        att = _mm_div_ps(lo, _mm_add_ps(lo, _mm_mul_ps(r, _mm_sub_ps(d, lo))));
+        mask = _mm_and_ps(_mm_cmpgt_ps(d, lo), _mm_cmpgt_ps(lo, zero));
+        att = SoundSimdSelect(mask, att, one);
+
+        /* Cone */
+        ox = _mm_loadu_ps(cx + i);
+        oy = _mm_loadu_ps(cy + i);
+        oz = _mm_loadu_ps(cz + i);
+        len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ox, ox), _mm_mul_ps(oy, oy)), _mm_mul_ps(oz, oz)));
+        in = _mm_loadu_ps(insideAngle + i);
+        out = _mm_loadu_ps(outsideAngle + i);
+        og = _mm_loadu_ps(outsideGain + i);
+
+        c = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, ox), _mm_mul_ps(py, oy)), _mm_mul_ps(pz, oz));
+        c = _mm_div_ps(_mm_sub_ps(zero, c), _mm_mul_ps(len, dist));
+        c = _mm_max_ps(_mm_min_ps(c, one), _mm_set1_ps(-1.0f));
+        angle = ConeAngle4(c);
+
+        ramp = _mm_add_ps(one, _mm_div_ps(_mm_mul_ps(_mm_sub_ps(og, one), _mm_sub_ps(angle, in)), _mm_sub_ps(out, in)));
+        cone = SoundSimdSelect(_mm_and_ps(_mm_cmpgt_ps(angle, in), _mm_cmpgt_ps(out, in)), ramp, one);
+        cone = SoundSimdSelect(_mm_cmpge_ps(angle, out), og, cone);
+
+        mask = _mm_and_ps(_mm_cmplt_ps(out, full), _mm_and_ps(_mm_cmpgt_ps(len, zero), _mm_cmpgt_ps(dist, zero)));
+        cone = SoundSimdSelect(mask, cone, one);
+
+        _mm_storeu_ps(gain + i, _mm_mul_ps(att, cone));
+    }
+#endif
+
+    ComputeScalar(i, m_Count, rollOff);
+}
+
+void SoundAttenuationBatch::ComputeScalar(int begin, int end, float rollOff)
+{
+    const float *x = GetField(SOUNDATTEN_X);
+    const float *y = GetField(SOUNDATTEN_Y);
+    const float *z = GetField(SOUNDATTEN_Z);
+    const float *cx = GetField(SOUNDATTEN_CONE_X);
+    const float *cy = GetField(SOUNDATTEN_CONE_Y);
+    const float *cz = GetField(SOUNDATTEN_CONE_Z);
+    const float *minDistance = GetField(SOUNDATTEN_MIN_DISTANCE);
+    const float *maxDistance = GetField(SOUNDATTEN_MAX_DISTANCE);
+    const float *insideAngle = GetField(SOUNDATTEN_INSIDE_ANGLE);
+    const float *outsideAngle = GetField(SOUNDATTEN_OUTSIDE_ANGLE);
+    const float *outsideGain = GetField(SOUNDATTEN_OUTSIDE_GAIN);
+    float *gain = GetField(SOUNDATTEN_GAIN);
+    float dist, d, att, len, c, angle, in, out, cone;
+    int i;
+
+    for (i = begin; i < end; ++i)
+    {
+        dist = sqrtf(x[i] * x[i] + y[i] * y[i] + z[i] * z[i]);
+
+        d = (dist < maxDistance[i]) ? dist : maxDistance[i];
+        att = 1.0f;
+        if (d > minDistance[i] && minDistance[i] > 0.0f)
+            att = minDistance[i] / (minDistance[i] + rollOff * (d - minDistance[i]));
+
+        cone = 1.0f;
+        len = sqrtf(cx[i] * cx[i] + cy[i] * cy[i] + cz[i] * cz[i]);
+        in = insideAngle[i];
+        out = outsideAngle[i];
+        if (out < 360.0f && len > 0.0f && dist > 0.0f)
+        {
+            c = -(x[i] * cx[i] + y[i] * cy[i] + z[i] * cz[i]) / (len * dist);
+            if (c > 1.0f)
+                c = 1.0f;
+            if (c < -1.0f)
+                c = -1.0f;
+            angle = ConeAngle(c);
+            if (angle >= out)
+                cone = outsideGain[i];
+            else if (angle > in && out > in)
+                cone = 1.0f + (outsideGain[i] - 1.0f) * (angle - in) / (out - in);
+        }
+
+        gain[i] = att * cone;
+    }
+}
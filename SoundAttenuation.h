@@ -0,0 +1,74 @@
+#ifndef SOUNDATTENUATION_H
+#define SOUNDATTENUATION_H
+
+#include "CKAll.h"
+
+/**
+ * @brief Arrays of a SoundAttenuationBatch, one float per voice each
+ */
+enum SOUNDATTEN_FIELD
+{
+    SOUNDATTEN_X = 0,        /* Position relative to the listener */
+    SOUNDATTEN_Y,
+    SOUNDATTEN_Z,
+    SOUNDATTEN_CONE_X,       /* Cone orientation, any length */
+    SOUNDATTEN_CONE_Y,
+    SOUNDATTEN_CONE_Z,
+    SOUNDATTEN_MIN_DISTANCE,
+    SOUNDATTEN_MAX_DISTANCE,
+    SOUNDATTEN_INSIDE_ANGLE, /* Degrees, full cone */
+    SOUNDATTEN_OUTSIDE_ANGLE,
+    SOUNDATTEN_OUTSIDE_GAIN, /* Linear */
+    SOUNDATTEN_GAIN,         /* Output: distance attenuation times cone gain */
+    SOUNDATTEN_FIELDS
+};
+
+/**
+ * @brief Distance and cone gains of many 3D voices, computed in one pass
+ *
+ * The voices are stored as structure of arrays so the kernel handles four
+ * of them per SSE instruction. It follows the DirectSound model:
+ *
+ *  - distance clamped to the maximum distance, full gain up to the minimum
+ *    one, min / (min + rolloff * (d - min)) beyond it;
+ *  - full gain inside the inner cone, the outside gain beyond the outer
+ *    one, linear in the angle between them. An outer angle of 360 or
+ *    more, a null orientation or a voice at the listener have no cone.
+ *
+ * The cone angle comes from a polynomial arc cosine (Abramowitz and
+ * Stegun 4.4.46, within 2e-8 radians), shared by the SSE and the scalar
+ * code, so both give the same gains up to float rounding.
+ */
+class SoundAttenuationBatch
+{
+public:
+    SoundAttenuationBatch();
+
+    // Sets the number of voices; their fields are undefined until set
+    void Resize(int count);
+    int GetCount() const { return m_Count; }
+
+    float *GetField(SOUNDATTEN_FIELD field) { return m_Data.Begin() + field * m_Stride; }
+    const float *GetField(SOUNDATTEN_FIELD field) const { return m_Data.Begin() + field * m_Stride; }
+
+    void SetVoice(int index, const VxVector &relative, const VxVector &cone,
+                  float minDistance, float maxDistance,
+                  float insideAngle, float outsideAngle, float outsideGain);
+    float GetGain(int index) const { return GetField(SOUNDATTEN_GAIN)[index]; }
+
+    // Fills SOUNDATTEN_GAIN for every voice
+    void Compute(float rollOff);
+
+private:
+    void ComputeScalar(int begin, int end, float rollOff);
+
+    XArray<float> m_Data;
+    int m_Count;
+    int m_Stride;            /* Count rounded up to a multiple of 4 */
+
+    // Prevent copying (VC6 style - declare but don't implement)
+    SoundAttenuationBatch(const SoundAttenuationBatch &);
+    SoundAttenuationBatch &operator=(const SoundAttenuationBatch &);
+};
+
+#endif /* SOUNDATTENUATION_H */
@@ -0,0 +1,127 @@
+#include "SoundBank.h"
+
+SoundBank::SoundBank()
+    : m_File(INVALID_HANDLE_VALUE),
+      m_Mapping(NULL),
+      m_View(NULL),
+      m_Index(NULL),
+      m_Count(0),
+      m_Sources(0)
+{
+}
+
+SoundBank::~SoundBank()
+{
+    Close();
+}
+
+CKBOOL SoundBank::Open(const char *path)
+{
+    CKDWORD fileSize;
+
+    Close();
+    if (!path)
+        return FALSE;
+
+    m_File = ::CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, NULL);
+    if (m_File == INVALID_HANDLE_VALUE)
+        return FALSE;
+
+    fileSize = ::GetFileSize(m_File, NULL);
+    if (fileSize == INVALID_FILE_SIZE || fileSize < sizeof(SoundBankHeader))
+    {
+        Close();
+        return FALSE;
+    }
+
+    m_Mapping = ::CreateFileMappingA(m_File, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (m_Mapping)
+        m_View = (const BYTE *)::MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!m_View || !Validate(fileSize))
+    {
+        Close();
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void SoundBank::Close()
+{
+    if (m_View)
+        ::UnmapViewOfFile(m_View);
+    if (m_Mapping)
+        ::CloseHandle(m_Mapping);
+    if (m_File != INVALID_HANDLE_VALUE)
+        ::CloseHandle(m_File);
+
+    m_File = INVALID_HANDLE_VALUE;
+    m_Mapping = NULL;
+    m_View = NULL;
+    m_Index = NULL;
+    m_Count = 0;
+}
+
+int SoundBank::Find(const char *name) const
+{
+    int lo = 0, hi = m_Count - 1, mid, order;
+
+    if (!name)
+        return -1;
+
+    while (lo <= hi)
+    {
+        mid = (lo + hi) / 2;
+        order = strcmp(name, m_Index[mid].m_Name);
+        if (order == 0)
+            return mid;
+        if (order < 0)
+            hi = mid - 1;
+        else
+            lo = mid + 1;
+    }
+    return -1;
+}
+
+void SoundBank::GetFormat(int index, CKWaveFormat &wf) const
+{
+    const SoundBankEntry &entry = m_Index[index];
+
+    memset(&wf, 0, sizeof(CKWaveFormat));
+    wf.wFormatTag = entry.m_FormatTag;
+    wf.nChannels = entry.m_Channels;
+    wf.nSamplesPerSec = entry.m_SampleRate;
+    wf.wBitsPerSample = entry.m_BitsPerSample;
+    wf.nBlockAlign = entry.m_BlockAlign;
+    wf.nAvgBytesPerSec = entry.m_SampleRate * entry.m_BlockAlign;
+}
+
+CKBOOL SoundBank::Validate(CKDWORD fileSize)
+{
+    const SoundBankHeader *header = (const SoundBankHeader *)m_View;
+    const SoundBankEntry *entry;
+    CKDWORD i;
+
+    if (header->m_Magic != SOUNDBANK_MAGIC || header->m_Version != SOUNDBANK_VERSION ||
+        header->m_FileSize != fileSize || header->m_IndexOffset % SOUNDBANK_ALIGN != 0 ||
+        header->m_IndexOffset > fileSize ||
+        header->m_Count > (fileSize - header->m_IndexOffset) / sizeof(SoundBankEntry))
+        return FALSE;
+
+    /* Checked once here so that lookups and source creation trust the index */
+    m_Index = (const SoundBankEntry *)(m_View + header->m_IndexOffset);
+    for (i = 0; i < header->m_Count; ++i)
+    {
+        entry = &m_Index[i];
+        if (entry->m_Name[SOUNDBANK_NAME_SIZE - 1] != '\0' || entry->m_BlockAlign == 0 ||
+            entry->m_Size == 0 || entry->m_Size % entry->m_BlockAlign != 0 ||
+            entry->m_Offset % SOUNDBANK_ALIGN != 0 ||
+            entry->m_Offset > fileSize || entry->m_Size > fileSize - entry->m_Offset)
+            return FALSE;
+        if (i > 0 && strcmp(m_Index[i - 1].m_Name, entry->m_Name) >= 0)
+            return FALSE;
+    }
+
+    m_Count = (int)header->m_Count;
+    return TRUE;
+}
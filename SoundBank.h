@@ -0,0 +1,87 @@
+#ifndef SOUNDBANK_H
+#define SOUNDBANK_H
+
+#include <windows.h>
+
+#include "CKAll.h"
+
+#define SOUNDBANK_MAGIC     0x4B425344 /* 'DSBK' */
+#define SOUNDBANK_VERSION   1
+#define SOUNDBANK_ALIGN     64         /* Of the index and of every sample */
+#define SOUNDBANK_NAME_SIZE 40         /* Including the terminating zero */
+
+// File layout: SoundBankHeader, the index of m_Count SoundBankEntry sorted
+// by name (strcmp), then the samples. The index and the samples start on
+// SOUNDBANK_ALIGN boundaries; samples hold raw PCM in the format of their
+// entry, converted by the packer to the output format of the game.
+
+struct SoundBankHeader
+{
+    CKDWORD m_Magic;
+    CKDWORD m_Version;
+    CKDWORD m_Count;
+    CKDWORD m_IndexOffset;
+    CKDWORD m_FileSize;
+    CKDWORD m_Reserved[3];
+};
+
+struct SoundBankEntry
+{
+    char m_Name[SOUNDBANK_NAME_SIZE];
+    CKWORD m_FormatTag;     /* WAVE_FORMAT_PCM or WAVE_FORMAT_IEEE_FLOAT */
+    CKWORD m_Channels;
+    CKDWORD m_SampleRate;
+    CKWORD m_BitsPerSample;
+    CKWORD m_BlockAlign;
+    CKDWORD m_Offset;       /* From the start of the file */
+    CKDWORD m_Size;         /* In bytes, whole frames */
+    CKDWORD m_Reserved;
+};
+
+/**
+ * @brief A sound bank file mapped in memory
+ *
+ * Opening the bank only maps the file and checks its index: sample pages
+ * are read by the system when first touched, so loading a level costs page
+ * faults instead of parsing and copying every sound. The data stays mapped
+ * until Close and is read-only.
+ */
+class SoundBank
+{
+public:
+    SoundBank();
+    ~SoundBank();
+
+    CKBOOL Open(const char *path);
+    void Close();
+    CKBOOL IsOpen() const { return m_View != NULL; }
+
+    int GetCount() const { return m_Count; }
+    const SoundBankEntry &GetEntry(int index) const { return m_Index[index]; }
+    // Index of the named sample, -1 if the bank has none
+    int Find(const char *name) const;
+
+    void GetFormat(int index, CKWaveFormat &wf) const;
+    const BYTE *GetData(int index) const { return m_View + m_Index[index].m_Offset; }
+
+    // Sources made from the bank, which must not outlive it
+    int GetSourceCount() const { return m_Sources; }
+    void AddSource() { ++m_Sources; }
+    void RemoveSource() { --m_Sources; }
+
+private:
+    CKBOOL Validate(CKDWORD fileSize);
+
+    HANDLE m_File;
+    HANDLE m_Mapping;
+    const BYTE *m_View;
+    const SoundBankEntry *m_Index;
+    int m_Count;
+    int m_Sources;
+
+    // Prevent copying (VC6 style - declare but don't implement)
+    SoundBank(const SoundBank &);
+    SoundBank &operator=(const SoundBank &);
+};
+
+#endif /* SOUNDBANK_H */
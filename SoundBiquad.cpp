@@ -0,0 +1,185 @@
+#include "SoundBiquad.h"
+#include "SoundSimd.h"
+
+#include <math.h>
+
+#define SOUNDBIQUAD_PI         3.14159265358979323846
+#define SOUNDBIQUAD_LOW_FREQ   300.0  /* Low shelf corner, in Hz */
+#define SOUNDBIQUAD_HIGH_FREQ  3000.0 /* High shelf corner, in Hz */
+#define SOUNDBIQUAD_LOW_GAIN   6.0    /* Low shelf gain at the ends of the range, in dB */
+#define SOUNDBIQUAD_HIGH_GAIN  12.0   /* High shelf gain at the ends of the range, in dB */
+
+static const SoundBiquadStage s_Identity = {1.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+
+// RBJ cookbook shelves with a slope of 1
+static void ComputeShelf(SoundBiquadStage &stage, CKBOOL high, double freq, double gainDb, int sampleRate)
+{
+    double a = pow(10.0, gainDb / 40.0);
+    double w0 = 2.0 * SOUNDBIQUAD_PI * freq / sampleRate;
+    double c = cos(w0);
+    double beta = 2.0 * sqrt(a) * sin(w0) / 2.0 * sqrt(2.0);
+    double sign = high ? -1.0 : 1.0;
+    double b0, b1, b2, a0, a1, a2;
+
+    /* The high shelf is the low shelf with the cosine terms negated */
+    b0 = a * ((a + 1.0) - sign * (a - 1.0) * c + beta);
+    b1 = 2.0 * sign * a * ((a - 1.0) - sign * (a + 1.0) * c);
+    b2 = a * ((a + 1.0) - sign * (a - 1.0) * c - beta);
+    a0 = (a + 1.0) + sign * (a - 1.0) * c + beta;
+    a1 = -2.0 * sign * ((a - 1.0) + sign * (a + 1.0) * c);
+    a2 = (a + 1.0) + sign * (a - 1.0) * c - beta;
+
+    stage.m_B0 = (float)(b0 / a0);
+    stage.m_B1 = (float)(b1 / a0);
+    stage.m_B2 = (float)(b2 / a0);
+    stage.m_A1 = (float)(a1 / a0);
+    stage.m_A2 = (float)(a2 / a0);
+}
+
+void SoundEqualizerInit(SoundEqualizer &eq)
+{
+    int i;
+
+    memset(&eq, 0, sizeof(SoundEqualizer));
+    for (i = 0; i < SOUNDBIQUAD_STAGES; ++i)
+        eq.m_Stages[i] = s_Identity;
+    eq.m_Setting = 0.5f;
+    eq.m_Flat = TRUE;
+}
+
+void SoundEqualizerSet(SoundEqualizer &eq, float setting)
+{
+    if (setting < 0.0f)
+        setting = 0.0f;
+    if (setting > 1.0f)
+        setting = 1.0f;
+
+    if (setting != eq.m_Setting)
+    {
+        eq.m_Setting = setting;
+        eq.m_SampleRate = 0;
+    }
+}
+
+void SoundEqualizerPrepare(SoundEqualizer &eq, int sampleRate)
+{
+    float tilt;
+    CKBOOL flat;
+
+    if (eq.m_SampleRate == sampleRate || sampleRate <= 0)
+        return;
+
+    eq.m_SampleRate = sampleRate;
+    tilt = (eq.m_Setting - 0.5f) * 2.0f;
+    flat = (tilt > -0.001f && tilt < 0.001f);
+
+    if (flat)
+    {
+        eq.m_Stages[0] = s_Identity;
+        eq.m_Stages[1] = s_Identity;
+    }
+    else
+    {
+        ComputeShelf(eq.m_Stages[0], FALSE, SOUNDBIQUAD_LOW_FREQ, -tilt * SOUNDBIQUAD_LOW_GAIN, sampleRate);
+        ComputeShelf(eq.m_Stages[1], TRUE, SOUNDBIQUAD_HIGH_FREQ, tilt * SOUNDBIQUAD_HIGH_GAIN, sampleRate);
+    }
+
+    /* Coming back from flat, don't ring with a stale state */
+    if (eq.m_Flat && !flat)
+        memset(eq.m_State, 0, sizeof(eq.m_State));
+    eq.m_Flat = flat;
+}
+
+void SoundBiquadProcess(float *data, int frames, const SoundBiquadLane *lanes)
+{
+    const SoundBiquadStage *stages[SOUNDBIQUAD_LANES];
+    const SoundBiquadStage *st;
+    float unused[SOUNDBIQUAD_STAGES * 2];
+    float *states[SOUNDBIQUAD_LANES];
+#ifdef SOUNDSIMD_SSE
+    float b0[SOUNDBIQUAD_LANES], b1[SOUNDBIQUAD_LANES], b2[SOUNDBIQUAD_LANES];
+    float a1[SOUNDBIQUAD_LANES], a2[SOUNDBIQUAD_LANES];
+    float z1[SOUNDBIQUAD_LANES], z2[SOUNDBIQUAD_LANES];
+    __m128 vb0, vb1, vb2, va1, va2, vz1, vz2, x, y;
+#else
+    float z1, z2, x, y;
+#endif
+    int lane, s, i;
+
+    for (lane = 0; lane < SOUNDBIQUAD_LANES; ++lane)
+    {
+        stages[lane] = lanes[lane].m_Stages;
+        states[lane] = lanes[lane].m_State;
+        if (!stages[lane] || !states[lane])
+        {
+            stages[lane] = NULL;
+            states[lane] = unused;
+        }
+    }
+    memset(unused, 0, sizeof(unused));
+
+    for (s = 0; s < SOUNDBIQUAD_STAGES; ++s)
+    {
+#ifdef SOUNDSIMD_SSE
+        /* Transpose the coefficients and state of the lanes once per block */
+        for (lane = 0; lane < SOUNDBIQUAD_LANES; ++lane)
+        {
+            st = stages[lane] ? &stages[lane][s] : &s_Identity;
+            b0[lane] = st->m_B0;
+            b1[lane] = st->m_B1;
+            b2[lane] = st->m_B2;
+            a1[lane] = st->m_A1;
+            a2[lane] = st->m_A2;
+            z1[lane] = states[lane][2 * s];
+            z2[lane] = states[lane][2 * s + 1];
+        }
+
+        vb0 = _mm_loadu_ps(b0);
+        vb1 = _mm_loadu_ps(b1);
+        vb2 = _mm_loadu_ps(b2);
+        va1 = _mm_loadu_ps(a1);
+        va2 = _mm_loadu_ps(a2);
+        vz1 = _mm_loadu_ps(z1);
+        vz2 = _mm_loadu_ps(z2);
+
+        for (i = 0; i < frames; ++i)
+        {
+            x = _mm_loadu_ps(data + i * SOUNDBIQUAD_LANES);
+            y = _mm_add_ps(_mm_mul_ps(vb0, x), vz1);
+            vz1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(vb1, x), _mm_mul_ps(va1, y)), vz2);
+            vz2 = _mm_sub_ps(_mm_mul_ps(vb2, x), _mm_mul_ps(va2, y));
+            _mm_storeu_ps(data + i * SOUNDBIQUAD_LANES, y);
+        }
+
+        _mm_storeu_ps(z1, vz1);
+        _mm_storeu_ps(z2, vz2);
+        for (lane = 0; lane < SOUNDBIQUAD_LANES; ++lane)
+        {
+            states[lane][2 * s] = z1[lane];
+            states[lane][2 * s + 1] = z2[lane];
+        }
+#else
+        for (lane = 0; lane < SOUNDBIQUAD_LANES; ++lane)
+        {
+            st = stages[lane];
+            if (!st)
+                continue;
+
+            st += s;
+            z1 = states[lane][2 * s];
+            z2 = states[lane][2 * s + 1];
+            for (i = 0; i < frames; ++i)
+            {
+                x = data[i * SOUNDBIQUAD_LANES + lane];
+                y = st->m_B0 * x + z1;
+                z1 = st->m_B1 * x - st->m_A1 * y + z2;
+                z2 = st->m_B2 * x - st->m_A2 * y;
+                data[i * SOUNDBIQUAD_LANES + lane] = y;
+            }
+
+            states[lane][2 * s] = z1;
+            states[lane][2 * s + 1] = z2;
+        }
+#endif
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef SOUNDBIQUAD_H
+#define SOUNDBIQUAD_H
+
+#include "CKAll.h"
+
+#define SOUNDBIQUAD_STAGES 2 /* Low shelf then high shelf */
+#define SOUNDBIQUAD_LANES  4 /* Channels filtered together, one per SIMD lane */
+#define SOUNDBIQUAD_MAX_CHANNELS 8
+
+/**
+ * @brief Normalized biquad coefficients (a0 = 1)
+ */
+struct SoundBiquadStage
+{
+    float m_B0, m_B1, m_B2;
+    float m_A1, m_A2;
+};
+
+/**
+ * @brief Tilt equalizer of a voice or of the listener
+ *
+ * Maps the CK equalization setting (0 to 1, 0.5 being flat as in the
+ * CKWaveSoundSettings defaults) to a low shelf and a high shelf of opposite
+ * gains: lower settings sound duller, higher ones brighter. Coefficients
+ * are only computed when the setting or the mix rate changes.
+ */
+struct SoundEqualizer
+{
+    SoundBiquadStage m_Stages[SOUNDBIQUAD_STAGES];
+    float m_State[SOUNDBIQUAD_MAX_CHANNELS][SOUNDBIQUAD_STAGES][2]; /* Per channel and stage: z1, z2 */
+    float m_Setting;
+    int m_SampleRate; /* Rate the coefficients were computed for */
+    CKBOOL m_Flat;    /* Unfiltered: skipped by the mixer */
+};
+
+// Flat equalizer
+void SoundEqualizerInit(SoundEqualizer &eq);
+// Changes the setting; the coefficients follow at the next Prepare
+void SoundEqualizerSet(SoundEqualizer &eq, float setting);
+// Recomputes the coefficients if the setting or the rate changed
+void SoundEqualizerPrepare(SoundEqualizer &eq, int sampleRate);
+
+/**
+ * @brief One channel of a SoundBiquadProcess call
+ */
+struct SoundBiquadLane
+{
+    const SoundBiquadStage *m_Stages; /* SOUNDBIQUAD_STAGES stages, NULL for an unused lane */
+    float *m_State;                   /* SOUNDBIQUAD_STAGES pairs of z1, z2 */
+};
+
+// Runs the cascade over frames of SOUNDBIQUAD_LANES interleaved channels
+// (transposed direct form II), each with its own coefficients and state.
+void SoundBiquadProcess(float *data, int frames, const SoundBiquadLane *lanes);
+
+#endif /* SOUNDBIQUAD_H */
@@ -0,0 +1,30 @@
+#ifndef SOUNDBUSEFFECT_H
+#define SOUNDBUSEFFECT_H
+
+#include "CKAll.h"
+
+typedef enum SOUNDBUS_EFFECT
+{
+    SOUNDBUS_REVERB = 0,      /* SoundReverb, feedback delay network */
+    SOUNDBUS_CONVOLUTION = 1  /* SoundConvolver, measured impulse response */
+} SOUNDBUS_EFFECT;
+
+/**
+ * @brief Effect processing the sends of a mixer bus
+ *
+ * Receives the interleaved stereo sum of the voices sending to the bus and
+ * adds its wet output to the interleaved stereo mix.
+ */
+class SoundBusEffect
+{
+public:
+    virtual ~SoundBusEffect() {}
+
+    virtual SOUNDBUS_EFFECT GetType() const = 0;
+    virtual CKBOOL SetSampleRate(int sampleRate) = 0;
+    // Clears the tail
+    virtual void Reset() = 0;
+    virtual void Process(const float *input, float *output, int frames) = 0;
+};
+
+#endif /* SOUNDBUSEFFECT_H */
@@ -0,0 +1,302 @@
+#include "SoundBusTree.h"
+
+SoundBusTree::SoundBusTree()
+    : m_BusCount(0),
+      m_FreeBuses(-1),
+      m_FreeMembers(-1),
+      m_Dirty(FALSE)
+{
+    memset(&m_Stats, 0, sizeof(SoundBusStats));
+}
+
+int SoundBusTree::CreateBus(int parent, float level)
+{
+    SoundBus added;
+    SoundBus *bus;
+    int index;
+
+    if (parent != SOUNDBUS_NONE && !IsBus(parent))
+        return SOUNDBUS_NONE;
+
+    if (m_FreeBuses >= 0)
+    {
+        index = m_FreeBuses;
+        m_FreeBuses = m_Buses[index].m_Next;
+    }
+    else
+    {
+        memset(&added, 0, sizeof(SoundBus));
+        m_Buses.PushBack(added);
+        index = m_Buses.Size() - 1;
+    }
+
+    bus = &m_Buses[index];
+    bus->m_Parent = parent;
+    bus->m_Level = (level > 0.0f) ? level : 0.0f;
+    bus->m_First = -1;
+    bus->m_Next = -1;
+    bus->m_Used = TRUE;
+    bus->m_Effective = ComputeEffective(index);
+    ++m_BusCount;
+    return index;
+}
+
+CKBOOL SoundBusTree::DestroyBus(int bus, SoundBusGainFunction function, void *context)
+{
+    int parent, member, next, i;
+
+    if (!IsBus(bus))
+        return FALSE;
+
+    parent = m_Buses[bus].m_Parent;
+    for (i = 0; i < m_Buses.Size(); ++i)
+    {
+        if (m_Buses[i].m_Used && m_Buses[i].m_Parent == bus)
+            m_Buses[i].m_Parent = parent;
+    }
+
+    for (member = m_Buses[bus].m_First; member >= 0; member = next)
+    {
+        next = m_Members[member].m_Next;
+        if (parent != SOUNDBUS_NONE)
+        {
+            Unlink(member);
+            Link(member, parent);
+        }
+        else
+        {
+            if (m_Members[member].m_Gain != m_Members[member].m_Applied)
+                function(context, m_Members[member].m_Source, m_Members[member].m_Gain);
+            Release(member);
+        }
+    }
+
+    /* The members moved in were applied another gain: have Flush visit them */
+    if (parent != SOUNDBUS_NONE)
+        m_Buses[parent].m_Effective = -1.0f;
+
+    m_Buses[bus].m_Used = FALSE;
+    m_Buses[bus].m_Parent = SOUNDBUS_NONE;
+    m_Buses[bus].m_First = -1;
+    m_Buses[bus].m_Next = m_FreeBuses;
+    m_FreeBuses = bus;
+    --m_BusCount;
+    m_Dirty = TRUE;
+    return TRUE;
+}
+
+CKBOOL SoundBusTree::SetLevel(int bus, float level)
+{
+    if (!IsBus(bus))
+        return FALSE;
+
+    if (level < 0.0f)
+        level = 0.0f;
+    if (level != m_Buses[bus].m_Level)
+    {
+        m_Buses[bus].m_Level = level;
+        m_Dirty = TRUE;
+    }
+    return TRUE;
+}
+
+CKBOOL SoundBusTree::SetParent(int bus, int parent)
+{
+    int ancestor;
+
+    if (!IsBus(bus) || (parent != SOUNDBUS_NONE && !IsBus(parent)))
+        return FALSE;
+
+    for (ancestor = parent; ancestor != SOUNDBUS_NONE; ancestor = m_Buses[ancestor].m_Parent)
+    {
+        if (ancestor == bus)
+            return FALSE;
+    }
+
+    if (parent != m_Buses[bus].m_Parent)
+    {
+        m_Buses[bus].m_Parent = parent;
+        m_Dirty = TRUE;
+    }
+    return TRUE;
+}
+
+float SoundBusTree::Assign(void *source, int bus, float gain)
+{
+    SoundBusMember added;
+    SoundBusMember *member;
+    int *found;
+    int index;
+
+    if (bus == SOUNDBUS_NONE || !IsBus(bus))
+    {
+        Remove(source);
+        return gain;
+    }
+
+    found = m_Lookup.FindPtr(source);
+    if (found)
+    {
+        index = *found;
+        Unlink(index);
+    }
+    else
+    {
+        if (m_FreeMembers >= 0)
+        {
+            index = m_FreeMembers;
+            m_FreeMembers = m_Members[index].m_Next;
+        }
+        else
+        {
+            memset(&added, 0, sizeof(SoundBusMember));
+            m_Members.PushBack(added);
+            index = m_Members.Size() - 1;
+        }
+        m_Members[index].m_Source = source;
+        m_Lookup.Insert(source, index, TRUE);
+    }
+
+    Link(index, bus);
+    member = &m_Members[index];
+    member->m_Gain = gain;
+    member->m_Applied = gain * ComputeEffective(bus);
+    return member->m_Applied;
+}
+
+void SoundBusTree::Remove(void *source)
+{
+    int *found = m_Lookup.FindPtr(source);
+
+    if (found)
+        Release(*found);
+}
+
+SoundBusMember *SoundBusTree::Find(void *source)
+{
+    int *found = m_Lookup.FindPtr(source);
+
+    return found ? &m_Members[*found] : NULL;
+}
+
+void SoundBusTree::RemoveMembers()
+{
+    int i;
+
+    m_Members.Clear();
+    m_Lookup.Clear();
+    m_FreeMembers = -1;
+    for (i = 0; i < m_Buses.Size(); ++i)
+        m_Buses[i].m_First = -1;
+}
+
+float SoundBusTree::Scale(void *source, float gain)
+{
+    SoundBusMember *member;
+    int *found;
+
+    if (m_Lookup.Size() == 0)
+        return gain;
+    found = m_Lookup.FindPtr(source);
+    if (!found)
+        return gain;
+
+    member = &m_Members[*found];
+    member->m_Gain = gain;
+    member->m_Applied = gain * ComputeEffective(member->m_Bus);
+    return member->m_Applied;
+}
+
+float SoundBusTree::GetScale(void *source)
+{
+    int *found;
+
+    if (m_Lookup.Size() == 0)
+        return 1.0f;
+    found = m_Lookup.FindPtr(source);
+    return found ? ComputeEffective(m_Members[*found].m_Bus) : 1.0f;
+}
+
+int SoundBusTree::Flush(SoundBusGainFunction function, void *context)
+{
+    SoundBusMember *member;
+    float effective, gain;
+    int bus, index;
+
+    m_Stats.m_Changed = 0;
+    m_Stats.m_Updated = 0;
+    if (!m_Dirty)
+        return 0;
+    m_Dirty = FALSE;
+
+    for (bus = 0; bus < m_Buses.Size(); ++bus)
+    {
+        if (!m_Buses[bus].m_Used)
+            continue;
+
+        effective = ComputeEffective(bus);
+        if (effective == m_Buses[bus].m_Effective)
+            continue;
+        m_Buses[bus].m_Effective = effective;
+        ++m_Stats.m_Changed;
+
+        for (index = m_Buses[bus].m_First; index >= 0; index = member->m_Next)
+        {
+            member = &m_Members[index];
+            gain = member->m_Gain * effective;
+            if (gain == member->m_Applied)
+                continue;
+            member->m_Applied = gain;
+            function(context, member->m_Source, gain);
+            ++m_Stats.m_Updated;
+        }
+    }
+
+    return m_Stats.m_Updated;
+}
+
+float SoundBusTree::ComputeEffective(int bus) const
+{
+    float effective = 1.0f;
+
+    for (; bus != SOUNDBUS_NONE; bus = m_Buses[bus].m_Parent)
+        effective *= m_Buses[bus].m_Level;
+    return effective;
+}
+
+void SoundBusTree::Link(int member, int bus)
+{
+    SoundBusMember *m = &m_Members[member];
+
+    m->m_Bus = bus;
+    m->m_Prev = -1;
+    m->m_Next = m_Buses[bus].m_First;
+    if (m->m_Next >= 0)
+        m_Members[m->m_Next].m_Prev = member;
+    m_Buses[bus].m_First = member;
+}
+
+void SoundBusTree::Unlink(int member)
+{
+    SoundBusMember *m = &m_Members[member];
+
+    if (m->m_Prev >= 0)
+        m_Members[m->m_Prev].m_Next = m->m_Next;
+    else
+        m_Buses[m->m_Bus].m_First = m->m_Next;
+    if (m->m_Next >= 0)
+        m_Members[m->m_Next].m_Prev = m->m_Prev;
+}
+
+void SoundBusTree::Release(int member)
+{
+    SoundBusMember *m = &m_Members[member];
+
+    Unlink(member);
+    m_Lookup.Remove(m->m_Source);
+
+    m->m_Source = NULL;
+    m->m_Prev = -1;
+    m->m_Next = m_FreeMembers;
+    m_FreeMembers = member;
+}
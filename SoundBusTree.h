@@ -0,0 +1,116 @@
+#ifndef SOUNDBUSTREE_H
+#define SOUNDBUSTREE_H
+
+#include "CKAll.h"
+
+#include "SampleStore.h"
+
+#define SOUNDBUS_NONE -1
+
+/**
+ * @brief A gain bus: music, effects, voices...
+ */
+struct SoundBus
+{
+    int m_Parent;           /* SOUNDBUS_NONE for a root, or on the free list */
+    float m_Level;          /* Own gain, linear */
+    float m_Effective;      /* Product of the levels up to the root, as of the last Flush */
+    int m_First;            /* First member, -1 if none */
+    int m_Next;             /* In the free list */
+    CKBOOL m_Used;
+};
+
+/**
+ * @brief A source routed through a bus
+ */
+struct SoundBusMember
+{
+    void *m_Source;         /* NULL while on the free list */
+    int m_Bus;
+    float m_Gain;           /* Gain the source was given, before the buses */
+    float m_Applied;        /* Last gain sent to the source */
+    int m_Prev;             /* In the bus, -1 at the ends */
+    int m_Next;             /* In the bus or the free list */
+};
+
+/**
+ * @brief Counters of the last Flush
+ */
+struct SoundBusStats
+{
+    int m_Changed;          /* Buses whose effective gain changed */
+    int m_Updated;          /* Sources sent a gain */
+};
+
+// Sends the gain of a source to the device, as is
+typedef void (*SoundBusGainFunction)(void *context, void *source, float gain);
+
+/**
+ * @brief Hierarchy of gain buses and the sources routed through them
+ *
+ * The gain heard from a source is its own gain times the levels of its bus
+ * and of every bus above it. Level changes only mark the tree dirty: Flush
+ * recomputes the effective gains, a handful of buses, and visits the
+ * members of the buses whose gain changed, each bus keeping a list of
+ * them. Sources outside the tree are never visited. Members are stored
+ * like the entries of SoundSpatialIndex: an array with a free list and a
+ * lookup by source.
+ */
+class SoundBusTree
+{
+public:
+    SoundBusTree();
+
+    // Returns the new bus, or SOUNDBUS_NONE if the parent does not exist
+    int CreateBus(int parent, float level);
+    // Children and members move to the parent; members of a root bus
+    // leave the tree and are sent their own gain back
+    CKBOOL DestroyBus(int bus, SoundBusGainFunction function, void *context);
+    CKBOOL SetLevel(int bus, float level);
+    // Fails if the parent is the bus or lies below it
+    CKBOOL SetParent(int bus, int parent);
+    CKBOOL IsBus(int bus) const { return bus >= 0 && bus < m_Buses.Size() && m_Buses[bus].m_Used; }
+    const SoundBus &GetBus(int bus) const { return m_Buses[bus]; }
+    int GetBusCount() const { return m_BusCount; }
+
+    // Routes a source given the gain it has, SOUNDBUS_NONE to remove it.
+    // Returns the gain to send now.
+    float Assign(void *source, int bus, float gain);
+    void Remove(void *source);
+    SoundBusMember *Find(void *source);
+    int GetMemberCount() const { return m_Lookup.Size(); }
+    void RemoveMembers();
+
+    // Records the own gain of a member and returns the gain to send;
+    // sources outside the tree keep theirs
+    float Scale(void *source, float gain);
+    // Product of the levels over a member, 1 outside the tree
+    float GetScale(void *source);
+
+    CKBOOL IsDirty() const { return m_Dirty; }
+    // Sends the new gains of the members of the buses that changed
+    int Flush(SoundBusGainFunction function, void *context);
+
+    const SoundBusStats &GetStats() const { return m_Stats; }
+
+private:
+    float ComputeEffective(int bus) const;
+    void Link(int member, int bus);
+    void Unlink(int member);
+    void Release(int member);
+
+    XArray<SoundBus> m_Buses;
+    int m_BusCount;
+    int m_FreeBuses;
+    XArray<SoundBusMember> m_Members;
+    int m_FreeMembers;
+    XHashTable<int, void *, SourceHash> m_Lookup;
+    CKBOOL m_Dirty;
+    SoundBusStats m_Stats;
+
+    // Prevent copying (VC6 style - declare but don't implement)
+    SoundBusTree(const SoundBusTree &);
+    SoundBusTree &operator=(const SoundBusTree &);
+};
+
+#endif /* SOUNDBUSTREE_H */
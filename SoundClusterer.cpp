@@ -0,0 +1,183 @@
+#include "SoundClusterer.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+SoundClusterer::SoundClusterer()
+    : m_Distance(0.0f),
+      m_CellSize(0.0f),
+      m_Frame(0)
+{
+    memset(&m_Stats, 0, sizeof(SoundClusterStats));
+}
+
+void SoundClusterer::SetDistance(float distance, float cellSize)
+{
+    m_Distance = (distance > 0.0f) ? distance : 0.0f;
+    m_CellSize = (cellSize > 0.0f) ? cellSize : m_Distance;
+}
+
+void SoundClusterer::Build(SoundClusterEmitter *emitters, int count, const VxVector &listener)
+{
+    SoundClusterEmitter *emitter;
+    VxVector offset;
+    Key key;
+    float nearest, split, d2;
+    int size, run, i, c;
+
+    ++m_Frame;
+    m_Keys.Clear();
+    m_Clusters.Clear();
+    m_Stats.m_Emitters = count;
+    m_Stats.m_Clusters = 0;
+    m_Stats.m_Folded = 0;
+
+    for (i = 0; i < count; ++i)
+        emitters[i].m_Cluster = -1;
+    if (!IsEnabled())
+        return;
+
+    nearest = m_Distance * m_Distance;
+    split = nearest * SOUNDCLUSTER_SPLIT_RATIO * SOUNDCLUSTER_SPLIT_RATIO;
+
+    for (i = 0; i < count; ++i)
+    {
+        emitter = &emitters[i];
+        offset = emitter->m_Position - listener;
+        d2 = offset.SquareMagnitude();
+        if (d2 <= split)
+            continue;
+        if (d2 <= nearest && !m_Saved.FindPtr(emitter->m_Source))
+            continue;
+
+        key.m_Asset = emitter->m_Asset;
+        for (c = 0; c < 3; ++c)
+            key.m_Cell[c] = (int)floorf(emitter->m_Position[c] / m_CellSize);
+        key.m_Emitter = i;
+        m_Keys.PushBack(key);
+    }
+
+    size = m_Keys.Size();
+    if (size < 2)
+        return;
+
+    /* Same bins end up adjacent, each in emitter order */
+    qsort(m_Keys.Begin(), size, sizeof(Key), CompareKeys);
+    for (i = 0; i < size; i = run)
+    {
+        for (run = i + 1; run < size; ++run)
+        {
+            if (m_Keys[run].m_Asset != m_Keys[i].m_Asset ||
+                memcmp(m_Keys[run].m_Cell, m_Keys[i].m_Cell, sizeof(key.m_Cell)) != 0)
+                break;
+        }
+        if (run - i > 1)
+            AddCluster(emitters, &m_Keys[i], run - i);
+    }
+}
+
+int SoundClusterer::CompareKeys(const void *a, const void *b)
+{
+    const Key *ka = (const Key *)a;
+    const Key *kb = (const Key *)b;
+    int c;
+
+    if (ka->m_Asset != kb->m_Asset)
+        return (ka->m_Asset < kb->m_Asset) ? -1 : 1;
+    for (c = 0; c < 3; ++c)
+    {
+        if (ka->m_Cell[c] != kb->m_Cell[c])
+            return (ka->m_Cell[c] < kb->m_Cell[c]) ? -1 : 1;
+    }
+    return ka->m_Emitter - kb->m_Emitter;
+}
+
+void SoundClusterer::AddCluster(SoundClusterEmitter *emitters, const Key *keys, int count)
+{
+    SoundCluster cluster;
+    SoundClusterEmitter *emitter;
+    VxVector position(0.0f, 0.0f, 0.0f), velocity(0.0f, 0.0f, 0.0f);
+    float total, power;
+    int index, i;
+
+    index = m_Clusters.Size();
+    cluster.m_Leader = keys[0].m_Emitter;
+    cluster.m_Count = count;
+    cluster.m_Position.Set(0.0f, 0.0f, 0.0f);
+    cluster.m_Velocity.Set(0.0f, 0.0f, 0.0f);
+
+    total = 0.0f;
+    power = 0.0f;
+    for (i = 0; i < count; ++i)
+    {
+        emitter = &emitters[keys[i].m_Emitter];
+        emitter->m_Cluster = index;
+
+        /* Ties keep the first emitter, the bin being in emitter order */
+        if (emitter->m_Gain > emitters[cluster.m_Leader].m_Gain)
+            cluster.m_Leader = keys[i].m_Emitter;
+
+        cluster.m_Position += emitter->m_Position * emitter->m_Gain;
+        cluster.m_Velocity += emitter->m_Velocity * emitter->m_Gain;
+        position += emitter->m_Position;
+        velocity += emitter->m_Velocity;
+        total += emitter->m_Gain;
+        power += emitter->m_Gain * emitter->m_Gain;
+    }
+
+    /* Silent clusters still need a place */
+    if (total > 0.0f)
+    {
+        cluster.m_Position *= 1.0f / total;
+        cluster.m_Velocity *= 1.0f / total;
+    }
+    else
+    {
+        cluster.m_Position = position * (1.0f / count);
+        cluster.m_Velocity = velocity * (1.0f / count);
+    }
+
+    cluster.m_Gain = sqrtf(power);
+    if (cluster.m_Gain > 1.0f)
+        cluster.m_Gain = 1.0f;
+
+    m_Clusters.PushBack(cluster);
+    ++m_Stats.m_Clusters;
+    m_Stats.m_Folded += count - 1;
+}
+
+SoundClusterSaved *SoundClusterer::SaveGain(void *source, float gain)
+{
+    SoundClusterSaved saved;
+    SoundClusterSaved *entry = m_Saved.FindPtr(source);
+
+    if (!entry)
+    {
+        saved.m_Gain = gain;
+        saved.m_Applied = gain;
+        saved.m_Frame = m_Frame;
+        m_Saved.Insert(source, saved, TRUE);
+        entry = m_Saved.FindPtr(source);
+    }
+    entry->m_Frame = m_Frame;
+    return entry;
+}
+
+void SoundClusterer::GetStaleSources(XArray<void *> &sources)
+{
+    XHashTable<SoundClusterSaved, void *, SourceHash>::Iterator it;
+
+    sources.Clear();
+    for (it = m_Saved.Begin(); it != m_Saved.End(); ++it)
+    {
+        if ((*it).m_Frame != m_Frame)
+            sources.PushBack(it.GetKey());
+    }
+}
+
+void SoundClusterer::Clear()
+{
+    m_Keys.Clear();
+    m_Clusters.Clear();
+    m_Saved.Clear();
+}
@@ -0,0 +1,123 @@
+#ifndef SOUNDCLUSTERER_H
+#define SOUNDCLUSTERER_H
+
+#include "CKAll.h"
+
+#include "SampleStore.h"
+
+/* Clustered emitters split again once this much closer than the threshold */
+#define SOUNDCLUSTER_SPLIT_RATIO 0.8f
+
+/**
+ * @brief A playing minion offered to the clusterer
+ */
+struct SoundClusterEmitter
+{
+    void *m_Source;
+    CK_ID m_Asset;          /* Original sound, only copies of one sound merge */
+    VxVector m_Position;    /* World space */
+    VxVector m_Velocity;
+    float m_Gain;           /* Own gain, whatever the cluster applied */
+    int m_Cluster;          /* Set by Build: cluster index, -1 if voiced alone */
+};
+
+/**
+ * @brief Emitters voiced by one of them
+ */
+struct SoundCluster
+{
+    int m_Leader;           /* Emitter voicing the cluster, the loudest one */
+    int m_Count;
+    VxVector m_Position;    /* Gain-weighted centroid */
+    VxVector m_Velocity;    /* Gain-weighted mean */
+    float m_Gain;           /* Power sum of the gains, at most 1 */
+};
+
+/**
+ * @brief Gain a clustered source had before the cluster changed it
+ */
+struct SoundClusterSaved
+{
+    float m_Gain;           /* Restored when the source is voiced alone again */
+    float m_Applied;        /* Last gain the cluster set */
+    int m_Frame;            /* Last Build the source was clustered in */
+};
+
+/**
+ * @brief Counters of the last Build
+ */
+struct SoundClusterStats
+{
+    int m_Emitters;         /* Emitters offered */
+    int m_Clusters;
+    int m_Folded;           /* Emitters muted in favour of their leader */
+};
+
+/**
+ * @brief Merges distant copies of a sound into single voices
+ *
+ * Emitters farther than the threshold from the listener are binned by
+ * sound and by a world grid of the given cell size. Every bin holding
+ * more than one emitter becomes a cluster: its loudest emitter is placed
+ * at the gain-weighted centroid with the combined gain and the others are
+ * muted. The copies play from unrelated offsets, so their levels add in
+ * power. An emitter that was clustered stays so until it comes closer
+ * than SOUNDCLUSTER_SPLIT_RATIO times the threshold, so clusters do not
+ * flicker at the boundary.
+ *
+ * Build only computes the clusters; the manager applies them and keeps
+ * the gains it replaced with SaveGain so they can be restored.
+ */
+class SoundClusterer
+{
+public:
+    SoundClusterer();
+
+    // A distance of 0 disables clustering; a cell size of 0 uses the distance
+    void SetDistance(float distance, float cellSize);
+    float GetDistance() const { return m_Distance; }
+    float GetCellSize() const { return m_CellSize; }
+    CKBOOL IsEnabled() const { return m_Distance > 0.0f; }
+
+    // Assigns the emitters to clusters around the listener
+    void Build(SoundClusterEmitter *emitters, int count, const VxVector &listener);
+    int GetClusterCount() const { return m_Clusters.Size(); }
+    const SoundCluster &GetCluster(int index) const { return m_Clusters[index]; }
+    int GetFrame() const { return m_Frame; }
+
+    // Gains replaced by the clusters, per source
+    SoundClusterSaved *FindSaved(void *source) { return m_Saved.FindPtr(source); }
+    SoundClusterSaved *SaveGain(void *source, float gain);
+    void RemoveSaved(void *source) { m_Saved.Remove(source); }
+    int GetSavedCount() const { return m_Saved.Size(); }
+    // Sources with a saved gain not clustered by the last Build
+    void GetStaleSources(XArray<void *> &sources);
+    void Clear();
+
+    const SoundClusterStats &GetStats() const { return m_Stats; }
+
+private:
+    struct Key
+    {
+        CK_ID m_Asset;
+        int m_Cell[3];
+        int m_Emitter;
+    };
+
+    static int CompareKeys(const void *a, const void *b);
+    void AddCluster(SoundClusterEmitter *emitters, const Key *keys, int count);
+
+    float m_Distance;
+    float m_CellSize;
+    int m_Frame;
+    XArray<Key> m_Keys;
+    XArray<SoundCluster> m_Clusters;
+    XHashTable<SoundClusterSaved, void *, SourceHash> m_Saved;
+    SoundClusterStats m_Stats;
+
+    // Prevent copying (VC6 style - declare but don't implement)
+    SoundClusterer(const SoundClusterer &);
+    SoundClusterer &operator=(const SoundClusterer &);
+};
+
+#endif /* SOUNDCLUSTERER_H */
@@ -0,0 +1,598 @@
+#include "SoundCommandLog.h"
+
+#define SOUNDLOG_MIN_HANDLES 64
+
+static inline unsigned int HashSource(void *source)
+{
+    /* Fibonacci hashing; buffers are at least 4-byte aligned */
+    return ((unsigned int)(size_t)source >> 2) * 2654435769U;
+}
+
+//-----------------------------------------------------------------------------
+// SoundCommandLog
+//-----------------------------------------------------------------------------
+
+SoundCommandLog::SoundCommandLog()
+{
+    int i;
+
+    m_File = NULL;
+    m_Thread = NULL;
+    m_WakeEvent = NULL;
+    m_FreeEvent = NULL;
+    m_Stop = 0;
+    ::InitializeCriticalSection(&m_Lock);
+
+    for (i = 0; i < SOUNDLOG_BUFFER_COUNT; ++i)
+    {
+        m_Buffers[i].m_Data = NULL;
+        m_Buffers[i].m_Used = 0;
+        m_Buffers[i].m_Full = 0;
+    }
+    m_Current = 0;
+    m_NextToWrite = 0;
+
+    m_LastTime = 0;
+    m_Frequency = 1;
+    m_RecordCount = 0;
+
+    m_HandleKeys = NULL;
+    m_HandleValues = NULL;
+    m_HandleCapacity = 0;
+    m_HandleCount = 0;
+    m_NextHandle = 1;
+}
+
+SoundCommandLog::~SoundCommandLog()
+{
+    Close();
+    ::DeleteCriticalSection(&m_Lock);
+}
+
+CKBOOL SoundCommandLog::Open(const char *path)
+{
+    SoundLogHeader header;
+    LARGE_INTEGER value;
+    DWORD threadId;
+    int i;
+
+    Close();
+
+    if (!path || !path[0])
+        return FALSE;
+
+    m_File = fopen(path, "wb");
+    if (!m_File)
+        return FALSE;
+
+    header.m_Magic = SOUNDLOG_MAGIC;
+    header.m_Version = SOUNDLOG_VERSION;
+    fwrite(&header, sizeof(header), 1, m_File);
+
+    for (i = 0; i < SOUNDLOG_BUFFER_COUNT; ++i)
+    {
+        m_Buffers[i].m_Data = new BYTE[SOUNDLOG_BUFFER_SIZE];
+        m_Buffers[i].m_Used = 0;
+        m_Buffers[i].m_Full = 0;
+    }
+    m_Current = 0;
+    m_NextToWrite = 0;
+
+    m_HandleCapacity = SOUNDLOG_MIN_HANDLES;
+    m_HandleKeys = new void *[m_HandleCapacity];
+    m_HandleValues = new CKDWORD[m_HandleCapacity];
+    memset(m_HandleKeys, 0, m_HandleCapacity * sizeof(void *));
+    m_HandleCount = 0;
+    m_NextHandle = 1;
+
+    ::QueryPerformanceFrequency(&value);
+    m_Frequency = value.QuadPart > 0 ? value.QuadPart : 1;
+    ::QueryPerformanceCounter(&value);
+    m_LastTime = value.QuadPart;
+    m_RecordCount = 0;
+
+    m_Stop = 0;
+    m_WakeEvent = ::CreateEvent(NULL, FALSE, FALSE, NULL);
+    m_FreeEvent = ::CreateEvent(NULL, FALSE, FALSE, NULL);
+    m_Thread = ::CreateThread(NULL, 0, WriterThread, this, 0, &threadId);
+    if (!m_Thread || !m_WakeEvent || !m_FreeEvent)
+    {
+        Close();
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+void SoundCommandLog::Close()
+{
+    int i;
+
+    if (m_Thread)
+    {
+        ::EnterCriticalSection(&m_Lock);
+        if (m_Buffers[m_Current].m_Used > 0)
+            Submit();
+        ::LeaveCriticalSection(&m_Lock);
+
+        ::InterlockedExchange(&m_Stop, 1);
+        ::SetEvent(m_WakeEvent);
+        ::WaitForSingleObject(m_Thread, INFINITE);
+        ::CloseHandle(m_Thread);
+        m_Thread = NULL;
+    }
+
+    if (m_WakeEvent)
+    {
+        ::CloseHandle(m_WakeEvent);
+        m_WakeEvent = NULL;
+    }
+    if (m_FreeEvent)
+    {
+        ::CloseHandle(m_FreeEvent);
+        m_FreeEvent = NULL;
+    }
+
+    if (m_File)
+    {
+        fclose(m_File);
+        m_File = NULL;
+    }
+
+    for (i = 0; i < SOUNDLOG_BUFFER_COUNT; ++i)
+    {
+        delete[] m_Buffers[i].m_Data;
+        m_Buffers[i].m_Data = NULL;
+        m_Buffers[i].m_Used = 0;
+        m_Buffers[i].m_Full = 0;
+    }
+
+    delete[] m_HandleKeys;
+    delete[] m_HandleValues;
+    m_HandleKeys = NULL;
+    m_HandleValues = NULL;
+    m_HandleCapacity = 0;
+    m_HandleCount = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Recording
+//-----------------------------------------------------------------------------
+
+void SoundCommandLog::RecordCreateSource(void *source, CK_WAVESOUND_TYPE type, const CKWaveFormat *wf, CKDWORD bytes, CKBOOL streamed)
+{
+    SoundLogCreateSource data;
+
+    if (!m_File || !source)
+        return;
+
+    memset(&data, 0, sizeof(data));
+    data.m_Type = (CKDWORD)type;
+    data.m_Bytes = bytes;
+    data.m_Streamed = streamed ? 1 : 0;
+    if (wf)
+        memcpy(&data.m_Format, wf, sizeof(WAVEFORMATEX));
+
+    ::EnterCriticalSection(&m_Lock);
+    data.m_Source = AddHandle(source);
+    Append(SOUNDLOG_CREATESOURCE, &data, sizeof(data));
+    ::LeaveCriticalSection(&m_Lock);
+}
+
+void SoundCommandLog::RecordDuplicateSource(void *source, void *duplicate)
+{
+    SoundLogDuplicateSource data;
+
+    if (!m_File || !duplicate)
+        return;
+
+    ::EnterCriticalSection(&m_Lock);
+    data.m_Source = FindHandle(source);
+    data.m_Duplicate = AddHandle(duplicate);
+    Append(SOUNDLOG_DUPLICATESOURCE, &data, sizeof(data));
+    ::LeaveCriticalSection(&m_Lock);
+}
+
+void SoundCommandLog::RecordReleaseSource(void *source)
+{
+    SoundLogSource data;
+
+    if (!m_File || !source)
+        return;
+
+    ::EnterCriticalSection(&m_Lock);
+    data.m_Source = FindHandle(source);
+    RemoveHandle(source);
+    Append(SOUNDLOG_RELEASESOURCE, &data, sizeof(data));
+    ::LeaveCriticalSection(&m_Lock);
+}
+
+void SoundCommandLog::RecordPlay(CKWaveSound *ws, void *source, CKBOOL loop)
+{
+    SoundLogPlay data;
+
+    if (!m_File)
+        return;
+
+    data.m_Sound = ws ? ws->GetID() : 0;
+    data.m_Loop = loop ? 1 : 0;
+
+    ::EnterCriticalSection(&m_Lock);
+    data.m_Source = FindHandle(source);
+    Append(SOUNDLOG_PLAY, &data, sizeof(data));
+    ::LeaveCriticalSection(&m_Lock);
+}
+
+void SoundCommandLog::RecordPlayAt(CKWaveSound *ws, void *source, CKBOOL loop, float delay)
+{
+    SoundLogPlayAt data;
+
+    if (!m_File)
+        return;
+
+    data.m_Sound = ws ? ws->GetID() : 0;
+    data.m_Loop = loop ? 1 : 0;
+    data.m_Delay = delay;
+
+    ::EnterCriticalSection(&m_Lock);
+    data.m_Source = FindHandle(source);
+    Append(SOUNDLOG_PLAYAT, &data, sizeof(data));
+    ::LeaveCriticalSection(&m_Lock);
+}
+
+void SoundCommandLog::RecordPause(CKWaveSound *ws, void *source)
+{
+    SoundLogPause data;
+
+    if (!m_File)
+        return;
+
+    data.m_Sound = ws ? ws->GetID() : 0;
+
+    ::EnterCriticalSection(&m_Lock);
+    data.m_Source = FindHandle(source);
+    Append(SOUNDLOG_PAUSE, &data, sizeof(data));
+    ::LeaveCriticalSection(&m_Lock);
+}
+
+void SoundCommandLog::RecordSetPlayPosition(void *source, int pos)
+{
+    SoundLogPlayPosition data;
+
+    if (!m_File)
+        return;
+
+    data.m_Position = pos;
+
+    ::EnterCriticalSection(&m_Lock);
+    data.m_Source = FindHandle(source);
+    Append(SOUNDLOG_SETPLAYPOSITION, &data, sizeof(data));
+    ::LeaveCriticalSection(&m_Lock);
+}
+
+void SoundCommandLog::RecordUpdateSettings(void *source, CK_SOUNDMANAGER_CAPS options, const CKWaveSoundSettings &settings)
+{
+    SoundLogSettings data;
+
+    if (!m_File)
+        return;
+
+    data.m_Options = (CKDWORD)options;
+    data.m_Settings = settings;
+
+    ::EnterCriticalSection(&m_Lock);
+    data.m_Source = FindHandle(source);
+    Append(SOUNDLOG_UPDATESETTINGS, &data, sizeof(data));
+    ::LeaveCriticalSection(&m_Lock);
+}
+
+void SoundCommandLog::RecordUpdate3DSettings(void *source, CK_SOUNDMANAGER_CAPS options, const CKWaveSound3DSettings &settings)
+{
+    SoundLog3DSettings data;
+
+    if (!m_File)
+        return;
+
+    data.m_Options = (CKDWORD)options;
+    data.m_Settings = settings;
+
+    ::EnterCriticalSection(&m_Lock);
+    data.m_Source = FindHandle(source);
+    Append(SOUNDLOG_UPDATE3DSETTINGS, &data, sizeof(data));
+    ::LeaveCriticalSection(&m_Lock);
+}
+
+void SoundCommandLog::RecordUpdateListenerSettings(CK_SOUNDMANAGER_CAPS options, const CKListenerSettings &settings)
+{
+    SoundLogListenerSettings data;
+
+    if (!m_File)
+        return;
+
+    data.m_Options = (CKDWORD)options;
+    data.m_Settings = settings;
+
+    ::EnterCriticalSection(&m_Lock);
+    Append(SOUNDLOG_UPDATELISTENERSETTINGS, &data, sizeof(data));
+    ::LeaveCriticalSection(&m_Lock);
+}
+
+void SoundCommandLog::RecordPostProcess(float deltaTime)
+{
+    SoundLogPostProcess data;
+
+    if (!m_File)
+        return;
+
+    data.m_DeltaTime = deltaTime;
+
+    ::EnterCriticalSection(&m_Lock);
+    Append(SOUNDLOG_POSTPROCESS, &data, sizeof(data));
+    ::LeaveCriticalSection(&m_Lock);
+}
+
+void SoundCommandLog::Append(SOUNDLOG_OP op, const void *payload, int size)
+{
+    SoundLogRecord record;
+    LARGE_INTEGER now;
+    LONGLONG micros;
+    Buffer *buffer;
+    int total = (int)sizeof(SoundLogRecord) + size;
+
+    ::QueryPerformanceCounter(&now);
+    micros = (now.QuadPart - m_LastTime) * 1000000 / m_Frequency;
+    m_LastTime = now.QuadPart;
+
+    record.m_Op = (BYTE)op;
+    record.m_Reserved = 0;
+    record.m_Size = (CKWORD)size;
+    record.m_DeltaMicros = micros > 0xFFFFFFFF ? 0xFFFFFFFF : (CKDWORD)micros;
+
+    buffer = &m_Buffers[m_Current];
+    if (buffer->m_Used + total > SOUNDLOG_BUFFER_SIZE)
+    {
+        Submit();
+        buffer = &m_Buffers[m_Current];
+    }
+
+    memcpy(buffer->m_Data + buffer->m_Used, &record, sizeof(record));
+    memcpy(buffer->m_Data + buffer->m_Used + sizeof(record), payload, size);
+    buffer->m_Used += total;
+    ++m_RecordCount;
+}
+
+void SoundCommandLog::Submit()
+{
+    // Hand the current buffer over and move on to the next one
+    ::InterlockedExchange(&m_Buffers[m_Current].m_Full, 1);
+    ::SetEvent(m_WakeEvent);
+
+    m_Current = (m_Current + 1) % SOUNDLOG_BUFFER_COUNT;
+
+    // The writer thread is behind: wait rather than lose commands
+    while (m_Buffers[m_Current].m_Full)
+        ::WaitForSingleObject(m_FreeEvent, INFINITE);
+}
+
+//-----------------------------------------------------------------------------
+// Writer thread
+//-----------------------------------------------------------------------------
+
+DWORD WINAPI SoundCommandLog::WriterThread(LPVOID param)
+{
+    ((SoundCommandLog *)param)->WriterLoop();
+    return 0;
+}
+
+void SoundCommandLog::WriterLoop()
+{
+    for (;;)
+    {
+        ::WaitForSingleObject(m_WakeEvent, INFINITE);
+
+        if (m_Stop)
+        {
+            // Everything submitted before the stop request is visible now
+            WriteFullBuffers();
+            break;
+        }
+        WriteFullBuffers();
+    }
+
+    fflush(m_File);
+}
+
+void SoundCommandLog::WriteFullBuffers()
+{
+    while (m_Buffers[m_NextToWrite].m_Full)
+    {
+        Buffer &buffer = m_Buffers[m_NextToWrite];
+        fwrite(buffer.m_Data, 1, buffer.m_Used, m_File);
+        buffer.m_Used = 0;
+        ::InterlockedExchange(&buffer.m_Full, 0);
+        ::SetEvent(m_FreeEvent);
+
+        m_NextToWrite = (m_NextToWrite + 1) % SOUNDLOG_BUFFER_COUNT;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Source handles
+//-----------------------------------------------------------------------------
+
+int SoundCommandLog::FindHandleSlot(void *source) const
+{
+    int mask = m_HandleCapacity - 1;
+    int slot = (int)(HashSource(source) & (unsigned int)mask);
+
+    while (m_HandleKeys[slot])
+    {
+        if (m_HandleKeys[slot] == source)
+            return slot;
+        slot = (slot + 1) & mask;
+    }
+    return -1;
+}
+
+CKDWORD SoundCommandLog::FindHandle(void *source) const
+{
+    int slot;
+
+    if (!source)
+        return 0;
+
+    slot = FindHandleSlot(source);
+    return (slot >= 0) ? m_HandleValues[slot] : 0;
+}
+
+CKDWORD SoundCommandLog::AddHandle(void *source)
+{
+    int mask, slot;
+
+    // Source pointers can be reused once released, the latest wins
+    slot = FindHandleSlot(source);
+    if (slot >= 0)
+    {
+        m_HandleValues[slot] = m_NextHandle;
+        return m_NextHandle++;
+    }
+
+    if ((m_HandleCount + 1) * 2 > m_HandleCapacity)
+        GrowHandles();
+
+    mask = m_HandleCapacity - 1;
+    slot = (int)(HashSource(source) & (unsigned int)mask);
+    while (m_HandleKeys[slot])
+        slot = (slot + 1) & mask;
+
+    m_HandleKeys[slot] = source;
+    m_HandleValues[slot] = m_NextHandle;
+    ++m_HandleCount;
+    return m_NextHandle++;
+}
+
+void SoundCommandLog::RemoveHandle(void *source)
+{
+    int mask = m_HandleCapacity - 1;
+    int hole = FindHandleSlot(source);
+    int slot;
+
+    if (hole < 0)
+        return;
+
+    // Backward-shift deletion keeps probe chains intact without tombstones
+    slot = (hole + 1) & mask;
+    while (m_HandleKeys[slot])
+    {
+        int home = (int)(HashSource(m_HandleKeys[slot]) & (unsigned int)mask);
+        if (((slot - home) & mask) >= ((slot - hole) & mask))
+        {
+            m_HandleKeys[hole] = m_HandleKeys[slot];
+            m_HandleValues[hole] = m_HandleValues[slot];
+            hole = slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    m_HandleKeys[hole] = NULL;
+    --m_HandleCount;
+}
+
+void SoundCommandLog::GrowHandles()
+{
+    void **oldKeys = m_HandleKeys;
+    CKDWORD *oldValues = m_HandleValues;
+    int oldCapacity = m_HandleCapacity;
+    int i, mask;
+
+    m_HandleCapacity = oldCapacity * 2;
+    m_HandleKeys = new void *[m_HandleCapacity];
+    m_HandleValues = new CKDWORD[m_HandleCapacity];
+    memset(m_HandleKeys, 0, m_HandleCapacity * sizeof(void *));
+    mask = m_HandleCapacity - 1;
+
+    for (i = 0; i < oldCapacity; ++i)
+    {
+        if (oldKeys[i])
+        {
+            int slot = (int)(HashSource(oldKeys[i]) & (unsigned int)mask);
+            while (m_HandleKeys[slot])
+                slot = (slot + 1) & mask;
+            m_HandleKeys[slot] = oldKeys[i];
+            m_HandleValues[slot] = oldValues[i];
+        }
+    }
+
+    delete[] oldKeys;
+    delete[] oldValues;
+}
+
+//-----------------------------------------------------------------------------
+// SoundCommandReader
+//-----------------------------------------------------------------------------
+
+SoundCommandReader::SoundCommandReader()
+{
+    m_File = NULL;
+}
+
+SoundCommandReader::~SoundCommandReader()
+{
+    Close();
+}
+
+CKBOOL SoundCommandReader::Open(const char *path)
+{
+    SoundLogHeader header;
+
+    Close();
+
+    if (!path)
+        return FALSE;
+
+    m_File = fopen(path, "rb");
+    if (!m_File)
+        return FALSE;
+
+    if (fread(&header, sizeof(header), 1, m_File) != 1 ||
+        header.m_Magic != SOUNDLOG_MAGIC || header.m_Version != SOUNDLOG_VERSION)
+    {
+        Close();
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+void SoundCommandReader::Close()
+{
+    if (m_File)
+    {
+        fclose(m_File);
+        m_File = NULL;
+    }
+}
+
+CKBOOL SoundCommandReader::Next(SoundLogRecord &record, void *payload, int capacity)
+{
+    int size, kept;
+
+    if (!m_File)
+        return FALSE;
+
+    if (fread(&record, sizeof(record), 1, m_File) != 1)
+        return FALSE;
+
+    // Payloads recorded by a build with larger structures are truncated,
+    // smaller ones leave the tail zeroed
+    size = record.m_Size;
+    kept = (size < capacity) ? size : capacity;
+    if (payload && capacity > 0)
+        memset(payload, 0, capacity);
+    if (kept > 0 && fread(payload, 1, kept, m_File) != (size_t)kept)
+        return FALSE;
+    if (size > kept)
+        fseek(m_File, size - kept, SEEK_CUR);
+
+    return TRUE;
+}
@@ -0,0 +1,230 @@
+#ifndef SOUNDCOMMANDLOG_H
+#define SOUNDCOMMANDLOG_H
+
+#include <stdio.h>
+#include <windows.h>
+
+#include "CKAll.h"
+
+// Environment variable enabling the capture at OnCKInit
+#define SOUNDLOG_ENV_PATH "DX8SOUND_COMMAND_LOG"
+
+#define SOUNDLOG_MAGIC        0x4C534458 /* 'XDSL' */
+#define SOUNDLOG_VERSION      1
+#define SOUNDLOG_BUFFER_COUNT 4
+#define SOUNDLOG_BUFFER_SIZE  (256 * 1024)
+
+/**
+ * @brief Sound API calls captured in a command log
+ */
+typedef enum SOUNDLOG_OP
+{
+    SOUNDLOG_CREATESOURCE = 1,
+    SOUNDLOG_DUPLICATESOURCE,
+    SOUNDLOG_RELEASESOURCE,
+    SOUNDLOG_PLAY,
+    SOUNDLOG_PAUSE,
+    SOUNDLOG_SETPLAYPOSITION,
+    SOUNDLOG_UPDATESETTINGS,
+    SOUNDLOG_UPDATE3DSETTINGS,
+    SOUNDLOG_UPDATELISTENERSETTINGS,
+    SOUNDLOG_POSTPROCESS,
+    SOUNDLOG_PLAYAT,
+    SOUNDLOG_OPCOUNT
+} SOUNDLOG_OP;
+
+// File layout: SoundLogHeader, then records made of a SoundLogRecord
+// followed by m_Size bytes of the payload matching m_Op. Sources are
+// identified by handles numbered from 1 in creation order.
+
+struct SoundLogHeader
+{
+    CKDWORD m_Magic;
+    CKDWORD m_Version;
+};
+
+struct SoundLogRecord
+{
+    BYTE m_Op;
+    BYTE m_Reserved;
+    CKWORD m_Size;
+    CKDWORD m_DeltaMicros; /* Time since the previous record */
+};
+
+struct SoundLogCreateSource
+{
+    CKDWORD m_Source;
+    CKDWORD m_Type;
+    CKDWORD m_Bytes;
+    CKDWORD m_Streamed;
+    WAVEFORMATEX m_Format;
+};
+
+struct SoundLogDuplicateSource
+{
+    CKDWORD m_Source;
+    CKDWORD m_Duplicate;
+};
+
+struct SoundLogSource
+{
+    CKDWORD m_Source;
+};
+
+struct SoundLogPlay
+{
+    CK_ID m_Sound; /* 0 for minions */
+    CKDWORD m_Source;
+    CKDWORD m_Loop;
+};
+
+struct SoundLogPlayAt
+{
+    CK_ID m_Sound; /* 0 for minions */
+    CKDWORD m_Source;
+    CKDWORD m_Loop;
+    float m_Delay; /* Seconds after the audio clock of the call */
+};
+
+struct SoundLogPause
+{
+    CK_ID m_Sound;
+    CKDWORD m_Source;
+};
+
+struct SoundLogPlayPosition
+{
+    CKDWORD m_Source;
+    int m_Position;
+};
+
+struct SoundLogSettings
+{
+    CKDWORD m_Source;
+    CKDWORD m_Options;
+    CKWaveSoundSettings m_Settings;
+};
+
+struct SoundLog3DSettings
+{
+    CKDWORD m_Source;
+    CKDWORD m_Options;
+    CKWaveSound3DSettings m_Settings;
+};
+
+struct SoundLogListenerSettings
+{
+    CKDWORD m_Options;
+    CKListenerSettings m_Settings;
+};
+
+struct SoundLogPostProcess
+{
+    float m_DeltaTime;
+};
+
+/**
+ * @brief Low-overhead binary capture of the sound API command stream
+ *
+ * Records are appended to one of a few preallocated buffers under a
+ * critical section; full buffers are handed to a writer thread, so the
+ * calling thread never touches the file. When the writer falls behind the
+ * recorder waits for a free buffer rather than dropping commands.
+ */
+class SoundCommandLog
+{
+public:
+    SoundCommandLog();
+    ~SoundCommandLog();
+
+    CKBOOL Open(const char *path);
+    void Close();
+    CKBOOL IsOpen() const { return m_File != NULL; }
+    CKDWORD GetRecordCount() const { return m_RecordCount; }
+
+    void RecordCreateSource(void *source, CK_WAVESOUND_TYPE type, const CKWaveFormat *wf, CKDWORD bytes, CKBOOL streamed);
+    void RecordDuplicateSource(void *source, void *duplicate);
+    void RecordReleaseSource(void *source);
+    void RecordPlay(CKWaveSound *ws, void *source, CKBOOL loop);
+    void RecordPlayAt(CKWaveSound *ws, void *source, CKBOOL loop, float delay);
+    void RecordPause(CKWaveSound *ws, void *source);
+    void RecordSetPlayPosition(void *source, int pos);
+    void RecordUpdateSettings(void *source, CK_SOUNDMANAGER_CAPS options, const CKWaveSoundSettings &settings);
+    void RecordUpdate3DSettings(void *source, CK_SOUNDMANAGER_CAPS options, const CKWaveSound3DSettings &settings);
+    void RecordUpdateListenerSettings(CK_SOUNDMANAGER_CAPS options, const CKListenerSettings &settings);
+    void RecordPostProcess(float deltaTime);
+
+private:
+    struct Buffer
+    {
+        BYTE *m_Data;
+        int m_Used;
+        volatile LONG m_Full;
+    };
+
+    // Appends a record; must be called with m_Lock held
+    void Append(SOUNDLOG_OP op, const void *payload, int size);
+    void Submit();
+
+    // Source pointer -> handle table (open addressing)
+    CKDWORD FindHandle(void *source) const;
+    CKDWORD AddHandle(void *source);
+    void RemoveHandle(void *source);
+    int FindHandleSlot(void *source) const;
+    void GrowHandles();
+
+    static DWORD WINAPI WriterThread(LPVOID param);
+    void WriterLoop();
+    void WriteFullBuffers();
+
+    FILE *m_File;
+    HANDLE m_Thread;
+    HANDLE m_WakeEvent;
+    HANDLE m_FreeEvent;
+    volatile LONG m_Stop;
+    CRITICAL_SECTION m_Lock;
+
+    Buffer m_Buffers[SOUNDLOG_BUFFER_COUNT];
+    int m_Current;     /* Buffer being filled */
+    int m_NextToWrite; /* Next buffer the writer thread flushes */
+
+    LONGLONG m_LastTime;
+    LONGLONG m_Frequency;
+    CKDWORD m_RecordCount;
+
+    void **m_HandleKeys;
+    CKDWORD *m_HandleValues;
+    int m_HandleCapacity;
+    int m_HandleCount;
+    CKDWORD m_NextHandle;
+
+    // Prevent copying (VC6 style - declare but don't implement)
+    SoundCommandLog(const SoundCommandLog &);
+    SoundCommandLog &operator=(const SoundCommandLog &);
+};
+
+/**
+ * @brief Sequential reader for command logs
+ */
+class SoundCommandReader
+{
+public:
+    SoundCommandReader();
+    ~SoundCommandReader();
+
+    CKBOOL Open(const char *path);
+    void Close();
+
+    // Reads the next record and its payload (truncated to capacity).
+    // Returns FALSE at the end of the log.
+    CKBOOL Next(SoundLogRecord &record, void *payload, int capacity);
+
+private:
+    FILE *m_File;
+
+    // Prevent copying (VC6 style - declare but don't implement)
+    SoundCommandReader(const SoundCommandReader &);
+    SoundCommandReader &operator=(const SoundCommandReader &);
+};
+
+#endif /* SOUNDCOMMANDLOG_H */
@@ -0,0 +1,199 @@
+#include "SoundConvolver.h"
+#include "SoundSimd.h"
+
+#include <stdlib.h>
+
+#define SOUNDCONVOLVER_BINS      SOUNDCONVOLVER_PARTITION       /* Packed bins of a 2-partition transform */
+#define SOUNDCONVOLVER_FFT_SIZE  (2 * SOUNDCONVOLVER_PARTITION)
+
+// sum += x * h over packed spectra. Bin 0 holds two real values (DC and
+// Nyquist) and is multiplied as a complex number here: callers fix it up.
+static void MultiplyAccumulate(const float *x, const float *h, float *sum)
+{
+    const float *xr = x, *xi = x + SOUNDCONVOLVER_BINS;
+    const float *hr = h, *hi = h + SOUNDCONVOLVER_BINS;
+    float *sr = sum, *si = sum + SOUNDCONVOLVER_BINS;
+    int i = 0;
+
+#ifdef SOUNDSIMD_SSE
+    for (; i + 4 <= SOUNDCONVOLVER_BINS; i += 4)
+    {
+        __m128 ar = _mm_loadu_ps(xr + i);
+        __m128 ai = _mm_loadu_ps(xi + i);
+        __m128 br = _mm_loadu_ps(hr + i);
+        __m128 bi = _mm_loadu_ps(hi + i);
+        _mm_storeu_ps(sr + i, _mm_add_ps(_mm_loadu_ps(sr + i), _mm_sub_ps(_mm_mul_ps(ar, br), _mm_mul_ps(ai, bi))));
+        _mm_storeu_ps(si + i, _mm_add_ps(_mm_loadu_ps(si + i), _mm_add_ps(_mm_mul_ps(ar, bi), _mm_mul_ps(ai, br))));
+    }
+#endif
+
+    for (; i < SOUNDCONVOLVER_BINS; ++i)
+    {
+        sr[i] += xr[i] * hr[i] - xi[i] * hi[i];
+        si[i] += xr[i] * hi[i] + xi[i] * hr[i];
+    }
+}
+
+SoundConvolver::SoundConvolver()
+{
+    m_Partitions = 0;
+    m_FilterChannels = 0;
+    m_Filter = NULL;
+    m_History = NULL;
+    m_Current = 0;
+    m_Input = NULL;
+    m_Output = NULL;
+    m_Time = NULL;
+    m_Sum = NULL;
+    m_Fill = 0;
+    m_Gain = 1.0f;
+}
+
+SoundConvolver::~SoundConvolver()
+{
+    ReleaseBuffers();
+}
+
+void SoundConvolver::ReleaseBuffers()
+{
+    free(m_Filter);
+    free(m_History);
+    free(m_Input);
+    free(m_Output);
+    free(m_Time);
+    free(m_Sum);
+
+    m_Filter = NULL;
+    m_History = NULL;
+    m_Input = NULL;
+    m_Output = NULL;
+    m_Time = NULL;
+    m_Sum = NULL;
+    m_Partitions = 0;
+    m_FilterChannels = 0;
+}
+
+CKBOOL SoundConvolver::SetImpulseResponse(const float *ir, int frames, int channels)
+{
+    int spectrumSize = 2 * SOUNDCONVOLVER_BINS;
+    int p, ch, i, count;
+    float *spectrum;
+
+    ReleaseBuffers();
+
+    if (!ir || frames <= 0 || channels < 1 || channels > 2)
+        return FALSE;
+    if (!m_FFT.Init(SOUNDCONVOLVER_FFT_SIZE))
+        return FALSE;
+
+    m_Partitions = (frames + SOUNDCONVOLVER_PARTITION - 1) / SOUNDCONVOLVER_PARTITION;
+    m_FilterChannels = channels;
+
+    m_Filter = (float *)malloc(m_Partitions * channels * spectrumSize * sizeof(float));
+    m_History = (float *)malloc(m_Partitions * spectrumSize * sizeof(float));
+    m_Input = (float *)malloc(SOUNDCONVOLVER_FFT_SIZE * sizeof(float));
+    m_Output = (float *)malloc(SOUNDCONVOLVER_PARTITION * 2 * sizeof(float));
+    m_Time = (float *)malloc(SOUNDCONVOLVER_FFT_SIZE * sizeof(float));
+    m_Sum = (float *)malloc(spectrumSize * sizeof(float));
+    if (!m_Filter || !m_History || !m_Input || !m_Output || !m_Time || !m_Sum)
+    {
+        ReleaseBuffers();
+        return FALSE;
+    }
+
+    /* Transform each zero-padded partition once, here rather than per block */
+    for (ch = 0; ch < channels; ++ch)
+    {
+        for (p = 0; p < m_Partitions; ++p)
+        {
+            count = frames - p * SOUNDCONVOLVER_PARTITION;
+            if (count > SOUNDCONVOLVER_PARTITION)
+                count = SOUNDCONVOLVER_PARTITION;
+
+            memset(m_Time, 0, SOUNDCONVOLVER_FFT_SIZE * sizeof(float));
+            for (i = 0; i < count; ++i)
+                m_Time[i] = ir[(p * SOUNDCONVOLVER_PARTITION + i) * channels + ch];
+
+            spectrum = GetSpectrum(m_Filter, ch * m_Partitions + p);
+            m_FFT.Forward(m_Time, spectrum, spectrum + SOUNDCONVOLVER_BINS);
+        }
+    }
+
+    Reset();
+    return TRUE;
+}
+
+void SoundConvolver::Reset()
+{
+    if (!m_Partitions)
+        return;
+
+    memset(m_History, 0, m_Partitions * 2 * SOUNDCONVOLVER_BINS * sizeof(float));
+    memset(m_Input, 0, SOUNDCONVOLVER_FFT_SIZE * sizeof(float));
+    memset(m_Output, 0, SOUNDCONVOLVER_PARTITION * 2 * sizeof(float));
+    m_Current = 0;
+    m_Fill = 0;
+}
+
+void SoundConvolver::Process(const float *input, float *output, int frames)
+{
+    int i;
+
+    if (!m_Partitions || !input || !output)
+        return;
+
+    for (i = 0; i < frames; ++i)
+    {
+        m_Input[SOUNDCONVOLVER_PARTITION + m_Fill] = (input[2 * i] + input[2 * i + 1]) * 0.5f;
+        output[2 * i] += m_Output[2 * m_Fill];
+        output[2 * i + 1] += m_Output[2 * m_Fill + 1];
+
+        if (++m_Fill == SOUNDCONVOLVER_PARTITION)
+        {
+            ProcessBlock();
+            m_Fill = 0;
+        }
+    }
+}
+
+void SoundConvolver::ProcessBlock()
+{
+    const float *x, *h;
+    float *newest;
+    float dc, nyquist;
+    int ch, p, i, slot;
+
+    newest = GetSpectrum(m_History, m_Current);
+    m_FFT.Forward(m_Input, newest, newest + SOUNDCONVOLVER_BINS);
+
+    for (ch = 0; ch < 2; ++ch)
+    {
+        memset(m_Sum, 0, 2 * SOUNDCONVOLVER_BINS * sizeof(float));
+        dc = nyquist = 0.0f;
+
+        /* Partition p of the response meets the input block of p blocks ago */
+        for (p = 0; p < m_Partitions; ++p)
+        {
+            slot = m_Current - p;
+            if (slot < 0)
+                slot += m_Partitions;
+            x = GetSpectrum(m_History, slot);
+            h = GetSpectrum(m_Filter, (ch % m_FilterChannels) * m_Partitions + p);
+
+            MultiplyAccumulate(x, h, m_Sum);
+            dc += x[0] * h[0];
+            nyquist += x[SOUNDCONVOLVER_BINS] * h[SOUNDCONVOLVER_BINS];
+        }
+        m_Sum[0] = dc;
+        m_Sum[SOUNDCONVOLVER_BINS] = nyquist;
+
+        /* Overlap-save: the first half wrapped around, keep the second */
+        m_FFT.Inverse(m_Sum, m_Sum + SOUNDCONVOLVER_BINS, m_Time);
+        for (i = 0; i < SOUNDCONVOLVER_PARTITION; ++i)
+            m_Output[2 * i + ch] = m_Time[SOUNDCONVOLVER_PARTITION + i] * m_Gain;
+    }
+
+    memcpy(m_Input, m_Input + SOUNDCONVOLVER_PARTITION, SOUNDCONVOLVER_PARTITION * sizeof(float));
+    if (++m_Current >= m_Partitions)
+        m_Current = 0;
+}
@@ -0,0 +1,69 @@
+#ifndef SOUNDCONVOLVER_H
+#define SOUNDCONVOLVER_H
+
+#include "CKAll.h"
+
+#include "SoundBusEffect.h"
+#include "SoundFFT.h"
+
+#define SOUNDCONVOLVER_PARTITION 512 /* Frames per partition, also the latency */
+
+/**
+ * @brief Uniformly partitioned convolution with an impulse response
+ *
+ * The impulse response is cut into partitions of SOUNDCONVOLVER_PARTITION
+ * frames, each transformed once when it is set. Every full block of input
+ * is transformed into a frequency-domain delay line; the output block is
+ * the inverse transform of the sum of the delayed input spectra multiplied
+ * by the matching partitions (overlap-save). The cost per frame grows
+ * linearly with the impulse response length, against its square for a
+ * direct convolution.
+ *
+ * The send is folded to mono and convolved with each channel of the
+ * impulse response. Output is delayed by one partition.
+ */
+class SoundConvolver : public SoundBusEffect
+{
+public:
+    SoundConvolver();
+    virtual ~SoundConvolver();
+
+    // Transforms the interleaved impulse response (1 or 2 channels),
+    // sampled at the mix rate
+    CKBOOL SetImpulseResponse(const float *ir, int frames, int channels);
+    int GetPartitionCount() const { return m_Partitions; }
+
+    void SetGain(float gain) { m_Gain = gain; }
+    float GetGain() const { return m_Gain; }
+
+    virtual SOUNDBUS_EFFECT GetType() const { return SOUNDBUS_CONVOLUTION; }
+    // The impulse response must already match the mix rate
+    virtual CKBOOL SetSampleRate(int /* sampleRate */) { return TRUE; }
+    virtual void Reset();
+    virtual void Process(const float *input, float *output, int frames);
+
+private:
+    void ReleaseBuffers();
+    void ProcessBlock();
+    float *GetSpectrum(float *spectra, int index) const { return spectra + index * SOUNDCONVOLVER_PARTITION * 2; }
+
+    SoundFFT m_FFT;
+    int m_Partitions;
+    int m_FilterChannels;
+    float *m_Filter;  /* Spectra of the partitions, per channel: re then im */
+    float *m_History; /* Frequency-domain delay line of the input blocks */
+    int m_Current;    /* Slot of the newest input spectrum */
+
+    float *m_Input;  /* Previous and current input blocks */
+    float *m_Output; /* Interleaved stereo block being played out */
+    float *m_Time;   /* Inverse transform output */
+    float *m_Sum;    /* Accumulated spectrum, re then im */
+    int m_Fill;      /* Frames of the current block received so far */
+    float m_Gain;
+
+    // Prevent copying (VC6 style - declare but don't implement)
+    SoundConvolver(const SoundConvolver &);
+    SoundConvolver &operator=(const SoundConvolver &);
+};
+
+#endif /* SOUNDCONVOLVER_H */
@@ -0,0 +1,215 @@
+#include "SoundFFT.h"
+#include "SoundSimd.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#define SOUNDFFT_PI 3.14159265358979323846
+
+SoundFFT::SoundFFT()
+{
+    m_Size = 0;
+    m_Half = 0;
+    m_BitReverse = NULL;
+    m_TwiddleRe = NULL;
+    m_TwiddleIm = NULL;
+    m_SplitRe = NULL;
+    m_SplitIm = NULL;
+    m_WorkRe = NULL;
+    m_WorkIm = NULL;
+}
+
+SoundFFT::~SoundFFT()
+{
+    Release();
+}
+
+void SoundFFT::Release()
+{
+    free(m_BitReverse);
+    free(m_TwiddleRe);
+    free(m_TwiddleIm);
+    free(m_SplitRe);
+    free(m_SplitIm);
+    free(m_WorkRe);
+    free(m_WorkIm);
+
+    m_BitReverse = NULL;
+    m_TwiddleRe = m_TwiddleIm = NULL;
+    m_SplitRe = m_SplitIm = NULL;
+    m_WorkRe = m_WorkIm = NULL;
+    m_Size = 0;
+    m_Half = 0;
+}
+
+CKBOOL SoundFFT::Init(int size)
+{
+    int half, bits, i, j, k, h;
+
+    if (size < 16 || (size & (size - 1)) != 0)
+        return FALSE;
+    if (size == m_Size)
+        return TRUE;
+
+    Release();
+
+    half = size / 2;
+    m_BitReverse = (int *)malloc(half * sizeof(int));
+    m_TwiddleRe = (float *)malloc(half * sizeof(float));
+    m_TwiddleIm = (float *)malloc(half * sizeof(float));
+    m_SplitRe = (float *)malloc(half * sizeof(float));
+    m_SplitIm = (float *)malloc(half * sizeof(float));
+    m_WorkRe = (float *)malloc(half * sizeof(float));
+    m_WorkIm = (float *)malloc(half * sizeof(float));
+    if (!m_BitReverse || !m_TwiddleRe || !m_TwiddleIm || !m_SplitRe || !m_SplitIm || !m_WorkRe || !m_WorkIm)
+    {
+        Release();
+        return FALSE;
+    }
+
+    for (bits = 0; (1 << bits) < half; ++bits)
+        ;
+    for (i = 0; i < half; ++i)
+    {
+        for (j = 0, k = i, h = 0; h < bits; ++h, k >>= 1)
+            j = (j << 1) | (k & 1);
+        m_BitReverse[i] = j;
+    }
+
+    /* The stage of half-size h uses exp(-i*pi*j/h), stored from index h-1 */
+    for (h = 1; h < half; h <<= 1)
+    {
+        for (j = 0; j < h; ++j)
+        {
+            m_TwiddleRe[h - 1 + j] = (float)cos(SOUNDFFT_PI * j / h);
+            m_TwiddleIm[h - 1 + j] = (float)-sin(SOUNDFFT_PI * j / h);
+        }
+    }
+
+    for (k = 0; k < half; ++k)
+    {
+        m_SplitRe[k] = (float)cos(2.0 * SOUNDFFT_PI * k / size);
+        m_SplitIm[k] = (float)-sin(2.0 * SOUNDFFT_PI * k / size);
+    }
+
+    m_Size = size;
+    m_Half = half;
+    return TRUE;
+}
+
+void SoundFFT::Transform(float *re, float *im) const
+{
+    const float *twRe, *twIm;
+    float ar, ai, tr, ti;
+    int h, g, j, a, b;
+
+    for (h = 1; h < m_Half; h <<= 1)
+    {
+        twRe = m_TwiddleRe + h - 1;
+        twIm = m_TwiddleIm + h - 1;
+
+        for (g = 0; g < m_Half; g += 2 * h)
+        {
+            j = 0;
+
+#ifdef SOUNDSIMD_SSE
+            for (; j + 4 <= h; j += 4)
+            {
+                a = g + j;
+                b = a + h;
+                __m128 wr = _mm_loadu_ps(twRe + j);
+                __m128 wi = _mm_loadu_ps(twIm + j);
+                __m128 br = _mm_loadu_ps(re + b);
+                __m128 bi = _mm_loadu_ps(im + b);
+                __m128 vr = _mm_sub_ps(_mm_mul_ps(br, wr), _mm_mul_ps(bi, wi));
+                __m128 vi = _mm_add_ps(_mm_mul_ps(br, wi), _mm_mul_ps(bi, wr));
+                __m128 xr = _mm_loadu_ps(re + a);
+                __m128 xi = _mm_loadu_ps(im + a);
+                _mm_storeu_ps(re + a, _mm_add_ps(xr, vr));
+                _mm_storeu_ps(im + a, _mm_add_ps(xi, vi));
+                _mm_storeu_ps(re + b, _mm_sub_ps(xr, vr));
+                _mm_storeu_ps(im + b, _mm_sub_ps(xi, vi));
+            }
+#endif
+
+            for (; j < h; ++j)
+            {
+                a = g + j;
+                b = a + h;
+                tr = re[b] * twRe[j] - im[b] * twIm[j];
+                ti = re[b] * twIm[j] + im[b] * twRe[j];
+                ar = re[a];
+                ai = im[a];
+                re[a] = ar + tr;
+                im[a] = ai + ti;
+                re[b] = ar - tr;
+                im[b] = ai - ti;
+            }
+        }
+    }
+}
+
+void SoundFFT::Forward(const float *input, float *re, float *im)
+{
+    float er, ei, orr, oi;
+    int k, m;
+
+    if (!m_Size)
+        return;
+
+    /* Even samples as the real part, odd samples as the imaginary part */
+    for (k = 0; k < m_Half; ++k)
+    {
+        m_WorkRe[m_BitReverse[k]] = input[2 * k];
+        m_WorkIm[m_BitReverse[k]] = input[2 * k + 1];
+    }
+    Transform(m_WorkRe, m_WorkIm);
+
+    /* Split into the spectra of the even and odd samples, then recombine */
+    re[0] = m_WorkRe[0] + m_WorkIm[0];
+    im[0] = m_WorkRe[0] - m_WorkIm[0];
+    for (k = 1; k < m_Half; ++k)
+    {
+        m = m_Half - k;
+        er = 0.5f * (m_WorkRe[k] + m_WorkRe[m]);
+        ei = 0.5f * (m_WorkIm[k] - m_WorkIm[m]);
+        orr = 0.5f * (m_WorkIm[k] + m_WorkIm[m]);
+        oi = -0.5f * (m_WorkRe[k] - m_WorkRe[m]);
+        re[k] = er + m_SplitRe[k] * orr - m_SplitIm[k] * oi;
+        im[k] = ei + m_SplitRe[k] * oi + m_SplitIm[k] * orr;
+    }
+}
+
+void SoundFFT::Inverse(const float *re, const float *im, float *output)
+{
+    float er, ei, dr, di, orr, oi, scale;
+    int k, m, n;
+
+    if (!m_Size)
+        return;
+
+    /* Rebuild the half-size spectrum, conjugated for an inverse transform */
+    m_WorkRe[0] = 0.5f * (re[0] + im[0]);
+    m_WorkIm[0] = -0.5f * (re[0] - im[0]);
+    for (k = 1; k < m_Half; ++k)
+    {
+        m = m_Half - k;
+        n = m_BitReverse[k];
+        er = 0.5f * (re[k] + re[m]);
+        ei = 0.5f * (im[k] - im[m]);
+        dr = 0.5f * (re[k] - re[m]);
+        di = 0.5f * (im[k] + im[m]);
+        orr = dr * m_SplitRe[k] + di * m_SplitIm[k];
+        oi = di * m_SplitRe[k] - dr * m_SplitIm[k];
+        m_WorkRe[n] = er - oi;
+        m_WorkIm[n] = -(ei + orr);
+    }
+    Transform(m_WorkRe, m_WorkIm);
+
+    scale = 1.0f / m_Half;
+    for (k = 0; k < m_Half; ++k)
+    {
+        output[2 * k] = m_WorkRe[k] * scale;
+        output[2 * k + 1] = -m_WorkIm[k] * scale;
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef SOUNDFFT_H
+#define SOUNDFFT_H
+
+#include "CKAll.h"
+
+/**
+ * @brief Real FFT of a fixed power-of-two size
+ *
+ * A real transform of N samples runs as a complex transform of N/2 points
+ * on split real/imaginary arrays, whose butterflies are vectorized when SSE
+ * is available (see SoundSimd.h).
+ *
+ * Spectra are packed in N/2 bins: re[0] holds DC and im[0] holds the
+ * Nyquist bin, both real. Inverse(Forward(x)) gives x back.
+ */
+class SoundFFT
+{
+public:
+    SoundFFT();
+    ~SoundFFT();
+
+    // Size of the real transform, a power of two of at least 16
+    CKBOOL Init(int size);
+    int GetSize() const { return m_Size; }
+
+    void Forward(const float *input, float *re, float *im);
+    void Inverse(const float *re, const float *im, float *output);
+
+private:
+    void Release();
+    // Complex FFT in place, the input in bit-reversed order
+    void Transform(float *re, float *im) const;
+
+    int m_Size;
+    int m_Half;
+    int *m_BitReverse;
+    float *m_TwiddleRe; /* Twiddles of each stage, stored contiguously */
+    float *m_TwiddleIm;
+    float *m_SplitRe;   /* exp(-2*pi*i*k/N), to split the half-size transform */
+    float *m_SplitIm;
+    float *m_WorkRe;
+    float *m_WorkIm;
+
+    // Prevent copying (VC6 style - declare but don't implement)
+    SoundFFT(const SoundFFT &);
+    SoundFFT &operator=(const SoundFFT &);
+};
+
+#endif /* SOUNDFFT_H */
@@ -0,0 +1,85 @@
+#include "SoundFadeScheduler.h"
+
+SoundFade *SoundFadeScheduler::Start(CK_ID sound, void *source, float from, float to, float duration, CKDWORD flags)
+{
+    SoundFade *fade = Find(source);
+    SoundFade added;
+
+    if (!fade)
+    {
+        memset(&added, 0, sizeof(SoundFade));
+        m_Fades.PushBack(added);
+        fade = &m_Fades[m_Fades.Size() - 1];
+    }
+
+    fade->m_Sound = sound;
+    fade->m_Source = source;
+    fade->m_From = from;
+    fade->m_To = to;
+    fade->m_Elapsed = 0.0f;
+    fade->m_Duration = duration;
+    fade->m_Applied = from;
+    fade->m_Flags = flags;
+    return fade;
+}
+
+SoundFade *SoundFadeScheduler::Find(void *source)
+{
+    int i;
+
+    for (i = 0; i < m_Fades.Size(); ++i)
+    {
+        if (m_Fades[i].m_Source == source)
+            return &m_Fades[i];
+    }
+    return NULL;
+}
+
+CKBOOL SoundFadeScheduler::Remove(void *source)
+{
+    int i;
+
+    for (i = 0; i < m_Fades.Size(); ++i)
+    {
+        if (m_Fades[i].m_Source == source)
+        {
+            RemoveAt(i);
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+void SoundFadeScheduler::RemoveSound(CK_ID sound)
+{
+    int i;
+
+    for (i = 0; i < m_Fades.Size();)
+    {
+        if (m_Fades[i].m_Sound == sound)
+            RemoveAt(i);
+        else
+            ++i;
+    }
+}
+
+void SoundFadeScheduler::RemoveAt(int index)
+{
+    int last = m_Fades.Size() - 1;
+
+    if (index < 0 || index > last)
+        return;
+
+    if (index != last)
+        m_Fades[index] = m_Fades[last];
+    m_Fades.PopBack();
+}
+
+float SoundFadeScheduler::GetGain(const SoundFade &fade, float elapsed)
+{
+    if (elapsed >= fade.m_Duration || fade.m_Duration <= 0.0f)
+        return fade.m_To;
+    if (elapsed <= 0.0f)
+        return fade.m_From;
+    return fade.m_From + (fade.m_To - fade.m_From) * (elapsed / fade.m_Duration);
+}
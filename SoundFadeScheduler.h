@@ -0,0 +1,63 @@
+#ifndef SOUNDFADESCHEDULER_H
+#define SOUNDFADESCHEDULER_H
+
+#include "CKAll.h"
+
+#define SOUNDFADE_STOP   0x00000001 /* Stop the sound when the ramp ends */
+#define SOUNDFADE_NATIVE 0x00000002 /* A CKWaveSound fade: the sound computes the gains, m_To holds the last one */
+
+/**
+ * @brief A gain ramp of one source
+ */
+struct SoundFade
+{
+    CK_ID m_Sound;    /* Sound the source belonged to when the ramp started */
+    void *m_Source;
+    float m_From;
+    float m_To;
+    float m_Elapsed;  /* In milliseconds */
+    float m_Duration; /* In milliseconds */
+    float m_Applied;  /* Gain last sent to the source */
+    CKDWORD m_Flags;
+};
+
+/**
+ * @brief Compact list of the gain ramps in progress
+ *
+ * Only sources with a running ramp are stored, so advancing the fades
+ * costs nothing for the sounds that merely play. A source has at most one
+ * ramp: starting another one retargets it from its current gain. Removal
+ * swaps the last ramp into the freed slot, like ActiveSoundSet. The fades
+ * a CKWaveSound runs itself are kept here too, so their steps are
+ * coalesced like the ramps.
+ */
+class SoundFadeScheduler
+{
+public:
+    SoundFadeScheduler() {}
+
+    // Starts a ramp, or retargets the one of the source
+    SoundFade *Start(CK_ID sound, void *source, float from, float to, float duration, CKDWORD flags);
+    SoundFade *Find(void *source);
+    // Returns TRUE if the source had a ramp
+    CKBOOL Remove(void *source);
+    // Removes the ramps started for a sound
+    void RemoveSound(CK_ID sound);
+    void RemoveAt(int index);
+    void Clear() { m_Fades.Clear(); }
+
+    int Size() const { return m_Fades.Size(); }
+    SoundFade &operator[](int index) { return m_Fades[index]; }
+
+    // Gain of a ramp after the given time (linear in amplitude)
+    static float GetGain(const SoundFade &fade, float elapsed);
+
+private:
+    XArray<SoundFade> m_Fades;
+
+    // Prevent copying (VC6 style - declare but don't implement)
+    SoundFadeScheduler(const SoundFadeScheduler &);
+    SoundFadeScheduler &operator=(const SoundFadeScheduler &);
+};
+
+#endif /* SOUNDFADESCHEDULER_H */
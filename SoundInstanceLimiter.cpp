@@ -0,0 +1,124 @@
+#include "SoundInstanceLimiter.h"
+
+SoundInstanceLimiter::SoundInstanceLimiter()
+{
+    memset(&m_Stats, 0, sizeof(SoundInstanceStats));
+}
+
+void SoundInstanceLimiter::SetLimit(void *asset, int maxInstances, SOUND_STEAL_POLICY policy, float coalesceWindow)
+{
+    SoundInstanceLimit limit;
+    int i;
+
+    limit.m_Asset = asset;
+    limit.m_MaxInstances = (maxInstances > 0) ? maxInstances : 0;
+    limit.m_Policy = policy;
+    limit.m_CoalesceWindow = (coalesceWindow > 0.0f) ? coalesceWindow : 0.0f;
+
+    for (i = 0; i < m_Limits.Size(); ++i)
+    {
+        if (m_Limits[i].m_Asset == asset)
+        {
+            m_Limits[i] = limit;
+            return;
+        }
+    }
+    m_Limits.PushBack(limit);
+}
+
+CKBOOL SoundInstanceLimiter::RemoveLimit(void *asset)
+{
+    CKBOOL found = FALSE;
+    int last, i;
+
+    for (i = 0; i < m_Limits.Size(); ++i)
+    {
+        if (m_Limits[i].m_Asset == asset)
+        {
+            last = m_Limits.Size() - 1;
+            if (i != last)
+                m_Limits[i] = m_Limits[last];
+            m_Limits.PopBack();
+            found = TRUE;
+            break;
+        }
+    }
+
+    for (i = 0; i < m_Instances.Size();)
+    {
+        if (m_Instances[i].m_Asset == asset)
+        {
+            last = m_Instances.Size() - 1;
+            if (i != last)
+                m_Instances[i] = m_Instances[last];
+            m_Instances.PopBack();
+        }
+        else
+        {
+            ++i;
+        }
+    }
+
+    return found;
+}
+
+const SoundInstanceLimit *SoundInstanceLimiter::GetLimit(void *asset) const
+{
+    int i;
+
+    for (i = 0; i < m_Limits.Size(); ++i)
+    {
+        if (m_Limits[i].m_Asset == asset)
+            return &m_Limits[i];
+    }
+    return NULL;
+}
+
+void SoundInstanceLimiter::AddInstance(void *asset, void *source, float time)
+{
+    SoundInstance instance;
+
+    instance.m_Source = source;
+    instance.m_Asset = asset;
+    instance.m_StartTime = time;
+    m_Instances.PushBack(instance);
+}
+
+CKBOOL SoundInstanceLimiter::RemoveInstance(void *source)
+{
+    int last, i;
+
+    for (i = 0; i < m_Instances.Size(); ++i)
+    {
+        if (m_Instances[i].m_Source == source)
+        {
+            last = m_Instances.Size() - 1;
+            if (i != last)
+                m_Instances[i] = m_Instances[last];
+            m_Instances.PopBack();
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+SoundInstance *SoundInstanceLimiter::FindNewest(void *asset)
+{
+    SoundInstance *newest = NULL;
+    int i;
+
+    for (i = 0; i < m_Instances.Size(); ++i)
+    {
+        if (m_Instances[i].m_Asset != asset)
+            continue;
+        if (!newest || m_Instances[i].m_StartTime > newest->m_StartTime)
+            newest = &m_Instances[i];
+    }
+    return newest;
+}
+
+void SoundInstanceLimiter::Clear()
+{
+    m_Limits.Clear();
+    m_Instances.Clear();
+}
@@ -0,0 +1,90 @@
+#ifndef SOUNDINSTANCELIMITER_H
+#define SOUNDINSTANCELIMITER_H
+
+#include "CKAll.h"
+
+/**
+ * @brief What happens to a trigger once its asset plays as often as allowed
+ */
+enum SOUND_STEAL_POLICY
+{
+    SOUNDSTEAL_OLDEST = 0,   /* Stop the instance started first */
+    SOUNDSTEAL_QUIETEST = 1, /* Stop the instance with the lowest gain */
+    SOUNDSTEAL_REJECT = 2    /* Refuse the new instance */
+};
+
+/**
+ * @brief Concurrency limit of one asset
+ */
+struct SoundInstanceLimit
+{
+    void *m_Asset;            /* Source the instances are duplicated from */
+    int m_MaxInstances;       /* 0 for no limit */
+    SOUND_STEAL_POLICY m_Policy;
+    float m_CoalesceWindow;   /* In milliseconds, 0 to never merge triggers */
+};
+
+/**
+ * @brief A duplicate made from a limited asset
+ */
+struct SoundInstance
+{
+    void *m_Source;
+    void *m_Asset;
+    float m_StartTime;        /* Manager clock when duplicated, in milliseconds */
+};
+
+/**
+ * @brief Counters of the triggers the limits acted on
+ */
+struct SoundInstanceStats
+{
+    int m_Coalesced;          /* Triggers merged into a running instance */
+    int m_Rejected;           /* Triggers refused */
+    int m_Stolen;             /* Instances stopped to make room */
+};
+
+/**
+ * @brief Per-asset instance limits and the duplicates they cover
+ *
+ * Only assets given a limit are tracked, so sounds without one cost a
+ * single lookup per duplication. Both lists are short and unordered;
+ * removal swaps the last entry into the freed slot, like ActiveSoundSet.
+ */
+class SoundInstanceLimiter
+{
+public:
+    SoundInstanceLimiter();
+
+    void SetLimit(void *asset, int maxInstances, SOUND_STEAL_POLICY policy, float coalesceWindow);
+    // Returns TRUE if the asset had a limit. Its instances are forgotten.
+    CKBOOL RemoveLimit(void *asset);
+    const SoundInstanceLimit *GetLimit(void *asset) const;
+    int GetLimitCount() const { return m_Limits.Size(); }
+
+    void AddInstance(void *asset, void *source, float time);
+    // Returns TRUE if the source was a tracked instance
+    CKBOOL RemoveInstance(void *source);
+    // Most recent instance of the asset, NULL if none
+    SoundInstance *FindNewest(void *asset);
+
+    int GetInstanceCount() const { return m_Instances.Size(); }
+    SoundInstance &GetInstance(int index) { return m_Instances[index]; }
+
+    // Forgets limits and instances; the statistics are kept
+    void Clear();
+
+    SoundInstanceStats &GetStats() { return m_Stats; }
+    const SoundInstanceStats &GetStats() const { return m_Stats; }
+
+private:
+    XArray<SoundInstanceLimit> m_Limits;
+    XArray<SoundInstance> m_Instances;
+    SoundInstanceStats m_Stats;
+
+    // Prevent copying (VC6 style - declare but don't implement)
+    SoundInstanceLimiter(const SoundInstanceLimiter &);
+    SoundInstanceLimiter &operator=(const SoundInstanceLimiter &);
+};
+
+#endif /* SOUNDINSTANCELIMITER_H */
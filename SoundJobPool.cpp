@@ -0,0 +1,233 @@
+#include "SoundJobPool.h"
+
+SoundJobPool::SoundJobPool()
+    : m_DoneEvent(NULL),
+      m_WorkerCount(0),
+      m_Stop(0),
+      m_Function(NULL),
+      m_Context(NULL),
+      m_Count(0),
+      m_ChunkSize(SOUNDJOB_DEFAULT_CHUNK),
+      m_Pending(0),
+      m_Steals(0)
+{
+    int i;
+
+    for (i = 0; i <= SOUNDJOB_MAX_WORKERS; ++i)
+    {
+        ::InitializeCriticalSection(&m_Queues[i].m_Lock);
+        m_Queues[i].m_Begin = 0;
+        m_Queues[i].m_End = 0;
+    }
+    memset(m_Workers, 0, sizeof(m_Workers));
+    memset(&m_Stats, 0, sizeof(SoundJobStats));
+}
+
+SoundJobPool::~SoundJobPool()
+{
+    int i;
+
+    Stop();
+    for (i = 0; i <= SOUNDJOB_MAX_WORKERS; ++i)
+        ::DeleteCriticalSection(&m_Queues[i].m_Lock);
+}
+
+CKBOOL SoundJobPool::Start(int workers)
+{
+    Worker *worker;
+    DWORD threadId;
+    int i;
+
+    Stop();
+    if (workers <= 0)
+        return TRUE;
+    if (workers > SOUNDJOB_MAX_WORKERS)
+        workers = SOUNDJOB_MAX_WORKERS;
+
+    m_DoneEvent = ::CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (!m_DoneEvent)
+        return FALSE;
+
+    m_Stop = 0;
+    for (i = 0; i < workers; ++i)
+    {
+        worker = &m_Workers[i];
+        worker->m_Pool = this;
+        worker->m_Index = i + 1;
+        worker->m_WakeEvent = ::CreateEvent(NULL, FALSE, FALSE, NULL);
+        worker->m_Thread = NULL;
+        if (worker->m_WakeEvent)
+            worker->m_Thread = ::CreateThread(NULL, 0, WorkerThread, worker, 0, &threadId);
+
+        if (!worker->m_Thread)
+        {
+            if (worker->m_WakeEvent)
+                ::CloseHandle(worker->m_WakeEvent);
+            worker->m_WakeEvent = NULL;
+            Stop();
+            return FALSE;
+        }
+        m_WorkerCount = i + 1;
+    }
+    return TRUE;
+}
+
+void SoundJobPool::Stop()
+{
+    Worker *worker;
+    int i;
+
+    ::InterlockedExchange(&m_Stop, 1);
+    for (i = 0; i < m_WorkerCount; ++i)
+    {
+        worker = &m_Workers[i];
+        ::SetEvent(worker->m_WakeEvent);
+        ::WaitForSingleObject(worker->m_Thread, INFINITE);
+        ::CloseHandle(worker->m_Thread);
+        ::CloseHandle(worker->m_WakeEvent);
+        worker->m_Thread = NULL;
+        worker->m_WakeEvent = NULL;
+    }
+    m_WorkerCount = 0;
+
+    if (m_DoneEvent)
+    {
+        ::CloseHandle(m_DoneEvent);
+        m_DoneEvent = NULL;
+    }
+}
+
+void SoundJobPool::ParallelFor(SoundJobFunction fn, void *context, int count, int chunkSize)
+{
+    int chunks, threads, begin, end, i;
+
+    if (!fn || count <= 0)
+        return;
+    if (chunkSize <= 0)
+        chunkSize = SOUNDJOB_DEFAULT_CHUNK;
+
+    chunks = (count + chunkSize - 1) / chunkSize;
+    ++m_Stats.m_Runs;
+    m_Stats.m_Chunks += chunks;
+
+    // Nothing to share: the same chunks, in order, on the caller
+    if (m_WorkerCount == 0 || chunks == 1)
+    {
+        for (i = 0; i < chunks; ++i)
+        {
+            begin = i * chunkSize;
+            end = begin + chunkSize;
+            if (end > count)
+                end = count;
+            fn(context, begin, end);
+        }
+        return;
+    }
+
+    // The job is in place before any chunk of it can be taken: a worker
+    // still leaving the previous call may pick up the first ones
+    m_Function = fn;
+    m_Context = context;
+    m_Count = count;
+    m_ChunkSize = chunkSize;
+    m_Steals = 0;
+    ::InterlockedExchange(&m_Pending, chunks);
+
+    threads = m_WorkerCount + 1;
+    for (i = 0; i < threads; ++i)
+    {
+        ::EnterCriticalSection(&m_Queues[i].m_Lock);
+        m_Queues[i].m_Begin = chunks * i / threads;
+        m_Queues[i].m_End = chunks * (i + 1) / threads;
+        ::LeaveCriticalSection(&m_Queues[i].m_Lock);
+    }
+
+    for (i = 0; i < m_WorkerCount; ++i)
+        ::SetEvent(m_Workers[i].m_WakeEvent);
+
+    RunChunks(0);
+
+    // The last chunks may still run on the workers. The event may be left
+    // set by a call that ended on the caller, hence the loop.
+    while (m_Pending > 0)
+        ::WaitForSingleObject(m_DoneEvent, INFINITE);
+
+    m_Stats.m_Steals += m_Steals;
+}
+
+DWORD WINAPI SoundJobPool::WorkerThread(LPVOID param)
+{
+    Worker *worker = (Worker *)param;
+    SoundJobPool *pool = worker->m_Pool;
+
+    for (;;)
+    {
+        ::WaitForSingleObject(worker->m_WakeEvent, INFINITE);
+        if (pool->m_Stop)
+            break;
+        pool->RunChunks(worker->m_Index);
+    }
+    return 0;
+}
+
+void SoundJobPool::RunChunks(int index)
+{
+    int chunk, begin, end;
+
+    for (;;)
+    {
+        chunk = PopChunk(index);
+        if (chunk < 0)
+            chunk = StealChunk(index);
+        if (chunk < 0)
+            return;
+
+        // Read once a chunk is held, the job is then the current one
+        begin = chunk * m_ChunkSize;
+        end = begin + m_ChunkSize;
+        if (end > m_Count)
+            end = m_Count;
+        m_Function(m_Context, begin, end);
+
+        if (::InterlockedDecrement(&m_Pending) == 0)
+            ::SetEvent(m_DoneEvent);
+    }
+}
+
+int SoundJobPool::PopChunk(int index)
+{
+    Queue *queue = &m_Queues[index];
+    int chunk = -1;
+
+    ::EnterCriticalSection(&queue->m_Lock);
+    if (queue->m_Begin < queue->m_End)
+        chunk = queue->m_Begin++;
+    ::LeaveCriticalSection(&queue->m_Lock);
+    return chunk;
+}
+
+int SoundJobPool::StealChunk(int index)
+{
+    Queue *queue;
+    int threads, chunk, i;
+
+    // Visit the others from the next one on, so thieves spread out
+    threads = m_WorkerCount + 1;
+    for (i = 1; i < threads; ++i)
+    {
+        queue = &m_Queues[(index + i) % threads];
+        chunk = -1;
+
+        ::EnterCriticalSection(&queue->m_Lock);
+        if (queue->m_Begin < queue->m_End)
+            chunk = --queue->m_End;
+        ::LeaveCriticalSection(&queue->m_Lock);
+
+        if (chunk >= 0)
+        {
+            ::InterlockedIncrement(&m_Steals);
+            return chunk;
+        }
+    }
+    return -1;
+}
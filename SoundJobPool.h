@@ -0,0 +1,100 @@
+#ifndef SOUNDJOBPOOL_H
+#define SOUNDJOBPOOL_H
+
+#include "CKAll.h"
+
+#define SOUNDJOB_MAX_WORKERS 15
+#define SOUNDJOB_DEFAULT_CHUNK 64
+#define SOUNDJOB_ENV_THREADS "DX8SOUND_JOB_THREADS"
+
+/**
+ * @brief Job run over the items [begin, end) of a ParallelFor
+ */
+typedef void (*SoundJobFunction)(void *context, int begin, int end);
+
+/**
+ * @brief Counters of the work the pool spread
+ */
+struct SoundJobStats
+{
+    int m_Runs;     /* ParallelFor calls */
+    int m_Chunks;   /* Chunks run, stolen or not */
+    int m_Steals;   /* Chunks run by another thread than the one given them */
+};
+
+/**
+ * @brief Small work-stealing pool for the per-voice computations of a frame
+ *
+ * A ParallelFor cuts its items into chunks of a fixed size and deals
+ * contiguous runs of chunks to the caller and the workers. Each one takes
+ * chunks from the front of its own run, then steals from the back of the
+ * others until none is left, so uneven chunks still keep every thread
+ * busy. The calling thread always takes part and the call returns once
+ * every chunk ran.
+ *
+ * The chunks do not depend on the number of threads: a job that only
+ * writes the items of its chunk gives the same result with any number of
+ * workers, including none, where everything runs on the caller in order.
+ */
+class SoundJobPool
+{
+public:
+    SoundJobPool();
+    ~SoundJobPool();
+
+    // Starts the given number of workers besides the caller, at most
+    // SOUNDJOB_MAX_WORKERS. Returns FALSE if a thread could not be made.
+    CKBOOL Start(int workers);
+    void Stop();
+    int GetWorkerCount() const { return m_WorkerCount; }
+
+    // Runs fn over [0, count) in chunks of chunkSize items
+    void ParallelFor(SoundJobFunction fn, void *context, int count, int chunkSize);
+
+    const SoundJobStats &GetStats() const { return m_Stats; }
+
+private:
+    // Chunks dealt to one thread: the owner pops m_Begin, thieves m_End
+    struct Queue
+    {
+        CRITICAL_SECTION m_Lock;
+        int m_Begin;
+        int m_End;
+    };
+
+    struct Worker
+    {
+        SoundJobPool *m_Pool;
+        int m_Index;            /* Of its queue */
+        HANDLE m_Thread;
+        HANDLE m_WakeEvent;     /* Auto-reset, set for each ParallelFor */
+    };
+
+    static DWORD WINAPI WorkerThread(LPVOID param);
+    // Runs chunks until every queue is empty
+    void RunChunks(int index);
+    int PopChunk(int index);
+    int StealChunk(int index);
+
+    Queue m_Queues[SOUNDJOB_MAX_WORKERS + 1]; /* 0 is the caller's */
+    Worker m_Workers[SOUNDJOB_MAX_WORKERS];
+    HANDLE m_DoneEvent;
+    int m_WorkerCount;
+    volatile LONG m_Stop;
+
+    // Current job, set before its chunks are queued
+    SoundJobFunction m_Function;
+    void *m_Context;
+    int m_Count;
+    int m_ChunkSize;
+    volatile LONG m_Pending;
+    volatile LONG m_Steals;
+
+    SoundJobStats m_Stats;
+
+    // Prevent copying (VC6 style - declare but don't implement)
+    SoundJobPool(const SoundJobPool &);
+    SoundJobPool &operator=(const SoundJobPool &);
+};
+
+#endif /* SOUNDJOBPOOL_H */
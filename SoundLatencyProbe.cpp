@@ -0,0 +1,252 @@
+#include "SoundLatencyProbe.h"
+
+#include <stdlib.h>
+
+SoundLatencyProbe::SoundLatencyProbe()
+    : m_Thread(NULL),
+      m_StopEvent(NULL),
+      m_Cursor(NULL),
+      m_Context(NULL),
+      m_PendingCount(0),
+      m_Next(0),
+      m_Dropped(0)
+{
+    LARGE_INTEGER value;
+
+    ::InitializeCriticalSection(&m_Lock);
+    ::QueryPerformanceFrequency(&value);
+    m_Frequency = value.QuadPart > 0 ? value.QuadPart : 1;
+}
+
+SoundLatencyProbe::~SoundLatencyProbe()
+{
+    Stop();
+    ::DeleteCriticalSection(&m_Lock);
+}
+
+CKBOOL SoundLatencyProbe::Start(SoundCursorFunction cursor, void *context)
+{
+    DWORD threadId;
+
+    if (m_Thread)
+        return TRUE;
+    if (!cursor)
+        return FALSE;
+
+    m_Cursor = cursor;
+    m_Context = context;
+    m_StopEvent = ::CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (!m_StopEvent)
+        return FALSE;
+
+    m_Thread = ::CreateThread(NULL, 0, ProbeThread, this, 0, &threadId);
+    if (!m_Thread)
+    {
+        Stop();
+        return FALSE;
+    }
+    ::SetThreadPriority(m_Thread, THREAD_PRIORITY_ABOVE_NORMAL);
+    return TRUE;
+}
+
+void SoundLatencyProbe::Stop()
+{
+    if (m_Thread)
+    {
+        ::SetEvent(m_StopEvent);
+        ::WaitForSingleObject(m_Thread, INFINITE);
+        ::CloseHandle(m_Thread);
+        m_Thread = NULL;
+    }
+
+    if (m_StopEvent)
+    {
+        ::CloseHandle(m_StopEvent);
+        m_StopEvent = NULL;
+    }
+
+    ::EnterCriticalSection(&m_Lock);
+    m_PendingCount = 0;
+    ::LeaveCriticalSection(&m_Lock);
+}
+
+LONGLONG SoundLatencyProbe::Stamp() const
+{
+    LARGE_INTEGER counter;
+
+    if (!m_Thread)
+        return 0;
+    ::QueryPerformanceCounter(&counter);
+    return counter.QuadPart;
+}
+
+void SoundLatencyProbe::Trigger(void *source, LONGLONG stamp)
+{
+    if (!source || stamp == 0)
+        return;
+
+    ::EnterCriticalSection(&m_Lock);
+    if (!Find(source))
+        Add(source, stamp);
+    ::LeaveCriticalSection(&m_Lock);
+}
+
+void SoundLatencyProbe::Arm(void *source, LONGLONG stamp, int position)
+{
+    Pending *pending;
+
+    if (!source || stamp == 0)
+        return;
+
+    ::EnterCriticalSection(&m_Lock);
+    pending = Find(source);
+    if (!pending)
+    {
+        Add(source, stamp);
+        pending = Find(source);
+    }
+    if (pending)
+    {
+        pending->m_Position = position;
+        pending->m_Armed = TRUE;
+    }
+    ::LeaveCriticalSection(&m_Lock);
+}
+
+void SoundLatencyProbe::Forget(void *source)
+{
+    int i;
+
+    ::EnterCriticalSection(&m_Lock);
+    for (i = 0; i < m_PendingCount; ++i)
+    {
+        if (m_Pending[i].m_Source == source)
+        {
+            RemoveAt(i);
+            break;
+        }
+    }
+    ::LeaveCriticalSection(&m_Lock);
+}
+
+void SoundLatencyProbe::GetStats(SoundLatencyStats &stats)
+{
+    int count;
+
+    memset(&stats, 0, sizeof(SoundLatencyStats));
+
+    ::EnterCriticalSection(&m_Lock);
+    m_Sorted = m_Latencies;
+    stats.m_Dropped = m_Dropped;
+    ::LeaveCriticalSection(&m_Lock);
+
+    count = m_Sorted.Size();
+    stats.m_Count = count;
+    if (count == 0)
+        return;
+
+    /* Nearest rank */
+    qsort(m_Sorted.Begin(), count, sizeof(float), CompareLatencies);
+    stats.m_P50 = m_Sorted[(count - 1) * 50 / 100];
+    stats.m_P90 = m_Sorted[(count - 1) * 90 / 100];
+    stats.m_P99 = m_Sorted[(count - 1) * 99 / 100];
+    stats.m_Max = m_Sorted[count - 1];
+}
+
+void SoundLatencyProbe::Reset()
+{
+    ::EnterCriticalSection(&m_Lock);
+    m_Latencies.Clear();
+    m_Next = 0;
+    m_Dropped = 0;
+    ::LeaveCriticalSection(&m_Lock);
+}
+
+DWORD WINAPI SoundLatencyProbe::ProbeThread(LPVOID param)
+{
+    SoundLatencyProbe *probe = (SoundLatencyProbe *)param;
+
+    // Waits are rounded up to the scheduler tick otherwise
+    timeBeginPeriod(1);
+    while (::WaitForSingleObject(probe->m_StopEvent, SOUNDLATENCY_POLL_MS) == WAIT_TIMEOUT)
+        probe->Poll();
+    timeEndPeriod(1);
+    return 0;
+}
+
+void SoundLatencyProbe::Poll()
+{
+    LARGE_INTEGER counter;
+    Pending *pending;
+    float latency;
+    int i;
+
+    ::EnterCriticalSection(&m_Lock);
+    for (i = 0; i < m_PendingCount;)
+    {
+        pending = &m_Pending[i];
+        if (!pending->m_Armed || m_Cursor(m_Context, pending->m_Source) == pending->m_Position)
+        {
+            ++i;
+            continue;
+        }
+
+        ::QueryPerformanceCounter(&counter);
+        latency = (float)((counter.QuadPart - pending->m_Stamp) * 1000.0 / m_Frequency);
+        if (m_Latencies.Size() < SOUNDLATENCY_MAX_SAMPLES)
+        {
+            m_Latencies.PushBack(latency);
+        }
+        else
+        {
+            m_Latencies[m_Next] = latency;
+            m_Next = (m_Next + 1) % SOUNDLATENCY_MAX_SAMPLES;
+        }
+        RemoveAt(i);
+    }
+    ::LeaveCriticalSection(&m_Lock);
+}
+
+SoundLatencyProbe::Pending *SoundLatencyProbe::Find(void *source)
+{
+    int i;
+
+    for (i = 0; i < m_PendingCount; ++i)
+    {
+        if (m_Pending[i].m_Source == source)
+            return &m_Pending[i];
+    }
+    return NULL;
+}
+
+void SoundLatencyProbe::Add(void *source, LONGLONG stamp)
+{
+    Pending *pending;
+
+    if (m_PendingCount >= SOUNDLATENCY_MAX_PENDING)
+    {
+        ++m_Dropped;
+        return;
+    }
+
+    pending = &m_Pending[m_PendingCount++];
+    pending->m_Source = source;
+    pending->m_Stamp = stamp;
+    pending->m_Position = 0;
+    pending->m_Armed = FALSE;
+}
+
+void SoundLatencyProbe::RemoveAt(int index)
+{
+    --m_PendingCount;
+    if (index != m_PendingCount)
+        m_Pending[index] = m_Pending[m_PendingCount];
+}
+
+int SoundLatencyProbe::CompareLatencies(const void *a, const void *b)
+{
+    float x = *(const float *)a;
+    float y = *(const float *)b;
+
+    return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
@@ -0,0 +1,98 @@
+#ifndef SOUNDLATENCYPROBE_H
+#define SOUNDLATENCYPROBE_H
+
+#include <windows.h>
+
+#include "CKAll.h"
+
+// Environment variable starting the probe at OnCKInit
+#define SOUNDLATENCY_ENV "DX8SOUND_LATENCY_PROBE"
+
+#define SOUNDLATENCY_MAX_SAMPLES 4096 /* Latencies kept, the oldest replaced first */
+#define SOUNDLATENCY_MAX_PENDING 64   /* Triggers watched at once, later ones are dropped */
+#define SOUNDLATENCY_POLL_MS     1
+
+// Play cursor of a source, in bytes
+typedef int (*SoundCursorFunction)(void *context, void *source);
+
+/**
+ * @brief Trigger-to-sound latencies measured so far, in milliseconds
+ */
+struct SoundLatencyStats
+{
+    int m_Count;            /* Latencies the percentiles are taken over */
+    int m_Dropped;          /* Triggers not watched, too many pending */
+    float m_P50;
+    float m_P90;
+    float m_P99;
+    float m_Max;
+};
+
+/**
+ * @brief Measures the time from a trigger to the play cursor moving
+ *
+ * A trigger is stamped when the sound is asked for, before any
+ * duplication, and armed with the cursor it had once the start call
+ * returns. A thread then polls the armed sources every
+ * SOUNDLATENCY_POLL_MS and records the latency when their cursor moves,
+ * which includes the driver and mixer start-up. Sources must be forgotten
+ * before they are released; the cursor is only read under the lock
+ * Forget takes.
+ */
+class SoundLatencyProbe
+{
+public:
+    SoundLatencyProbe();
+    ~SoundLatencyProbe();
+
+    CKBOOL Start(SoundCursorFunction cursor, void *context);
+    void Stop();
+    CKBOOL IsRunning() const { return m_Thread != NULL; }
+
+    // Performance counter of a trigger, 0 while the probe is stopped
+    LONGLONG Stamp() const;
+    // Notes the trigger of a source unless one is pending already
+    void Trigger(void *source, LONGLONG stamp);
+    // The source was started with its cursor at position
+    void Arm(void *source, LONGLONG stamp, int position);
+    void Forget(void *source);
+
+    // Percentiles of the latencies kept
+    void GetStats(SoundLatencyStats &stats);
+    void Reset();
+
+private:
+    struct Pending
+    {
+        void *m_Source;
+        LONGLONG m_Stamp;
+        int m_Position;
+        CKBOOL m_Armed;
+    };
+
+    static DWORD WINAPI ProbeThread(LPVOID param);
+    void Poll();
+    Pending *Find(void *source);
+    void Add(void *source, LONGLONG stamp);
+    void RemoveAt(int index);
+    static int CompareLatencies(const void *a, const void *b);
+
+    HANDLE m_Thread;
+    HANDLE m_StopEvent;
+    CRITICAL_SECTION m_Lock;
+    SoundCursorFunction m_Cursor;
+    void *m_Context;
+    LONGLONG m_Frequency;
+    Pending m_Pending[SOUNDLATENCY_MAX_PENDING];
+    int m_PendingCount;
+    XArray<float> m_Latencies;
+    XArray<float> m_Sorted;
+    int m_Next;             /* Slot the next latency replaces once full */
+    int m_Dropped;
+
+    // Prevent copying (VC6 style - declare but don't implement)
+    SoundLatencyProbe(const SoundLatencyProbe &);
+    SoundLatencyProbe &operator=(const SoundLatencyProbe &);
+};
+
+#endif /* SOUNDLATENCYPROBE_H */
@@ -0,0 +1,355 @@
+#include "SoundOutput.h"
+#include "SoundSimd.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SOUNDOUTPUT_MINUS_3DB 0.70710678f
+
+#define SOUNDOUTPUT_LEFT_SPEAKERS  (SPEAKER_FRONT_LEFT | SPEAKER_BACK_LEFT | SPEAKER_SIDE_LEFT)
+#define SOUNDOUTPUT_RIGHT_SPEAKERS (SPEAKER_FRONT_RIGHT | SPEAKER_BACK_RIGHT | SPEAKER_SIDE_RIGHT)
+
+/* KSDATAFORMAT_SUBTYPE_PCM and KSDATAFORMAT_SUBTYPE_IEEE_FLOAT, defined here
+   so the plugin does not need ksguid.lib */
+static const GUID s_SubtypePcm = {0x00000001, 0x0000, 0x0010, {0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71}};
+static const GUID s_SubtypeFloat = {0x00000003, 0x0000, 0x0010, {0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71}};
+
+static int ReadEnvironmentInt(const char *name, int defaultValue)
+{
+    const char *value = getenv(name);
+
+    if (!value || !*value)
+        return defaultValue;
+    return atoi(value);
+}
+
+// Speaker of each channel of a layout, in mask order
+static int GetSpeakers(int channels, CKDWORD *speakers)
+{
+    CKDWORD mask = SoundGetChannelMask(channels);
+    CKDWORD bit;
+    int count = 0;
+
+    for (bit = 1; mask && bit <= SPEAKER_SIDE_RIGHT; bit <<= 1)
+    {
+        if (mask & bit)
+            speakers[count++] = bit;
+    }
+    return count;
+}
+
+// Channel of a speaker in a layout, -1 if the layout lacks it
+static int FindSpeaker(const CKDWORD *speakers, int count, CKDWORD speaker)
+{
+    int i;
+
+    for (i = 0; i < count; ++i)
+    {
+        if (speakers[i] == speaker)
+            return i;
+    }
+    return -1;
+}
+
+// Azimuth of a speaker in degrees, as placed by ITU-R BS.775
+static float GetSpeakerAzimuth(CKDWORD speaker)
+{
+    switch (speaker)
+    {
+    case SPEAKER_FRONT_LEFT:  return -30.0f;
+    case SPEAKER_FRONT_RIGHT: return 30.0f;
+    case SPEAKER_BACK_LEFT:   return -135.0f;
+    case SPEAKER_BACK_RIGHT:  return 135.0f;
+    case SPEAKER_SIDE_LEFT:   return -90.0f;
+    case SPEAKER_SIDE_RIGHT:  return 90.0f;
+    default:                  return 0.0f;
+    }
+}
+
+CKDWORD SoundGetChannelMask(int channels)
+{
+    switch (channels)
+    {
+    case 1: return SPEAKER_FRONT_CENTER;
+    case 2: return SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT;
+    case 3: return SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_FRONT_CENTER;
+    case 4: return SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT;
+    case 5: return SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_FRONT_CENTER | SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT;
+    case 6: return SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_FRONT_CENTER | SPEAKER_LOW_FREQUENCY |
+                   SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT;
+    case 7: return SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_FRONT_CENTER |
+                   SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT | SPEAKER_SIDE_LEFT | SPEAKER_SIDE_RIGHT;
+    case 8: return SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_FRONT_CENTER | SPEAKER_LOW_FREQUENCY |
+                   SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT | SPEAKER_SIDE_LEFT | SPEAKER_SIDE_RIGHT;
+    default: return 0;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Formats
+//-----------------------------------------------------------------------------
+
+void SoundOutputFormatInit(SoundOutputFormat &format, int sampleRate, int channels, int bitsPerSample)
+{
+    format.m_SampleRate = sampleRate;
+    format.m_Channels = channels;
+    format.m_BitsPerSample = bitsPerSample;
+    format.m_Float = FALSE;
+    format.m_ChannelMask = SoundGetChannelMask(channels);
+}
+
+void SoundOutputFormatFromEnvironment(SoundOutputFormat &format)
+{
+    int rate = ReadEnvironmentInt(SOUNDOUTPUT_ENV_RATE, 0);
+    int channels = ReadEnvironmentInt(SOUNDOUTPUT_ENV_CHANNELS, 0);
+    int useFloat = ReadEnvironmentInt(SOUNDOUTPUT_ENV_FLOAT, -1);
+
+    if (rate > 0)
+        format.m_SampleRate = rate;
+
+    if (SoundGetChannelMask(channels) != 0)
+    {
+        format.m_Channels = channels;
+        format.m_ChannelMask = SoundGetChannelMask(channels);
+    }
+
+    if (useFloat > 0)
+    {
+        format.m_Float = TRUE;
+        format.m_BitsPerSample = 32;
+    }
+    else if (useFloat == 0 && format.m_Float)
+    {
+        format.m_Float = FALSE;
+        format.m_BitsPerSample = 16;
+    }
+}
+
+void SoundOutputFormatToWave(const SoundOutputFormat &format, WAVEFORMATEXTENSIBLE &wfx)
+{
+    memset(&wfx, 0, sizeof(WAVEFORMATEXTENSIBLE));
+    wfx.Format.nChannels = (WORD)format.m_Channels;
+    wfx.Format.nSamplesPerSec = format.m_SampleRate;
+    wfx.Format.wBitsPerSample = (WORD)format.m_BitsPerSample;
+    wfx.Format.nBlockAlign = (WORD)(format.m_BitsPerSample / 8 * format.m_Channels);
+    wfx.Format.nAvgBytesPerSec = wfx.Format.nSamplesPerSec * wfx.Format.nBlockAlign;
+
+    if (!format.m_Float && format.m_Channels <= 2 && format.m_BitsPerSample <= 16)
+    {
+        wfx.Format.wFormatTag = WAVE_FORMAT_PCM;
+        return;
+    }
+
+    wfx.Format.wFormatTag = WAVE_FORMAT_EXTENSIBLE;
+    wfx.Format.cbSize = sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX);
+    wfx.Samples.wValidBitsPerSample = (WORD)format.m_BitsPerSample;
+    wfx.dwChannelMask = format.m_ChannelMask;
+    wfx.SubFormat = format.m_Float ? s_SubtypeFloat : s_SubtypePcm;
+}
+
+CKBOOL SoundMakeExtensible(const WAVEFORMATEX &wf, WAVEFORMATEXTENSIBLE &wfx)
+{
+    CKBOOL isFloat = (wf.wFormatTag == WAVE_FORMAT_IEEE_FLOAT);
+
+    if (wf.wFormatTag != WAVE_FORMAT_PCM && !isFloat)
+        return FALSE;
+    if (!isFloat && wf.nChannels <= 2 && wf.wBitsPerSample <= 16)
+        return FALSE;
+
+    memset(&wfx, 0, sizeof(WAVEFORMATEXTENSIBLE));
+    wfx.Format = wf;
+    wfx.Format.wFormatTag = WAVE_FORMAT_EXTENSIBLE;
+    wfx.Format.cbSize = sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX);
+    wfx.Samples.wValidBitsPerSample = wf.wBitsPerSample;
+    wfx.dwChannelMask = SoundGetChannelMask(wf.nChannels);
+    wfx.SubFormat = isFloat ? s_SubtypeFloat : s_SubtypePcm;
+    return TRUE;
+}
+
+WORD SoundGetFormatTag(const WAVEFORMATEX &wf)
+{
+    const WAVEFORMATEXTENSIBLE *wfx = (const WAVEFORMATEXTENSIBLE *)&wf;
+
+    if (wf.wFormatTag != WAVE_FORMAT_EXTENSIBLE ||
+        wf.cbSize < sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX))
+        return wf.wFormatTag;
+
+    // The KSDATAFORMAT subtypes share all but their first field
+    if (wfx->SubFormat.Data2 != s_SubtypePcm.Data2 || wfx->SubFormat.Data3 != s_SubtypePcm.Data3 ||
+        memcmp(wfx->SubFormat.Data4, s_SubtypePcm.Data4, sizeof(s_SubtypePcm.Data4)) != 0)
+        return wf.wFormatTag;
+    return (WORD)wfx->SubFormat.Data1;
+}
+
+//-----------------------------------------------------------------------------
+// Matrices
+//-----------------------------------------------------------------------------
+
+// Adds an input channel meant for the given speaker to the output row(s)
+// standing in for it
+static void RouteSpeaker(float *matrix, int input, int inChannels,
+                         const CKDWORD *outSpeakers, int outChannels,
+                         CKDWORD speaker, float gain)
+{
+    int out = FindSpeaker(outSpeakers, outChannels, speaker);
+
+    if (out >= 0)
+    {
+        matrix[out * inChannels + input] += gain;
+        return;
+    }
+
+    switch (speaker)
+    {
+    case SPEAKER_FRONT_LEFT:
+    case SPEAKER_FRONT_RIGHT:
+        /* Only a mono layout lacks the front pair, and it has the centre */
+        RouteSpeaker(matrix, input, inChannels, outSpeakers, outChannels, SPEAKER_FRONT_CENTER, gain * SOUNDOUTPUT_MINUS_3DB);
+        break;
+    case SPEAKER_FRONT_CENTER:
+        RouteSpeaker(matrix, input, inChannels, outSpeakers, outChannels, SPEAKER_FRONT_LEFT, gain * SOUNDOUTPUT_MINUS_3DB);
+        RouteSpeaker(matrix, input, inChannels, outSpeakers, outChannels, SPEAKER_FRONT_RIGHT, gain * SOUNDOUTPUT_MINUS_3DB);
+        break;
+    case SPEAKER_BACK_LEFT:
+    case SPEAKER_SIDE_LEFT:
+        if (FindSpeaker(outSpeakers, outChannels, speaker ^ (SPEAKER_BACK_LEFT | SPEAKER_SIDE_LEFT)) >= 0)
+            RouteSpeaker(matrix, input, inChannels, outSpeakers, outChannels, speaker ^ (SPEAKER_BACK_LEFT | SPEAKER_SIDE_LEFT), gain);
+        else
+            RouteSpeaker(matrix, input, inChannels, outSpeakers, outChannels, SPEAKER_FRONT_LEFT, gain * SOUNDOUTPUT_MINUS_3DB);
+        break;
+    case SPEAKER_BACK_RIGHT:
+    case SPEAKER_SIDE_RIGHT:
+        if (FindSpeaker(outSpeakers, outChannels, speaker ^ (SPEAKER_BACK_RIGHT | SPEAKER_SIDE_RIGHT)) >= 0)
+            RouteSpeaker(matrix, input, inChannels, outSpeakers, outChannels, speaker ^ (SPEAKER_BACK_RIGHT | SPEAKER_SIDE_RIGHT), gain);
+        else
+            RouteSpeaker(matrix, input, inChannels, outSpeakers, outChannels, SPEAKER_FRONT_RIGHT, gain * SOUNDOUTPUT_MINUS_3DB);
+        break;
+    default:
+        /* The LFE only goes to an LFE */
+        break;
+    }
+}
+
+void SoundBuildChannelMatrix(int inChannels, int outChannels, float *matrix)
+{
+    CKDWORD inSpeakers[SOUNDOUTPUT_MAX_CHANNELS];
+    CKDWORD outSpeakers[SOUNDOUTPUT_MAX_CHANNELS];
+    int n;
+
+    memset(matrix, 0, inChannels * outChannels * sizeof(float));
+
+    if (GetSpeakers(inChannels, inSpeakers) != inChannels ||
+        GetSpeakers(outChannels, outSpeakers) != outChannels)
+    {
+        /* Unknown layout: channel to channel */
+        for (n = 0; n < inChannels && n < outChannels; ++n)
+            matrix[n * inChannels + n] = 1.0f;
+        return;
+    }
+
+    for (n = 0; n < inChannels; ++n)
+        RouteSpeaker(matrix, n, inChannels, outSpeakers, outChannels, inSpeakers[n], 1.0f);
+}
+
+void SoundPanChannels(int channels, float pan, float *gains)
+{
+    CKDWORD speakers[SOUNDOUTPUT_MAX_CHANNELS];
+    int count = GetSpeakers(channels, speakers);
+    int i;
+
+    for (i = 0; i < channels; ++i)
+    {
+        gains[i] = 1.0f;
+        if (count != channels)
+            continue;
+        if ((speakers[i] & SOUNDOUTPUT_LEFT_SPEAKERS) && pan > 0.0f)
+            gains[i] = 1.0f - pan;
+        if ((speakers[i] & SOUNDOUTPUT_RIGHT_SPEAKERS) && pan < 0.0f)
+            gains[i] = 1.0f + pan;
+    }
+}
+
+void SoundPanGains(int channels, float azimuth, float *gains)
+{
+    CKDWORD speakers[SOUNDOUTPUT_MAX_CHANNELS];
+    float angles[SOUNDOUTPUT_MAX_CHANNELS];
+    int order[SOUNDOUTPUT_MAX_CHANNELS];
+    int count, ring, i, j, k, a, b;
+    float from, span, t;
+
+    memset(gains, 0, channels * sizeof(float));
+
+    count = GetSpeakers(channels, speakers);
+    if (count != channels || channels < 2)
+    {
+        /* Nowhere to pan: spread at constant power */
+        for (i = 0; i < channels; ++i)
+            gains[i] = 1.0f / sqrtf((float)channels);
+        return;
+    }
+
+    /* The speakers around the listener, sorted by azimuth */
+    ring = 0;
+    for (i = 0; i < count; ++i)
+    {
+        if (speakers[i] == SPEAKER_LOW_FREQUENCY)
+            continue;
+        for (j = ring; j > 0 && angles[j - 1] > GetSpeakerAzimuth(speakers[i]); --j)
+        {
+            angles[j] = angles[j - 1];
+            order[j] = order[j - 1];
+        }
+        angles[j] = GetSpeakerAzimuth(speakers[i]);
+        order[j] = i;
+        ++ring;
+    }
+
+    azimuth = fmodf(azimuth, 360.0f);
+    if (azimuth > 180.0f)
+        azimuth -= 360.0f;
+    if (azimuth <= -180.0f)
+        azimuth += 360.0f;
+
+    /* Find the arc holding the source; the last one wraps behind */
+    k = ring - 1;
+    for (i = 0; i < ring - 1; ++i)
+    {
+        if (azimuth >= angles[i] && azimuth < angles[i + 1])
+        {
+            k = i;
+            break;
+        }
+    }
+    a = k;
+    b = (k + 1) % ring;
+    from = angles[a];
+    span = angles[b] - from;
+    if (span <= 0.0f)
+        span += 360.0f;
+    t = azimuth - from;
+    if (t < 0.0f)
+        t += 360.0f;
+    t /= span;
+
+    gains[order[a]] = cosf(t * 1.57079633f);
+    gains[order[b]] += sinf(t * 1.57079633f);
+}
+
+void SoundMatrixMix(const float *const *input, int inChannels,
+                    float *const *output, int outChannels,
+                    const float *matrix, int frames)
+{
+    const float *row;
+    int m, n;
+
+    for (m = 0; m < outChannels; ++m)
+    {
+        row = matrix + m * inChannels;
+        for (n = 0; n < inChannels; ++n)
+        {
+            if (row[n] != 0.0f)
+                SoundSimdScaleAdd(output[m], input[n], row[n], frames);
+        }
+    }
+}
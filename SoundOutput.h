@@ -0,0 +1,76 @@
+#ifndef SOUNDOUTPUT_H
+#define SOUNDOUTPUT_H
+
+#include <windows.h>
+#include <mmreg.h>
+
+#include "CKAll.h"
+
+#define SOUNDOUTPUT_MAX_CHANNELS 8
+
+// Environment variables overriding the output format
+#define SOUNDOUTPUT_ENV_RATE     "DX8SOUND_OUTPUT_RATE"     /* Sample rate in Hz */
+#define SOUNDOUTPUT_ENV_CHANNELS "DX8SOUND_OUTPUT_CHANNELS" /* 1, 2, 4, 6 (5.1) or 8 (7.1) */
+#define SOUNDOUTPUT_ENV_FLOAT    "DX8SOUND_OUTPUT_FLOAT"    /* Non-zero for 32-bit float samples */
+
+/**
+ * @brief Sample rate and speaker layout the sound is mixed for
+ *
+ * Channels follow the WAVEFORMATEXTENSIBLE order of their speaker mask:
+ * FL FR FC LFE BL BR SL SR, minus the speakers the layout lacks.
+ */
+struct SoundOutputFormat
+{
+    int m_SampleRate;
+    int m_Channels;
+    int m_BitsPerSample; /* 16, 24 or 32 */
+    CKBOOL m_Float;      /* IEEE float samples, 32 bits */
+    CKDWORD m_ChannelMask;
+};
+
+// Speaker mask of the usual layout for a channel count (0 if unsupported)
+CKDWORD SoundGetChannelMask(int channels);
+
+void SoundOutputFormatInit(SoundOutputFormat &format, int sampleRate, int channels, int bitsPerSample);
+// Applies the DX8SOUND_OUTPUT_* overrides
+void SoundOutputFormatFromEnvironment(SoundOutputFormat &format);
+
+// Describes the format to the device: a plain WAVEFORMATEX (cbSize 0) for
+// 16-bit PCM up to stereo, WAVE_FORMAT_EXTENSIBLE otherwise
+void SoundOutputFormatToWave(const SoundOutputFormat &format, WAVEFORMATEXTENSIBLE &wfx);
+
+// Rewrites a source format that a plain WAVEFORMATEX cannot describe to
+// DirectSound (float, more than two channels or more than 16 bits) as
+// extensible. Returns FALSE, leaving wfx untouched, when the plain format
+// is fine.
+CKBOOL SoundMakeExtensible(const WAVEFORMATEX &wf, WAVEFORMATEXTENSIBLE &wfx);
+// Plain tag of a format: the subformat of an extensible one with a
+// KSDATAFORMAT subtype (WAVE_FORMAT_PCM or WAVE_FORMAT_IEEE_FLOAT), else
+// its own tag. Reads the extension only when cbSize says it is there.
+WORD SoundGetFormatTag(const WAVEFORMATEX &wf);
+
+/**
+ * Mixing matrices, stored as outChannels rows of inChannels gains.
+ */
+
+// Maps one layout onto another: shared speakers pass through, the others
+// fold into their neighbours at -3 dB (ITU-R BS.775), LFE is dropped
+// unless both layouts have it
+void SoundBuildChannelMatrix(int inChannels, int outChannels, float *matrix);
+
+// DirectSound-style balance over a layout: a positive pan attenuates the
+// speakers on the left, a negative one those on the right
+void SoundPanChannels(int channels, float pan, float *gains);
+
+// Constant-power gains of a point source at the given azimuth (degrees,
+// 0 ahead, positive to the right) over the speakers of the layout,
+// between the two speakers around it. The LFE gets nothing.
+void SoundPanGains(int channels, float azimuth, float *gains);
+
+// output[m] += sum of matrix[m][n] * input[n] over planar channels,
+// vectorized over the frames
+void SoundMatrixMix(const float *const *input, int inChannels,
+                    float *const *output, int outChannels,
+                    const float *matrix, int frames);
+
+#endif /* SOUNDOUTPUT_H */
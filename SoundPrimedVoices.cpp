@@ -0,0 +1,109 @@
+#include "SoundPrimedVoices.h"
+
+SoundPrimedVoices::SoundPrimedVoices()
+{
+    memset(&m_Stats, 0, sizeof(SoundPrimedStats));
+}
+
+SoundPrimedPool *SoundPrimedVoices::SetPool(void *asset, int size, XArray<void *> &released)
+{
+    SoundPrimedPool *pool;
+    SoundPrimedPool added;
+
+    if (size < 0)
+        size = 0;
+    if (size > SOUNDPRIMED_MAX_VOICES)
+        size = SOUNDPRIMED_MAX_VOICES;
+
+    pool = GetPool(asset);
+    if (!pool)
+    {
+        memset(&added, 0, sizeof(SoundPrimedPool));
+        added.m_Asset = asset;
+        m_Pools.PushBack(added);
+        pool = &m_Pools[m_Pools.Size() - 1];
+    }
+
+    pool->m_Size = size;
+    while (pool->m_Count > size)
+        released.PushBack(pool->m_Ready[--pool->m_Count]);
+    return pool;
+}
+
+CKBOOL SoundPrimedVoices::RemovePool(void *asset, XArray<void *> &released)
+{
+    int last, i, k;
+
+    for (i = 0; i < m_Pools.Size(); ++i)
+    {
+        if (m_Pools[i].m_Asset != asset)
+            continue;
+
+        for (k = 0; k < m_Pools[i].m_Count; ++k)
+            released.PushBack(m_Pools[i].m_Ready[k]);
+
+        last = m_Pools.Size() - 1;
+        if (i != last)
+            m_Pools[i] = m_Pools[last];
+        m_Pools.PopBack();
+        return TRUE;
+    }
+    return FALSE;
+}
+
+SoundPrimedPool *SoundPrimedVoices::GetPool(void *asset)
+{
+    int i;
+
+    for (i = 0; i < m_Pools.Size(); ++i)
+    {
+        if (m_Pools[i].m_Asset == asset)
+            return &m_Pools[i];
+    }
+    return NULL;
+}
+
+void *SoundPrimedVoices::Take(void *asset)
+{
+    SoundPrimedPool *pool = GetPool(asset);
+
+    if (!pool)
+        return NULL;
+
+    if (pool->m_Count == 0)
+    {
+        ++m_Stats.m_Misses;
+        return NULL;
+    }
+
+    /* Last in, first out: the voice primed last is the one in cache */
+    ++m_Stats.m_Hits;
+    return pool->m_Ready[--pool->m_Count];
+}
+
+void SoundPrimedVoices::Add(SoundPrimedPool &pool, void *source)
+{
+    if (pool.m_Count >= SOUNDPRIMED_MAX_VOICES)
+        return;
+
+    pool.m_Ready[pool.m_Count++] = source;
+    ++m_Stats.m_Primed;
+}
+
+void SoundPrimedVoices::Drain(XArray<void *> &released)
+{
+    int i, k;
+
+    for (i = 0; i < m_Pools.Size(); ++i)
+    {
+        for (k = 0; k < m_Pools[i].m_Count; ++k)
+            released.PushBack(m_Pools[i].m_Ready[k]);
+        m_Pools[i].m_Count = 0;
+    }
+}
+
+void SoundPrimedVoices::Clear(XArray<void *> &released)
+{
+    Drain(released);
+    m_Pools.Clear();
+}
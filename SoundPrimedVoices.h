@@ -0,0 +1,78 @@
+#ifndef SOUNDPRIMEDVOICES_H
+#define SOUNDPRIMEDVOICES_H
+
+#include "CKAll.h"
+
+#define SOUNDPRIMED_MAX_VOICES 16 /* Ready voices an asset may keep */
+
+/**
+ * @brief Duplicates of one asset made ahead of their triggers
+ */
+struct SoundPrimedPool
+{
+    void *m_Asset;
+    int m_Size;                           /* Ready voices to keep */
+    int m_Count;                          /* Ready now */
+    void *m_Ready[SOUNDPRIMED_MAX_VOICES];
+    CKWaveSoundSettings m_Settings;       /* Of the asset when they were last synced */
+};
+
+/**
+ * @brief Counters of the duplications the pools served
+ */
+struct SoundPrimedStats
+{
+    int m_Hits;             /* Duplicates handed out ready */
+    int m_Misses;           /* Duplicates of a pooled asset made on the spot */
+    int m_Primed;           /* Voices made ahead */
+};
+
+/**
+ * @brief Ready-to-start duplicates of the latency-critical assets
+ *
+ * Duplicating a buffer and setting it up is most of the time between a
+ * trigger and the sound. The manager refills the pools between frames,
+ * so a duplication only takes a ready voice and the trigger only has to
+ * start it. The pools are few and short: lookups are linear and removal
+ * swaps the last pool into the freed slot, like SoundInstanceLimiter.
+ * This class only does the bookkeeping; the manager makes and releases
+ * the voices.
+ */
+class SoundPrimedVoices
+{
+public:
+    SoundPrimedVoices();
+
+    // Size clamped to SOUNDPRIMED_MAX_VOICES. Ready voices beyond a smaller
+    // size are appended to released.
+    SoundPrimedPool *SetPool(void *asset, int size, XArray<void *> &released);
+    // Returns TRUE if the asset had a pool; its ready voices are appended
+    // to released
+    CKBOOL RemovePool(void *asset, XArray<void *> &released);
+    SoundPrimedPool *GetPool(void *asset);
+    int GetPoolCount() const { return m_Pools.Size(); }
+    SoundPrimedPool &GetPoolAt(int index) { return m_Pools[index]; }
+
+    // A ready voice of the asset, NULL if there is none
+    void *Take(void *asset);
+    void Add(SoundPrimedPool &pool, void *source);
+
+    // Empties the pools, which the manager refills later, appending their
+    // ready voices to released
+    void Drain(XArray<void *> &released);
+    // Removes every pool, appending their ready voices to released
+    void Clear(XArray<void *> &released);
+
+    SoundPrimedStats &GetStats() { return m_Stats; }
+    const SoundPrimedStats &GetStats() const { return m_Stats; }
+
+private:
+    XArray<SoundPrimedPool> m_Pools;
+    SoundPrimedStats m_Stats;
+
+    // Prevent copying (VC6 style - declare but don't implement)
+    SoundPrimedVoices(const SoundPrimedVoices &);
+    SoundPrimedVoices &operator=(const SoundPrimedVoices &);
+};
+
+#endif /* SOUNDPRIMEDVOICES_H */
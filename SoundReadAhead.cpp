@@ -0,0 +1,375 @@
+#include "SoundReadAhead.h"
+
+SoundReadAhead::SoundReadAhead()
+{
+    m_Thread = NULL;
+    m_WakeEvent = NULL;
+    m_Stop = 0;
+    memset(&m_Stats, 0, sizeof(SoundReadAheadStats));
+    ::InitializeCriticalSection(&m_Lock);
+    ::InitializeCriticalSection(&m_ReadLock);
+}
+
+SoundReadAhead::~SoundReadAhead()
+{
+    Clear();
+    ::DeleteCriticalSection(&m_ReadLock);
+    ::DeleteCriticalSection(&m_Lock);
+}
+
+SoundReadAheadStream *SoundReadAhead::Open(void *source, const char *path, CKDWORD dataOffset, CKDWORD dataSize,
+                                           CKBOOL loop)
+{
+    SoundReadAheadStream *stream;
+    BYTE *data;
+    int i;
+
+    if (!source || !path || dataSize == 0 || dataOffset + dataSize < dataOffset)
+        return NULL;
+    if (!m_Thread && !Start())
+        return NULL;
+
+    Close(source);
+
+    /* Unbuffered reads need sector-aligned offsets, sizes and addresses */
+    data = (BYTE *)::VirtualAlloc(NULL, SOUNDREADAHEAD_BLOCKS * SOUNDREADAHEAD_BLOCK_SIZE,
+                                  MEM_COMMIT, PAGE_READWRITE);
+    if (!data)
+        return NULL;
+
+    stream = new SoundReadAheadStream;
+    memset(stream, 0, sizeof(SoundReadAheadStream));
+    stream->m_File = ::CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                   FILE_FLAG_NO_BUFFERING, NULL);
+    if (stream->m_File == INVALID_HANDLE_VALUE)
+    {
+        ::VirtualFree(data, 0, MEM_RELEASE);
+        delete stream;
+        return NULL;
+    }
+
+    stream->m_Source = source;
+    stream->m_DataStart = dataOffset;
+    stream->m_DataEnd = dataOffset + dataSize;
+    stream->m_Loop = loop;
+    stream->m_NextRead = dataOffset - dataOffset % SOUNDREADAHEAD_BLOCK_SIZE;
+    stream->m_Position = dataOffset;
+    stream->m_EndPosition = -1;
+    for (i = 0; i < SOUNDREADAHEAD_BLOCKS; ++i)
+        stream->m_Blocks[i].m_Data = data + i * SOUNDREADAHEAD_BLOCK_SIZE;
+
+    ::EnterCriticalSection(&m_Lock);
+    m_Streams.PushBack(stream);
+    ::LeaveCriticalSection(&m_Lock);
+    return stream;
+}
+
+CKBOOL SoundReadAhead::Close(void *source)
+{
+    SoundReadAheadStream *stream = NULL;
+    int i;
+
+    ::EnterCriticalSection(&m_Lock);
+    for (i = 0; i < m_Streams.Size(); ++i)
+    {
+        if (m_Streams[i]->m_Source == source)
+        {
+            stream = m_Streams[i];
+            m_Streams[i] = m_Streams[m_Streams.Size() - 1];
+            m_Streams.Resize(m_Streams.Size() - 1);
+            break;
+        }
+    }
+    ::LeaveCriticalSection(&m_Lock);
+
+    if (!stream)
+        return FALSE;
+    Release(stream);
+    return TRUE;
+}
+
+SoundReadAheadStream *SoundReadAhead::Find(void *source)
+{
+    int i;
+
+    for (i = 0; i < m_Streams.Size(); ++i)
+    {
+        if (m_Streams[i]->m_Source == source)
+            return m_Streams[i];
+    }
+    return NULL;
+}
+
+void SoundReadAhead::Clear()
+{
+    XArray<SoundReadAheadStream *> streams;
+    int i;
+
+    ::EnterCriticalSection(&m_Lock);
+    streams = m_Streams;
+    m_Streams.Clear();
+    ::LeaveCriticalSection(&m_Lock);
+
+    for (i = 0; i < streams.Size(); ++i)
+        Release(streams[i]);
+    Stop();
+}
+
+void SoundReadAhead::Release(SoundReadAheadStream *stream)
+{
+    /* The stream left m_Streams: wait out a read of one of its blocks */
+    ::EnterCriticalSection(&m_ReadLock);
+    ::LeaveCriticalSection(&m_ReadLock);
+
+    ::CloseHandle(stream->m_File);
+    ::VirtualFree(stream->m_Blocks[0].m_Data, 0, MEM_RELEASE);
+    delete stream;
+}
+
+CKDWORD SoundReadAhead::GetBlockEnd(const SoundReadAheadStream &stream, const SoundReadAheadBlock &block)
+{
+    CKDWORD end = block.m_FileOffset + SOUNDREADAHEAD_BLOCK_SIZE;
+
+    return (end > stream.m_DataEnd || end < block.m_FileOffset) ? stream.m_DataEnd : end;
+}
+
+void SoundReadAhead::Schedule(SoundReadAheadStream &stream, float deadline, float blockTime)
+{
+    SoundReadAheadBlock *block;
+    CKBOOL queued = FALSE;
+    int i;
+
+    ::EnterCriticalSection(&m_Lock);
+
+    for (i = 0; i < stream.m_Count; ++i)
+    {
+        block = &stream.m_Blocks[(stream.m_First + i) % SOUNDREADAHEAD_BLOCKS];
+        if (block->m_State == SOUNDREADAHEAD_READY)
+            continue;
+        if (block->m_State == SOUNDREADAHEAD_QUEUED)
+            block->m_Deadline = deadline;
+        deadline += blockTime;
+    }
+
+    while (stream.m_Count < SOUNDREADAHEAD_BLOCKS && !stream.m_Failed && stream.m_NextRead < stream.m_DataEnd)
+    {
+        block = &stream.m_Blocks[(stream.m_First + stream.m_Count) % SOUNDREADAHEAD_BLOCKS];
+        block->m_FileOffset = stream.m_NextRead;
+        block->m_Bytes = 0;
+        block->m_Deadline = deadline;
+        block->m_State = SOUNDREADAHEAD_QUEUED;
+        ++stream.m_Count;
+        deadline += blockTime;
+        queued = TRUE;
+
+        stream.m_NextRead = GetBlockEnd(stream, *block);
+        if (stream.m_NextRead >= stream.m_DataEnd && stream.m_Loop)
+            stream.m_NextRead = stream.m_DataStart - stream.m_DataStart % SOUNDREADAHEAD_BLOCK_SIZE;
+    }
+
+    ::LeaveCriticalSection(&m_Lock);
+
+    if (queued)
+        ::SetEvent(m_WakeEvent);
+}
+
+CKDWORD SoundReadAhead::GetReady(SoundReadAheadStream &stream)
+{
+    SoundReadAheadBlock *block;
+    CKDWORD ready = 0, position, end;
+    int i;
+
+    ::EnterCriticalSection(&m_Lock);
+
+    position = stream.m_Position;
+    for (i = 0; i < stream.m_Count && !stream.m_Ended; ++i)
+    {
+        block = &stream.m_Blocks[(stream.m_First + i) % SOUNDREADAHEAD_BLOCKS];
+        if (block->m_State != SOUNDREADAHEAD_READY)
+            break;
+
+        end = block->m_FileOffset + block->m_Bytes;
+        if (end > GetBlockEnd(stream, *block))
+            end = GetBlockEnd(stream, *block);
+        if (position < end)
+            ready += end - position;
+        if (end < GetBlockEnd(stream, *block))
+            break;
+        position = (end >= stream.m_DataEnd) ? stream.m_DataStart : end;
+    }
+
+    ::LeaveCriticalSection(&m_Lock);
+    return ready;
+}
+
+int SoundReadAhead::GetPending(SoundReadAheadStream &stream)
+{
+    int pending = 0, i;
+
+    ::EnterCriticalSection(&m_Lock);
+    for (i = 0; i < stream.m_Count; ++i)
+    {
+        if (stream.m_Blocks[(stream.m_First + i) % SOUNDREADAHEAD_BLOCKS].m_State != SOUNDREADAHEAD_READY)
+            ++pending;
+    }
+    ::LeaveCriticalSection(&m_Lock);
+    return pending;
+}
+
+CKDWORD SoundReadAhead::Read(SoundReadAheadStream &stream, void *data, CKDWORD bytes)
+{
+    SoundReadAheadBlock *block;
+    CKDWORD copied = 0, end, count;
+
+    ::EnterCriticalSection(&m_Lock);
+
+    while (copied < bytes && stream.m_Count > 0 && !stream.m_Ended)
+    {
+        block = &stream.m_Blocks[stream.m_First];
+        if (block->m_State != SOUNDREADAHEAD_READY)
+            break;
+
+        end = block->m_FileOffset + block->m_Bytes;
+        if (end > GetBlockEnd(stream, *block))
+            end = GetBlockEnd(stream, *block);
+        if (stream.m_Position < end)
+        {
+            count = end - stream.m_Position;
+            if (count > bytes - copied)
+                count = bytes - copied;
+            memcpy((BYTE *)data + copied, block->m_Data + (stream.m_Position - block->m_FileOffset), count);
+            stream.m_Position += count;
+            copied += count;
+            if (stream.m_Position < end)
+                break;
+        }
+
+        /* The block is used up */
+        block->m_State = SOUNDREADAHEAD_FREE;
+        stream.m_First = (stream.m_First + 1) % SOUNDREADAHEAD_BLOCKS;
+        --stream.m_Count;
+
+        if (end < GetBlockEnd(stream, *block) || (end >= stream.m_DataEnd && !stream.m_Loop))
+            stream.m_Ended = TRUE;
+        else if (end >= stream.m_DataEnd)
+            stream.m_Position = stream.m_DataStart;
+    }
+
+    ::LeaveCriticalSection(&m_Lock);
+    return copied;
+}
+
+//-----------------------------------------------------------------------------
+// I/O thread
+//-----------------------------------------------------------------------------
+
+CKBOOL SoundReadAhead::Start()
+{
+    DWORD threadId;
+
+    m_Stop = 0;
+    m_WakeEvent = ::CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (m_WakeEvent)
+        m_Thread = ::CreateThread(NULL, 0, IoThread, this, 0, &threadId);
+    if (!m_Thread)
+    {
+        Stop();
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void SoundReadAhead::Stop()
+{
+    if (m_Thread)
+    {
+        ::InterlockedExchange(&m_Stop, 1);
+        ::SetEvent(m_WakeEvent);
+        ::WaitForSingleObject(m_Thread, INFINITE);
+        ::CloseHandle(m_Thread);
+        m_Thread = NULL;
+    }
+    if (m_WakeEvent)
+    {
+        ::CloseHandle(m_WakeEvent);
+        m_WakeEvent = NULL;
+    }
+}
+
+DWORD WINAPI SoundReadAhead::IoThread(LPVOID param)
+{
+    ((SoundReadAhead *)param)->IoLoop();
+    return 0;
+}
+
+void SoundReadAhead::IoLoop()
+{
+    for (;;)
+    {
+        ::WaitForSingleObject(m_WakeEvent, INFINITE);
+        if (m_Stop)
+            break;
+
+        while (!m_Stop && ReadNext())
+            ;
+    }
+}
+
+CKBOOL SoundReadAhead::ReadNext()
+{
+    SoundReadAheadStream *stream = NULL;
+    SoundReadAheadBlock *block = NULL, *candidate;
+    DWORD bytes = 0;
+    LONG high = 0;
+    CKBOOL ok;
+    int i, j;
+
+    ::EnterCriticalSection(&m_Lock);
+
+    for (i = 0; i < m_Streams.Size(); ++i)
+    {
+        for (j = 0; j < m_Streams[i]->m_Count; ++j)
+        {
+            candidate = &m_Streams[i]->m_Blocks[(m_Streams[i]->m_First + j) % SOUNDREADAHEAD_BLOCKS];
+            if (candidate->m_State != SOUNDREADAHEAD_QUEUED)
+                continue;
+            if (!block || candidate->m_Deadline < block->m_Deadline)
+            {
+                stream = m_Streams[i];
+                block = candidate;
+            }
+            /* The blocks of a stream are due in file order */
+            break;
+        }
+    }
+
+    if (!block)
+    {
+        ::LeaveCriticalSection(&m_Lock);
+        return FALSE;
+    }
+
+    /* Taken before m_Lock is left, so closing the stream waits for the read */
+    block->m_State = SOUNDREADAHEAD_READING;
+    ::EnterCriticalSection(&m_ReadLock);
+    ::LeaveCriticalSection(&m_Lock);
+
+    /* Block offsets never equal INVALID_SET_FILE_POINTER */
+    ok = ::SetFilePointer(stream->m_File, (LONG)block->m_FileOffset, &high, FILE_BEGIN) != INVALID_SET_FILE_POINTER &&
+         ::ReadFile(stream->m_File, block->m_Data, SOUNDREADAHEAD_BLOCK_SIZE, &bytes, NULL);
+
+    ::EnterCriticalSection(&m_Lock);
+    block->m_Bytes = ok ? (CKDWORD)bytes : 0;
+    block->m_State = SOUNDREADAHEAD_READY;
+    ++m_Stats.m_Reads;
+    m_Stats.m_BytesRead += block->m_Bytes;
+    if (block->m_FileOffset + block->m_Bytes < GetBlockEnd(*stream, *block))
+    {
+        ++m_Stats.m_Failures;
+        stream->m_Failed = TRUE;
+    }
+    ::LeaveCriticalSection(&m_Lock);
+
+    ::LeaveCriticalSection(&m_ReadLock);
+    return TRUE;
+}
@@ -0,0 +1,130 @@
+#ifndef SOUNDREADAHEAD_H
+#define SOUNDREADAHEAD_H
+
+#include <windows.h>
+
+#include "CKAll.h"
+
+#define SOUNDREADAHEAD_BLOCK_SIZE 65536 /* Bytes per read, a multiple of any sector size */
+#define SOUNDREADAHEAD_BLOCKS     4     /* Blocks queued, in progress or ready per stream */
+
+enum SOUNDREADAHEAD_STATE
+{
+    SOUNDREADAHEAD_FREE,
+    SOUNDREADAHEAD_QUEUED,
+    SOUNDREADAHEAD_READING,
+    SOUNDREADAHEAD_READY
+};
+
+/**
+ * @brief Counters of the reads made by the I/O thread
+ */
+struct SoundReadAheadStats
+{
+    int m_Reads;
+    int m_Failures;         /* Failed or short reads, each ending its stream */
+    LONGLONG m_BytesRead;
+};
+
+struct SoundReadAheadBlock
+{
+    BYTE *m_Data;           /* SOUNDREADAHEAD_BLOCK_SIZE bytes, page aligned */
+    CKDWORD m_FileOffset;   /* Multiple of SOUNDREADAHEAD_BLOCK_SIZE */
+    CKDWORD m_Bytes;        /* Read, fewer at the end of the file */
+    float m_Deadline;       /* When the stream needs it, orders the queue */
+    int m_State;            /* SOUNDREADAHEAD_STATE */
+};
+
+/**
+ * @brief A file read ahead of its consumer
+ *
+ * The blocks in use follow each other in file order from m_First, the
+ * one holding m_Position. Looping streams wrap back to the block holding
+ * the first data byte.
+ */
+struct SoundReadAheadStream
+{
+    void *m_Source;
+    HANDLE m_File;
+    CKDWORD m_DataStart;    /* File offsets of the PCM data */
+    CKDWORD m_DataEnd;
+    CKBOOL m_Loop;
+    CKDWORD m_NextRead;     /* Offset of the next block to queue */
+    CKDWORD m_Position;     /* Offset of the next byte handed out */
+    int m_First;
+    int m_Count;
+    CKBOOL m_Failed;        /* No block is queued after a failed read */
+    CKBOOL m_Ended;         /* Every byte was handed out, or a read failed */
+    int m_LateReads;        /* Underruns of the consumer with a block outstanding */
+    LONGLONG m_EndPosition; /* Of the last byte in the streaming ring, -1 until ended */
+    SoundReadAheadBlock m_Blocks[SOUNDREADAHEAD_BLOCKS];
+};
+
+/**
+ * @brief Reads streamed files ahead of their play cursors on one thread
+ *
+ * Every stream keeps SOUNDREADAHEAD_BLOCKS large reads queued or ready,
+ * so the consumer copies from memory and never waits on the disk. Reads
+ * bypass the file cache and start on block boundaries. The I/O thread
+ * serves the queued blocks of every stream by deadline, so a stream
+ * close to running dry is read before the ones with data to spare
+ * instead of the streams taking turns with small reads.
+ *
+ * Streams are few: lookups are linear, like SoundStreamRings. Everything
+ * but the reads themselves happens on the caller's thread.
+ */
+class SoundReadAhead
+{
+public:
+    SoundReadAhead();
+    ~SoundReadAhead();
+
+    // Opens the file, the bytes [dataOffset, dataOffset + dataSize) being
+    // the data. The I/O thread starts with the first stream.
+    SoundReadAheadStream *Open(void *source, const char *path, CKDWORD dataOffset, CKDWORD dataSize, CKBOOL loop);
+    // Waits for a read of the stream in progress and closes its file.
+    // Returns TRUE if the source had a stream.
+    CKBOOL Close(void *source);
+    SoundReadAheadStream *Find(void *source);
+    int GetCount() const { return m_Streams.Size(); }
+    SoundReadAheadStream &GetAt(int index) { return *m_Streams[index]; }
+    void Clear();
+
+    // Queues the free blocks of the stream. The first block not yet ready
+    // is due at deadline and each one after it blockTime later.
+    void Schedule(SoundReadAheadStream &stream, float deadline, float blockTime);
+    // Bytes ready to be handed out without waiting
+    CKDWORD GetReady(SoundReadAheadStream &stream);
+    // Blocks queued or being read
+    int GetPending(SoundReadAheadStream &stream);
+    // Copies up to bytes ready bytes, returns the number copied
+    CKDWORD Read(SoundReadAheadStream &stream, void *data, CKDWORD bytes);
+
+    const SoundReadAheadStats &GetStats() const { return m_Stats; }
+
+private:
+    CKBOOL Start();
+    void Stop();
+    void Release(SoundReadAheadStream *stream);
+    // Last offset of the data the block holds once read in full
+    static CKDWORD GetBlockEnd(const SoundReadAheadStream &stream, const SoundReadAheadBlock &block);
+
+    static DWORD WINAPI IoThread(LPVOID param);
+    void IoLoop();
+    // Reads the queued block with the earliest deadline, FALSE if none
+    CKBOOL ReadNext();
+
+    XArray<SoundReadAheadStream *> m_Streams;
+    CRITICAL_SECTION m_Lock;        /* Streams and block states */
+    CRITICAL_SECTION m_ReadLock;    /* Held by the I/O thread during a read */
+    HANDLE m_Thread;
+    HANDLE m_WakeEvent;             /* Auto-reset, set when blocks are queued */
+    volatile LONG m_Stop;
+    SoundReadAheadStats m_Stats;
+
+    // Prevent copying (VC6 style - declare but don't implement)
+    SoundReadAhead(const SoundReadAhead &);
+    SoundReadAhead &operator=(const SoundReadAhead &);
+};
+
+#endif /* SOUNDREADAHEAD_H */
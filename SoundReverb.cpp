@@ -0,0 +1,238 @@
+#include "SoundReverb.h"
+#include "SoundSimd.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+// Delay lengths at 48 kHz for the largest room, mutually prime so the
+// echoes of the lines do not pile up on the same frames
+static const int s_BaseLengths[SOUNDREVERB_LINES] = {1423, 1777, 1973, 2099, 2557, 2879, 3221, 3517};
+
+// Input and output taps: alternating signs decorrelate the two channels
+static const float s_InputSigns[SOUNDREVERB_LINES] = {1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, -1.0f, 1.0f};
+static const float s_LeftTaps[SOUNDREVERB_LINES] = {1.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, -1.0f, 0.0f};
+static const float s_RightTaps[SOUNDREVERB_LINES] = {0.0f, 1.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, -1.0f};
+
+#define SOUNDREVERB_MIN_ROOM    0.3f  /* Delay scale of the smallest room */
+#define SOUNDREVERB_MAX_DAMPING 0.7f  /* Keeps the lowpass away from DC-only */
+#define SOUNDREVERB_INPUT_GAIN  0.35f /* ~1/sqrt(8): the input goes to every line */
+#define SOUNDREVERB_DENORMAL    1e-20f /* Keeps a silent tail out of denormals */
+
+#ifdef SOUNDSIMD_SSE
+static inline float HorizontalSum(__m128 v)
+{
+    float result;
+    v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+    _mm_store_ss(&result, v);
+    return result;
+}
+#endif
+
+SoundReverb::SoundReverb()
+{
+    int i;
+
+    m_SampleRate = 0;
+    m_Damping = 0.0f;
+    for (i = 0; i < SOUNDREVERB_LINES; ++i)
+    {
+        m_Lines[i] = NULL;
+        m_MaxLength[i] = 0;
+        m_Length[i] = 0;
+        m_Cursor[i] = 0;
+        m_Feedback[i] = 0.0f;
+        m_DampState[i] = 0.0f;
+    }
+
+    m_Settings.m_DecayTime = 1.5f;
+    m_Settings.m_RoomSize = 0.5f;
+    m_Settings.m_Damping = 0.5f;
+    m_Settings.m_Gain = 0.3f;
+}
+
+SoundReverb::~SoundReverb()
+{
+    ReleaseLines();
+}
+
+void SoundReverb::ReleaseLines()
+{
+    int i;
+
+    for (i = 0; i < SOUNDREVERB_LINES; ++i)
+    {
+        free(m_Lines[i]);
+        m_Lines[i] = NULL;
+        m_MaxLength[i] = 0;
+        m_Length[i] = 0;
+    }
+    m_SampleRate = 0;
+}
+
+CKBOOL SoundReverb::SetSampleRate(int sampleRate)
+{
+    int i;
+
+    if (sampleRate <= 0)
+        return FALSE;
+    if (sampleRate == m_SampleRate)
+        return TRUE;
+
+    ReleaseLines();
+
+    for (i = 0; i < SOUNDREVERB_LINES; ++i)
+    {
+        m_MaxLength[i] = (int)((LONGLONG)s_BaseLengths[i] * sampleRate / 48000) + 1;
+        m_Lines[i] = (float *)malloc(m_MaxLength[i] * sizeof(float));
+        if (!m_Lines[i])
+        {
+            ReleaseLines();
+            return FALSE;
+        }
+    }
+
+    m_SampleRate = sampleRate;
+    UpdateLines();
+    Reset();
+    return TRUE;
+}
+
+void SoundReverb::SetSettings(const SoundReverbSettings &settings)
+{
+    m_Settings = settings;
+
+    if (m_Settings.m_DecayTime < 0.01f)
+        m_Settings.m_DecayTime = 0.01f;
+    if (m_Settings.m_RoomSize < 0.0f)
+        m_Settings.m_RoomSize = 0.0f;
+    if (m_Settings.m_RoomSize > 1.0f)
+        m_Settings.m_RoomSize = 1.0f;
+    if (m_Settings.m_Damping < 0.0f)
+        m_Settings.m_Damping = 0.0f;
+    if (m_Settings.m_Damping > 1.0f)
+        m_Settings.m_Damping = 1.0f;
+    if (m_Settings.m_Gain < 0.0f)
+        m_Settings.m_Gain = 0.0f;
+
+    if (m_SampleRate > 0)
+        UpdateLines();
+}
+
+void SoundReverb::UpdateLines()
+{
+    float scale = SOUNDREVERB_MIN_ROOM + (1.0f - SOUNDREVERB_MIN_ROOM) * m_Settings.m_RoomSize;
+    int i;
+
+    for (i = 0; i < SOUNDREVERB_LINES; ++i)
+    {
+        m_Length[i] = (int)(m_MaxLength[i] * scale);
+        if (m_Length[i] < 1)
+            m_Length[i] = 1;
+        if (m_Cursor[i] >= m_Length[i])
+            m_Cursor[i] = 0;
+
+        /* -60 dB after m_DecayTime seconds of round trips through this line */
+        m_Feedback[i] = (float)pow(10.0, -3.0 * m_Length[i] / (m_Settings.m_DecayTime * m_SampleRate));
+    }
+
+    m_Damping = m_Settings.m_Damping * SOUNDREVERB_MAX_DAMPING;
+}
+
+void SoundReverb::Reset()
+{
+    int i;
+
+    for (i = 0; i < SOUNDREVERB_LINES; ++i)
+    {
+        if (m_Lines[i])
+            memset(m_Lines[i], 0, m_MaxLength[i] * sizeof(float));
+        m_Cursor[i] = 0;
+        m_DampState[i] = 0.0f;
+    }
+}
+
+void SoundReverb::Process(const float *input, float *output, int frames)
+{
+    float taps[SOUNDREVERB_LINES];
+    float gain = m_Settings.m_Gain;
+    float in, left, right;
+    int i, k;
+#ifdef SOUNDSIMD_SSE
+    __m128 state0, state1, feedback0, feedback1, signs0, signs1;
+    __m128 left0, left1, right0, right1, damp, pass;
+    __m128 x0, x1, mix, v;
+#else
+    float sum;
+#endif
+
+    if (!m_SampleRate || !input || !output)
+        return;
+
+#ifdef SOUNDSIMD_SSE
+    state0 = _mm_loadu_ps(m_DampState);
+    state1 = _mm_loadu_ps(m_DampState + 4);
+    feedback0 = _mm_loadu_ps(m_Feedback);
+    feedback1 = _mm_loadu_ps(m_Feedback + 4);
+    signs0 = _mm_loadu_ps(s_InputSigns);
+    signs1 = _mm_loadu_ps(s_InputSigns + 4);
+    left0 = _mm_loadu_ps(s_LeftTaps);
+    left1 = _mm_loadu_ps(s_LeftTaps + 4);
+    right0 = _mm_loadu_ps(s_RightTaps);
+    right1 = _mm_loadu_ps(s_RightTaps + 4);
+    damp = _mm_set1_ps(m_Damping);
+    pass = _mm_set1_ps(1.0f - m_Damping);
+#endif
+
+    for (i = 0; i < frames; ++i)
+    {
+        in = (input[2 * i] + input[2 * i + 1]) * (0.5f * SOUNDREVERB_INPUT_GAIN) + SOUNDREVERB_DENORMAL;
+
+        for (k = 0; k < SOUNDREVERB_LINES; ++k)
+            taps[k] = m_Lines[k][m_Cursor[k]];
+
+#ifdef SOUNDSIMD_SSE
+        /* Damping lowpass */
+        state0 = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(taps), pass), _mm_mul_ps(state0, damp));
+        state1 = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(taps + 4), pass), _mm_mul_ps(state1, damp));
+
+        left = HorizontalSum(_mm_add_ps(_mm_mul_ps(state0, left0), _mm_mul_ps(state1, left1)));
+        right = HorizontalSum(_mm_add_ps(_mm_mul_ps(state0, right0), _mm_mul_ps(state1, right1)));
+
+        /* Householder feedback: x - 2/N * sum(x) */
+        mix = _mm_set1_ps(HorizontalSum(_mm_add_ps(state0, state1)) * (-2.0f / SOUNDREVERB_LINES));
+        v = _mm_set1_ps(in);
+        x0 = _mm_add_ps(_mm_mul_ps(_mm_add_ps(state0, mix), feedback0), _mm_mul_ps(v, signs0));
+        x1 = _mm_add_ps(_mm_mul_ps(_mm_add_ps(state1, mix), feedback1), _mm_mul_ps(v, signs1));
+        _mm_storeu_ps(taps, x0);
+        _mm_storeu_ps(taps + 4, x1);
+#else
+        left = right = sum = 0.0f;
+        for (k = 0; k < SOUNDREVERB_LINES; ++k)
+        {
+            m_DampState[k] = taps[k] * (1.0f - m_Damping) + m_DampState[k] * m_Damping;
+            left += m_DampState[k] * s_LeftTaps[k];
+            right += m_DampState[k] * s_RightTaps[k];
+            sum += m_DampState[k];
+        }
+        sum *= -2.0f / SOUNDREVERB_LINES;
+        for (k = 0; k < SOUNDREVERB_LINES; ++k)
+            taps[k] = (m_DampState[k] + sum) * m_Feedback[k] + in * s_InputSigns[k];
+#endif
+
+        for (k = 0; k < SOUNDREVERB_LINES; ++k)
+        {
+            m_Lines[k][m_Cursor[k]] = taps[k];
+            if (++m_Cursor[k] >= m_Length[k])
+                m_Cursor[k] = 0;
+        }
+
+        output[2 * i] += left * gain;
+        output[2 * i + 1] += right * gain;
+    }
+
+#ifdef SOUNDSIMD_SSE
+    _mm_storeu_ps(m_DampState, state0);
+    _mm_storeu_ps(m_DampState + 4, state1);
+#endif
+}
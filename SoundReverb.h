@@ -0,0 +1,73 @@
+#ifndef SOUNDREVERB_H
+#define SOUNDREVERB_H
+
+#include "CKAll.h"
+
+#include "SoundBusEffect.h"
+
+#define SOUNDREVERB_LINES     8 /* Delay lines in the feedback network */
+#define SOUNDREVERB_MAX_BUSES 4 /* Reverb buses per manager */
+
+/**
+ * @brief Parameters of a reverb bus
+ */
+struct SoundReverbSettings
+{
+    float m_DecayTime; /* Time for the tail to decay by 60 dB, in seconds */
+    float m_RoomSize;  /* 0 (small) to 1 (large), scales the delay lengths */
+    float m_Damping;   /* 0 (bright) to 1 (dark), high frequency loss per pass */
+    float m_Gain;      /* Level of the wet signal returned to the mix */
+};
+
+/**
+ * @brief Feedback delay network reverb
+ *
+ * Eight delay lines of mutually prime lengths feed back through a
+ * Householder matrix, each with a one-pole lowpass for damping and a gain
+ * setting its decay time. The lines are processed as two 4-wide vectors
+ * when SSE is available (see SoundSimd.h).
+ *
+ * One instance serves a whole bus: voices add into a shared stereo send
+ * buffer, so the cost does not depend on how many voices are sending.
+ */
+class SoundReverb : public SoundBusEffect
+{
+public:
+    SoundReverb();
+    virtual ~SoundReverb();
+
+    virtual SOUNDBUS_EFFECT GetType() const { return SOUNDBUS_REVERB; }
+
+    // Allocates the delay lines for the largest room at this rate
+    virtual CKBOOL SetSampleRate(int sampleRate);
+    int GetSampleRate() const { return m_SampleRate; }
+
+    void SetSettings(const SoundReverbSettings &settings);
+    const SoundReverbSettings &GetSettings() const { return m_Settings; }
+
+    virtual void Reset();
+    virtual void Process(const float *input, float *output, int frames);
+
+private:
+    void ReleaseLines();
+    void UpdateLines();
+
+    SoundReverbSettings m_Settings;
+    int m_SampleRate;
+
+    float *m_Lines[SOUNDREVERB_LINES];
+    int m_MaxLength[SOUNDREVERB_LINES]; /* Allocated length of each line */
+    int m_Length[SOUNDREVERB_LINES];    /* Current delay in frames */
+    int m_Cursor[SOUNDREVERB_LINES];
+
+    // Per-line coefficients and state, in lane order for the vector code
+    float m_Feedback[SOUNDREVERB_LINES];
+    float m_DampState[SOUNDREVERB_LINES];
+    float m_Damping;
+
+    // Prevent copying (VC6 style - declare but don't implement)
+    SoundReverb(const SoundReverb &);
+    SoundReverb &operator=(const SoundReverb &);
+};
+
+#endif /* SOUNDREVERB_H */
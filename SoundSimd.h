@@ -0,0 +1,44 @@
+#ifndef SOUNDSIMD_H
+#define SOUNDSIMD_H
+
+// SSE is used when the compiler targets it (x64, /arch:SSE or later, -msse)
+// unless DX8SOUND_NO_SIMD is defined. Every SIMD path has a scalar twin
+// producing the same results up to float rounding.
+#if !defined(DX8SOUND_NO_SIMD) && \
+    (defined(_M_X64) || defined(__SSE__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+    #define SOUNDSIMD_SSE 1
+    #include <xmmintrin.h>
+#endif
+
+#ifdef SOUNDSIMD_SSE
+/**
+ * @brief Lanes of a where mask is set, of b elsewhere
+ */
+inline __m128 SoundSimdSelect(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+#endif
+
+/**
+ * @brief Accumulates src * gain into dst
+ */
+inline void SoundSimdScaleAdd(float *dst, const float *src, float gain, int count)
+{
+    int i = 0;
+
+#ifdef SOUNDSIMD_SSE
+    __m128 g = _mm_set1_ps(gain);
+    for (; i + 4 <= count; i += 4)
+    {
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(_mm_loadu_ps(src + i), g)));
+    }
+#endif
+
+    for (; i < count; ++i)
+    {
+        dst[i] += src[i] * gain;
+    }
+}
+
+#endif /* SOUNDSIMD_H */
@@ -0,0 +1,241 @@
+#include "SoundSpatialIndex.h"
+
+#include <math.h>
+
+SoundSpatialIndex::SoundSpatialIndex()
+    : m_CellSize(1.0f),
+      m_FreeList(-1)
+{
+    m_Buckets.Resize(SOUNDSPATIAL_MIN_BUCKETS);
+    m_Buckets.Fill(-1);
+    memset(&m_Stats, 0, sizeof(SoundSpatialStats));
+}
+
+void SoundSpatialIndex::SetCellSize(float size)
+{
+    if (size <= 0.0f || size == m_CellSize)
+        return;
+
+    m_CellSize = size;
+    Rehash(m_Buckets.Size());
+}
+
+void SoundSpatialIndex::Update(void *source, const VxVector &position)
+{
+    SoundSpatialEntry added;
+    SoundSpatialEntry *entry;
+    int *found;
+    int index;
+
+    found = m_Lookup.FindPtr(source);
+    if (found)
+    {
+        index = *found;
+        entry = &m_Entries[index];
+        entry->m_Position = position;
+
+        if (!IsInLooseCell(position, entry->m_Cell))
+        {
+            Unlink(index);
+            ComputeCell(position, entry->m_Cell);
+            Link(index);
+            ++m_Stats.m_Moves;
+        }
+        return;
+    }
+
+    if (2 * (GetCount() + 1) > m_Buckets.Size())
+        Rehash(2 * m_Buckets.Size());
+
+    if (m_FreeList >= 0)
+    {
+        index = m_FreeList;
+        m_FreeList = m_Entries[index].m_Next;
+    }
+    else
+    {
+        memset(&added, 0, sizeof(SoundSpatialEntry));
+        m_Entries.PushBack(added);
+        index = m_Entries.Size() - 1;
+    }
+
+    entry = &m_Entries[index];
+    entry->m_Source = source;
+    entry->m_Position = position;
+    ComputeCell(position, entry->m_Cell);
+    Link(index);
+    m_Lookup.Insert(source, index, TRUE);
+}
+
+void SoundSpatialIndex::Remove(void *source)
+{
+    int *found = m_Lookup.FindPtr(source);
+
+    if (found)
+        Release(*found);
+}
+
+int SoundSpatialIndex::Query(const VxVector &center, float radius, XArray<int> &entries)
+{
+    int lo[3], hi[3], cell[3];
+    float radius2, cells;
+    int found, entry, c;
+
+    m_Stats.m_Visited = 0;
+    m_Stats.m_Found = 0;
+    if (radius < 0.0f || GetCount() == 0)
+        return 0;
+
+    found = entries.Size();
+    radius2 = radius * radius;
+
+    cells = 1.0f;
+    for (c = 0; c < 3; ++c)
+    {
+        lo[c] = ToCell((center[c] - radius) / m_CellSize - SOUNDSPATIAL_LOOSENESS);
+        hi[c] = ToCell((center[c] + radius) / m_CellSize + SOUNDSPATIAL_LOOSENESS);
+        cells *= (float)(hi[c] - lo[c] + 1);
+    }
+
+    /* A box wider than the population is cheaper to scan */
+    if (cells > (float)GetCount())
+    {
+        for (entry = 0; entry < m_Entries.Size(); ++entry)
+        {
+            if (m_Entries[entry].m_Source)
+                TestEntry(entry, center, radius2, entries);
+        }
+        m_Stats.m_Found = entries.Size() - found;
+        return m_Stats.m_Found;
+    }
+
+    for (cell[0] = lo[0]; cell[0] <= hi[0]; ++cell[0])
+    {
+        for (cell[1] = lo[1]; cell[1] <= hi[1]; ++cell[1])
+        {
+            for (cell[2] = lo[2]; cell[2] <= hi[2]; ++cell[2])
+            {
+                /* Other cells share the bucket, skip their emitters */
+                for (entry = m_Buckets[HashCell(cell)]; entry >= 0; entry = m_Entries[entry].m_Next)
+                {
+                    if (memcmp(m_Entries[entry].m_Cell, cell, sizeof(cell)) == 0)
+                        TestEntry(entry, center, radius2, entries);
+                }
+            }
+        }
+    }
+
+    m_Stats.m_Found = entries.Size() - found;
+    return m_Stats.m_Found;
+}
+
+void SoundSpatialIndex::Clear()
+{
+    m_Entries.Clear();
+    m_Lookup.Clear();
+    m_FreeList = -1;
+    m_Buckets.Resize(SOUNDSPATIAL_MIN_BUCKETS);
+    m_Buckets.Fill(-1);
+}
+
+void SoundSpatialIndex::ComputeCell(const VxVector &position, int *cell) const
+{
+    int c;
+
+    for (c = 0; c < 3; ++c)
+        cell[c] = ToCell(position[c] / m_CellSize);
+}
+
+int SoundSpatialIndex::ToCell(float coordinate)
+{
+    /* Out of range or NaN would overflow the conversion */
+    if (!(coordinate > (float)-SOUNDSPATIAL_MAX_CELL))
+        return -SOUNDSPATIAL_MAX_CELL;
+    if (coordinate >= (float)SOUNDSPATIAL_MAX_CELL)
+        return SOUNDSPATIAL_MAX_CELL;
+    return (int)floorf(coordinate);
+}
+
+CKBOOL SoundSpatialIndex::IsInLooseCell(const VxVector &position, const int *cell) const
+{
+    float p;
+    int c;
+
+    for (c = 0; c < 3; ++c)
+    {
+        p = position[c] / m_CellSize - (float)cell[c];
+        if (p < -SOUNDSPATIAL_LOOSENESS || p >= 1.0f + SOUNDSPATIAL_LOOSENESS)
+            return FALSE;
+    }
+    return TRUE;
+}
+
+int SoundSpatialIndex::HashCell(const int *cell) const
+{
+    CKDWORD h;
+
+    h = (CKDWORD)cell[0] * 73856093U ^ (CKDWORD)cell[1] * 19349663U ^ (CKDWORD)cell[2] * 83492791U;
+    return (int)(h & (CKDWORD)(m_Buckets.Size() - 1));
+}
+
+void SoundSpatialIndex::Rehash(int buckets)
+{
+    int i;
+
+    m_Buckets.Resize(buckets);
+    m_Buckets.Fill(-1);
+    for (i = 0; i < m_Entries.Size(); ++i)
+    {
+        if (!m_Entries[i].m_Source)
+            continue;
+        ComputeCell(m_Entries[i].m_Position, m_Entries[i].m_Cell);
+        Link(i);
+    }
+}
+
+void SoundSpatialIndex::Link(int entry)
+{
+    SoundSpatialEntry *e = &m_Entries[entry];
+    int bucket = HashCell(e->m_Cell);
+
+    e->m_Bucket = bucket;
+    e->m_Prev = -1;
+    e->m_Next = m_Buckets[bucket];
+    if (e->m_Next >= 0)
+        m_Entries[e->m_Next].m_Prev = entry;
+    m_Buckets[bucket] = entry;
+}
+
+void SoundSpatialIndex::Unlink(int entry)
+{
+    SoundSpatialEntry *e = &m_Entries[entry];
+
+    if (e->m_Prev >= 0)
+        m_Entries[e->m_Prev].m_Next = e->m_Next;
+    else
+        m_Buckets[e->m_Bucket] = e->m_Next;
+    if (e->m_Next >= 0)
+        m_Entries[e->m_Next].m_Prev = e->m_Prev;
+}
+
+void SoundSpatialIndex::Release(int entry)
+{
+    SoundSpatialEntry *e = &m_Entries[entry];
+
+    Unlink(entry);
+    m_Lookup.Remove(e->m_Source);
+
+    e->m_Source = NULL;
+    e->m_Prev = -1;
+    e->m_Next = m_FreeList;
+    m_FreeList = entry;
+}
+
+void SoundSpatialIndex::TestEntry(int entry, const VxVector &center, float radius2, XArray<int> &entries)
+{
+    VxVector offset = m_Entries[entry].m_Position - center;
+
+    ++m_Stats.m_Visited;
+    if (offset.SquareMagnitude() <= radius2)
+        entries.PushBack(entry);
+}
@@ -0,0 +1,94 @@
+#ifndef SOUNDSPATIALINDEX_H
+#define SOUNDSPATIALINDEX_H
+
+#include "CKAll.h"
+
+#include "SampleStore.h"
+
+#define SOUNDSPATIAL_MIN_BUCKETS 256 /* Power of two, doubled to keep two per emitter */
+#define SOUNDSPATIAL_LOOSENESS 0.5f /* Of a cell, on each side */
+#define SOUNDSPATIAL_MAX_CELL (1 << 20) /* Cell coordinates are clamped to +/- this */
+
+/**
+ * @brief An emitter filed in the grid
+ */
+struct SoundSpatialEntry
+{
+    void *m_Source;         /* NULL while on the free list */
+    VxVector m_Position;
+    int m_Cell[3];
+    int m_Bucket;
+    int m_Prev;             /* In the bucket, -1 at the ends */
+    int m_Next;             /* In the bucket or the free list */
+};
+
+/**
+ * @brief Counters of the index
+ */
+struct SoundSpatialStats
+{
+    int m_Moves;            /* Emitters re-filed after leaving their cell */
+    int m_Visited;          /* Emitters tested by the last query */
+    int m_Found;            /* Emitters returned by the last query */
+};
+
+/**
+ * @brief Loose grid over the positions of the 3D emitters
+ *
+ * The grid is unbounded: cells are hashed into buckets, each a list of the
+ * emitters filed there, with at least two buckets per emitter. An emitter
+ * keeps its cell while it stays within SOUNDSPATIAL_LOOSENESS cells of it,
+ * so emitters moving about a boundary are not re-filed every frame;
+ * queries widen their box by the same margin. A radius query visits the
+ * buckets of the cells its box covers, falling back to a scan when that
+ * would visit more cells than there are emitters.
+ */
+class SoundSpatialIndex
+{
+public:
+    SoundSpatialIndex();
+
+    // Re-files every emitter if the size changed
+    void SetCellSize(float size);
+    float GetCellSize() const { return m_CellSize; }
+
+    // Files or moves the emitter of a source; emitters stay filed until
+    // removed, callers only update the ones that moved
+    void Update(void *source, const VxVector &position);
+    void Remove(void *source);
+
+    // Appends the emitters within radius of center and returns how many
+    // were found. They stay valid until the next Update or Remove.
+    int Query(const VxVector &center, float radius, XArray<int> &entries);
+    const SoundSpatialEntry &GetEntry(int entry) const { return m_Entries[entry]; }
+
+    int GetCount() const { return m_Lookup.Size(); }
+    void Clear();
+
+    const SoundSpatialStats &GetStats() const { return m_Stats; }
+
+private:
+    void ComputeCell(const VxVector &position, int *cell) const;
+    // floorf of a coordinate in cells, clamped to SOUNDSPATIAL_MAX_CELL
+    static int ToCell(float coordinate);
+    CKBOOL IsInLooseCell(const VxVector &position, const int *cell) const;
+    int HashCell(const int *cell) const;
+    void Rehash(int buckets);
+    void Link(int entry);
+    void Unlink(int entry);
+    void Release(int entry);
+    void TestEntry(int entry, const VxVector &center, float radius2, XArray<int> &entries);
+
+    float m_CellSize;
+    int m_FreeList;
+    XArray<SoundSpatialEntry> m_Entries;
+    XArray<int> m_Buckets;
+    XHashTable<int, void *, SourceHash> m_Lookup;
+    SoundSpatialStats m_Stats;
+
+    // Prevent copying (VC6 style - declare but don't implement)
+    SoundSpatialIndex(const SoundSpatialIndex &);
+    SoundSpatialIndex &operator=(const SoundSpatialIndex &);
+};
+
+#endif /* SOUNDSPATIALINDEX_H */
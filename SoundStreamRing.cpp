@@ -0,0 +1,156 @@
+#include "SoundStreamRing.h"
+
+SoundStreamRings::SoundStreamRings()
+    : m_Underruns(0)
+{
+}
+
+SoundStreamRing *SoundStreamRings::Open(void *source, CKDWORD size, CKDWORD align, CKDWORD bytesPerSecond,
+                                        CKDWORD guard, CKDWORD playCursor)
+{
+    SoundStreamRing *ring;
+    SoundStreamRing added;
+
+    if (!source || align == 0 || size < align || bytesPerSecond == 0)
+        return NULL;
+
+    ring = Find(source);
+    if (!ring)
+    {
+        memset(&added, 0, sizeof(SoundStreamRing));
+        m_Rings.PushBack(added);
+        ring = &m_Rings[m_Rings.Size() - 1];
+    }
+
+    memset(ring, 0, sizeof(SoundStreamRing));
+    ring->m_Source = source;
+    ring->m_Align = align;
+    ring->m_Size = size - size % align;
+    ring->m_BytesPerSecond = bytesPerSecond;
+    ring->m_Guard = guard - guard % align;
+    if (ring->m_Guard >= ring->m_Size)
+        ring->m_Guard = 0;
+    ring->m_PlayCursor = playCursor % ring->m_Size;
+    ring->m_Played = ring->m_PlayCursor;
+    ring->m_Written = ring->m_Played - ring->m_Played % align;
+    ring->m_Stats.m_MinQueued = ring->m_Size;
+    return ring;
+}
+
+CKBOOL SoundStreamRings::Close(void *source)
+{
+    int i;
+
+    for (i = 0; i < m_Rings.Size(); ++i)
+    {
+        if (m_Rings[i].m_Source == source)
+        {
+            m_Rings[i] = m_Rings[m_Rings.Size() - 1];
+            m_Rings.Resize(m_Rings.Size() - 1);
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+SoundStreamRing *SoundStreamRings::Find(void *source)
+{
+    int i;
+
+    for (i = 0; i < m_Rings.Size(); ++i)
+    {
+        if (m_Rings[i].m_Source == source)
+            return &m_Rings[i];
+    }
+    return NULL;
+}
+
+CKBOOL SoundStreamRings::Advance(SoundStreamRing &ring, CKDWORD playCursor)
+{
+    LONGLONG resume;
+    CKBOOL underrun = FALSE;
+
+    playCursor %= ring.m_Size;
+    ring.m_Played += (playCursor + ring.m_Size - ring.m_PlayCursor) % ring.m_Size;
+    ring.m_PlayCursor = playCursor;
+
+    /* Nothing written yet: the buffer plays whatever it was created with */
+    if (ring.m_Stats.m_Written == 0 && ring.m_Played > ring.m_Written)
+        ring.m_Written = ring.m_Played - ring.m_Played % ring.m_Align;
+
+    if (ring.m_Played > ring.m_Written)
+    {
+        if (!ring.m_Starved)
+        {
+            ring.m_Starved = TRUE;
+            ring.m_Low = FALSE;
+            ++ring.m_Stats.m_Underruns;
+            ++m_Underruns;
+            underrun = TRUE;
+        }
+
+        resume = ring.m_Played + ring.m_Guard;
+        ring.m_Written = resume + (ring.m_Align - resume % ring.m_Align) % ring.m_Align;
+        ring.m_Stats.m_MinQueued = 0;
+    }
+
+    /* While starved, the bytes up to the resume point are stale */
+    ring.m_Stats.m_Queued = ring.m_Starved ? 0 : (CKDWORD)(ring.m_Written - ring.m_Played);
+    if (ring.m_Stats.m_Written > 0 && !ring.m_Starved && ring.m_Stats.m_Queued < ring.m_Stats.m_MinQueued)
+        ring.m_Stats.m_MinQueued = ring.m_Stats.m_Queued;
+    return underrun;
+}
+
+CKBOOL SoundStreamRings::CheckLow(SoundStreamRing &ring)
+{
+    float left;
+
+    if (ring.m_Stats.m_Written == 0 || ring.m_Starved)
+        return FALSE;
+
+    left = GetTimeToUnderrun(ring);
+    if (ring.m_Low)
+    {
+        if (left >= 2 * SOUNDSTREAM_LOW_MS)
+            ring.m_Low = FALSE;
+        return FALSE;
+    }
+    if (left >= SOUNDSTREAM_LOW_MS)
+        return FALSE;
+
+    ring.m_Low = TRUE;
+    ++ring.m_Stats.m_LowWarnings;
+    return TRUE;
+}
+
+float SoundStreamRings::GetTimeToUnderrun(const SoundStreamRing &ring)
+{
+    return (float)ring.m_Stats.m_Queued * 1000.0f / ring.m_BytesPerSecond;
+}
+
+CKDWORD SoundStreamRings::GetWritable(const SoundStreamRing &ring)
+{
+    /* A frame short of the whole buffer: a full ring never looks empty */
+    LONGLONG free = ring.m_Played + ring.m_Size - ring.m_Align - ring.m_Written;
+
+    if (free <= 0)
+        return 0;
+    return (CKDWORD)(free - free % ring.m_Align);
+}
+
+void SoundStreamRings::Commit(SoundStreamRing &ring, CKDWORD bytes)
+{
+    bytes -= bytes % ring.m_Align;
+    ring.m_Written += bytes;
+    ring.m_Stats.m_Written += bytes;
+    ring.m_Stats.m_Queued = (CKDWORD)(ring.m_Written - ring.m_Played);
+    if (bytes > 0)
+        ring.m_Starved = FALSE;
+}
+
+void SoundStreamRings::Discard(SoundStreamRing &ring)
+{
+    ring.m_Written = ring.m_Played + (ring.m_Align - ring.m_Played % ring.m_Align) % ring.m_Align;
+    ring.m_Stats.m_Queued = 0;
+    ring.m_Low = FALSE;
+}
@@ -0,0 +1,101 @@
+#ifndef SOUNDSTREAMRING_H
+#define SOUNDSTREAMRING_H
+
+#include "CKAll.h"
+
+#define SOUNDSTREAM_GUARD_MS 10 /* Left ahead of the play cursor when writing resumes after an underrun */
+#define SOUNDSTREAM_LOW_MS   40 /* Time to underrun reported as low, about two frames at 50 Hz */
+
+/**
+ * @brief Counters of a streaming ring
+ */
+struct SoundStreamStats
+{
+    int m_Underruns;        /* Times the play cursor overtook the data written */
+    CKDWORD m_Queued;       /* Bytes written ahead of the play cursor */
+    CKDWORD m_MinQueued;    /* Lowest m_Queued seen once data was written */
+    LONGLONG m_Written;     /* Bytes committed since the ring was opened */
+    int m_LowWarnings;      /* Times the time to underrun fell below SOUNDSTREAM_LOW_MS */
+};
+
+/**
+ * @brief Write side of a streamed buffer
+ *
+ * Positions are counted in bytes since the start of the buffer without
+ * wrapping; the offset in the buffer is the position modulo its size.
+ */
+struct SoundStreamRing
+{
+    void *m_Source;
+    CKDWORD m_Size;         /* Of the buffer, whole frames */
+    CKDWORD m_Align;        /* Bytes per frame */
+    CKDWORD m_Guard;        /* SOUNDSTREAM_GUARD_MS, whole frames */
+    CKDWORD m_BytesPerSecond;
+    CKDWORD m_PlayCursor;   /* As of the last Advance */
+    LONGLONG m_Played;
+    LONGLONG m_Written;
+    CKBOOL m_Starved;       /* Underrun not yet followed by a write */
+    CKBOOL m_Low;           /* Below SOUNDSTREAM_LOW_MS, until back above twice that */
+    CKDWORD m_Pending;      /* Bytes locked by the write in progress, 0 if none */
+    void *m_Region[2];      /* Of the write in progress */
+    CKDWORD m_RegionBytes[2];
+    SoundStreamStats m_Stats;
+    int m_ReportedUnderruns;    /* m_Stats counts already shown on the console */
+    int m_ReportedLowWarnings;
+};
+
+/**
+ * @brief Streaming rings of the sources fed by a producer
+ *
+ * The ring follows the play cursor so the producer is only handed the
+ * bytes it may overwrite, which it fills in place. When the play cursor
+ * overtakes the data, the underrun is counted once and writing resumes
+ * the guard ahead of the cursor. Rings are few: lookups are linear and
+ * removal swaps the last ring into the freed slot, like
+ * SoundInstanceLimiter. This class only does the bookkeeping; the
+ * manager locks the buffers.
+ */
+class SoundStreamRings
+{
+public:
+    SoundStreamRings();
+
+    // Starts writing at the play cursor. Size and guard are rounded down
+    // to whole frames.
+    SoundStreamRing *Open(void *source, CKDWORD size, CKDWORD align, CKDWORD bytesPerSecond,
+                          CKDWORD guard, CKDWORD playCursor);
+    // Returns TRUE if the source had a ring
+    CKBOOL Close(void *source);
+    SoundStreamRing *Find(void *source);
+    int GetCount() const { return m_Rings.Size(); }
+    SoundStreamRing &GetAt(int index) { return m_Rings[index]; }
+    void Clear() { m_Rings.Clear(); }
+
+    // Follows the play cursor; returns TRUE on a new underrun
+    CKBOOL Advance(SoundStreamRing &ring, CKDWORD playCursor);
+    // Returns TRUE when the data queued falls below SOUNDSTREAM_LOW_MS,
+    // once until it rises back above twice that or runs out
+    CKBOOL CheckLow(SoundStreamRing &ring);
+    // Milliseconds the queued data lasts at the play cursor
+    static float GetTimeToUnderrun(const SoundStreamRing &ring);
+    // Bytes the producer may write now, whole frames
+    static CKDWORD GetWritable(const SoundStreamRing &ring);
+    static CKDWORD GetWriteOffset(const SoundStreamRing &ring) { return (CKDWORD)(ring.m_Written % ring.m_Size); }
+    static void Commit(SoundStreamRing &ring, CKDWORD bytes);
+    // Forgets the bytes queued when the buffer lost its content; writing
+    // resumes at the play cursor
+    static void Discard(SoundStreamRing &ring);
+
+    // Underruns of every ring, closed ones included
+    int GetUnderrunCount() const { return m_Underruns; }
+
+private:
+    XArray<SoundStreamRing> m_Rings;
+    int m_Underruns;
+
+    // Prevent copying (VC6 style - declare but don't implement)
+    SoundStreamRings(const SoundStreamRings &);
+    SoundStreamRings &operator=(const SoundStreamRings &);
+};
+
+#endif /* SOUNDSTREAMRING_H */
@@ -0,0 +1,391 @@
+/*
+ * SoundBankPacker - builds a sound bank from WAV files
+ *
+ * Usage: SoundBankPacker <bank> [-rate <hz>] [-channels <n>] [-float] <wav>...
+ *
+ * Every sample is converted once here to the output format of the game:
+ * resampled to -rate (44100 by default), remixed to -channels (0, the
+ * default, keeps the channels of each file; 3D sounds must stay mono) and
+ * stored as 16-bit PCM, or 32-bit float with -float. Samples are named
+ * after their file, without directory nor extension, and looked up by
+ * that name with DXSoundManager::CreateBankSource. The layout is described
+ * in SoundBank.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "CKAll.h"
+#include "SoundBank.h"
+
+#define WAVE_FORMAT_FLOAT_TAG      3      /* WAVE_FORMAT_IEEE_FLOAT */
+#define WAVE_FORMAT_EXTENSIBLE_TAG 0xFFFE /* WAVE_FORMAT_EXTENSIBLE */
+
+struct PackedSample
+{
+    SoundBankEntry m_Entry;
+    BYTE *m_Data;
+};
+
+static int CompareSamples(const void *a, const void *b)
+{
+    return strcmp(((const PackedSample *)a)->m_Entry.m_Name, ((const PackedSample *)b)->m_Entry.m_Name);
+}
+
+static CKDWORD ReadLE(const BYTE *p, int bytes)
+{
+    CKDWORD value = 0;
+    int i;
+
+    for (i = bytes - 1; i >= 0; --i)
+        value = (value << 8) | p[i];
+    return value;
+}
+
+static CKBOOL MakeName(const char *path, char *name)
+{
+    const char *start = path, *end, *p;
+
+    for (p = path; *p; ++p)
+    {
+        if (*p == '/' || *p == '\\' || *p == ':')
+            start = p + 1;
+    }
+    end = strrchr(start, '.');
+    if (!end)
+        end = start + strlen(start);
+    if (end == start || end - start >= SOUNDBANK_NAME_SIZE)
+        return FALSE;
+
+    memset(name, 0, SOUNDBANK_NAME_SIZE);
+    memcpy(name, start, end - start);
+    return TRUE;
+}
+
+// Reads a WAV file as interleaved float frames
+static float *ReadWave(const char *path, int *channels, int *rate, int *frames)
+{
+    FILE *file;
+    BYTE *data = NULL, *fmt = NULL, *pcm = NULL;
+    CKDWORD chunkSize, pcmSize = 0, tag;
+    long size;
+    float *samples;
+    int bits, align, count, i;
+    const BYTE *p;
+
+    file = fopen(path, "rb");
+    if (!file)
+        return NULL;
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (size >= 12)
+        data = (BYTE *)malloc(size);
+    if (!data || fread(data, 1, size, file) != (size_t)size ||
+        memcmp(data, "RIFF", 4) != 0 || memcmp(data + 8, "WAVE", 4) != 0)
+    {
+        fclose(file);
+        free(data);
+        return NULL;
+    }
+    fclose(file);
+
+    for (p = data + 12; p + 8 <= data + size; p += 8 + chunkSize + (chunkSize & 1))
+    {
+        chunkSize = ReadLE(p + 4, 4);
+        if (chunkSize > (CKDWORD)(data + size - p - 8))
+            break;
+        if (!memcmp(p, "fmt ", 4) && chunkSize >= 16)
+            fmt = (BYTE *)p + 8;
+        else if (!memcmp(p, "data", 4))
+        {
+            pcm = (BYTE *)p + 8;
+            pcmSize = chunkSize;
+        }
+    }
+    if (!fmt || !pcm)
+    {
+        free(data);
+        return NULL;
+    }
+
+    tag = ReadLE(fmt, 2);
+    *channels = (int)ReadLE(fmt + 2, 2);
+    *rate = (int)ReadLE(fmt + 4, 4);
+    align = (int)ReadLE(fmt + 12, 2);
+    bits = (int)ReadLE(fmt + 14, 2);
+    /* The sub-format of WAVE_FORMAT_EXTENSIBLE starts with the format tag */
+    if (tag == WAVE_FORMAT_EXTENSIBLE_TAG && ReadLE(fmt + 16, 2) >= 22)
+        tag = ReadLE(fmt + 24, 2);
+    if ((tag != WAVE_FORMAT_PCM && tag != WAVE_FORMAT_FLOAT_TAG) || *channels <= 0 || *rate <= 0 ||
+        align != *channels * (bits / 8) || (tag == WAVE_FORMAT_FLOAT_TAG && bits != 32) ||
+        (tag == WAVE_FORMAT_PCM && (bits < 8 || bits > 32 || bits % 8 != 0)))
+    {
+        free(data);
+        return NULL;
+    }
+
+    *frames = (int)(pcmSize / align);
+    count = *frames * *channels;
+    samples = (float *)malloc((count ? count : 1) * sizeof(float));
+    for (i = 0; samples && i < count; ++i)
+    {
+        p = pcm + i * (bits / 8);
+        if (tag == WAVE_FORMAT_FLOAT_TAG)
+            memcpy(&samples[i], p, sizeof(float));
+        else if (bits == 8)
+            samples[i] = ((int)p[0] - 128) / 128.0f;
+        else
+            /* Sign-extend from the top byte, then scale to [-1, 1) */
+            samples[i] = (float)((int)(ReadLE(p, bits / 8) << (32 - bits)) / 2147483648.0);
+    }
+
+    free(data);
+    return samples;
+}
+
+// Remixes and resamples (linear interpolation) interleaved float frames
+static float *ConvertWave(const float *in, int channels, int rate, int frames,
+                          int outChannels, int outRate, int *outFrames)
+{
+    float *mixed, *out;
+    double position, step;
+    int i, c, k, i0, i1;
+    float t, sum;
+
+    mixed = (float *)malloc((frames ? frames : 1) * outChannels * sizeof(float));
+    if (!mixed)
+        return NULL;
+    for (i = 0; i < frames; ++i)
+    {
+        for (c = 0; c < outChannels; ++c)
+        {
+            if (outChannels == channels)
+                mixed[i * outChannels + c] = in[i * channels + c];
+            else if (outChannels == 1)
+            {
+                for (sum = 0.0f, k = 0; k < channels; ++k)
+                    sum += in[i * channels + k];
+                mixed[i * outChannels] = sum / channels;
+            }
+            else if (channels == 1)
+                mixed[i * outChannels + c] = in[i * channels];
+            else
+                mixed[i * outChannels + c] = (c < channels) ? in[i * channels + c] : 0.0f;
+        }
+    }
+
+    if (outRate == rate)
+    {
+        *outFrames = frames;
+        return mixed;
+    }
+
+    *outFrames = (int)((double)frames * outRate / rate);
+    out = (float *)malloc((*outFrames ? *outFrames : 1) * outChannels * sizeof(float));
+    if (!out)
+    {
+        free(mixed);
+        return NULL;
+    }
+    step = (double)rate / outRate;
+    for (i = 0, position = 0.0; i < *outFrames; ++i, position += step)
+    {
+        i0 = (int)position;
+        i1 = (i0 + 1 < frames) ? i0 + 1 : i0;
+        t = (float)(position - i0);
+        for (c = 0; c < outChannels; ++c)
+            out[i * outChannels + c] = mixed[i0 * outChannels + c] +
+                                       (mixed[i1 * outChannels + c] - mixed[i0 * outChannels + c]) * t;
+    }
+    free(mixed);
+    return out;
+}
+
+static CKBOOL PackSample(const char *path, int outRate, int outChannels, CKBOOL useFloat, PackedSample &sample)
+{
+    float *samples, *converted;
+    int channels, rate, frames, outFrames, count, i;
+    float s;
+    short *pcm;
+
+    memset(&sample, 0, sizeof(PackedSample));
+    if (!MakeName(path, sample.m_Entry.m_Name))
+    {
+        printf("%s: the name must have 1 to %d characters\n", path, SOUNDBANK_NAME_SIZE - 1);
+        return FALSE;
+    }
+
+    samples = ReadWave(path, &channels, &rate, &frames);
+    if (!samples)
+    {
+        printf("%s: not a PCM or float WAV file\n", path);
+        return FALSE;
+    }
+    if (frames == 0)
+    {
+        printf("%s: no sample data\n", path);
+        free(samples);
+        return FALSE;
+    }
+
+    if (outChannels == 0)
+        outChannels = channels;
+    converted = ConvertWave(samples, channels, rate, frames, outChannels, outRate, &outFrames);
+    free(samples);
+    if (!converted || outFrames == 0)
+    {
+        free(converted);
+        printf("%s: cannot convert\n", path);
+        return FALSE;
+    }
+
+    count = outFrames * outChannels;
+    sample.m_Entry.m_Channels = (CKWORD)outChannels;
+    sample.m_Entry.m_SampleRate = (CKDWORD)outRate;
+    if (useFloat)
+    {
+        sample.m_Entry.m_FormatTag = WAVE_FORMAT_FLOAT_TAG;
+        sample.m_Entry.m_BitsPerSample = 32;
+        sample.m_Data = (BYTE *)converted;
+    }
+    else
+    {
+        sample.m_Entry.m_FormatTag = WAVE_FORMAT_PCM;
+        sample.m_Entry.m_BitsPerSample = 16;
+        pcm = (short *)malloc(count * sizeof(short));
+        for (i = 0; pcm && i < count; ++i)
+        {
+            s = converted[i] * 32768.0f;
+            pcm[i] = (short)((s > 32767.0f) ? 32767 : (s < -32768.0f) ? -32768 : (int)(s + (s < 0.0f ? -0.5f : 0.5f)));
+        }
+        free(converted);
+        sample.m_Data = (BYTE *)pcm;
+    }
+    sample.m_Entry.m_BlockAlign = (CKWORD)(outChannels * sample.m_Entry.m_BitsPerSample / 8);
+    sample.m_Entry.m_Size = (CKDWORD)outFrames * sample.m_Entry.m_BlockAlign;
+    return sample.m_Data != NULL;
+}
+
+static CKDWORD AlignUp(CKDWORD offset)
+{
+    return (offset + SOUNDBANK_ALIGN - 1) & ~(CKDWORD)(SOUNDBANK_ALIGN - 1);
+}
+
+static CKBOOL WriteBank(const char *path, PackedSample *samples, int count)
+{
+    static const BYTE padding[SOUNDBANK_ALIGN] = {0};
+    SoundBankHeader header;
+    CKDWORD offset;
+    FILE *file;
+    CKBOOL ok;
+    int i;
+
+    memset(&header, 0, sizeof(SoundBankHeader));
+    header.m_Magic = SOUNDBANK_MAGIC;
+    header.m_Version = SOUNDBANK_VERSION;
+    header.m_Count = (CKDWORD)count;
+    header.m_IndexOffset = AlignUp(sizeof(SoundBankHeader));
+
+    offset = AlignUp(header.m_IndexOffset + count * sizeof(SoundBankEntry));
+    for (i = 0; i < count; ++i)
+    {
+        samples[i].m_Entry.m_Offset = offset;
+        offset = AlignUp(offset + samples[i].m_Entry.m_Size);
+    }
+    header.m_FileSize = offset;
+
+    file = fopen(path, "wb");
+    if (!file)
+        return FALSE;
+
+    ok = fwrite(&header, sizeof(SoundBankHeader), 1, file) == 1;
+    ok = ok && fwrite(padding, header.m_IndexOffset - sizeof(SoundBankHeader), 1, file) <= 1;
+    for (i = 0; ok && i < count; ++i)
+        ok = fwrite(&samples[i].m_Entry, sizeof(SoundBankEntry), 1, file) == 1;
+    for (i = 0; ok && i < count; ++i)
+    {
+        fseek(file, samples[i].m_Entry.m_Offset, SEEK_SET);
+        ok = fwrite(samples[i].m_Data, samples[i].m_Entry.m_Size, 1, file) == 1;
+    }
+    /* Pad the last sample so the file size matches the header */
+    if (ok && AlignUp(ftell(file)) > (CKDWORD)ftell(file))
+        ok = fwrite(padding, AlignUp(ftell(file)) - ftell(file), 1, file) == 1;
+
+    ok = (fclose(file) == 0) && ok;
+    return ok;
+}
+
+static void PrintUsage()
+{
+    printf("Usage: SoundBankPacker <bank> [-rate <hz>] [-channels <n>] [-float] <wav>...\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *bankPath = NULL;
+    PackedSample *samples;
+    int outRate = 44100, outChannels = 0;
+    CKBOOL useFloat = FALSE;
+    CKDWORD total = 0;
+    int count = 0, i, result = 0;
+
+    samples = (PackedSample *)malloc(argc * sizeof(PackedSample));
+    if (!samples)
+        return 1;
+
+    for (i = 1; i < argc && result == 0; ++i)
+    {
+        if (!strcmp(argv[i], "-rate") && i + 1 < argc)
+            outRate = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-channels") && i + 1 < argc)
+            outChannels = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-float"))
+            useFloat = TRUE;
+        else if (argv[i][0] == '-')
+            result = 1;
+        else if (!bankPath)
+            bankPath = argv[i];
+        else if (outRate <= 0 || outChannels < 0 || outChannels > 8 ||
+                 !PackSample(argv[i], outRate, outChannels, useFloat, samples[count]))
+            result = 1;
+        else
+            total += samples[count++].m_Entry.m_Size;
+    }
+
+    if (result == 0 && (!bankPath || count == 0))
+    {
+        PrintUsage();
+        result = 1;
+    }
+
+    if (result == 0)
+    {
+        qsort(samples, count, sizeof(PackedSample), CompareSamples);
+        for (i = 1; i < count; ++i)
+        {
+            if (!strcmp(samples[i - 1].m_Entry.m_Name, samples[i].m_Entry.m_Name))
+            {
+                printf("Two samples are named %s\n", samples[i].m_Entry.m_Name);
+                result = 1;
+            }
+        }
+    }
+
+    if (result == 0)
+    {
+        if (WriteBank(bankPath, samples, count))
+            printf("%s: %d samples, %lu KB of sample data\n", bankPath, count, (unsigned long)(total / 1024));
+        else
+        {
+            printf("Cannot write %s\n", bankPath);
+            result = 1;
+        }
+    }
+
+    for (i = 0; i < count; ++i)
+        free(samples[i].m_Data);
+    free(samples);
+    return result;
+}
@@ -0,0 +1,687 @@
+/*
+ * SoundBench - times the building blocks of the sound managers
+ *
+ * Usage: SoundBench [benchmark...]
+ *
+ * Runs the named benchmarks, or all of them without arguments:
+ *   activeset    play/stop churn of the playing sound set
+ *   convolver    partitioned convolution with 0.5 to 4 second responses
+ *   biquad       equalizer cascades over four-channel mix blocks
+ *   jobpool      emitter transforms spread over 1 to 16 threads
+ *   attenuation  batched distance and cone gains against the exact model
+ *
+ * Inputs come from a fixed-seed generator, so two runs on one machine
+ * time the same work. Times are wall clock from the performance counter,
+ * averaged over enough repetitions to last a fraction of a second. The
+ * DSP benchmarks time whichever path the build selected: configure with
+ * DX8SOUND_ENABLE_SIMD off to time the scalar fallbacks.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "CKAll.h"
+#include "ActiveSoundSet.h"
+#include "SoundAttenuation.h"
+#include "SoundBiquad.h"
+#include "SoundConvolver.h"
+#include "SoundJobPool.h"
+#include "SoundSimd.h"
+
+static LONGLONG ReadCounter()
+{
+    LARGE_INTEGER value;
+    ::QueryPerformanceCounter(&value);
+    return value.QuadPart;
+}
+
+static double GetMicroseconds(LONGLONG ticks)
+{
+    LARGE_INTEGER frequency;
+    ::QueryPerformanceFrequency(&frequency);
+    return (double)ticks * 1000000.0 / (double)frequency.QuadPart;
+}
+
+// Park-Miller generator: rand() differs between runtimes
+static CKDWORD g_Seed = 1;
+
+static void SeedRandom(CKDWORD seed)
+{
+    g_Seed = seed ? seed : 1;
+}
+
+static int Random(int range)
+{
+    g_Seed = (CKDWORD)(((unsigned long long)g_Seed * 48271ULL) % 2147483647ULL);
+    return (int)(g_Seed % (CKDWORD)range);
+}
+
+// Uniform in [-1, 1)
+static float RandomSample()
+{
+    return (float)Random(65536) / 32768.0f - 1.0f;
+}
+
+// Uniform in [low, high]
+static float RandomRange(float low, float high)
+{
+    return low + (high - low) * (float)Random(65537) / 65536.0f;
+}
+
+//-----------------------------------------------------------------------------
+// Playing sound set
+//-----------------------------------------------------------------------------
+
+// What m_SoundsPlaying did as an XObjectArray: a scan per Add and Remove
+class LinearSoundSet
+{
+public:
+    void Add(CK_ID id)
+    {
+        if (Find(id) < 0)
+            m_Ids.PushBack(id);
+    }
+    void Remove(CK_ID id)
+    {
+        int index = Find(id);
+        if (index >= 0)
+            m_Ids.RemoveAt(index);
+    }
+    CKBOOL Contains(CK_ID id) const { return Find(id) >= 0; }
+    int Size() const { return m_Ids.Size(); }
+    void Clear() { m_Ids.Clear(); }
+
+private:
+    int Find(CK_ID id) const
+    {
+        int i;
+        for (i = 0; i < m_Ids.Size(); ++i)
+        {
+            if (m_Ids[i] == id)
+                return i;
+        }
+        return -1;
+    }
+
+    XArray<CK_ID> m_Ids;
+};
+
+// One frame of churn: a tenth of the playing sounds stop and as many new
+// ones start, each looked up first as Play does before registering it
+template <class Set>
+static double RunChurn(Set &set, int active, int frames)
+{
+    XArray<CK_ID> playing;
+    CK_ID next;
+    LONGLONG start;
+    int burst, frame, i, slot;
+    CKDWORD check = 0;
+
+    set.Clear();
+    playing.Resize(active);
+    for (i = 0; i < active; ++i)
+    {
+        playing[i] = (CK_ID)(i + 1);
+        set.Add(playing[i]);
+    }
+    next = (CK_ID)(active + 1);
+
+    SeedRandom(26);
+    burst = active / 10;
+    start = ReadCounter();
+    for (frame = 0; frame < frames; ++frame)
+    {
+        for (i = 0; i < burst; ++i)
+        {
+            slot = Random(active);
+            set.Remove(playing[slot]);
+            check += set.Contains(next);
+            set.Add(next);
+            playing[slot] = next++;
+        }
+    }
+    start = ReadCounter() - start;
+
+    if (check != 0 || set.Size() != active)
+        printf("churn left the set inconsistent\n");
+    return GetMicroseconds(start) / frames;
+}
+
+static void BenchActiveSet()
+{
+    static const int counts[] = {100, 500, 2000, 10000};
+    ActiveSoundSet hashed;
+    LinearSoundSet linear;
+    double hashedTime, linearTime;
+    int frames, i;
+
+    printf("activeset: a tenth of the playing sounds stop and start each frame\n");
+    printf("  sounds   array scan   ActiveSoundSet   (us/frame)\n");
+    for (i = 0; i < (int)(sizeof(counts) / sizeof(counts[0])); ++i)
+    {
+        frames = 20000000 / (counts[i] * counts[i] / 10 + counts[i]);
+        if (frames < 10)
+            frames = 10;
+        linearTime = RunChurn(linear, counts[i], frames);
+        hashedTime = RunChurn(hashed, counts[i], frames * 20);
+        printf("  %6d   %10.1f   %14.2f   (%.0fx)\n", counts[i], linearTime, hashedTime, linearTime / hashedTime);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Convolution bus
+//-----------------------------------------------------------------------------
+
+#define BENCH_MIX_RATE 48000
+#define BENCH_MIX_BLOCK 256
+
+// Largest difference from a direct convolution, output delayed by a partition
+static double CheckConvolver()
+{
+    const int irFrames = 1500;
+    const int frames = 6000;
+    const int blockFrames = 137; /* Not a divisor of the partition */
+    SoundConvolver convolver;
+    float *ir = new float[irFrames * 2];
+    float *input = new float[frames * 2];
+    float *output = new float[frames * 2];
+    double sum, error = 0.0;
+    int i, k, ch, offset, count, t;
+
+    for (i = 0; i < irFrames * 2; ++i)
+        ir[i] = RandomSample() * expf(-(float)i / 800.0f);
+    for (i = 0; i < frames; ++i)
+        input[i * 2] = input[i * 2 + 1] = sinf((float)i * 0.05f) * (float)((i / 300) % 2);
+
+    convolver.SetImpulseResponse(ir, irFrames, 2);
+    for (offset = 0; offset < frames; offset += count)
+    {
+        count = (frames - offset < blockFrames) ? frames - offset : blockFrames;
+        convolver.Process(input + offset * 2, output + offset * 2, count);
+    }
+
+    for (i = SOUNDCONVOLVER_PARTITION; i < frames; ++i)
+    {
+        t = i - SOUNDCONVOLVER_PARTITION;
+        for (ch = 0; ch < 2; ++ch)
+        {
+            sum = 0.0;
+            for (k = 0; k < irFrames && k <= t; ++k)
+                sum += input[(t - k) * 2] * ir[k * 2 + ch];
+            if (fabs(sum - output[i * 2 + ch]) > error)
+                error = fabs(sum - output[i * 2 + ch]);
+        }
+    }
+
+    delete[] ir;
+    delete[] input;
+    delete[] output;
+    return error;
+}
+
+static void BenchConvolver()
+{
+    static const float lengths[] = {0.5f, 1.0f, 2.0f, 4.0f};
+    const int repeats = 5;
+    float *ir, *input, *output;
+    LONGLONG start, prepare, process;
+    int frames, i, j, offset, count;
+
+    printf("convolver: stereo response at %d Hz, %d-frame mix blocks\n", BENCH_MIX_RATE, BENCH_MIX_BLOCK);
+    printf("  largest difference from direct convolution: %.1e\n", CheckConvolver());
+    printf("  response   partitions   prepare (ms)   CPU per second of audio (ms)\n");
+
+    input = new float[BENCH_MIX_RATE * 2];
+    output = new float[BENCH_MIX_RATE * 2];
+    for (i = 0; i < BENCH_MIX_RATE * 2; ++i)
+        input[i] = RandomSample() * 0.5f;
+
+    for (i = 0; i < (int)(sizeof(lengths) / sizeof(lengths[0])); ++i)
+    {
+        SoundConvolver convolver;
+
+        frames = (int)(BENCH_MIX_RATE * lengths[i]);
+        ir = new float[frames * 2];
+        for (j = 0; j < frames * 2; ++j)
+            ir[j] = RandomSample() * expf(-(float)j / (float)frames);
+
+        start = ReadCounter();
+        convolver.SetImpulseResponse(ir, frames, 2);
+        prepare = ReadCounter() - start;
+
+        start = ReadCounter();
+        for (j = 0; j < repeats; ++j)
+        {
+            for (offset = 0; offset < BENCH_MIX_RATE; offset += count)
+            {
+                count = (BENCH_MIX_RATE - offset < BENCH_MIX_BLOCK) ? BENCH_MIX_RATE - offset : BENCH_MIX_BLOCK;
+                convolver.Process(input + offset * 2, output + offset * 2, count);
+            }
+        }
+        process = ReadCounter() - start;
+
+        printf("  %6.1f s   %10d   %12.1f   %28.1f\n", lengths[i], convolver.GetPartitionCount(),
+               GetMicroseconds(prepare) / 1000.0, GetMicroseconds(process) / 1000.0 / repeats);
+        delete[] ir;
+    }
+
+    delete[] input;
+    delete[] output;
+}
+
+//-----------------------------------------------------------------------------
+// Equalizer
+//-----------------------------------------------------------------------------
+
+// Steady-state gain in dB of a prepared equalizer at a frequency
+static double GetEqualizerGain(SoundEqualizer &eq, double frequency)
+{
+    SoundBiquadLane lanes[SOUNDBIQUAD_LANES];
+    float *data = new float[BENCH_MIX_RATE * SOUNDBIQUAD_LANES];
+    double peak = 0.0;
+    int i;
+
+    memset(lanes, 0, sizeof(lanes));
+    memset(eq.m_State, 0, sizeof(eq.m_State));
+    lanes[0].m_Stages = eq.m_Stages;
+    lanes[0].m_State = eq.m_State[0][0];
+
+    memset(data, 0, BENCH_MIX_RATE * SOUNDBIQUAD_LANES * sizeof(float));
+    for (i = 0; i < BENCH_MIX_RATE; ++i)
+        data[i * SOUNDBIQUAD_LANES] = (float)sin(2.0 * 3.14159265358979 * frequency * i / BENCH_MIX_RATE);
+    SoundBiquadProcess(data, BENCH_MIX_RATE, lanes);
+
+    // The second half is past the transient
+    for (i = BENCH_MIX_RATE / 2; i < BENCH_MIX_RATE; ++i)
+    {
+        if (fabs(data[i * SOUNDBIQUAD_LANES]) > peak)
+            peak = fabs(data[i * SOUNDBIQUAD_LANES]);
+    }
+
+    delete[] data;
+    return 20.0 * log10(peak);
+}
+
+static void BenchBiquad()
+{
+    static float source[BENCH_MIX_BLOCK * SOUNDBIQUAD_LANES];
+    static float block[BENCH_MIX_BLOCK * SOUNDBIQUAD_LANES];
+    const int repeats = 200000;
+    SoundEqualizer eq[2];
+    SoundBiquadLane lanes[SOUNDBIQUAD_LANES];
+    LONGLONG start;
+    double ms;
+    int i, k;
+
+    printf("biquad: low and high shelf cascade, %d-frame blocks of %d channels\n", BENCH_MIX_BLOCK, SOUNDBIQUAD_LANES);
+    printf("  setting   100 Hz   1 kHz   10 kHz   (dB)\n");
+    for (i = 0; i <= 4; ++i)
+    {
+        SoundEqualizerInit(eq[0]);
+        SoundEqualizerSet(eq[0], (float)i * 0.25f);
+        SoundEqualizerPrepare(eq[0], BENCH_MIX_RATE);
+        printf("  %7.2f   %6.1f   %5.1f   %6.1f%s\n", (float)i * 0.25f, GetEqualizerGain(eq[0], 100.0),
+               GetEqualizerGain(eq[0], 1000.0), GetEqualizerGain(eq[0], 10000.0), eq[0].m_Flat ? "   (skipped)" : "");
+    }
+
+    // Two stereo voices of different settings, as the mixer pairs them
+    for (k = 0; k < 2; ++k)
+    {
+        SoundEqualizerInit(eq[k]);
+        SoundEqualizerSet(eq[k], 0.2f + 0.5f * k);
+        SoundEqualizerPrepare(eq[k], BENCH_MIX_RATE);
+    }
+    for (i = 0; i < SOUNDBIQUAD_LANES; ++i)
+    {
+        lanes[i].m_Stages = eq[i / 2].m_Stages;
+        lanes[i].m_State = eq[i / 2].m_State[i % 2][0];
+    }
+    for (i = 0; i < BENCH_MIX_BLOCK * SOUNDBIQUAD_LANES; ++i)
+        source[i] = RandomSample() * 0.5f;
+
+    // Each block starts from the same input, copied as the mixer renders it
+    start = ReadCounter();
+    for (k = 0; k < repeats; ++k)
+    {
+        memcpy(block, source, sizeof(block));
+        SoundBiquadProcess(block, BENCH_MIX_BLOCK, lanes);
+    }
+    ms = GetMicroseconds(ReadCounter() - start) / 1000.0;
+
+    printf("  %.0f channel cascades of %d frames per ms (%.0f biquad sections)\n",
+           repeats * (double)SOUNDBIQUAD_LANES / ms, BENCH_MIX_BLOCK,
+           repeats * (double)SOUNDBIQUAD_LANES * SOUNDBIQUAD_STAGES / ms);
+}
+
+//-----------------------------------------------------------------------------
+// Job pool
+//-----------------------------------------------------------------------------
+
+// The fields DXSoundManager::ComputeEmitterRange reads and writes
+struct BenchEmitter
+{
+    VxVector m_Offset;
+    VxVector m_Aim;
+    VxVector m_OldPosition;
+};
+
+struct BenchEmitterJob
+{
+    BenchEmitter *m_Emitter;
+    VxMatrix m_World;
+    VxVector m_Position;
+    VxVector m_Velocity;
+    VxVector m_Direction;
+};
+
+// Same math as ComputeEmitterRange, over the same chunks
+static void ComputeBenchEmitters(void *context, int begin, int end)
+{
+    BenchEmitterJob *jobs = (BenchEmitterJob *)context;
+    BenchEmitterJob *job;
+    int i;
+
+    for (i = begin; i < end; ++i)
+    {
+        job = &jobs[i];
+        Vx3DMultiplyMatrixVector(&job->m_Position, job->m_World, &job->m_Emitter->m_Offset);
+        Vx3DRotateVector(&job->m_Direction, job->m_World, &job->m_Emitter->m_Aim);
+        job->m_Velocity = job->m_Position - job->m_Emitter->m_OldPosition;
+        job->m_Emitter->m_OldPosition = job->m_Position;
+    }
+}
+
+// FNV-1a over the job outputs
+static CKDWORD HashEmitterJobs(const BenchEmitterJob *jobs, int count)
+{
+    const CKBYTE *bytes;
+    CKDWORD hash = 2166136261U;
+    int i, b;
+
+    for (i = 0; i < count; ++i)
+    {
+        bytes = (const CKBYTE *)&jobs[i].m_Position;
+        for (b = 0; b < (int)(3 * sizeof(VxVector)); ++b)
+        {
+            hash ^= bytes[b];
+            hash *= 16777619U;
+        }
+    }
+    return hash;
+}
+
+static void BenchJobPool()
+{
+    static const int counts[] = {1000, 5000, 10000, 20000};
+    static const int threads[] = {1, 2, 4, 8, 16};
+    BenchEmitter *emitters;
+    BenchEmitterJob *jobs;
+    SYSTEM_INFO info;
+    LONGLONG start;
+    CKDWORD hash, serialHash = 0;
+    CKBOOL deterministic = TRUE;
+    int c, t, i, frame, frames;
+
+    ::GetSystemInfo(&info);
+    printf("jobpool: emitter transforms in chunks of %d, processors: %lu\n", SOUNDJOB_DEFAULT_CHUNK, (unsigned long)info.dwNumberOfProcessors);
+    printf("  voices");
+    for (t = 0; t < (int)(sizeof(threads) / sizeof(threads[0])); ++t)
+        printf("   %2d thr", threads[t]);
+    printf("   (us/frame)\n");
+
+    for (c = 0; c < (int)(sizeof(counts) / sizeof(counts[0])); ++c)
+    {
+        emitters = new BenchEmitter[counts[c]];
+        jobs = new BenchEmitterJob[counts[c]];
+        frames = 2000000 / counts[c];
+
+        printf("  %6d", counts[c]);
+        for (t = 0; t < (int)(sizeof(threads) / sizeof(threads[0])); ++t)
+        {
+            SoundJobPool pool;
+            pool.Start(threads[t] - 1);
+
+            for (i = 0; i < counts[c]; ++i)
+            {
+                emitters[i].m_Offset = VxVector(i * 0.1f, 1.0f, 2.0f);
+                emitters[i].m_Aim = VxVector(0.0f, 0.0f, 1.0f);
+                emitters[i].m_OldPosition = VxVector(0.0f, 0.0f, 0.0f);
+                jobs[i].m_Emitter = &emitters[i];
+                jobs[i].m_World.SetIdentity();
+                jobs[i].m_World[3][0] = i * 0.01f;
+                jobs[i].m_World[3][1] = 3.0f;
+                jobs[i].m_World[3][2] = -i * 0.5f;
+            }
+
+            start = ReadCounter();
+            for (frame = 0; frame < frames; ++frame)
+            {
+                // Some entities move between frames
+                for (i = 0; i < counts[c]; i += 97)
+                    jobs[i].m_World[3][0] += 0.001f;
+                pool.ParallelFor(ComputeBenchEmitters, jobs, counts[c], SOUNDJOB_DEFAULT_CHUNK);
+            }
+            start = ReadCounter() - start;
+            pool.Stop();
+
+            hash = HashEmitterJobs(jobs, counts[c]);
+            if (t == 0)
+                serialHash = hash;
+            else if (hash != serialHash)
+                deterministic = FALSE;
+            printf("   %6.1f", GetMicroseconds(start) / frames);
+        }
+        printf("\n");
+
+        delete[] emitters;
+        delete[] jobs;
+    }
+
+    printf("  output %s with every thread count\n", deterministic ? "identical" : "DIFFERS");
+    // Past the processor count, threads can only add overhead
+    if (info.dwNumberOfProcessors < 16)
+        printf("  columns with more threads than processors measure overhead, not scaling\n");
+}
+
+//-----------------------------------------------------------------------------
+// Attenuation
+//-----------------------------------------------------------------------------
+
+struct BenchVoice
+{
+    VxVector m_Relative;
+    VxVector m_Cone;
+    float m_MinDistance;
+    float m_MaxDistance;
+    float m_InsideAngle;
+    float m_OutsideAngle;
+    float m_OutsideGain;
+};
+
+// The DirectSound model with an exact arc cosine, one voice at a time
+static float GetExactGain(const BenchVoice &v, float rollOff)
+{
+    float distance, clamped, gain, length, cosine, angle;
+    float cone = 1.0f;
+
+    distance = sqrtf(v.m_Relative.x * v.m_Relative.x + v.m_Relative.y * v.m_Relative.y + v.m_Relative.z * v.m_Relative.z);
+    clamped = (distance > v.m_MaxDistance) ? v.m_MaxDistance : distance;
+    gain = 1.0f;
+    if (clamped > v.m_MinDistance && v.m_MinDistance > 0.0f)
+        gain = v.m_MinDistance / (v.m_MinDistance + rollOff * (clamped - v.m_MinDistance));
+
+    length = sqrtf(v.m_Cone.x * v.m_Cone.x + v.m_Cone.y * v.m_Cone.y + v.m_Cone.z * v.m_Cone.z);
+    if (v.m_OutsideAngle < 360.0f && length > 0.0f && distance > 0.0f)
+    {
+        cosine = -(v.m_Relative.x * v.m_Cone.x + v.m_Relative.y * v.m_Cone.y + v.m_Relative.z * v.m_Cone.z) / (length * distance);
+        if (cosine > 1.0f)
+            cosine = 1.0f;
+        if (cosine < -1.0f)
+            cosine = -1.0f;
+
+        angle = 2.0f * acosf(cosine) * 57.29578f;
+        if (angle >= v.m_OutsideAngle)
+            cone = v.m_OutsideGain;
+        else if (angle > v.m_InsideAngle && v.m_OutsideAngle > v.m_InsideAngle)
+            cone = 1.0f + (v.m_OutsideGain - 1.0f) * (angle - v.m_InsideAngle) / (v.m_OutsideAngle - v.m_InsideAngle);
+    }
+    return gain * cone;
+}
+
+static void FillAttenuationBatch(SoundAttenuationBatch &batch, const BenchVoice *voices, int count)
+{
+    int i;
+
+    batch.Resize(count);
+    for (i = 0; i < count; ++i)
+    {
+        batch.SetVoice(i, voices[i].m_Relative, voices[i].m_Cone, voices[i].m_MinDistance, voices[i].m_MaxDistance,
+                       voices[i].m_InsideAngle, voices[i].m_OutsideAngle, voices[i].m_OutsideGain);
+    }
+}
+
+static void BenchAttenuation()
+{
+    static const float rollOffs[] = {0.5f, 1.0f, 3.0f};
+    static const int counts[] = {256, 1024, 4096, 20000};
+    const int voiceCount = 20000;
+    SoundAttenuationBatch batch;
+    BenchVoice *voices = new BenchVoice[voiceCount];
+    LONGLONG start;
+    double error, exactTime, batchTime, gatherTime;
+    double checksum = 0.0; /* Printed, so no pass can be optimized away */
+    float sum;
+    int i, k, repeat, repeats;
+
+    // Random voices, with the corner cases every few
+    SeedRandom(43);
+    for (i = 0; i < voiceCount; ++i)
+    {
+        BenchVoice &v = voices[i];
+        v.m_Relative = VxVector(RandomRange(-200.0f, 200.0f), RandomRange(-20.0f, 20.0f), RandomRange(-200.0f, 200.0f));
+        if (i % 50 == 0)
+            v.m_Relative = VxVector(0.0f, 0.0f, 0.0f);
+        v.m_Cone = VxVector(RandomSample(), RandomSample(), RandomSample());
+        if (i % 37 == 0)
+            v.m_Cone = VxVector(0.0f, 0.0f, 0.0f);
+        v.m_MinDistance = (i % 41 == 0) ? 0.0f : RandomRange(0.0f, 10.0f);
+        v.m_MaxDistance = RandomRange(v.m_MinDistance, 300.0f);
+        v.m_InsideAngle = RandomRange(0.0f, 180.0f);
+        v.m_OutsideAngle = (i % 5 == 0) ? 360.0f : RandomRange(v.m_InsideAngle, 360.0f);
+        v.m_OutsideGain = RandomRange(0.0f, 1.0f);
+    }
+
+    printf("attenuation: distance rolloff times cone gain\n");
+    for (k = 0; k < (int)(sizeof(rollOffs) / sizeof(rollOffs[0])); ++k)
+    {
+        FillAttenuationBatch(batch, voices, voiceCount);
+        batch.Compute(rollOffs[k]);
+
+        error = 0.0;
+        for (i = 0; i < voiceCount; ++i)
+        {
+            if (fabs(batch.GetGain(i) - GetExactGain(voices[i], rollOffs[k])) > error)
+                error = fabs(batch.GetGain(i) - GetExactGain(voices[i], rollOffs[k]));
+        }
+        printf("  rolloff %.1f: largest difference from acosf over %d voices %.1e\n", rollOffs[k], voiceCount, error);
+    }
+
+    printf("  voices   per-voice acosf   batch   batch + gather   (us/pass)\n");
+    for (k = 0; k < (int)(sizeof(counts) / sizeof(counts[0])); ++k)
+    {
+        repeats = 4000000 / counts[k];
+
+        start = ReadCounter();
+        for (repeat = 0; repeat < repeats; ++repeat)
+        {
+            sum = 0.0f;
+            for (i = 0; i < counts[k]; ++i)
+                sum += GetExactGain(voices[i], 1.0f);
+            checksum += sum;
+        }
+        exactTime = GetMicroseconds(ReadCounter() - start) / repeats;
+
+        FillAttenuationBatch(batch, voices, counts[k]);
+        start = ReadCounter();
+        for (repeat = 0; repeat < repeats; ++repeat)
+        {
+            batch.Compute(1.0f);
+            checksum += batch.GetGain(0);
+        }
+        batchTime = GetMicroseconds(ReadCounter() - start) / repeats;
+
+        // As the mixer runs it: the voices are gathered every pass
+        start = ReadCounter();
+        for (repeat = 0; repeat < repeats; ++repeat)
+        {
+            FillAttenuationBatch(batch, voices, counts[k]);
+            batch.Compute(1.0f);
+            checksum += batch.GetGain(0);
+        }
+        gatherTime = GetMicroseconds(ReadCounter() - start) / repeats;
+
+        printf("  %6d   %15.1f   %5.1f   %14.1f   (%.1fx)\n", counts[k], exactTime, batchTime, gatherTime, exactTime / batchTime);
+    }
+    printf("  gain checksum %.3f\n", checksum);
+
+    delete[] voices;
+}
+
+//-----------------------------------------------------------------------------
+// Driver
+//-----------------------------------------------------------------------------
+
+struct Benchmark
+{
+    const char *m_Name;
+    void (*m_Run)();
+};
+
+static const Benchmark g_Benchmarks[] = {
+    {"activeset", BenchActiveSet},
+    {"convolver", BenchConvolver},
+    {"biquad", BenchBiquad},
+    {"jobpool", BenchJobPool},
+    {"attenuation", BenchAttenuation},
+};
+
+#define BENCHMARK_COUNT (int)(sizeof(g_Benchmarks) / sizeof(g_Benchmarks[0]))
+
+int main(int argc, char **argv)
+{
+    int i, j;
+
+#ifdef SOUNDSIMD_SSE
+    printf("SoundBench, SSE build\n");
+#else
+    printf("SoundBench, scalar build\n");
+#endif
+
+    if (argc < 2)
+    {
+        for (j = 0; j < BENCHMARK_COUNT; ++j)
+            g_Benchmarks[j].m_Run();
+        return 0;
+    }
+
+    for (i = 1; i < argc; ++i)
+    {
+        for (j = 0; j < BENCHMARK_COUNT; ++j)
+        {
+            if (!strcmp(argv[i], g_Benchmarks[j].m_Name))
+                break;
+        }
+        if (j == BENCHMARK_COUNT)
+        {
+            printf("Unknown benchmark %s, expected one of:", argv[i]);
+            for (j = 0; j < BENCHMARK_COUNT; ++j)
+                printf(" %s", g_Benchmarks[j].m_Name);
+            printf("\n");
+            return 1;
+        }
+        g_Benchmarks[j].m_Run();
+    }
+    return 0;
+}
@@ -0,0 +1,445 @@
+/*
+ * SoundReplay - drives a sound manager from a captured command log
+ *
+ * Usage: SoundReplay <log> [-realtime] [-repeat <n>] [-plugins <dir>] [-offline <wav>]
+ *
+ * The log is produced by running the engine with DX8SOUND_COMMAND_LOG set
+ * to an output path. Commands are replayed through the CKSoundManager
+ * interface, so any backend can be measured: the DirectSound manager by
+ * default, the software mixer when -offline names a WAV file. Sources are
+ * filled with silence and sounds are replaced by placeholder objects, the
+ * manager work itself is what is timed. By default commands are issued as
+ * fast as possible; -realtime keeps the recorded spacing.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "CKAll.h"
+#include "DxSoundManager.h"
+#include "SoundCommandLog.h"
+
+#define REPLAY_MAX_PAYLOAD 1024
+
+static const char *g_OpNames[SOUNDLOG_OPCOUNT] = {
+    "",
+    "CreateSource",
+    "DuplicateSource",
+    "ReleaseSource",
+    "Play",
+    "Pause",
+    "SetPlayPosition",
+    "UpdateSettings",
+    "Update3DSettings",
+    "UpdateListener",
+    "PostProcess",
+    "PlayAt",
+};
+
+struct OpStats
+{
+    CKDWORD m_Count;
+    LONGLONG m_Ticks;
+    LONGLONG m_MaxTicks;
+};
+
+static LONGLONG ReadCounter()
+{
+    LARGE_INTEGER value;
+    ::QueryPerformanceCounter(&value);
+    return value.QuadPart;
+}
+
+class SoundReplayer
+{
+public:
+    SoundReplayer(CKContext *context, CKSoundManager *manager)
+    {
+        LARGE_INTEGER frequency;
+
+        m_Context = context;
+        m_Manager = manager;
+        memset(m_Stats, 0, sizeof(m_Stats));
+        ::QueryPerformanceFrequency(&frequency);
+        m_Frequency = frequency.QuadPart > 0 ? frequency.QuadPart : 1;
+    }
+
+    ~SoundReplayer()
+    {
+        Reset();
+    }
+
+    CKBOOL Run(const char *path, CKBOOL realtime);
+    void Reset();
+    void PrintStats() const;
+
+private:
+    void Execute(const SoundLogRecord &record, BYTE *payload);
+
+    void *GetSource(CKDWORD handle) const
+    {
+        return (handle < (CKDWORD)m_Sources.Size()) ? m_Sources[handle] : NULL;
+    }
+    void SetSource(CKDWORD handle, void *source);
+    CKWaveSound *GetSound(CK_ID recorded);
+
+    CKContext *m_Context;
+    CKSoundManager *m_Manager;
+    XArray<void *> m_Sources;    /* Log handle -> live source */
+    XArray<CK_ID> m_SoundKeys;   /* Recorded sound IDs ... */
+    XArray<CK_ID> m_SoundValues; /* ... and their placeholders */
+    OpStats m_Stats[SOUNDLOG_OPCOUNT];
+    LONGLONG m_Frequency;
+};
+
+void SoundReplayer::SetSource(CKDWORD handle, void *source)
+{
+    while ((CKDWORD)m_Sources.Size() <= handle)
+        m_Sources.PushBack(NULL);
+    m_Sources[handle] = source;
+}
+
+CKWaveSound *SoundReplayer::GetSound(CK_ID recorded)
+{
+    CKObject *sound;
+    int i;
+
+    if (!recorded)
+        return NULL;
+
+    for (i = 0; i < m_SoundKeys.Size(); ++i)
+    {
+        if (m_SoundKeys[i] == recorded)
+            return (CKWaveSound *)m_Context->GetObject(m_SoundValues[i]);
+    }
+
+    sound = m_Context->CreateObject(CKCID_WAVESOUND, "SoundReplay");
+    if (!sound)
+        return NULL;
+
+    m_SoundKeys.PushBack(recorded);
+    m_SoundValues.PushBack(sound->GetID());
+    return (CKWaveSound *)sound;
+}
+
+void SoundReplayer::Execute(const SoundLogRecord &record, BYTE *payload)
+{
+    switch (record.m_Op)
+    {
+    case SOUNDLOG_CREATESOURCE:
+    {
+        SoundLogCreateSource *data = (SoundLogCreateSource *)payload;
+        void *source = m_Manager->CreateSource((CK_WAVESOUND_TYPE)data->m_Type, &data->m_Format,
+                                               data->m_Bytes, data->m_Streamed);
+        void *ptr1, *ptr2;
+        CKDWORD bytes1, bytes2;
+
+        // Silence, so that replays are repeatable whatever the content was
+        if (source && m_Manager->Lock(source, 0, 0, &ptr1, &bytes1, &ptr2, &bytes2,
+                                      CK_WAVESOUND_LOCKENTIREBUFFER) == CK_OK)
+        {
+            BYTE fill = (data->m_Format.wBitsPerSample == 8) ? 0x80 : 0;
+            if (ptr1)
+                memset(ptr1, fill, bytes1);
+            if (ptr2)
+                memset(ptr2, fill, bytes2);
+            m_Manager->Unlock(source, ptr1, bytes1, ptr2, bytes2);
+        }
+        SetSource(data->m_Source, source);
+        break;
+    }
+    case SOUNDLOG_DUPLICATESOURCE:
+    {
+        SoundLogDuplicateSource *data = (SoundLogDuplicateSource *)payload;
+        void *source = GetSource(data->m_Source);
+        SetSource(data->m_Duplicate, source ? m_Manager->DuplicateSource(source) : NULL);
+        break;
+    }
+    case SOUNDLOG_RELEASESOURCE:
+    {
+        SoundLogSource *data = (SoundLogSource *)payload;
+        void *source = GetSource(data->m_Source);
+        if (source)
+        {
+            m_Manager->ReleaseSource(source);
+            SetSource(data->m_Source, NULL);
+        }
+        break;
+    }
+    case SOUNDLOG_PLAY:
+    {
+        SoundLogPlay *data = (SoundLogPlay *)payload;
+        void *source = GetSource(data->m_Source);
+        if (!source)
+            break;
+
+        if (data->m_Sound)
+        {
+            m_Manager->Play(GetSound(data->m_Sound), source, data->m_Loop);
+        }
+        else
+        {
+            // Minion plays hand the minion over, rebuild a transient one
+            SoundMinion minion;
+            memset(&minion, 0, sizeof(minion));
+            minion.m_Source = source;
+            m_Manager->Play(NULL, &minion, data->m_Loop);
+        }
+        break;
+    }
+    case SOUNDLOG_PAUSE:
+    {
+        SoundLogPause *data = (SoundLogPause *)payload;
+        void *source = GetSource(data->m_Source);
+        if (source)
+            m_Manager->Pause(GetSound(data->m_Sound), source);
+        break;
+    }
+    case SOUNDLOG_SETPLAYPOSITION:
+    {
+        SoundLogPlayPosition *data = (SoundLogPlayPosition *)payload;
+        void *source = GetSource(data->m_Source);
+        if (source)
+            m_Manager->SetPlayPosition(source, data->m_Position);
+        break;
+    }
+    case SOUNDLOG_UPDATESETTINGS:
+    {
+        SoundLogSettings *data = (SoundLogSettings *)payload;
+        void *source = GetSource(data->m_Source);
+        if (source)
+            m_Manager->UpdateSettings(source, (CK_SOUNDMANAGER_CAPS)data->m_Options, data->m_Settings, TRUE);
+        break;
+    }
+    case SOUNDLOG_UPDATE3DSETTINGS:
+    {
+        SoundLog3DSettings *data = (SoundLog3DSettings *)payload;
+        void *source = GetSource(data->m_Source);
+        if (source)
+            m_Manager->Update3DSettings(source, (CK_SOUNDMANAGER_CAPS)data->m_Options, data->m_Settings, TRUE);
+        break;
+    }
+    case SOUNDLOG_UPDATELISTENERSETTINGS:
+    {
+        SoundLogListenerSettings *data = (SoundLogListenerSettings *)payload;
+        m_Manager->UpdateListenerSettings((CK_SOUNDMANAGER_CAPS)data->m_Options, data->m_Settings, TRUE);
+        break;
+    }
+    case SOUNDLOG_POSTPROCESS:
+    {
+        SoundLogPostProcess *data = (SoundLogPostProcess *)payload;
+        m_Context->GetTimeManager()->SetLastDeltaTime(data->m_DeltaTime);
+        m_Manager->PostProcess();
+        break;
+    }
+    case SOUNDLOG_PLAYAT:
+    {
+        // Scheduling is not part of CKSoundManager: every manager this
+        // plugin registers derives from DXSoundManager
+        SoundLogPlayAt *data = (SoundLogPlayAt *)payload;
+        DXSoundManager *manager = (DXSoundManager *)m_Manager;
+        void *source = GetSource(data->m_Source);
+        if (!source)
+            break;
+
+        if (data->m_Sound)
+        {
+            manager->PlayAt(GetSound(data->m_Sound), source, data->m_Loop, manager->GetAudioClock() + data->m_Delay);
+        }
+        else
+        {
+            SoundMinion minion;
+            memset(&minion, 0, sizeof(minion));
+            minion.m_Source = source;
+            manager->PlayAt(NULL, &minion, data->m_Loop, manager->GetAudioClock() + data->m_Delay);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+CKBOOL SoundReplayer::Run(const char *path, CKBOOL realtime)
+{
+    SoundCommandReader reader;
+    SoundLogRecord record;
+    BYTE payload[REPLAY_MAX_PAYLOAD];
+    LONGLONG start, before, elapsed, recordedMicros;
+
+    if (!reader.Open(path))
+        return FALSE;
+
+    start = ReadCounter();
+    recordedMicros = 0;
+
+    while (reader.Next(record, payload, sizeof(payload)))
+    {
+        if (record.m_Op == 0 || record.m_Op >= SOUNDLOG_OPCOUNT)
+            continue;
+
+        // Keep the recorded spacing between commands
+        recordedMicros += record.m_DeltaMicros;
+        if (realtime)
+        {
+            LONGLONG aheadMicros = recordedMicros - (ReadCounter() - start) * 1000000 / m_Frequency;
+            if (aheadMicros > 1000)
+                ::Sleep((DWORD)(aheadMicros / 1000));
+        }
+
+        before = ReadCounter();
+        Execute(record, payload);
+        elapsed = ReadCounter() - before;
+
+        OpStats &stats = m_Stats[record.m_Op];
+        ++stats.m_Count;
+        stats.m_Ticks += elapsed;
+        if (elapsed > stats.m_MaxTicks)
+            stats.m_MaxTicks = elapsed;
+    }
+
+    return TRUE;
+}
+
+void SoundReplayer::Reset()
+{
+    int i;
+
+    for (i = 0; i < m_Sources.Size(); ++i)
+    {
+        if (m_Sources[i])
+            m_Manager->ReleaseSource(m_Sources[i]);
+    }
+    m_Sources.Clear();
+
+    for (i = 0; i < m_SoundValues.Size(); ++i)
+    {
+        CKObject *sound = m_Context->GetObject(m_SoundValues[i]);
+        if (sound)
+            m_Context->DestroyObject(sound);
+    }
+    m_SoundKeys.Clear();
+    m_SoundValues.Clear();
+}
+
+void SoundReplayer::PrintStats() const
+{
+    LONGLONG totalTicks = 0;
+    CKDWORD totalCount = 0;
+    int i;
+
+    printf("%-18s %10s %12s %10s %10s\n", "Command", "Count", "Total (ms)", "Avg (us)", "Max (us)");
+    for (i = 1; i < SOUNDLOG_OPCOUNT; ++i)
+    {
+        const OpStats &stats = m_Stats[i];
+        if (!stats.m_Count)
+            continue;
+
+        printf("%-18s %10lu %12.3f %10.2f %10.2f\n", g_OpNames[i], (unsigned long)stats.m_Count,
+               (double)stats.m_Ticks * 1000.0 / m_Frequency,
+               (double)stats.m_Ticks * 1000000.0 / m_Frequency / stats.m_Count,
+               (double)stats.m_MaxTicks * 1000000.0 / m_Frequency);
+        totalTicks += stats.m_Ticks;
+        totalCount += stats.m_Count;
+    }
+    printf("%-18s %10lu %12.3f\n", "Total", (unsigned long)totalCount,
+           (double)totalTicks * 1000.0 / m_Frequency);
+}
+
+static void PrintUsage()
+{
+    printf("Usage: SoundReplay <log> [-realtime] [-repeat <n>] [-plugins <dir>] [-offline <wav>]\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *logPath = NULL;
+    const char *pluginDir = "Managers";
+    const char *offlinePath = NULL;
+    CKBOOL realtime = FALSE;
+    int repeat = 1;
+    CKContext *context = NULL;
+    CKSoundManager *manager;
+    int i, result = 0;
+
+    for (i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "-realtime"))
+            realtime = TRUE;
+        else if (!strcmp(argv[i], "-repeat") && i + 1 < argc)
+            repeat = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-plugins") && i + 1 < argc)
+            pluginDir = argv[++i];
+        else if (!strcmp(argv[i], "-offline") && i + 1 < argc)
+            offlinePath = argv[++i];
+        else if (!logPath && argv[i][0] != '-')
+            logPath = argv[i];
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if (!logPath || repeat < 1)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    // The plugin picks its backend from the environment when it is created
+    if (offlinePath)
+    {
+        static char variable[1024];
+        _snprintf(variable, sizeof(variable) - 1, "DX8SOUND_OFFLINE_RENDER=%s", offlinePath);
+        variable[sizeof(variable) - 1] = '\0';
+        _putenv(variable);
+    }
+
+    if (CKStartUp() != CK_OK)
+    {
+        printf("Cannot start CK2\n");
+        return 1;
+    }
+    CKGetPluginManager()->ParsePlugins((CKSTRING)pluginDir);
+
+    if (CKCreateContext(&context, NULL, 0, 0) != CK_OK || !context)
+    {
+        printf("Cannot create a CK context\n");
+        CKShutdown();
+        return 1;
+    }
+
+    manager = (CKSoundManager *)context->GetManagerByGuid(SOUND_MANAGER_GUID);
+    if (!manager || !manager->IsInitialized())
+    {
+        printf("No sound manager found in %s\n", pluginDir);
+        result = 1;
+    }
+    else
+    {
+        SoundReplayer replayer(context, manager);
+        LONGLONG start = ReadCounter();
+        LARGE_INTEGER frequency;
+
+        for (i = 0; i < repeat && result == 0; ++i)
+        {
+            if (!replayer.Run(logPath, realtime))
+            {
+                printf("Cannot read command log %s\n", logPath);
+                result = 1;
+            }
+            replayer.Reset();
+        }
+
+        ::QueryPerformanceFrequency(&frequency);
+        replayer.PrintStats();
+        printf("Replayed %d pass(es) in %.3f s\n", repeat,
+               (double)(ReadCounter() - start) / (frequency.QuadPart > 0 ? frequency.QuadPart : 1));
+    }
+
+    CKCloseContext(context);
+    CKShutdown();
+    return result;
+}
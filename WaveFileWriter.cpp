@@ -0,0 +1,130 @@
+#include "WaveFileWriter.h"
+#include "SoundOutput.h"
+
+#define WAVE_FORMAT_FLOAT_TAG      3      /* WAVE_FORMAT_IEEE_FLOAT */
+#define WAVE_FORMAT_EXTENSIBLE_TAG 0xFFFE /* WAVE_FORMAT_EXTENSIBLE */
+
+/* KSDATAFORMAT_SUBTYPE_IEEE_FLOAT, as stored in the file */
+static const BYTE s_FloatSubFormat[16] = {
+    0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00,
+    0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71
+};
+
+static void WriteTag(FILE *f, const char *tag)
+{
+    fwrite(tag, 1, 4, f);
+}
+
+static void WriteU32(FILE *f, CKDWORD v)
+{
+    BYTE b[4];
+    b[0] = (BYTE)(v & 0xFF);
+    b[1] = (BYTE)((v >> 8) & 0xFF);
+    b[2] = (BYTE)((v >> 16) & 0xFF);
+    b[3] = (BYTE)((v >> 24) & 0xFF);
+    fwrite(b, 1, 4, f);
+}
+
+static void WriteU16(FILE *f, CKWORD v)
+{
+    BYTE b[2];
+    b[0] = (BYTE)(v & 0xFF);
+    b[1] = (BYTE)((v >> 8) & 0xFF);
+    fwrite(b, 1, 2, f);
+}
+
+WaveFileWriter::WaveFileWriter()
+{
+    m_File = NULL;
+    m_SampleRate = 0;
+    m_Channels = 0;
+    m_Frames = 0;
+}
+
+WaveFileWriter::~WaveFileWriter()
+{
+    Close();
+}
+
+CKBOOL WaveFileWriter::Open(const char *path, int sampleRate, int channels)
+{
+    Close();
+
+    if (!path || sampleRate <= 0 || channels <= 0)
+        return FALSE;
+
+    m_File = fopen(path, "wb");
+    if (!m_File)
+        return FALSE;
+
+    m_SampleRate = sampleRate;
+    m_Channels = channels;
+    m_Frames = 0;
+    WriteHeader();
+    return TRUE;
+}
+
+CKBOOL WaveFileWriter::Write(const float *samples, int frames)
+{
+    size_t count;
+
+    if (!m_File || !samples || frames <= 0)
+        return FALSE;
+
+    /* Samples are stored little-endian, which is the native x86 order */
+    count = (size_t)frames * m_Channels;
+    if (fwrite(samples, sizeof(float), count, m_File) != count)
+        return FALSE;
+
+    m_Frames += frames;
+    return TRUE;
+}
+
+void WaveFileWriter::Close()
+{
+    if (!m_File)
+        return;
+
+    /* Patch the chunk sizes now that the sample count is known */
+    fseek(m_File, 0, SEEK_SET);
+    WriteHeader();
+    fclose(m_File);
+    m_File = NULL;
+}
+
+void WaveFileWriter::WriteHeader()
+{
+    CKDWORD blockAlign = m_Channels * sizeof(float);
+    CKDWORD dataBytes = m_Frames * blockAlign;
+    /* Beyond stereo, players need the speaker mask of the extensible format */
+    CKBOOL extensible = (m_Channels > 2);
+    CKDWORD extraBytes = extensible ? 22 : 0;
+
+    WriteTag(m_File, "RIFF");
+    WriteU32(m_File, 4 + (8 + 18 + extraBytes) + (8 + 4) + (8 + dataBytes));
+    WriteTag(m_File, "WAVE");
+
+    /* Non-PCM formats carry cbSize and a fact chunk */
+    WriteTag(m_File, "fmt ");
+    WriteU32(m_File, 18 + extraBytes);
+    WriteU16(m_File, extensible ? WAVE_FORMAT_EXTENSIBLE_TAG : WAVE_FORMAT_FLOAT_TAG);
+    WriteU16(m_File, (CKWORD)m_Channels);
+    WriteU32(m_File, m_SampleRate);
+    WriteU32(m_File, m_SampleRate * blockAlign);
+    WriteU16(m_File, (CKWORD)blockAlign);
+    WriteU16(m_File, 32);
+    WriteU16(m_File, (CKWORD)extraBytes);
+    if (extensible)
+    {
+        WriteU16(m_File, 32); /* Valid bits per sample */
+        WriteU32(m_File, SoundGetChannelMask(m_Channels));
+        fwrite(s_FloatSubFormat, 1, sizeof(s_FloatSubFormat), m_File);
+    }
+
+    WriteTag(m_File, "fact");
+    WriteU32(m_File, 4);
+    WriteU32(m_File, m_Frames);
+
+    WriteTag(m_File, "data");
+    WriteU32(m_File, dataBytes);
+}
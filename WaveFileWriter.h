@@ -0,0 +1,43 @@
+#ifndef WAVEFILEWRITER_H
+#define WAVEFILEWRITER_H
+
+#include <stdio.h>
+
+#include "CKAll.h"
+
+/**
+ * @brief Minimal RIFF/WAVE writer for 32-bit float PCM
+ *
+ * The header is written with placeholder sizes on Open() and patched on
+ * Close(), so samples can be appended block by block. More than two
+ * channels are written as WAVE_FORMAT_EXTENSIBLE with the speaker mask of
+ * SoundGetChannelMask.
+ */
+class WaveFileWriter
+{
+public:
+    WaveFileWriter();
+    ~WaveFileWriter();
+
+    CKBOOL Open(const char *path, int sampleRate, int channels);
+    // Appends interleaved float frames
+    CKBOOL Write(const float *samples, int frames);
+    void Close();
+
+    CKBOOL IsOpen() const { return m_File != NULL; }
+    CKDWORD GetWrittenFrames() const { return m_Frames; }
+
+private:
+    void WriteHeader();
+
+    FILE *m_File;
+    int m_SampleRate;
+    int m_Channels;
+    CKDWORD m_Frames;
+
+    // Prevent copying (VC6 style - declare but don't implement)
+    WaveFileWriter(const WaveFileWriter &);
+    WaveFileWriter &operator=(const WaveFileWriter &);
+};
+
+#endif /* WAVEFILEWRITER_H */